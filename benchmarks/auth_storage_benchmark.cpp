@@ -0,0 +1,125 @@
+#include <benchmark/benchmark.h>
+#include <auth_storage/mem_auth_storage.h>
+#include <auth_storage/sharded_auth_storage.h>
+#include <auth_storage/persistent_auth_storage.h>
+#include <map_configuration.h>
+#include <QFile>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QTemporaryDir>
+#include <memory>
+#include <vector>
+
+/// @brief MemAuthStorage is not thread-safe, so the baseline serializes it behind one global lock.
+class LockedMemAuthStorage : public IAuthStorage {
+    QMutex mutex;
+    MemAuthStorage storage;
+
+public:
+    QString authenticate(const QString &username, const QString &userVersion) override {
+        QMutexLocker locker(&this->mutex);
+        return this->storage.authenticate(username, userVersion);
+    }
+
+    std::optional<QPair<QString, QString> > get(const QString &auth_id) override {
+        QMutexLocker locker(&this->mutex);
+        return this->storage.get(auth_id);
+    }
+
+    bool remove(const QString &auth_id) override {
+        QMutexLocker locker(&this->mutex);
+        return this->storage.remove(auth_id);
+    }
+};
+
+static constexpr int SESSIONS = 100000;
+
+static std::unique_ptr<IAuthStorage> storage;
+static std::vector<QString> tokens;
+
+template<typename Storage>
+static void setUp(const benchmark::State &) {
+    storage = std::make_unique<Storage>();
+    tokens.clear();
+    tokens.reserve(SESSIONS);
+    for (int i = 0; i < SESSIONS; ++i) {
+        tokens.push_back(storage->authenticate(QString("user%1").arg(i % 1000), "version"));
+    }
+}
+
+static void tearDown(const benchmark::State &) {
+    storage.reset();
+    tokens.clear();
+}
+
+/// checkAuth traffic: lookups only.
+static void BM_Get(benchmark::State &state) {
+    size_t i = static_cast<size_t>(state.thread_index()) * 7919;
+    for (auto _: state) {
+        benchmark::DoNotOptimize(storage->get(tokens[i++ % tokens.size()]));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+/// Production-like mix: one login and one logout per 50 checks.
+static void BM_Mixed(benchmark::State &state) {
+    size_t i = static_cast<size_t>(state.thread_index()) * 7919;
+    std::vector<QString> own;
+    for (auto _: state) {
+        const size_t step = i++;
+        if (step % 52 == 0) {
+            own.push_back(storage->authenticate("user", "version"));
+        } else if (step % 52 == 1 && !own.empty()) {
+            benchmark::DoNotOptimize(storage->remove(own.back()));
+            own.pop_back();
+        } else {
+            benchmark::DoNotOptimize(storage->get(tokens[step % tokens.size()]));
+        }
+    }
+    for (const auto &token: own) {
+        storage->remove(token);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+/// Login with "batch" fsync: every call waits for its log record on disk.
+static void BM_PersistentLogin(benchmark::State &state) {
+    QTemporaryDir dir;
+    MapConfiguration config;
+    config.auth["persistence_dir"] = dir.path();
+    PersistentAuthStorage persistent(&config);
+    for (auto _: state) {
+        benchmark::DoNotOptimize(persistent.authenticate("user", "version"));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+/// Login while log can't be written (it points to /dev/full): logins should fail fast, not wait for retries.
+/// That they leave no sessions behind is checked by auth_storage_test.
+static void BM_PersistentLoginWriteError(benchmark::State &state) {
+    QTemporaryDir dir;
+    if (!QFile::link("/dev/full", dir.filePath("sessions.log"))) {
+        state.SkipWithError("/dev/full is not available");
+        return;
+    }
+    MapConfiguration config;
+    config.auth["persistence_dir"] = dir.path();
+    PersistentAuthStorage persistent(&config);
+    for (auto _: state) {
+        benchmark::DoNotOptimize(persistent.authenticate("user", "version"));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK(BM_Get)->Name("Get/LockedMemAuthStorage")
+        ->Setup(setUp<LockedMemAuthStorage>)->Teardown(tearDown)->ThreadRange(1, 16)->UseRealTime();
+BENCHMARK(BM_Get)->Name("Get/ShardedAuthStorage")
+        ->Setup(setUp<ShardedAuthStorage>)->Teardown(tearDown)->ThreadRange(1, 16)->UseRealTime();
+BENCHMARK(BM_Mixed)->Name("Mixed/LockedMemAuthStorage")
+        ->Setup(setUp<LockedMemAuthStorage>)->Teardown(tearDown)->ThreadRange(1, 16)->UseRealTime();
+BENCHMARK(BM_Mixed)->Name("Mixed/ShardedAuthStorage")
+        ->Setup(setUp<ShardedAuthStorage>)->Teardown(tearDown)->ThreadRange(1, 16)->UseRealTime();
+BENCHMARK(BM_PersistentLogin)->Iterations(1000)->UseRealTime();
+BENCHMARK(BM_PersistentLoginWriteError)->Iterations(1000)->UseRealTime();
+
+BENCHMARK_MAIN();
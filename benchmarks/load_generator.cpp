@@ -0,0 +1,606 @@
+#include <metrics/latency_histogram.h>
+#include <user_storage/password_hasher.h>
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QProcess>
+#include <QTcpSocket>
+#include <QTemporaryDir>
+#include <QThread>
+#include <QTimer>
+#include <QtSql/qsqldatabase.h>
+#include <QtSql/qsqlerror.h>
+#include <QtSql/qsqlquery.h>
+#include <cstdio>
+#include <deque>
+#include <optional>
+#include <random>
+#include <vector>
+
+/// End-to-end load generator: starts `jrpc_auth` or `jrpc_double_token_auth` against QSQLITE user database with
+/// `--users` users (`user<i>` / `password<i>`) and drives it over HTTP with login/checkAuth/refresh/logout mix.
+/// Open-loop mode (`--rate`) schedules calls at fixed intended times and measures latency from intended time, not
+/// from the moment call was sent, so stalls of server are not hidden by client waiting for it (coordinated omission).
+/// Closed-loop mode (`--concurrency`) keeps given number of calls in flight.
+
+namespace {
+    enum Method {
+        Login,
+        CheckAuth,
+        Refresh,
+        Logout,
+    };
+
+    constexpr int METHODS = 4;
+    const char *const METHOD_NAMES[METHODS] = {"login", "checkAuth", "refresh", "logout"};
+
+    /// @brief time to wait for calls in flight after end of run, microseconds
+    constexpr qint64 DRAIN_TIMEOUT = 10000000;
+
+    struct Options {
+        QString server;
+        QJsonObject config;
+        int port = 17777;
+        int users = 10000;
+        double rate = 1000;
+        /// @brief calls in flight for closed-loop mode, 0 - open loop
+        int concurrency = 0;
+        int connections = 64;
+        double duration = 30;
+        double warmup = 5;
+        std::vector<double> weights = {1, 20, 2, 1};
+        QString json;
+    };
+
+    struct Session {
+        /// @brief token of single-token service or access token
+        QString access;
+        QString refresh;
+    };
+
+    struct Call {
+        Method method = Login;
+        Session session;
+        int user = 0;
+        /// @brief microseconds since start of run, when call should have been sent
+        qint64 intended = 0;
+    };
+
+    struct MethodStats {
+        LatencyHistogram latency;
+        /// @brief JSON-RPC error responses
+        quint64 errors = 0;
+        /// @brief HTTP errors and broken connections
+        quint64 failures = 0;
+    };
+
+    struct Connection {
+        QTcpSocket *socket = nullptr;
+        QByteArray buffer;
+        std::optional<Call> call;
+    };
+}
+
+/// @brief drives service with calls and collects latency of every method
+class LoadGenerator : public QObject {
+    Options options;
+    std::vector<Connection> connections;
+    /// @brief open loop: calls, that are due, but have no free connection yet
+    std::deque<Call> backlog;
+    std::vector<Session> sessions;
+    std::mt19937 random{std::random_device{}()};
+    std::discrete_distribution<int> mix;
+    /// @brief whether login response is a pair of tokens; refresh is dropped from mix of single-token service
+    std::optional<bool> doubleToken;
+
+    QElapsedTimer clock;
+    QTimer ticker;
+    /// @brief microseconds since start of run: end of warmup, end of run
+    qint64 measureFrom = 0;
+    qint64 end = 0;
+    /// @brief intended time of next open-loop call
+    double next = 0;
+    qint64 nextId = 0;
+    size_t maxBacklog = 0;
+
+    MethodStats stats[METHODS];
+    quint64 unfinished = 0;
+
+    [[nodiscard]] qint64 now() const {
+        return this->clock.nsecsElapsed() / 1000;
+    }
+
+    [[nodiscard]] bool openLoop() const {
+        return this->options.concurrency == 0;
+    }
+
+    /// @brief take random session; check keeps it in pool, other methods consume it
+    Call makeCall(const qint64 intended) {
+        Call call;
+        call.intended = intended;
+        call.method = static_cast<Method>(this->mix(this->random));
+        if (call.method != Login && this->sessions.empty()) {
+            call.method = Login;
+        }
+        if (call.method == Login) {
+            call.user = static_cast<int>(this->random() % this->options.users);
+        } else {
+            const size_t index = this->random() % this->sessions.size();
+            if (call.method == CheckAuth) {
+                call.session = this->sessions[index];
+            } else {
+                call.session = std::move(this->sessions[index]);
+                this->sessions[index] = std::move(this->sessions.back());
+                this->sessions.pop_back();
+            }
+        }
+        return call;
+    }
+
+    void send(Connection &connection, Call call) {
+        QJsonObject params;
+        switch (call.method) {
+            case Login:
+                params = {
+                    {"username", QString("user%1").arg(call.user)},
+                    {"password", QString("password%1").arg(call.user)},
+                    // ignored by single-token service
+                    {"audience", "load_generator"},
+                };
+                break;
+            case Refresh:
+                params = {{"token", call.session.refresh}};
+                break;
+            default:
+                params = {{"token", call.session.access}};
+                break;
+        }
+        const QByteArray body = QJsonDocument(QJsonObject{
+            {"jsonrpc", "2.0"},
+            {"id", ++this->nextId},
+            {"method", QString("auth.") + METHOD_NAMES[call.method]},
+            {"params", params},
+        }).toJson(QJsonDocument::Compact);
+
+        connection.socket->write("POST / HTTP/1.1\r\nHost: 127.0.0.1\r\nContent-Type: application/json\r\n"
+                                 "Content-Length: " + QByteArray::number(body.size()) + "\r\n\r\n" + body);
+        connection.call = std::move(call);
+    }
+
+    /// @brief send next call on idle connection
+    void dispatch(Connection &connection) {
+        if (connection.call || connection.socket->state() != QAbstractSocket::ConnectedState) {
+            return;
+        }
+        if (this->openLoop()) {
+            if (!this->backlog.empty()) {
+                Call call = std::move(this->backlog.front());
+                this->backlog.pop_front();
+                this->send(connection, std::move(call));
+            }
+        } else if (this->now() < this->end) {
+            this->send(connection, this->makeCall(this->now()));
+        }
+    }
+
+    void record(const Call &call, const bool error, const bool failure) {
+        if (call.intended < this->measureFrom || call.intended >= this->end) {
+            return;
+        }
+        MethodStats &stats = this->stats[call.method];
+        stats.latency.record(static_cast<uint64_t>(qMax<qint64>(0, this->now() - call.intended)));
+        stats.errors += error;
+        stats.failures += failure;
+    }
+
+    /// @brief tokens of login or refresh result
+    [[nodiscard]] static Session sessionOf(const QJsonObject &result) {
+        if (result.contains("access")) {
+            return {result.value("access").toString(), result.value("refresh").toString()};
+        }
+        return {result.value("token").toString(), QString()};
+    }
+
+    void complete(Connection &connection, const int status, const QByteArray &body) {
+        Call call = std::move(*connection.call);
+        connection.call.reset();
+
+        const QJsonObject response = QJsonDocument::fromJson(body).object();
+        const bool failure = status != 200 || response.isEmpty();
+        const bool error = !failure && response.contains("error");
+        this->record(call, error, failure);
+
+        const QJsonObject result = response.value("result").toObject();
+        if (call.method == Login && !error && !failure) {
+            if (!this->doubleToken) {
+                this->doubleToken = result.contains("access");
+                if (!this->doubleToken.value()) {
+                    std::vector<double> weights = this->options.weights;
+                    weights[Refresh] = 0;
+                    this->mix = std::discrete_distribution<int>(weights.begin(), weights.end());
+                }
+            }
+            this->sessions.push_back(sessionOf(result));
+        } else if (call.method == Refresh) {
+            // rejected refresh (e.g. refresh_delay of base configuration isn't over) keeps old pair valid
+            this->sessions.push_back(!error && !failure ? sessionOf(result) : std::move(call.session));
+        }
+        this->dispatch(connection);
+    }
+
+    void readResponses(Connection &connection) {
+        connection.buffer += connection.socket->readAll();
+        while (connection.call) {
+            const int headerEnd = connection.buffer.indexOf("\r\n\r\n");
+            if (headerEnd < 0) {
+                return;
+            }
+            const QList<QByteArray> lines = connection.buffer.left(headerEnd).split('\n');
+            const QList<QByteArray> statusLine = lines.first().split(' ');
+            const int status = statusLine.size() > 1 ? statusLine[1].toInt() : 0;
+            int length = 0;
+            for (const auto &line: lines) {
+                if (line.toLower().startsWith("content-length:")) {
+                    length = line.mid(15).trimmed().toInt();
+                }
+            }
+            if (connection.buffer.size() < headerEnd + 4 + length) {
+                return;
+            }
+            const QByteArray body = connection.buffer.mid(headerEnd + 4, length);
+            connection.buffer.remove(0, headerEnd + 4 + length);
+            this->complete(connection, status, body);
+        }
+    }
+
+    void disconnected(Connection &connection) {
+        connection.buffer.clear();
+        if (connection.call) {
+            this->record(connection.call.value(), false, true);
+            connection.call.reset();
+        }
+        if (this->now() < this->end) {
+            QTimer::singleShot(100, this, [this, &connection]() {
+                connection.socket->connectToHost("127.0.0.1", this->options.port);
+            });
+        }
+    }
+
+    void tick() {
+        const qint64 now = this->now();
+        if (this->openLoop()) {
+            const double interval = 1000000.0 / this->options.rate;
+            while (this->next <= now && this->next < this->end) {
+                this->backlog.push_back(this->makeCall(static_cast<qint64>(this->next)));
+                this->next += interval;
+            }
+            this->maxBacklog = qMax(this->maxBacklog, this->backlog.size());
+        }
+        for (auto &connection: this->connections) {
+            this->dispatch(connection);
+        }
+        if (now < this->end) {
+            return;
+        }
+
+        size_t inFlight = this->backlog.size();
+        for (const auto &connection: this->connections) {
+            inFlight += connection.call.has_value();
+        }
+        if (inFlight == 0 || now >= this->end + DRAIN_TIMEOUT) {
+            this->unfinished = inFlight;
+            this->ticker.stop();
+            QCoreApplication::exit(0);
+        }
+    }
+
+public:
+    explicit LoadGenerator(Options options) : options(std::move(options)),
+                                               connections(this->options.concurrency > 0
+                                                               ? this->options.concurrency
+                                                               : this->options.connections),
+                                               mix(this->options.weights.begin(), this->options.weights.end()) {
+    }
+
+    void start() {
+        this->measureFrom = static_cast<qint64>(this->options.warmup * 1000000);
+        this->end = this->measureFrom + static_cast<qint64>(this->options.duration * 1000000);
+        this->clock.start();
+
+        for (auto &connection: this->connections) {
+            connection.socket = new QTcpSocket(this);
+            connect(connection.socket, &QTcpSocket::connected, this, [this, &connection]() {
+                connection.socket->setSocketOption(QAbstractSocket::LowDelayOption, 1);
+                this->dispatch(connection);
+            });
+            connect(connection.socket, &QTcpSocket::readyRead, this, [this, &connection]() {
+                this->readResponses(connection);
+            });
+            connect(connection.socket, &QTcpSocket::disconnected, this, [this, &connection]() {
+                this->disconnected(connection);
+            });
+            connection.socket->connectToHost("127.0.0.1", this->options.port);
+        }
+
+        this->ticker.setTimerType(Qt::PreciseTimer);
+        connect(&this->ticker, &QTimer::timeout, this, [this]() {
+            this->tick();
+        });
+        this->ticker.start(1);
+    }
+
+    /// @brief print results table and write them to JSON file, if requested
+    void report() const {
+        const double seconds = this->options.duration;
+        if (this->openLoop()) {
+            std::printf("open loop: %.0f calls/s over %d connections, max backlog %zu\n", this->options.rate,
+                        this->options.connections, this->maxBacklog);
+        } else {
+            std::printf("closed loop: %d calls in flight\n", this->options.concurrency);
+        }
+        std::printf("%-10s %10s %8s %8s %10s %9s %9s %9s %9s %9s %9s\n", "method", "count", "errors", "failed",
+                    "calls/s", "mean,ms", "p50,ms", "p90,ms", "p99,ms", "p99.9,ms", "max,ms");
+
+        QJsonObject methods;
+        LatencyHistogram all;
+        quint64 errors = 0;
+        quint64 failures = 0;
+        const auto print = [seconds](const char *name, const LatencyHistogram &latency, const quint64 errors,
+                                     const quint64 failures) {
+            std::printf("%-10s %10llu %8llu %8llu %10.1f %9.3f %9.3f %9.3f %9.3f %9.3f %9.3f\n", name,
+                        static_cast<unsigned long long>(latency.count()), static_cast<unsigned long long>(errors),
+                        static_cast<unsigned long long>(failures), latency.count() / seconds, latency.mean() / 1000,
+                        latency.percentile(50) / 1000.0, latency.percentile(90) / 1000.0,
+                        latency.percentile(99) / 1000.0, latency.percentile(99.9) / 1000.0, latency.max() / 1000.0);
+            return QJsonObject{
+                {"count", static_cast<qint64>(latency.count())},
+                {"errors", static_cast<qint64>(errors)},
+                {"failures", static_cast<qint64>(failures)},
+                {"throughput", latency.count() / seconds},
+                {"mean_us", latency.mean()},
+                {"p50_us", static_cast<qint64>(latency.percentile(50))},
+                {"p90_us", static_cast<qint64>(latency.percentile(90))},
+                {"p99_us", static_cast<qint64>(latency.percentile(99))},
+                {"p999_us", static_cast<qint64>(latency.percentile(99.9))},
+                {"max_us", static_cast<qint64>(latency.max())},
+            };
+        };
+        for (int i = 0; i < METHODS; ++i) {
+            const MethodStats &stats = this->stats[i];
+            if (stats.latency.count() == 0) {
+                continue;
+            }
+            methods[METHOD_NAMES[i]] = print(METHOD_NAMES[i], stats.latency, stats.errors, stats.failures);
+            all.merge(stats.latency);
+            errors += stats.errors;
+            failures += stats.failures;
+        }
+        const QJsonObject total = print("total", all, errors, failures);
+        if (this->unfinished > 0) {
+            std::printf("%llu calls didn't finish within drain timeout\n",
+                        static_cast<unsigned long long>(this->unfinished));
+        }
+
+        if (!this->options.json.isEmpty()) {
+            QFile file(this->options.json);
+            if (!file.open(QIODevice::WriteOnly | QIODevice::Text)) {
+                std::fprintf(stderr, "Failed to open %s for write\n", qPrintable(this->options.json));
+                return;
+            }
+            file.write(QJsonDocument(QJsonObject{
+                {"mode", this->openLoop() ? "open" : "closed"},
+                {"rate", this->options.rate},
+                {"concurrency", this->options.concurrency},
+                {"duration", seconds},
+                {"users", this->options.users},
+                {"methods", methods},
+                {"total", total},
+                {"unfinished", static_cast<qint64>(this->unfinished)},
+            }).toJson());
+        }
+    }
+};
+
+/// @brief create QSQLITE database with users `user<i>`, passwords `password<i>`
+static bool seedUsers(const QString &path, const int users, const PasswordHasher &hasher) {
+    bool ok = false;
+    {
+        QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE", "seed");
+        db.setDatabaseName(path);
+        if (db.open()) {
+            QSqlQuery query(db);
+            query.exec("CREATE TABLE users (id INTEGER PRIMARY KEY, username VARCHAR(255), password VARCHAR(255))");
+            query.exec("CREATE UNIQUE INDEX users_username ON users (username)");
+            db.transaction();
+            query.prepare("INSERT INTO users (username, password) VALUES (:username, :password)");
+            ok = true;
+            for (int i = 0; i < users && ok; ++i) {
+                const QString username = QString("user%1").arg(i);
+                query.bindValue(":username", username);
+                query.bindValue(":password", hasher.hash(username, QString("password%1").arg(i)));
+                ok = query.exec();
+            }
+            ok = ok && db.commit();
+            if (!ok) {
+                std::fprintf(stderr, "Failed to seed users: %s\n", qPrintable(query.lastError().text()));
+            }
+        }
+    }
+    QSqlDatabase::removeDatabase("seed");
+    return ok;
+}
+
+/// @brief wait until server accepts connections
+static bool waitForServer(const QProcess &server, const int port) {
+    for (int attempt = 0; attempt < 100; ++attempt) {
+        if (server.state() == QProcess::NotRunning) {
+            return false;
+        }
+        QTcpSocket socket;
+        socket.connectToHost("127.0.0.1", port);
+        if (socket.waitForConnected(100)) {
+            return true;
+        }
+        QThread::msleep(100);
+    }
+    return false;
+}
+
+static std::optional<Options> parseOptions(const QCoreApplication &app) {
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Load generator for jrpc_auth and jrpc_double_token_auth");
+    parser.addHelpOption();
+    parser.addOptions({
+        {"server", "Path to service executable.", "path"},
+        {"config", "Base service configuration made for load runs, not the shipped one; database, port, login "
+                   "limits, refresh delay and persistence_dir are replaced.", "path"},
+        {"port", "Port of service (default 17777).", "port"},
+        {"users", "Number of users in database (default 10000).", "count"},
+        {"rate", "Open loop: calls per second (default 1000).", "rate"},
+        {"concurrency", "Closed loop: calls in flight, instead of --rate.", "count"},
+        {"connections", "Open loop: number of connections (default 64).", "count"},
+        {"duration", "Measured seconds (default 30).", "seconds"},
+        {"warmup", "Seconds before measurement (default 5).", "seconds"},
+        {"mix", "Weights of methods (default login=1,checkAuth=20,refresh=2,logout=1).", "weights"},
+        {"json", "Write results to JSON file.", "path"},
+    });
+    parser.process(app);
+
+    Options options;
+    options.server = parser.value("server");
+    if (options.server.isEmpty()) {
+        std::fprintf(stderr, "--server is required\n");
+        return std::nullopt;
+    }
+    if (parser.isSet("config")) {
+        QFile file(parser.value("config"));
+        if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+            std::fprintf(stderr, "Failed to open %s\n", qPrintable(file.fileName()));
+            return std::nullopt;
+        }
+        options.config = QJsonDocument::fromJson(file.readAll()).object();
+    }
+    const auto number = [&parser](const QString &name, auto value) {
+        return parser.isSet(name) ? static_cast<decltype(value)>(parser.value(name).toDouble()) : value;
+    };
+    options.port = number("port", options.port);
+    options.users = qMax(1, number("users", options.users));
+    options.rate = qMax(1.0, number("rate", options.rate));
+    options.concurrency = qMax(0, number("concurrency", options.concurrency));
+    options.connections = qMax(1, number("connections", options.connections));
+    options.duration = qMax(1.0, number("duration", options.duration));
+    options.warmup = qMax(0.0, number("warmup", options.warmup));
+    options.json = parser.value("json");
+
+    if (parser.isSet("mix")) {
+        options.weights.assign(METHODS, 0);
+        for (const auto &weight: parser.value("mix").split(',')) {
+            if (weight.trimmed().isEmpty()) {
+                continue;
+            }
+            const QStringList pair = weight.split('=');
+            int method = 0;
+            while (method < METHODS && pair.first().trimmed() != METHOD_NAMES[method]) {
+                ++method;
+            }
+            if (pair.size() != 2 || method == METHODS) {
+                std::fprintf(stderr, "Invalid --mix entry: %s\n", qPrintable(weight));
+                return std::nullopt;
+            }
+            options.weights[method] = qMax(0.0, pair.last().toDouble());
+        }
+    }
+    return options;
+}
+
+int main(int argc, char *argv[]) {
+    QCoreApplication app(argc, argv);
+    const auto options = parseOptions(app);
+    if (!options) {
+        return 1;
+    }
+
+    QTemporaryDir directory;
+    QJsonObject service = options->config.value("service").toObject();
+    QJsonObject user = options->config.value("user").toObject();
+    QJsonObject auth = options->config.value("auth").toObject();
+    QJsonObject config = options->config;
+    service["port"] = options->port;
+    // all calls come from one address for a few users, limits of production config would reject most logins
+    for (const char *key: {"login_user_rate", "login_peer_rate", "forwarded_header"}) {
+        service.remove(key);
+    }
+    // refresh tokens are usable at once, so refresh calls measure token rotation rather than its rejection
+    service["refresh_delay"] = 0;
+    service["private_key"] = KEY_DIR "/jwtRS512.pem";
+    service["public_key"] = KEY_DIR "/jwtRS512.pem.pub";
+    user["driver"] = "qsqlite";
+    user["name"] = directory.filePath("users.sqlite");
+    user["schema"] = "main";
+    if (user.value("salt").toString().isEmpty()) {
+        user["salt"] = "SOME_PASSWORD_SALT";
+    }
+    // sessions of previous runs aren't loaded
+    if (auth.contains("persistence_dir")) {
+        auth["persistence_dir"] = directory.filePath("sessions");
+    }
+    config["service"] = service;
+    config["user"] = user;
+    config["auth"] = auth;
+
+    const QString passwordHash = user.value("password_hash").toString();
+    const auto userOption = [&user](const char *option, const quint64 defaultValue) {
+        return user.contains(option) ? user.value(option).toVariant().toULongLong() : defaultValue;
+    };
+    const PasswordHasher hasher(passwordHash == "pbkdf2" ? PasswordHasher::Algorithm::Pbkdf2
+                                : passwordHash == "scrypt" ? PasswordHasher::Algorithm::Scrypt
+                                : PasswordHasher::Algorithm::Sha256,
+                                user.value("salt").toString(),
+                                static_cast<int>(userOption("pbkdf2_iterations", 100000)),
+                                {userOption("scrypt_n", 32768), userOption("scrypt_r", 8), userOption("scrypt_p", 1)});
+    std::printf("seeding %d users\n", options->users);
+    if (!seedUsers(user.value("name").toString(), options->users, hasher)) {
+        return 1;
+    }
+
+    const QString configPath = directory.filePath("config.json");
+    {
+        QFile file(configPath);
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Text)) {
+            std::fprintf(stderr, "Failed to write %s\n", qPrintable(configPath));
+            return 1;
+        }
+        file.write(QJsonDocument(config).toJson());
+    }
+
+    // other relative paths of base configuration stay inside temporary directory
+    QProcess server;
+    QProcessEnvironment environment = QProcessEnvironment::systemEnvironment();
+    environment.insert("JRPC_AUTH_CONFIG_PATH", configPath);
+    server.setProcessEnvironment(environment);
+    server.setWorkingDirectory(directory.path());
+    server.setStandardOutputFile(directory.filePath("server.log"));
+    server.setStandardErrorFile(directory.filePath("server.log"), QIODevice::Append);
+    server.start(options->server, {});
+    if (!server.waitForStarted() || !waitForServer(server, options->port)) {
+        std::fprintf(stderr, "Service didn't start, see %s\n", qPrintable(directory.filePath("server.log")));
+        directory.setAutoRemove(false);
+        return 1;
+    }
+
+    std::printf("running: %.0f s warmup, %.0f s measurement\n", options->warmup, options->duration);
+    LoadGenerator generator(options.value());
+    generator.start();
+    app.exec();
+    generator.report();
+
+    server.terminate();
+    if (!server.waitForFinished(5000)) {
+        server.kill();
+        server.waitForFinished();
+    }
+    return 0;
+}
@@ -0,0 +1,312 @@
+#include <benchmark/benchmark.h>
+#include <auth_configuration/json_configuration.h>
+#include <auth_storage/mem_auth_storage.h>
+#include <auth_storage/random_token.h>
+#include <token/base64_url.h>
+#include <token/jwt_token.h>
+#include <user_storage/password_hasher.h>
+#include <rs256_engine.h>
+#include <jwt/jwt.hpp>
+#include <QFile>
+#include <QTemporaryDir>
+#include <fstream>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <vector>
+
+/// Every primitive of request path is measured in isolation, so regression can be traced to one of them.
+/// Run with `--benchmark_out=<file>.json --benchmark_out_format=json` (or `run_benchmarks` target) to keep results.
+
+static const QString SECRET = "SOME_JWT_SECRET";
+
+static std::string readKey(const char *name) {
+    std::ifstream file(std::string(KEY_DIR) + "/" + name);
+    std::stringstream content;
+    content << file.rdbuf();
+    return content.str();
+}
+
+static JwtClaims claimsOf(const std::string &jti) {
+    const auto now = std::chrono::system_clock::now();
+    JwtClaims claims;
+    claims.jti = jti;
+    claims.issuer = "jrpc_double_token_auth";
+    claims.subject = "user";
+    claims.audience = "jrpc_double_token_auth";
+    claims.issuedAt = now;
+    claims.notBefore = now;
+    claims.expiration = now + std::chrono::hours(1);
+    return claims;
+}
+
+static void BM_Hs256Create(benchmark::State &state) {
+    const QString jti = randomToken();
+    for (auto _: state) {
+        benchmark::DoNotOptimize(createJwtToken(SECRET, jti, "jrpc_auth", "user"));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+static void BM_Hs256Verify(benchmark::State &state) {
+    const QString jwt = createJwtToken(SECRET, randomToken(), "jrpc_auth", "user");
+    for (auto _: state) {
+        benchmark::DoNotOptimize(verifyJwtAndGetToken(jwt, SECRET));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+/// Token and secret are bytes already, as they are in request handlers.
+static void BM_Hs256VerifyBytes(benchmark::State &state) {
+    const QByteArray jwt = createJwtToken(SECRET, randomToken(), "jrpc_auth", "user").toLatin1();
+    const QByteArray secret = SECRET.toUtf8();
+    const std::string_view token(jwt.constData(), jwt.size());
+    const std::string_view key(secret.constData(), secret.size());
+    for (auto _: state) {
+        benchmark::DoNotOptimize(verifyJwtAndGetToken(token, key));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+/// Baseline: former verification by cpp-jwt, token and secret are converted to std::string on every call.
+static void BM_Hs256VerifyCppJwt(benchmark::State &state) {
+    const QString jwt = createJwtToken(SECRET, randomToken(), "jrpc_auth", "user");
+    for (auto _: state) {
+        std::error_code ec;
+        auto decoded = jwt::decode(jwt.toStdString(), jwt::params::algorithms({"HS256"}), ec,
+                                   jwt::params::secret(SECRET.toStdString()), jwt::params::verify(true));
+        if (ec) {
+            state.SkipWithError(ec.message().c_str());
+            break;
+        }
+        benchmark::DoNotOptimize(QString::fromStdString(
+            decoded.payload().get_claim_value<std::string>(jwt::registered_claims::jti)));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+/// Rejection of token with tampered payload: signature mismatch is found without parsing claims. Forged, damaged
+/// and stale tokens are checked by token_test.
+static void BM_Hs256VerifyRejected(benchmark::State &state) {
+    const QString valid = createJwtToken(SECRET, "token", "jrpc_auth", "user");
+    const int headerEnd = valid.indexOf('.');
+    const int payloadEnd = valid.indexOf('.', headerEnd + 1);
+    QString tampered = valid;
+    tampered.replace(headerEnd + 1, payloadEnd - headerEnd - 1,
+                     QString::fromStdString(base64UrlEncode(R"({"jti":"other","sub":"admin"})")));
+    for (auto _: state) {
+        benchmark::DoNotOptimize(verifyJwtAndGetToken(tampered, SECRET));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+static void BM_Rs256Sign(benchmark::State &state) {
+    const Rs256Engine engine(readKey("jwtRS512.pem"), readKey("jwtRS512.pem.pub"));
+    const JwtClaims claims = claimsOf(randomToken().toStdString());
+    for (auto _: state) {
+        benchmark::DoNotOptimize(engine.sign(claims));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+static void BM_Rs256Verify(benchmark::State &state) {
+    const Rs256Engine engine(readKey("jwtRS512.pem"), readKey("jwtRS512.pem.pub"));
+    const std::string token = engine.sign(claimsOf(randomToken().toStdString()));
+    for (auto _: state) {
+        benchmark::DoNotOptimize(engine.verify(token));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+/// Baseline: cpp-jwt parses PEM key on every decode.
+static void BM_Rs256DecodeCppJwt(benchmark::State &state) {
+    const std::string publicKey = readKey("jwtRS512.pem.pub");
+    const Rs256Engine engine(readKey("jwtRS512.pem"), publicKey);
+    const std::string token = engine.sign(claimsOf(randomToken().toStdString()));
+    for (auto _: state) {
+        std::error_code ec;
+        auto decoded = jwt::decode(token, jwt::params::algorithms({"RS256"}), ec, jwt::params::secret(publicKey),
+                                   jwt::params::verify(true));
+        benchmark::DoNotOptimize(decoded);
+        if (ec) {
+            state.SkipWithError(ec.message().c_str());
+            break;
+        }
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+static void BM_PasswordSha256(benchmark::State &state) {
+    const PasswordHasher hasher(PasswordHasher::Algorithm::Sha256, "SOME_PASSWORD_SALT");
+    for (auto _: state) {
+        benchmark::DoNotOptimize(hasher.hash("user", "password"));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+/// Argument: number of PBKDF2 iterations.
+static void BM_PasswordPbkdf2(benchmark::State &state) {
+    const PasswordHasher hasher(PasswordHasher::Algorithm::Pbkdf2, "SOME_PASSWORD_SALT",
+                                static_cast<int>(state.range(0)));
+    for (auto _: state) {
+        benchmark::DoNotOptimize(hasher.hash("user", "password"));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+/// Argument: scrypt N, r = 8, p = 1.
+static void BM_PasswordScrypt(benchmark::State &state) {
+    const PasswordHasher hasher(PasswordHasher::Algorithm::Scrypt, "SOME_PASSWORD_SALT", 0,
+                                {static_cast<quint64>(state.range(0)), 8, 1});
+    for (auto _: state) {
+        benchmark::DoNotOptimize(hasher.hash("user", "password"));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+/// @brief former generator, kept as baseline: mt19937 (not cryptographically secure), character by character
+static QString mt19937Token() {
+    const static std::string chars = "0123456789abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ";
+    thread_local std::mt19937 gen(std::random_device{}());
+    std::uniform_int_distribution<> dis(0, static_cast<int>(chars.size() - 1));
+    std::string token;
+    for (int i = 0; i < 32; ++i) {
+        token.push_back(chars[dis(gen)]);
+    }
+    return QString::fromStdString(token);
+}
+
+static void BM_RandomTokenMt19937(benchmark::State &state) {
+    for (auto _: state) {
+        benchmark::DoNotOptimize(mt19937Token());
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+/// Threads don't share buffers, so throughput should grow with them.
+static void BM_RandomToken(benchmark::State &state) {
+    for (auto _: state) {
+        benchmark::DoNotOptimize(randomToken());
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+static void BM_RandomBytes(benchmark::State &state) {
+    unsigned char bytes[RANDOM_TOKEN_BYTES];
+    for (auto _: state) {
+        randomBytes(bytes, sizeof(bytes));
+        benchmark::DoNotOptimize(bytes);
+    }
+    state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(sizeof(bytes)));
+}
+
+static std::unique_ptr<MemAuthStorage> storage;
+static std::vector<QString> tokens;
+
+/// @brief fill storage with `range(0)` sessions
+static void setUpStorage(const benchmark::State &state) {
+    storage = std::make_unique<MemAuthStorage>();
+    tokens.clear();
+    tokens.reserve(state.range(0));
+    for (int64_t i = 0; i < state.range(0); ++i) {
+        tokens.push_back(storage->authenticate(QString("user%1").arg(i % 1000), "version"));
+    }
+}
+
+static void tearDownStorage(const benchmark::State &) {
+    storage.reset();
+    tokens.clear();
+}
+
+/// Argument: number of sessions in table.
+static void BM_MemAuthenticateRemove(benchmark::State &state) {
+    for (auto _: state) {
+        const QString token = storage->authenticate("user", "version");
+        benchmark::DoNotOptimize(storage->remove(token));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+/// Argument: number of sessions in table.
+static void BM_MemGet(benchmark::State &state) {
+    size_t i = 0;
+    for (auto _: state) {
+        benchmark::DoNotOptimize(storage->get(tokens[i++ % tokens.size()]));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+/// Argument: number of sessions in table.
+static void BM_MemGetMissing(benchmark::State &state) {
+    const QString token = randomToken();
+    for (auto _: state) {
+        benchmark::DoNotOptimize(storage->get(token));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+static std::unique_ptr<QTemporaryDir> directory;
+static std::unique_ptr<JsonConfiguration> configuration;
+
+static void setUpConfiguration(const benchmark::State &) {
+    directory = std::make_unique<QTemporaryDir>();
+    QFile file(directory->filePath("config.json"));
+    file.open(QIODevice::WriteOnly | QIODevice::Text);
+    file.write(R"({
+        "service": {"threads": 4, "login_threads": 2},
+        "auth": {"secret": "SOME_JWT_SECRET", "storage": "sharded", "ttl": 3600},
+        "user": {"driver": "qpsql", "salt": "SOME_PASSWORD_SALT", "pool_max": 8}
+    })");
+    file.close();
+    configuration = std::make_unique<JsonConfiguration>(file.fileName());
+}
+
+static void tearDownConfiguration(const benchmark::State &) {
+    configuration.reset();
+    directory.reset();
+}
+
+static void BM_ConfigGetString(benchmark::State &state) {
+    for (auto _: state) {
+        benchmark::DoNotOptimize(configuration->getAuthConfig("secret").toString());
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+static void BM_ConfigGetInt(benchmark::State &state) {
+    for (auto _: state) {
+        benchmark::DoNotOptimize(configuration->getServiceConfig("threads").toInt());
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+static void BM_ConfigGetMissing(benchmark::State &state) {
+    for (auto _: state) {
+        benchmark::DoNotOptimize(configuration->getUserConfig("missing"));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK(BM_Hs256Create);
+BENCHMARK(BM_Hs256Verify);
+BENCHMARK(BM_Hs256VerifyBytes);
+BENCHMARK(BM_Hs256VerifyCppJwt);
+BENCHMARK(BM_Hs256VerifyRejected);
+BENCHMARK(BM_Rs256Sign);
+BENCHMARK(BM_Rs256Verify);
+BENCHMARK(BM_Rs256DecodeCppJwt);
+BENCHMARK(BM_PasswordSha256);
+BENCHMARK(BM_PasswordPbkdf2)->Arg(10000)->Arg(100000)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_PasswordScrypt)->Arg(1 << 14)->Arg(1 << 15)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_RandomTokenMt19937)->ThreadRange(1, 8)->UseRealTime();
+BENCHMARK(BM_RandomToken)->ThreadRange(1, 8)->UseRealTime();
+BENCHMARK(BM_RandomBytes);
+BENCHMARK(BM_MemAuthenticateRemove)->Arg(1000)->Arg(100000)->Arg(1000000)->Setup(setUpStorage)
+        ->Teardown(tearDownStorage);
+BENCHMARK(BM_MemGet)->Arg(1000)->Arg(100000)->Arg(1000000)->Setup(setUpStorage)->Teardown(tearDownStorage);
+BENCHMARK(BM_MemGetMissing)->Arg(1000)->Arg(100000)->Arg(1000000)->Setup(setUpStorage)->Teardown(tearDownStorage);
+BENCHMARK(BM_ConfigGetString)->Setup(setUpConfiguration)->Teardown(tearDownConfiguration);
+BENCHMARK(BM_ConfigGetInt)->Setup(setUpConfiguration)->Teardown(tearDownConfiguration);
+BENCHMARK(BM_ConfigGetMissing)->Setup(setUpConfiguration)->Teardown(tearDownConfiguration);
+
+BENCHMARK_MAIN();
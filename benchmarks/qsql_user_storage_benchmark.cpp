@@ -0,0 +1,92 @@
+#include <benchmark/benchmark.h>
+#include <map_configuration.h>
+#include <user_storage/qsql_user_storage.h>
+#include <QCoreApplication>
+#include <QTemporaryDir>
+#include <QtSql/qsqldriver.h>
+#include <QtSql/qsqlerror.h>
+#include <QtSql/qsqlquery.h>
+#include <memory>
+
+static constexpr int USERS = 1000;
+
+static std::unique_ptr<QTemporaryDir> directory;
+static std::unique_ptr<QSqlUserStorage> storage;
+
+/// @brief create QSQLITE database with USERS users
+static void setUp(const benchmark::State &) {
+    directory = std::make_unique<QTemporaryDir>();
+    const QString path = directory->filePath("users.sqlite");
+    {
+        QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE", "seed");
+        db.setDatabaseName(path);
+        db.open();
+        QSqlQuery query(db);
+        query.exec("CREATE TABLE users (id INTEGER PRIMARY KEY, username VARCHAR(255), password VARCHAR(255))");
+        query.exec("CREATE UNIQUE INDEX users_username ON users (username)");
+        db.transaction();
+        query.prepare("INSERT INTO users (username, password) VALUES (:username, :password)");
+        for (int i = 0; i < USERS; ++i) {
+            query.bindValue(":username", QString("user%1").arg(i));
+            query.bindValue(":password", QString("version%1").arg(i));
+            query.exec();
+        }
+        db.commit();
+    }
+    QSqlDatabase::removeDatabase("seed");
+
+    MapConfiguration configuration;
+    configuration.user = {{"driver", "qsqlite"}, {"name", path}, {"schema", "main"}};
+    storage = std::make_unique<QSqlUserStorage>(&configuration);
+}
+
+static void tearDown(const benchmark::State &) {
+    storage.reset();
+    directory.reset();
+}
+
+/// Old query path: table name escaped and statement prepared on fresh QSqlQuery per call.
+static void BM_PreparePerCall(benchmark::State &state) {
+    {
+        QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE", "baseline");
+        db.setDatabaseName(directory->filePath("users.sqlite"));
+        db.open();
+
+        int i = 0;
+        for (auto _: state) {
+            QSqlQuery query(db);
+            const QString safeTable = db.driver()->escapeIdentifier("main.users", QSqlDriver::TableName);
+            query.prepare("SELECT password FROM " + safeTable + " WHERE username = :username");
+            query.bindValue(":username", QString("user%1").arg(i++ % USERS));
+            query.exec();
+            query.next();
+            benchmark::DoNotOptimize(query.value(0).toString());
+        }
+    }
+    QSqlDatabase::removeDatabase("baseline");
+    state.SetItemsProcessed(state.iterations());
+}
+
+/// New query path: statement prepared once per pooled connection, only bind + exec per call.
+static void BM_ReusedStatement(benchmark::State &state) {
+    int i = 0;
+    for (auto _: state) {
+        benchmark::DoNotOptimize(storage->getUserVersion(QString("user%1").arg(i++ % USERS)));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK(BM_PreparePerCall)->Setup(setUp)->Teardown(tearDown);
+BENCHMARK(BM_ReusedStatement)->Setup(setUp)->Teardown(tearDown);
+
+int main(int argc, char *argv[]) {
+    /// SQL drivers are loaded as plugins, so application object is required
+    QCoreApplication app(argc, argv);
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv)) {
+        return 1;
+    }
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
@@ -0,0 +1,165 @@
+#include <benchmark/benchmark.h>
+#include <service/rpc_http_server.h>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QTcpSocket>
+#include <QThread>
+#include <memory>
+
+/// Round trips of RpcHttpServer over loopback: single call, pipelining, chunked body, "Expect: 100-continue".
+/// Responses, limits and malformed requests are checked by rpc_http_server_test.
+
+static std::unique_ptr<QThread> serverThread;
+static RpcHttpServer *server = nullptr;
+static quint16 port = 0;
+
+/// @brief server runs event loop of its own thread, so client below may block
+static void setUp(const benchmark::State &) {
+    serverThread = std::make_unique<QThread>();
+    serverThread->start();
+    server = new RpcHttpServer(2);
+    server->addMethod("test.echo", {"value"}, [](const QJsonRpcMessage &request, const QJsonArray &params) {
+        return request.createResponse(params[0]);
+    });
+    server->moveToThread(serverThread.get());
+    QMetaObject::invokeMethod(server, []() {
+        server->listen(QHostAddress::LocalHost, 0);
+        port = server->serverPort();
+    }, Qt::BlockingQueuedConnection);
+}
+
+static void tearDown(const benchmark::State &) {
+    QMetaObject::invokeMethod(server, []() {
+        delete server;
+    }, Qt::BlockingQueuedConnection);
+    server = nullptr;
+    serverThread->quit();
+    serverThread->wait();
+    serverThread.reset();
+}
+
+/// @brief status codes and bodies of complete responses in data
+static QList<QPair<int, QByteArray> > parseResponses(const QByteArray &data) {
+    QList<QPair<int, QByteArray> > responses;
+    int position = 0;
+    while (true) {
+        const int headerEnd = data.indexOf("\r\n\r\n", position);
+        if (headerEnd < 0) {
+            return responses;
+        }
+        const QList<QByteArray> lines = data.mid(position, headerEnd - position).split('\n');
+        const int status = lines.first().split(' ').value(1).toInt();
+        int length = 0;
+        for (const auto &line: lines) {
+            if (line.toLower().startsWith("content-length:")) {
+                length = line.mid(line.indexOf(':') + 1).trimmed().toInt();
+            }
+        }
+        if (data.size() < headerEnd + 4 + length) {
+            return responses;
+        }
+        responses.append({status, data.mid(headerEnd + 4, length)});
+        position = headerEnd + 4 + length;
+    }
+}
+
+/// @brief read from socket until `expected` responses arrived, connection is closed or timeout expired
+static void receive(QTcpSocket &socket, QByteArray &received, const int expected) {
+    QElapsedTimer timer;
+    timer.start();
+    while (parseResponses(received).size() < expected && timer.elapsed() < 2000) {
+        const bool ready = socket.waitForReadyRead(100);
+        received += socket.readAll();
+        if (!ready && socket.state() != QAbstractSocket::ConnectedState) {
+            return;
+        }
+    }
+}
+
+/// @brief send parts of request one after another, so they arrive separately
+/// @param parts parts of request
+/// @param expected number of responses to wait for
+/// @param interim wait for one interim response (e.g. "100 Continue") after each part but the last one
+/// @return complete responses
+static QList<QPair<int, QByteArray> > exchange(const QList<QByteArray> &parts, const int expected,
+                                               const bool interim = false) {
+    QTcpSocket socket;
+    socket.connectToHost(QHostAddress::LocalHost, port);
+    if (!socket.waitForConnected(1000)) {
+        return {};
+    }
+    QByteArray received;
+    for (int i = 0; i < parts.size(); ++i) {
+        socket.write(parts[i]);
+        socket.waitForBytesWritten(1000);
+        if (i + 1 < parts.size()) {
+            if (interim) {
+                receive(socket, received, i + 1);
+            } else {
+                QThread::msleep(5);
+            }
+        }
+    }
+    receive(socket, received, expected);
+    return parseResponses(received);
+}
+
+static QByteArray post(const QByteArray &body, const QByteArray &headers = QByteArray()) {
+    return "POST / HTTP/1.1\r\nHost: localhost\r\n" + headers + "Content-Length: " + QByteArray::number(body.size())
+           + "\r\n\r\n" + body;
+}
+
+static const QByteArray ECHO = R"({"jsonrpc": "2.0", "id": 1, "method": "test.echo", "params": [42]})";
+
+static void BM_Call(benchmark::State &state) {
+    for (auto _: state) {
+        benchmark::DoNotOptimize(exchange({post(ECHO)}, 1));
+    }
+}
+
+static void BM_Pipelined(benchmark::State &state) {
+    const QByteArray second = R"({"jsonrpc": "2.0", "id": 2, "method": "test.echo", "params": {"value": 7}})";
+    for (auto _: state) {
+        benchmark::DoNotOptimize(exchange({post(ECHO) + post(second)}, 2));
+    }
+}
+
+static void BM_Chunked(benchmark::State &state) {
+    const QByteArray request = "POST / HTTP/1.1\r\nHost: localhost\r\nTransfer-Encoding: chunked\r\n\r\n"
+                               + QByteArray::number(20, 16) + ";ext=1\r\n" + ECHO.left(20) + "\r\n"
+                               + QByteArray::number(ECHO.size() - 20, 16) + "\r\n" + ECHO.mid(20) + "\r\n0\r\n\r\n";
+    // request is split in the middle of the first chunk, so parser waits for the rest
+    const int split = request.indexOf("\r\n\r\n") + 20;
+    for (auto _: state) {
+        benchmark::DoNotOptimize(exchange({request.left(split), request.mid(split)}, 1));
+    }
+}
+
+static void BM_ExpectContinue(benchmark::State &state) {
+    const QByteArray request = post(ECHO, "Expect: 100-continue\r\n");
+    const int bodyStart = request.indexOf("\r\n\r\n") + 4;
+    // body is sent after interim response
+    for (auto _: state) {
+        benchmark::DoNotOptimize(exchange({request.left(bodyStart), request.mid(bodyStart)}, 2, true));
+    }
+}
+
+int main(int argc, char *argv[]) {
+    QCoreApplication app(argc, argv);
+
+    const auto withServer = [](benchmark::internal::Benchmark *benchmark) {
+        benchmark->Setup(setUp)->Teardown(tearDown)->UseRealTime();
+    };
+    withServer(benchmark::RegisterBenchmark("BM_Call", BM_Call));
+    withServer(benchmark::RegisterBenchmark("BM_Pipelined", BM_Pipelined));
+    withServer(benchmark::RegisterBenchmark("BM_Chunked", BM_Chunked));
+    withServer(benchmark::RegisterBenchmark("BM_ExpectContinue", BM_ExpectContinue));
+
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv)) {
+        return 1;
+    }
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
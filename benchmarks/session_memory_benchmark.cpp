@@ -0,0 +1,61 @@
+#include <benchmark/benchmark.h>
+#include <auth_storage/compact_auth_storage.h>
+#include <auth_storage/mem_auth_storage.h>
+#include <QCryptographicHash>
+#include <malloc.h>
+#include <memory>
+#include <vector>
+
+static constexpr int USERS = 1000;
+
+/// @brief heap bytes in use
+static size_t heapUsage() {
+    return mallinfo2().uordblks;
+}
+
+/// @brief user versions as produced by QSqlUserStorage: SHA-256 in hex
+static std::vector<QByteArray> makeVersions() {
+    std::vector<QByteArray> versions;
+    versions.reserve(USERS);
+    for (int i = 0; i < USERS; ++i) {
+        versions.push_back(QCryptographicHash::hash(QByteArray::number(i), QCryptographicHash::Sha256).toHex());
+    }
+    return versions;
+}
+
+/// Fills storage with `state.range(0)` sessions and reports heap bytes per session. Username and version strings are
+/// built per call, as request parsing does in the service.
+template<typename Storage>
+static void BM_SessionMemory(benchmark::State &state) {
+    const auto sessions = static_cast<int>(state.range(0));
+    const auto versions = makeVersions();
+    for (auto _: state) {
+        state.PauseTiming();
+        const size_t before = heapUsage();
+        state.ResumeTiming();
+
+        auto storage = std::make_unique<Storage>();
+        std::vector<QString> tokens;
+        tokens.reserve(sessions);
+        for (int i = 0; i < sessions; ++i) {
+            tokens.push_back(storage->authenticate(QString("user%1").arg(i % USERS),
+                                                   QString::fromLatin1(versions[i % USERS])));
+        }
+
+        state.PauseTiming();
+        // tokens are held by clients, so they are dropped before measuring (storage keeps its own copy)
+        tokens.clear();
+        tokens.shrink_to_fit();
+        state.counters["bytes_per_session"] = static_cast<double>(heapUsage() - before) / sessions;
+        storage.reset();
+        state.ResumeTiming();
+    }
+    state.SetItemsProcessed(state.iterations() * sessions);
+}
+
+BENCHMARK_TEMPLATE(BM_SessionMemory, MemAuthStorage)->Name("SessionMemory/MemAuthStorage")
+        ->Arg(1000000)->Arg(10000000)->Iterations(1)->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(BM_SessionMemory, CompactAuthStorage)->Name("SessionMemory/CompactAuthStorage")
+        ->Arg(1000000)->Arg(10000000)->Iterations(1)->Unit(benchmark::kMillisecond);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,194 @@
+#include <benchmark/benchmark.h>
+#include <map_configuration.h>
+#include <auth_storage/mem_auth_storage.h>
+#include <user_storage/caching_user_storage.h>
+#include <user_storage/filtered_user_storage.h>
+#include <user_storage/qsql_user_storage.h>
+#include <QCoreApplication>
+#include <QMutex>
+#include <QTemporaryDir>
+#include <QWaitCondition>
+#include <QtSql/qsqldatabase.h>
+#include <QtSql/qsqlquery.h>
+#include <memory>
+
+static constexpr int USERS = 1000;
+/// @brief change, that isn't delivered within it, fails the benchmark
+static constexpr unsigned long DELIVERY_TIMEOUT_MS = 5000;
+
+static std::unique_ptr<QTemporaryDir> directory;
+static std::unique_ptr<CachingUserStorage> users;
+static std::unique_ptr<MemAuthStorage> auths;
+static std::unique_ptr<FilteredUserStorage> filtered;
+
+/// @brief users reported by change feed, guarded by mutex
+static QMutex mutex;
+static QWaitCondition delivered;
+static QSet<QString> changed;
+
+/// @brief connection of "administrator", that updates users
+static const QString ADMIN = "admin";
+
+/// @brief create QSQLITE database with USERS users
+/// @return configuration of polled change feed of the database, range(0) is poll interval
+static MapConfiguration createDatabase(const benchmark::State &state) {
+    directory = std::make_unique<QTemporaryDir>();
+    const QString path = directory->filePath("users.sqlite");
+    {
+        QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE", ADMIN);
+        db.setDatabaseName(path);
+        db.open();
+        QSqlQuery query(db);
+        query.exec("CREATE TABLE users (id INTEGER PRIMARY KEY, username VARCHAR(255), password VARCHAR(255))");
+        query.exec("CREATE UNIQUE INDEX users_username ON users (username)");
+        db.transaction();
+        query.prepare("INSERT INTO users (username, password) VALUES (:username, :password)");
+        for (int i = 0; i < USERS; ++i) {
+            query.bindValue(":username", QString("user%1").arg(i));
+            query.bindValue(":password", QString("version%1").arg(i));
+            query.exec();
+        }
+        db.commit();
+    }
+
+    MapConfiguration configuration;
+    configuration.user = {
+        {"driver", "qsqlite"}, {"name", path}, {"schema", "main"}, {"change_feed", "poll"},
+        {"change_poll_interval", static_cast<int>(state.range(0))},
+    };
+    return configuration;
+}
+
+/// @brief report changes to listener
+static void collectChanges(const QSet<QString> &usernames) {
+    QMutexLocker locker(&mutex);
+    changed.unite(usernames);
+    delivered.wakeAll();
+}
+
+static void setUp(const benchmark::State &state) {
+    MapConfiguration configuration = createDatabase(state);
+    users = std::make_unique<CachingUserStorage>(std::make_unique<QSqlUserStorage>(&configuration), &configuration);
+    auths = std::make_unique<MemAuthStorage>();
+    users->onUsersChanged([](const QSet<QString> &usernames) {
+        auths->removeByUsers(usernames);
+        collectChanges(usernames);
+    });
+}
+
+/// @brief filter is never rebuilt, so only the change feed lets new users in
+static void setUpFiltered(const benchmark::State &state) {
+    MapConfiguration configuration = createDatabase(state);
+    configuration.user["filter_refresh"] = 0;
+    filtered = std::make_unique<FilteredUserStorage>(std::make_unique<QSqlUserStorage>(&configuration),
+                                                     &configuration);
+    filtered->onUsersChanged(collectChanges);
+}
+
+static void tearDown(const benchmark::State &) {
+    users.reset();
+    auths.reset();
+    filtered.reset();
+    changed.clear();
+    QSqlDatabase::removeDatabase(ADMIN);
+    directory.reset();
+}
+
+/// @brief update version of user by connection of administrator
+static bool updateUser(const QString &username, const QString &version) {
+    QSqlQuery query(QSqlDatabase::database(ADMIN));
+    query.prepare("UPDATE users SET password = :password WHERE username = :username");
+    query.bindValue(":password", version);
+    query.bindValue(":username", username);
+    return query.exec() && query.numRowsAffected() == 1;
+}
+
+/// @brief add user by connection of administrator
+static bool insertUser(const QString &username, const QString &version) {
+    QSqlQuery query(QSqlDatabase::database(ADMIN));
+    query.prepare("INSERT INTO users (username, password) VALUES (:username, :password)");
+    query.bindValue(":username", username);
+    query.bindValue(":password", version);
+    return query.exec();
+}
+
+/// @brief wait until change of user is delivered to listener
+static bool waitDelivered(const QString &username) {
+    QMutexLocker locker(&mutex);
+    while (!changed.contains(username)) {
+        if (!delivered.wait(&mutex, DELIVERY_TIMEOUT_MS)) {
+            return false;
+        }
+    }
+    changed.remove(username);
+    return true;
+}
+
+/// @brief time from UPDATE of user to removal of its session and cached version; it is bound by poll interval,
+/// while without change feed stale session lives until its next user version check
+static void BM_ChangeToInvalidation(benchmark::State &state) {
+    int i = 0;
+    for (auto _: state) {
+        state.PauseTiming();
+        const QString username = QString("user%1").arg(i % USERS);
+        const QString version = QString("version%1-%2").arg(i % USERS).arg(i);
+        ++i;
+        // user version is cached and session is open before change
+        const auto cached = users->getUserVersion(username);
+        (void) auths->authenticate(username, cached.value_or(QString()));
+        state.ResumeTiming();
+
+        if (!updateUser(username, version)) {
+            state.SkipWithError("user is not updated");
+            break;
+        }
+        if (!waitDelivered(username)) {
+            state.SkipWithError("change is not delivered");
+            break;
+        }
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+// argument is poll interval in milliseconds
+BENCHMARK(BM_ChangeToInvalidation)->Arg(10)->Arg(100)->Setup(setUp)->Teardown(tearDown)
+        ->Unit(benchmark::kMillisecond)->UseRealTime();
+
+/// @brief time from INSERT of user to its acceptance by filter built before; without change feed the user is
+/// rejected until the next rebuild
+static void BM_InsertToFilter(benchmark::State &state) {
+    int i = 0;
+    for (auto _: state) {
+        state.PauseTiming();
+        const QString username = QString("new%1").arg(i);
+        const QString version = QString("version-new%1").arg(i);
+        ++i;
+        state.ResumeTiming();
+
+        if (!insertUser(username, version)) {
+            state.SkipWithError("user is not inserted");
+            break;
+        }
+        // filter subscribed first, so it has added the user when this listener is called
+        if (!waitDelivered(username)) {
+            state.SkipWithError("insert is not delivered");
+            break;
+        }
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK(BM_InsertToFilter)->Arg(10)->Setup(setUpFiltered)->Teardown(tearDown)->Unit(benchmark::kMillisecond)
+        ->UseRealTime();
+
+int main(int argc, char *argv[]) {
+    /// SQL drivers are loaded as plugins, so application object is required
+    QCoreApplication app(argc, argv);
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv)) {
+        return 1;
+    }
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
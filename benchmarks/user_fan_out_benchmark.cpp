@@ -0,0 +1,249 @@
+#include <benchmark/benchmark.h>
+#include <map_configuration.h>
+#include <user_storage/fan_out_user_storage.h>
+#include <user_storage/qsql_user_storage.h>
+#include <QCoreApplication>
+#include <QTemporaryDir>
+#include <QtSql/qsqldatabase.h>
+#include <QtSql/qsqlquery.h>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+static constexpr int USERS = 1000;
+/// @brief latency added to slow backend, like remote directory
+static constexpr auto SLOW_DELAY = std::chrono::milliseconds(20);
+
+/// @brief Backend with added latency
+class DelayedUserStorage : public IUserStorage {
+    std::unique_ptr<IUserStorage> storage;
+    std::chrono::milliseconds delay;
+
+public:
+    DelayedUserStorage(std::unique_ptr<IUserStorage> storage, const std::chrono::milliseconds delay)
+        : storage(std::move(storage)), delay(delay) {
+    }
+
+    std::optional<QString> authenticate(const QString &username, const QString &password) override {
+        std::this_thread::sleep_for(this->delay);
+        return this->storage->authenticate(username, password);
+    }
+
+    std::optional<QString> getUserVersion(const QString &username) override {
+        std::this_thread::sleep_for(this->delay);
+        return this->storage->getUserVersion(username);
+    }
+};
+
+/// @brief Backend, that doesn't answer until it is released, like directory behind dead connection
+class HungUserStorage : public IUserStorage {
+    std::mutex mutex;
+    std::condition_variable changed;
+    bool released = false;
+
+    void hang() {
+        std::unique_lock lock(this->mutex);
+        this->changed.wait(lock, [this]() {
+            return this->released;
+        });
+    }
+
+public:
+    std::optional<QString> authenticate(const QString &, const QString &) override {
+        this->hang();
+        return std::nullopt;
+    }
+
+    std::optional<QString> getUserVersion(const QString &) override {
+        this->hang();
+        return std::nullopt;
+    }
+
+    /// @brief let abandoned queries finish
+    void release() {
+        std::lock_guard lock(this->mutex);
+        this->released = true;
+        this->changed.notify_all();
+    }
+};
+
+static std::unique_ptr<QTemporaryDir> directory;
+/// @brief slow backend first, as it is listed before local one
+static std::vector<std::unique_ptr<IUserStorage> > sequential;
+static std::unique_ptr<FanOutUserStorage> fanOut;
+
+/// @brief create QSQLITE database with users [first, first + count)
+static QString createDatabase(const QString &name, const int first, const int count) {
+    const QString path = directory->filePath(name + ".sqlite");
+    {
+        QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE", "seed");
+        db.setDatabaseName(path);
+        db.open();
+        QSqlQuery query(db);
+        query.exec("CREATE TABLE users (id INTEGER PRIMARY KEY, username VARCHAR(255), password VARCHAR(255))");
+        query.exec("CREATE UNIQUE INDEX users_username ON users (username)");
+        db.transaction();
+        query.prepare("INSERT INTO users (username, password) VALUES (:username, :password)");
+        for (int i = first; i < first + count; ++i) {
+            query.bindValue(":username", QString("user%1").arg(i));
+            query.bindValue(":password", QString("version%1").arg(i));
+            query.exec();
+        }
+        db.commit();
+    }
+    QSqlDatabase::removeDatabase("seed");
+    return path;
+}
+
+/// @brief slow backend followed by local one
+static std::vector<std::unique_ptr<IUserStorage> > backends(const QString &slowPath, const QString &fastPath) {
+    MapConfiguration slow;
+    slow.user = {{"driver", "qsqlite"}, {"name", slowPath}, {"schema", "main"}};
+    MapConfiguration fast;
+    fast.user = {{"driver", "qsqlite"}, {"name", fastPath}, {"schema", "main"}};
+
+    std::vector<std::unique_ptr<IUserStorage> > storages;
+    storages.emplace_back(std::make_unique<DelayedUserStorage>(std::make_unique<QSqlUserStorage>(&slow), SLOW_DELAY));
+    storages.emplace_back(std::make_unique<QSqlUserStorage>(&fast));
+    return storages;
+}
+
+/// @brief users [0, USERS / 2) are in slow backend, the rest are in fast one; range(0) is hedge delay
+static void setUp(const benchmark::State &state) {
+    directory = std::make_unique<QTemporaryDir>();
+    const QString slowPath = createDatabase("slow", 0, USERS / 2);
+    const QString fastPath = createDatabase("fast", USERS / 2, USERS / 2);
+
+    sequential = backends(slowPath, fastPath);
+    MapConfiguration configuration;
+    configuration.user = {{"hedge_delay", static_cast<int>(state.range(0))}, {"backend_timeout", 1000}};
+    fanOut = std::make_unique<FanOutUserStorage>(backends(slowPath, fastPath), &configuration);
+}
+
+static HungUserStorage *hung = nullptr;
+
+/// @brief hung backend followed by local one with all users, range(0) is hedge delay
+static void setUpHung(const benchmark::State &state) {
+    directory = std::make_unique<QTemporaryDir>();
+    MapConfiguration fast;
+    fast.user = {{"driver", "qsqlite"}, {"name", createDatabase("fast", 0, USERS)}, {"schema", "main"}};
+
+    std::vector<std::unique_ptr<IUserStorage> > storages;
+    auto hungStorage = std::make_unique<HungUserStorage>();
+    hung = hungStorage.get();
+    storages.emplace_back(std::move(hungStorage));
+    storages.emplace_back(std::make_unique<QSqlUserStorage>(&fast));
+    MapConfiguration configuration;
+    configuration.user = {{"hedge_delay", static_cast<int>(state.range(0))}, {"backend_timeout", 50}};
+    fanOut = std::make_unique<FanOutUserStorage>(std::move(storages), &configuration);
+}
+
+static void tearDown(const benchmark::State &) {
+    if (hung) {
+        hung->release();
+        hung = nullptr;
+    }
+    fanOut.reset();
+    sequential.clear();
+    directory.reset();
+}
+
+/// @brief user of fast backend: loop of AuthService waits for slow backend first
+static void BM_SequentialFastUser(benchmark::State &state) {
+    int i = 0;
+    for (auto _: state) {
+        const int user = USERS / 2 + i++ % (USERS / 2);
+        std::optional<QString> version;
+        for (const auto &storage: sequential) {
+            if ((version = storage->getUserVersion(QString("user%1").arg(user)))) {
+                break;
+            }
+        }
+        benchmark::DoNotOptimize(version);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+/// @brief user of fast backend: answered by fast backend, without waiting for slow one
+static void BM_FanOutFastUser(benchmark::State &state) {
+    int i = 0;
+    for (auto _: state) {
+        const int user = USERS / 2 + i++ % (USERS / 2);
+        benchmark::DoNotOptimize(fanOut->getUserVersion(QString("user%1").arg(user)));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+/// @brief user of slow backend: answered by slow backend, it can't be faster than it
+static void BM_FanOutSlowUser(benchmark::State &state) {
+    int i = 0;
+    for (auto _: state) {
+        const int user = i++ % (USERS / 2);
+        benchmark::DoNotOptimize(fanOut->getUserVersion(QString("user%1").arg(user)));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+/// @brief unknown user: every backend has to answer
+static void BM_FanOutMissingUser(benchmark::State &state) {
+    for (auto _: state) {
+        benchmark::DoNotOptimize(fanOut->getUserVersion("missing"));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+/// @brief user of fast backend, while the other backend never answers: once workers and queue of hung backend are
+/// taken, it is skipped at once, queries of fast backend don't queue behind it
+static void BM_FanOutHungBackend(benchmark::State &state) {
+    int i = 0;
+    for (auto _: state) {
+        const int user = i++ % USERS;
+        try {
+            benchmark::DoNotOptimize(fanOut->getUserVersion(QString("user%1").arg(user)));
+        } catch (const UserStorageUnavailable &) {
+            state.SkipWithError("fast backend is blocked by hung one");
+            break;
+        }
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+/// @brief unknown user, while the other backend never answers: it is reported as unavailable, and after workers of
+/// hung backend are taken, without waiting for timeout
+static void BM_FanOutHungMissingUser(benchmark::State &state) {
+    for (auto _: state) {
+        try {
+            benchmark::DoNotOptimize(fanOut->getUserVersion("missing"));
+        } catch (const UserStorageUnavailable &) {
+            // expected: hung backend is reported as unavailable
+        }
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+// argument is hedge delay in milliseconds, 0 - all backends at once
+BENCHMARK(BM_SequentialFastUser)->Arg(0)->Setup(setUp)->Teardown(tearDown)->Unit(benchmark::kMillisecond)
+        ->UseRealTime();
+BENCHMARK(BM_FanOutFastUser)->Arg(0)->Arg(5)->Setup(setUp)->Teardown(tearDown)->Unit(benchmark::kMillisecond)
+        ->UseRealTime();
+BENCHMARK(BM_FanOutSlowUser)->Arg(0)->Arg(5)->Setup(setUp)->Teardown(tearDown)->Unit(benchmark::kMillisecond)
+        ->UseRealTime();
+BENCHMARK(BM_FanOutMissingUser)->Arg(0)->Arg(5)->Setup(setUp)->Teardown(tearDown)->Unit(benchmark::kMillisecond)
+        ->UseRealTime();
+BENCHMARK(BM_FanOutHungBackend)->Arg(0)->Arg(5)->Setup(setUpHung)->Teardown(tearDown)
+        ->Unit(benchmark::kMillisecond)->UseRealTime();
+BENCHMARK(BM_FanOutHungMissingUser)->Arg(0)->Setup(setUpHung)->Teardown(tearDown)->Unit(benchmark::kMillisecond)
+        ->UseRealTime();
+
+int main(int argc, char *argv[]) {
+    /// SQL drivers are loaded as plugins, so application object is required
+    QCoreApplication app(argc, argv);
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv)) {
+        return 1;
+    }
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
@@ -1,11 +1,18 @@
 #ifndef AUTH_CONFIGURATION_H
 #define AUTH_CONFIGURATION_H
 
-#include <QFile>
-#include <QJsonObject>
 #include <auth_configuration/iuser_config.h>
 #include <auth_configuration/iauth_config.h>
 #include <auth_configuration/iservice_config.h>
+#include <memory>
+#include <QByteArray>
+#include <QFileSystemWatcher>
+#include <QHash>
+#include <QJsonObject>
+#include <QMutex>
+#include <QObject>
+#include <QStringList>
+#include <QVariant>
 
 /**
  * @brief This class provides access to configuration file in JSON format.
@@ -15,14 +22,37 @@
  * - Configuration MAY contain "service", "auth" and "user" objects,
  * - Configuration CANNOT contain "service", "auth" and "user" elements.
  * - Configuration MAY contain "service.<name>", "auth.<name>" and "user.<name>" elements,
+ *
+ * File is parsed once into immutable **Snapshot** with values already converted to QVariant, getters only look it up
+ * in hash. Snapshot is replaced atomically with `std::atomic_store`; readers take it with `std::atomic_load`, which
+ * in libstdc++ briefly locks a mutex from address-hashed pool, so getters don't belong on hot paths (see
+ * **Reloadable**). Readers keep their snapshot while it is replaced.
+ * After `watch()` file is reloaded on change; new content is validated and invalid one is ignored, keeping current
+ * snapshot. Values read once at start (e.g. SQL settings) don't follow reload, `reloaded()` tells which keys changed.
+ * Setters replace snapshot at once and coalesce writes: file is saved atomically (temporary file and
+ * rename) from event loop and on destruction. If file is changed while own write is pending, file wins.
  */
-class JsonConfiguration : public IUserConfig, public IAuthConfig, public IServiceConfig {
+class JsonConfiguration : public QObject, public IUserConfig, public IAuthConfig, public IServiceConfig {
+    Q_OBJECT
+
 public:
+    /**
+     * @brief Immutable parsed configuration
+     */
+    struct Snapshot {
+        QJsonObject root;
+        QHash<QString, QVariant> service;
+        QHash<QString, QVariant> auth;
+        QHash<QString, QVariant> user;
+    };
+
     /**
      * @brief JsonConfiguration
      * @param configPath path to config file
+     * @param parent parent object
      */
-    explicit JsonConfiguration(const QString &configPath = "~/.config/jrpc_auth/config.json");
+    explicit JsonConfiguration(const QString &configPath = "~/.config/jrpc_auth/config.json",
+                               QObject *parent = nullptr);
 
     /**
      * @brief set service related configurations.
@@ -67,11 +97,58 @@ public:
      */
     [[nodiscard]] QVariant getUserConfig(const QString &config) const override;
 
-    virtual ~JsonConfiguration() = default;
+    /**
+     * @brief current configuration. It stays valid after reload, so related values can be read consistently.
+     */
+    [[nodiscard]] std::shared_ptr<const Snapshot> snapshot() const;
+
+    /**
+     * @brief reload configuration on file change.
+     * @return false if file can't be watched
+     */
+    bool watch();
+
+    /**
+     * @brief read file again and replace snapshot, if file is valid.
+     * @return false if file can't be read or is invalid, current snapshot is kept then
+     */
+    bool reload();
+
+    /**
+     * @brief save pending changes now.
+     */
+    void flush();
+
+    ~JsonConfiguration() override;
+
+signals:
+    /**
+     * @brief snapshot is replaced by changed file
+     * @param changed added, removed and changed keys, as "<section>.<name>"
+     */
+    void reloaded(const QStringList &changed);
 
 private:
     QString configPath;
-    QJsonObject root;
+    /// @brief accessed with std::atomic_load / std::atomic_store only
+    std::shared_ptr<const Snapshot> current;
+    QFileSystemWatcher *watcher = nullptr;
+
+    /// @brief guards fields below, serializes writers
+    QMutex mutex;
+    /// @brief content last read or written, changes of file to the same content are ignored
+    QByteArray content;
+    bool savePending = false;
+
+    /**
+     * @brief parse and validate configuration
+     * @param content file content
+     * @param error reason, if configuration is invalid
+     * @return snapshot, or nullptr if configuration is invalid
+     */
+    [[nodiscard]] static std::shared_ptr<const Snapshot> parse(const QByteArray &content, QString &error);
+
+    void set(const QString &section, const QString &config, const QVariant &value);
 };
 
 /**
@@ -0,0 +1,146 @@
+#ifndef COMPACT_AUTH_STORAGE_H
+#define COMPACT_AUTH_STORAGE_H
+
+#include <auth_storage/iauth_storage.h>
+#include <auth_configuration/iauth_config.h>
+#include <array>
+#include <memory>
+#include <vector>
+#include <QHash>
+#include <QReadWriteLock>
+#include <QSet>
+
+/// @brief CompactAuthStorage
+/// Thread-safe in-memory session storage with compact layout, for millions of sessions.
+/// Authentication identifier is 24 random bytes in base64url (32 characters), stored in binary. Usernames are interned,
+/// user version is stored as 32-byte digest if it's 64 lowercase hex characters (SHA-256 of **QSqlUserStorage**),
+/// otherwise interned too. Every session takes one 64-byte slot of open-addressing table with linear probing, so
+/// there are no per-session allocations. Sessions are sharded by identifier like in **ShardedAuthStorage**.
+/// Expired sessions are rejected by `get()` and dropped by incremental sweep on writes to their shard.
+/// Sessions of changed users are removed by scanning slots of shards, where these users are interned.
+/// parameters from configuration:
+/// - auth.shards: number of shards, rounded up to power of two (default - 4 * ideal thread count)
+/// - auth.session_ttl: session lifetime in milliseconds, if deadline isn't given (default - 0, sessions never expire)
+/// - auth.max_sessions: maximum number of sessions (default - 0, unlimited). Above it the session with the earliest
+///   deadline among a few sampled ones is evicted, which is oldest-first for sessions with equal lifetime.
+class CompactAuthStorage : public IAuthStorage {
+public:
+    static constexpr int ID_SIZE = 24;
+    static constexpr int DIGEST_SIZE = 32;
+
+private:
+    using Id = std::array<uchar, ID_SIZE>;
+
+    /// @brief Session, one cache line
+    struct Slot {
+        Id id;
+        /// @brief binary user version, or index of interned version in first 4 bytes
+        std::array<uchar, DIGEST_SIZE> version;
+        /// @brief interned username index + 1 (0 - empty slot), INTERNED_VERSION bit - version is interned
+        quint32 user;
+        /// @brief seconds since epoch, 0 - never expires
+        quint32 deadline;
+    };
+
+    static_assert(sizeof(Slot) == 64, "slot should fit one cache line");
+
+    /// @brief Interned strings with reference counts, released strings are freed
+    class StringPool {
+        QHash<QString, quint32> ids;
+        std::vector<QString> strings;
+        std::vector<quint32> refs;
+        std::vector<quint32> freeIds;
+
+    public:
+        [[nodiscard]] quint32 acquire(const QString &string);
+
+        void release(quint32 id);
+
+        [[nodiscard]] const QString &at(quint32 id) const;
+
+        /// @brief index of interned string, or std::nullopt if it isn't interned
+        [[nodiscard]] std::optional<quint32> find(const QString &string) const;
+    };
+
+    struct alignas(64) Shard {
+        QReadWriteLock lock;
+        std::vector<Slot> slots;
+        size_t count = 0;
+        /// @brief position of incremental expiry sweep
+        size_t cursor = 0;
+        StringPool users;
+        StringPool versions;
+
+        [[nodiscard]] const Slot *find(const Id &id) const;
+
+        void insert(const Slot &slot);
+
+        /// @brief remove slot, shifting following slots of the same probe sequence back
+        void erase(size_t index);
+
+        /// @brief release interned strings of slot
+        void release(const Slot &slot);
+
+        void rehash(size_t capacity);
+
+        /// @brief check a few slots after cursor and remove expired ones
+        void sweep(quint32 now);
+
+        /// @brief remove session with the earliest deadline of a few sampled ones
+        /// @param start slot to start sampling from
+        /// @param keep session, that is never evicted (just inserted one)
+        void evict(size_t start, const Id &keep);
+
+        /// @brief remove all sessions of users
+        /// @return number of removed sessions
+        size_t eraseUsers(const QSet<QString> &usernames);
+    };
+
+    std::vector<std::unique_ptr<Shard> > shards;
+    uint shardBits = 0;
+    qint64 sessionTtl = 0;
+    size_t maxPerShard = 0;
+
+    [[nodiscard]] Shard &shardOf(const Id &id) const;
+
+    [[nodiscard]] QString insert(const QString &username, const QString &userVersion, qint64 deadline);
+
+public:
+    /// @brief constructor
+    /// @param config auth configuration
+    explicit CompactAuthStorage(IAuthConfig *config = nullptr);
+
+    /// @brief create internal authentication identifier
+    /// @param username user name
+    /// @param userVersion user version
+    /// @return authentication identifier
+    [[nodiscard]] QString authenticate(const QString &username, const QString &userVersion) override;
+
+    /// @brief create internal authentication identifier, valid until deadline
+    /// @param username user name
+    /// @param userVersion user version
+    /// @param deadline time, after which identifier is invalid
+    /// @return authentication identifier
+    [[nodiscard]] QString authenticate(const QString &username, const QString &userVersion,
+                                       std::chrono::system_clock::time_point deadline) override;
+
+    /// @brief get user data by authentication identifier
+    /// @param auth_id authentication identifier
+    /// @return username and user version on success, or std::nullopt
+    [[nodiscard]] std::optional<QPair<QString, QString> > get(const QString &auth_id) override;
+
+    /// @brief remove authentication identifier
+    /// @param auth_id authentication identifier to remove
+    bool remove(const QString &auth_id) override;
+
+    /// @brief number of live sessions
+    [[nodiscard]] qint64 sessionCount() override;
+
+    /// @brief remove all sessions of users, scanning shards one by one
+    qint64 removeByUsers(const QSet<QString> &usernames) override;
+
+    /// @brief number of stored sessions
+    [[nodiscard]] size_t size() const;
+};
+
+#endif // COMPACT_AUTH_STORAGE_H
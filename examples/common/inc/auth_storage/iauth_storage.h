@@ -1,10 +1,12 @@
 #ifndef IAUTH_STORAGE_H
 #define IAUTH_STORAGE_H
 
+#include <chrono>
 #include <optional>
 #include <utility>
 #include <QString>
 #include <QPair>
+#include <QSet>
 
 class IAuthStorage {
 public:
@@ -14,6 +16,17 @@ public:
     /// @return authentication identifier
     [[nodiscard]] virtual QString authenticate(const QString &username, const QString &userVersion) = 0;
 
+    /// @brief create internal authentication identifier, valid until deadline.
+    /// Storages without expiry support ignore deadline.
+    /// @param username user name
+    /// @param userVersion user version
+    /// @param deadline time, after which identifier is invalid and may be dropped
+    /// @return authentication identifier
+    [[nodiscard]] virtual QString authenticate(const QString &username, const QString &userVersion,
+                                               [[maybe_unused]] std::chrono::system_clock::time_point deadline) {
+        return this->authenticate(username, userVersion);
+    }
+
     /// @brief get user data by authentication identifier
     /// @param auth_id authentication identifier
     /// @return username and user version on success, or std::nullopt
@@ -23,6 +36,19 @@ public:
     /// @param auth_id authentication identifier to remove
     virtual bool remove(const QString &auth_id) = 0;
 
+    /// @brief number of live sessions, for monitoring
+    /// @return number of sessions, or -1 if storage doesn't keep count
+    [[nodiscard]] virtual qint64 sessionCount() {
+        return -1;
+    }
+
+    /// @brief remove all sessions of users, e.g. when their user version is changed
+    /// @param usernames user names
+    /// @return number of removed sessions, or -1 if storage can't find or remove sessions by user
+    virtual qint64 removeByUsers(const QSet<QString> & /*usernames*/) {
+        return -1;
+    }
+
     virtual ~IAuthStorage() = default;
 };
 
@@ -0,0 +1,41 @@
+#ifndef INSTRUMENTED_AUTH_STORAGE_H
+#define INSTRUMENTED_AUTH_STORAGE_H
+
+#include <auth_storage/iauth_storage.h>
+#include <metrics/metrics.h>
+#include <memory>
+
+/// @brief InstrumentedAuthStorage
+/// Decorator for IAuthStorage, that records time of every operation in **Metrics**
+/// (`jrpc_auth_session_storage_duration_seconds{operation=...}`) and exports number of live sessions
+/// (`jrpc_auth_sessions`), if wrapped storage keeps count.
+/// Storage is thread-safe if wrapped storage is thread-safe.
+class InstrumentedAuthStorage : public IAuthStorage {
+    std::unique_ptr<IAuthStorage> storage;
+    Metrics::Histogram &authenticateDuration;
+    Metrics::Histogram &getDuration;
+    Metrics::Histogram &removeDuration;
+    std::unique_ptr<Metrics::Gauge> sessions;
+
+public:
+    InstrumentedAuthStorage(const InstrumentedAuthStorage &) = delete;
+
+    /// @brief constructor
+    /// @param storage wrapped storage
+    explicit InstrumentedAuthStorage(std::unique_ptr<IAuthStorage> storage);
+
+    [[nodiscard]] QString authenticate(const QString &username, const QString &userVersion) override;
+
+    [[nodiscard]] QString authenticate(const QString &username, const QString &userVersion,
+                                       std::chrono::system_clock::time_point deadline) override;
+
+    [[nodiscard]] std::optional<QPair<QString, QString> > get(const QString &auth_id) override;
+
+    bool remove(const QString &auth_id) override;
+
+    [[nodiscard]] qint64 sessionCount() override;
+
+    qint64 removeByUsers(const QSet<QString> &usernames) override;
+};
+
+#endif // INSTRUMENTED_AUTH_STORAGE_H
@@ -2,17 +2,24 @@
 #define MEM_AUTH_STORAGE_H
 
 #include <auth_storage/iauth_storage.h>
-#include <random>
-#include <QHash>
+#include <auth_storage/session_table.h>
+#include <auth_configuration/iauth_config.h>
 
+/// @brief MemAuthStorage
+/// Simple in-memory session storage, not thread-safe.
+/// parameters from configuration:
+/// - auth.session_ttl: session lifetime in milliseconds, if deadline isn't given (default - 0, sessions never expire)
+/// - auth.max_sessions: maximum number of sessions, oldest sessions are evicted above it (default - 0, unlimited)
 class MemAuthStorage : public IAuthStorage {
-    QHash<QString, QPair<QString, QString> > token2user;
-    std::mt19937 gen;
+    SessionTable token2user;
+    qint64 sessionTtl = 0;
+
+    [[nodiscard]] QString insert(const QString &username, const QString &userVersion, qint64 deadline);
 
 public:
-    /// @brief constructor
-    /// @param seed random generator seed
-    explicit MemAuthStorage(uint64_t seed = -1);
+    /// @brief constructor, identifiers are drawn from `randomToken()`
+    /// @param config auth configuration
+    explicit MemAuthStorage(IAuthConfig *config = nullptr);
 
     /// @brief create internal authentication identifier
     /// @param username user name
@@ -20,6 +27,14 @@ public:
     /// @return authentication identifier
     [[nodiscard]] QString authenticate(const QString &username, const QString &userVersion) override;
 
+    /// @brief create internal authentication identifier, valid until deadline
+    /// @param username user name
+    /// @param userVersion user version
+    /// @param deadline time, after which identifier is invalid
+    /// @return authentication identifier
+    [[nodiscard]] QString authenticate(const QString &username, const QString &userVersion,
+                                       std::chrono::system_clock::time_point deadline) override;
+
     /// @brief get user data by authentication identifier
     /// @param auth_id authentication identifier
     /// @return username and user version on success, or std::nullopt
@@ -28,6 +43,12 @@ public:
     /// @brief remove authentication identifier
     /// @param auth_id authentication identifier to remove
     bool remove(const QString &auth_id) override;
+
+    /// @brief number of live sessions
+    [[nodiscard]] qint64 sessionCount() override;
+
+    /// @brief remove all sessions of users, scanning all sessions
+    qint64 removeByUsers(const QSet<QString> &usernames) override;
 };
 
 #endif // MEM_AUTH_STORAGE_H
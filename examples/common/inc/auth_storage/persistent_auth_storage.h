@@ -0,0 +1,157 @@
+#ifndef PERSISTENT_AUTH_STORAGE_H
+#define PERSISTENT_AUTH_STORAGE_H
+
+#include <auth_storage/sharded_auth_storage.h>
+#include <auth_configuration/iauth_config.h>
+#include <memory>
+#include <QDir>
+#include <QFile>
+#include <QMutex>
+#include <QWaitCondition>
+
+class QThread;
+
+/// @brief PersistentAuthStorage
+/// Thread-safe session storage, that survives restarts. Sessions are served from **ShardedAuthStorage**, every
+/// `authenticate()` and successful `remove()` is appended to `sessions.log`. Snapshot of all sessions is written to
+/// `sessions.snapshot` periodically and on shutdown, after that the log starts over. On startup snapshot is mapped
+/// into memory and the log is replayed over it; torn record at the end of the log (crash during write) is dropped.
+/// Snapshot is written in background: log is switched to new file first, then sessions are dumped to temporary file,
+/// which atomically replaces the old snapshot. Until then previous log is kept as `sessions.log.1`; if snapshot
+/// fails, the next switch appends the log to `sessions.log.1` instead of replacing it.
+/// Replaying a record twice has no effect, so sessions changed while snapshot is written may be both in snapshot
+/// and in new log.
+/// If log can't be written, partly written records are cut off and kept in buffer for the next flush. In "batch"
+/// mode calls waiting for failed write fail too: login returns empty identifier and its session is dropped.
+/// parameters from configuration:
+/// - auth.persistence_dir: directory for snapshot and log (required)
+/// - auth.fsync: durability of log records:
+///   "batch" (default) - call returns after its record is on disk, concurrent calls share one fsync;
+///   "interval" - log is flushed and synced every auth.fsync_interval milliseconds (default 100), records written
+///   in the last interval may be lost on crash;
+///   "none" - log is flushed every interval, syncing is left to OS.
+/// - auth.snapshot_interval: milliseconds between snapshots, if log isn't empty (default 60000)
+/// - auth.log_max_size: log size in bytes, after which snapshot is taken before interval (default 64 MiB)
+/// - auth.session_ttl, auth.max_sessions, auth.shards: see **ShardedAuthStorage**. Evictions by auth.max_sessions
+///   aren't logged, such sessions are evicted again after restart.
+class PersistentAuthStorage : public IAuthStorage {
+public:
+    enum class SyncMode {
+        None,
+        Interval,
+        Batch,
+    };
+
+private:
+    std::unique_ptr<ShardedAuthStorage> storage;
+    QDir directory;
+    SyncMode syncMode = SyncMode::Batch;
+    int syncInterval = 100;
+    int snapshotInterval = 60000;
+    qint64 logMaxSize = 64 * 1024 * 1024;
+    qint64 sessionTtl = 0;
+
+    /// @brief guards log file and buffer
+    QMutex logMutex;
+    /// @brief signalled, when buffered records are written
+    QWaitCondition logWritten;
+    QFile log;
+    /// @brief records, not written to log yet
+    QByteArray buffer;
+    /// @brief number of last buffered record
+    quint64 appended = 0;
+    /// @brief number of last written (and synced, if required) record
+    quint64 written = 0;
+    /// @brief number of last record of the last failed write
+    quint64 failed = 0;
+    /// @brief some thread is writing log right now
+    bool writing = false;
+    qint64 logSize = 0;
+
+    /// @brief guards background thread state
+    QMutex stateMutex;
+    QWaitCondition wakeup;
+    bool stopping = false;
+    std::unique_ptr<QThread> worker;
+
+    [[nodiscard]] QString path(const QString &name) const;
+
+    /// @brief load snapshot and logs into storage
+    /// @return true if previous snapshot was interrupted
+    bool load();
+
+    /// @brief load snapshot file
+    /// @return number of loaded sessions
+    qint64 loadSnapshot(const QString &fileName);
+
+    /// @brief replay log file, dropping broken tail
+    /// @return number of replayed records
+    qint64 replayLog(const QString &fileName);
+
+    /// @brief buffer log record and wait for it according to sync mode
+    /// @return false if record was to be written before return, but writing failed
+    bool append(const QByteArray &record);
+
+    /// @brief write buffered records to log, called with locked log mutex (unlocked while writing).
+    /// On failure records are kept in buffer.
+    /// @param locker locker of log mutex
+    /// @param sync sync log to disk
+    /// @return false if records cannot be written
+    bool flush(QMutexLocker &locker, bool sync);
+
+    /// @brief log created session, drop it if log fails
+    /// @return session identifier, or empty string if session cannot be logged
+    QString logCreated(const QString &token, const QString &username, const QString &userVersion, qint64 deadline);
+
+    /// @brief switch log and write snapshot
+    void snapshot();
+
+    /// @brief dump all sessions to snapshot file
+    /// @return true if snapshot is written and synced
+    bool writeSnapshot();
+
+    /// @brief background thread: periodic flushes and snapshots
+    void run();
+
+public:
+    PersistentAuthStorage(const PersistentAuthStorage &) = delete;
+
+    /// @brief constructor, loads sessions from disk
+    /// @param config auth configuration
+    /// @throw std::runtime_error if persistence directory is not set or cannot be used
+    explicit PersistentAuthStorage(IAuthConfig *config);
+
+    /// @brief create internal authentication identifier
+    /// @param username user name
+    /// @param userVersion user version
+    /// @return authentication identifier, or empty string if it cannot be logged
+    [[nodiscard]] QString authenticate(const QString &username, const QString &userVersion) override;
+
+    /// @brief create internal authentication identifier, valid until deadline
+    /// @param username user name
+    /// @param userVersion user version
+    /// @param deadline time, after which identifier is invalid
+    /// @return authentication identifier, or empty string if it cannot be logged
+    [[nodiscard]] QString authenticate(const QString &username, const QString &userVersion,
+                                       std::chrono::system_clock::time_point deadline) override;
+
+    /// @brief get user data by authentication identifier
+    /// @param auth_id authentication identifier
+    /// @return username and user version on success, or std::nullopt
+    [[nodiscard]] std::optional<QPair<QString, QString> > get(const QString &auth_id) override;
+
+    /// @brief remove authentication identifier
+    /// @param auth_id authentication identifier to remove
+    bool remove(const QString &auth_id) override;
+
+    /// @brief number of live sessions
+    [[nodiscard]] qint64 sessionCount() override;
+
+    /// @brief remove all sessions of users, every removal is logged
+    qint64 removeByUsers(const QSet<QString> &usernames) override;
+
+    /// @brief flush log, write final snapshot
+    ~PersistentAuthStorage() override;
+};
+
+#endif // PERSISTENT_AUTH_STORAGE_H
@@ -0,0 +1,175 @@
+#ifndef QSQL_AUTH_STORAGE_H
+#define QSQL_AUTH_STORAGE_H
+
+#include <auth_storage/iauth_storage.h>
+#include <auth_configuration/iauth_config.h>
+#include <auth_configuration/iuser_config.h>
+#include <user_storage/qsql_connection_pool.h>
+#include <memory>
+#include <QHash>
+#include <QMutex>
+#include <QReadWriteLock>
+#include <QSet>
+#include <QWaitCondition>
+
+class QThread;
+
+/// @brief QSqlAuthStorage
+/// Session storage in SQL database, shared between service instances. Database connection is configured by the same
+/// `user.*` keys as **QSqlUserStorage**, sessions are kept in `<schema>.sessions` table (created if it doesn't exist).
+/// Writes are buffered (write-behind): `authenticate()` and `remove()` only change local state, background thread
+/// flushes new sessions and removals as multi-row statements in one transaction every auth.sql_flush_interval
+/// milliseconds or as soon as auth.sql_batch_size changes are buffered. Until flushed, buffered changes are visible
+/// to this instance only. If database is unavailable, changes stay buffered and are retried on next flush. If batch
+/// fails because of its data, rows are written one by one, so one bad row doesn't block the others; row failing
+/// auth.sql_max_attempts flushes is dropped. At most auth.sql_max_pending changes are buffered, above that logins
+/// fail and removals throw **UserStorageUnavailable**.
+/// `get()` is read-through: sessions are cached locally for auth.sql_cache_ttl milliseconds, so removal on another
+/// instance is noticed after at most this time. Removal of sessions of changed users isn't buffered, it is written
+/// right away, so sessions of a blocked user don't outlive the change on other instances longer than their cache.
+/// parameters from configuration:
+/// - user.*: database connection and pool, see **QSqlUserStorage**
+/// - auth.session_ttl: session lifetime in milliseconds, if deadline isn't given (default - 0, sessions never expire)
+/// - auth.sql_flush_interval: milliseconds between flushes (default - 5)
+/// - auth.sql_batch_size: number of buffered changes, that triggers flush (default - 256)
+/// - auth.sql_cache_ttl: milliseconds session is served from cache (default - 5000)
+/// - auth.sql_cache_size: maximum number of cached sessions (default - 100000)
+/// - auth.sql_max_pending: maximum number of buffered changes (default - 100000)
+/// - auth.sql_max_attempts: flushes, after which row failing with data error is dropped (default - 3)
+/// Storage is thread-safe.
+class QSqlAuthStorage : public IAuthStorage {
+    struct Session {
+        QString username;
+        QString userVersion;
+        /// @brief milliseconds since epoch, 0 - never expires
+        qint64 deadline = 0;
+    };
+
+    /// @brief result of writing changes
+    enum class WriteResult {
+        Ok,
+        /// @brief database is unavailable, changes can be retried as they are
+        ConnectionError,
+        /// @brief database rejected changes
+        DataError,
+    };
+
+    struct CachedSession {
+        Session session;
+        /// @brief milliseconds since epoch, when session was read
+        qint64 cachedAt = 0;
+    };
+
+    std::unique_ptr<QSqlConnectionPool> pool;
+    QString insertSql;
+    QString deleteSql;
+    QString deleteUsersSql;
+    QString selectSql;
+    QString purgeSql;
+
+    qint64 sessionTtl = 0;
+    int flushInterval = 5;
+    int batchSize = 256;
+    qint64 cacheTtl = 5000;
+    int cacheSize = 100000;
+    int maxPending = 100000;
+    int maxAttempts = 3;
+
+    /// @brief guards cache and buffered changes
+    mutable QReadWriteLock lock;
+    QHash<QString, CachedSession> cache;
+    /// @brief sessions not written yet
+    QHash<QString, Session> pendingInserts;
+    /// @brief removals not written yet
+    QSet<QString> pendingDeletes;
+    /// @brief changes being written right now, still visible for readers
+    QHash<QString, Session> flushingInserts;
+    QSet<QString> flushingDeletes;
+    /// @brief number of written removals, so session read from database before removal isn't cached after it
+    quint64 removals = 0;
+    /// @brief failed writes of rows with data errors, used by writer thread only
+    QHash<QString, int> failedAttempts;
+
+    QMutex stateMutex;
+    QWaitCondition wakeup;
+    bool stopping = false;
+    std::unique_ptr<QThread> writer;
+
+    [[nodiscard]] QString insert(const QString &username, const QString &userVersion, qint64 deadline);
+
+    /// @brief put session to cache, unless it is removed already, called with locked write lock
+    void cachePut(const QString &auth_id, const Session &session, qint64 now);
+
+    /// @brief drop removed session from cache after removal is written, called with locked write lock
+    void cacheRemoved(const QString &auth_id);
+
+    /// @brief read session from database
+    [[nodiscard]] std::optional<Session> select(const QString &auth_id);
+
+    /// @brief write changes in one transaction
+    /// @param connection database connection
+    /// @param inserts sessions to insert
+    /// @param deletes sessions to delete
+    /// @return result of writing, nothing is written on error
+    WriteResult write(QSqlConnectionPool::Connection &connection, const QHash<QString, Session> &inserts,
+                      const QSet<QString> &deletes);
+
+    /// @brief write flushing changes row by row after data error of batch. Written rows, and rows failed too many
+    /// times, are removed from flushing ones; written sessions are cached.
+    /// @param connection database connection
+    void writeRows(QSqlConnectionPool::Connection &connection);
+
+    /// @brief count data error of row
+    /// @return true if row should be dropped
+    bool failed(const QString &auth_id);
+
+    /// @brief move buffered changes to flushing ones, write them, return the rest back to buffer
+    void flush();
+
+    /// @brief background writer
+    void run();
+
+public:
+    QSqlAuthStorage(const QSqlAuthStorage &) = delete;
+
+    /// @brief constructor
+    /// @param userConfig database configuration
+    /// @param authConfig auth configuration
+    /// @throw std::runtime_error if database is not available or table cannot be created
+    explicit QSqlAuthStorage(IUserConfig *userConfig, IAuthConfig *authConfig = nullptr);
+
+    /// @brief create internal authentication identifier
+    /// @param username user name
+    /// @param userVersion user version
+    /// @return authentication identifier, or empty string if too many changes are buffered
+    [[nodiscard]] QString authenticate(const QString &username, const QString &userVersion) override;
+
+    /// @brief create internal authentication identifier, valid until deadline
+    /// @param username user name
+    /// @param userVersion user version
+    /// @param deadline time, after which identifier is invalid
+    /// @return authentication identifier, or empty string if too many changes are buffered
+    [[nodiscard]] QString authenticate(const QString &username, const QString &userVersion,
+                                       std::chrono::system_clock::time_point deadline) override;
+
+    /// @brief get user data by authentication identifier
+    /// @param auth_id authentication identifier
+    /// @return username and user version on success, or std::nullopt
+    /// @throw UserStorageUnavailable if session is not cached and database is unavailable
+    [[nodiscard]] std::optional<QPair<QString, QString> > get(const QString &auth_id) override;
+
+    /// @brief remove authentication identifier
+    /// @param auth_id authentication identifier to remove
+    /// @throw UserStorageUnavailable if too many changes are buffered, or session can't be read
+    bool remove(const QString &auth_id) override;
+
+    /// @brief remove all sessions of users, buffered ones at once, written ones by statement executed right away
+    /// @param usernames user names
+    /// @return number of removed sessions, or -1 if database is unavailable and written sessions are kept
+    qint64 removeByUsers(const QSet<QString> &usernames) override;
+
+    /// @brief write all buffered changes
+    ~QSqlAuthStorage() override;
+};
+
+#endif // QSQL_AUTH_STORAGE_H
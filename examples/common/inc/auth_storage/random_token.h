@@ -0,0 +1,26 @@
+#ifndef RANDOM_TOKEN_H
+#define RANDOM_TOKEN_H
+
+#include <QString>
+#include <cstddef>
+
+/// @brief random bytes in authentication identifier
+static constexpr int RANDOM_TOKEN_BYTES = 24;
+/// @brief length of authentication identifier: base64url of RANDOM_TOKEN_BYTES, without padding
+static constexpr int RANDOM_TOKEN_LENGTH = RANDOM_TOKEN_BYTES / 3 * 4;
+
+/// @brief fill buffer with bytes of OS cryptographically secure generator (getrandom on Linux).
+/// Bytes are drawn from OS in blocks into per-thread buffer, so most calls don't make system call and don't lock.
+/// @param data buffer
+/// @param size number of bytes
+/// @throw std::runtime_error if OS generator fails
+void randomBytes(void *data, size_t size);
+
+/// @brief generate random authentication identifier: RANDOM_TOKEN_LENGTH base64url characters of
+/// RANDOM_TOKEN_BYTES bytes from `randomBytes()`.
+/// Generation is thread-safe and doesn't need a lock.
+/// @return authentication identifier
+/// @throw std::runtime_error if OS generator fails
+[[nodiscard]] QString randomToken();
+
+#endif // RANDOM_TOKEN_H
@@ -0,0 +1,46 @@
+#ifndef REVOCATION_SET_H
+#define REVOCATION_SET_H
+
+#include <filter/bloom_filter.h>
+#include <chrono>
+#include <QHash>
+#include <QReadWriteLock>
+#include <QString>
+
+/// @brief RevocationSet
+/// Set of revoked token identifiers, kept only until revoked token expires.
+/// Lookups check Bloom filter first and exact table only on positive answer, so check of not revoked token (common
+/// case) touches a few bits under shared lock. Expired entries are purged (and filter rebuilt) periodically on
+/// `revoke()`, so memory is proportional to number of recent revocations.
+/// Set is thread-safe.
+class RevocationSet {
+    mutable QReadWriteLock lock;
+    BloomFilter filter;
+    /// @brief token id -> token expiration (milliseconds since epoch)
+    QHash<QByteArray, qint64> revoked;
+    size_t capacity;
+    qint64 nextPurge = 0;
+
+    /// @brief drop expired entries and rebuild filter, called with locked write lock
+    void purge(qint64 now);
+
+public:
+    /// @brief constructor
+    /// @param capacity expected number of simultaneously revoked tokens (set grows beyond it if needed)
+    explicit RevocationSet(size_t capacity = 65536);
+
+    /// @brief revoke token until its expiration
+    /// @param jti token identifier
+    /// @param expiration expiration of token, after which it's rejected anyway
+    void revoke(const QString &jti, std::chrono::system_clock::time_point expiration);
+
+    /// @brief check if token is revoked
+    /// @param jti token identifier
+    /// @return true if token was revoked and hasn't expired yet
+    [[nodiscard]] bool isRevoked(const QString &jti) const;
+
+    /// @brief number of kept revocations
+    [[nodiscard]] int size() const;
+};
+
+#endif // REVOCATION_SET_H
@@ -0,0 +1,90 @@
+#ifndef SESSION_TABLE_H
+#define SESSION_TABLE_H
+
+#include <auth_storage/timing_wheel.h>
+#include <deque>
+#include <functional>
+#include <optional>
+#include <QHash>
+#include <QPair>
+#include <QSet>
+#include <QString>
+#include <QStringList>
+
+/// @brief SessionTable
+/// Session map with per-session deadline and size limit, used by in-memory auth storages.
+/// Deadlines are tracked by timing wheel, insertion order by queue, so both expiry and oldest-first eviction are
+/// O(1) amortized. Removed sessions are dropped from wheel and queue lazily: they are skipped when reached, and both
+/// are rebuilt when stale entries outnumber live sessions.
+/// Table is not thread-safe.
+class SessionTable {
+    struct Session {
+        QString username;
+        QString userVersion;
+        /// @brief milliseconds since epoch, 0 - never expires
+        qint64 deadline;
+        /// @brief insertion number, to tell queue entries of reused key apart
+        quint64 sequence;
+    };
+
+    QHash<QString, Session> sessions;
+    TimingWheel wheel;
+    /// @brief keys in insertion order, with insertion number
+    std::deque<QPair<QString, quint64> > order;
+    quint64 nextSequence = 0;
+    int maxSessions;
+
+    /// @brief remove oldest sessions over limit
+    void evict();
+
+    /// @brief rebuild wheel and queue, if they hold too many removed sessions
+    void compact();
+
+public:
+    /// @brief constructor
+    /// @param maxSessions maximum number of sessions, 0 - unlimited
+    explicit SessionTable(int maxSessions = 0);
+
+    /// @brief check if key is taken (even by expired session)
+    [[nodiscard]] bool contains(const QString &key) const;
+
+    /// @brief add session, evicting the oldest one if table is full
+    /// @param key authentication identifier
+    /// @param username user name
+    /// @param userVersion user version
+    /// @param deadline milliseconds since epoch, 0 - never expires
+    void insert(const QString &key, const QString &username, const QString &userVersion, qint64 deadline);
+
+    /// @brief get session
+    /// @param key authentication identifier
+    /// @param now current time in milliseconds
+    /// @return username and user version, if session exists and is not expired
+    [[nodiscard]] std::optional<QPair<QString, QString> > get(const QString &key, qint64 now) const;
+
+    /// @brief remove session
+    /// @param key authentication identifier
+    /// @param now current time in milliseconds
+    /// @return true if session existed and was not expired
+    bool remove(const QString &key, qint64 now);
+
+    /// @brief remove all sessions of users
+    /// @param usernames user names
+    /// @param now current time in milliseconds
+    /// @return keys of removed sessions, that were not expired
+    QStringList removeUsers(const QSet<QString> &usernames, qint64 now);
+
+    /// @brief remove expired sessions
+    /// @param now current time in milliseconds
+    void expire(qint64 now);
+
+    /// @brief number of sessions, including expired, but not removed yet
+    [[nodiscard]] int size() const;
+
+    /// @brief visit all not expired sessions
+    /// @param now current time in milliseconds
+    /// @param callback called with key, username, user version and deadline of every session
+    void forEach(qint64 now, const std::function<void(const QString &key, const QString &username,
+                                                      const QString &userVersion, qint64 deadline)> &callback) const;
+};
+
+#endif // SESSION_TABLE_H
@@ -0,0 +1,97 @@
+#ifndef SHARDED_AUTH_STORAGE_H
+#define SHARDED_AUTH_STORAGE_H
+
+#include <auth_storage/iauth_storage.h>
+#include <auth_storage/session_table.h>
+#include <auth_configuration/iauth_config.h>
+#include <memory>
+#include <vector>
+#include <QReadWriteLock>
+
+/// @brief ShardedAuthStorage
+/// Thread-safe in-memory session storage. Sessions are spread over independent shards by hash of authentication
+/// identifier, every shard is guarded by its own read-write lock, so `get()` calls from different threads never
+/// block each other and writes only block readers of one shard.
+/// Expired sessions are rejected by `get()` and dropped by writes to their shard.
+/// parameters from configuration:
+/// - auth.shards: number of shards, rounded up to power of two (default - 4 * ideal thread count)
+/// - auth.session_ttl: session lifetime in milliseconds, if deadline isn't given (default - 0, sessions never expire)
+/// - auth.max_sessions: maximum number of sessions, oldest sessions are evicted above it (default - 0, unlimited).
+///   Limit is split evenly between shards, so eviction is oldest-first within shard.
+class ShardedAuthStorage : public IAuthStorage {
+    /// @brief Aligned to cache line, so locks of neighbour shards don't share one line.
+    struct alignas(64) Shard {
+        QReadWriteLock lock;
+        SessionTable sessions;
+
+        explicit Shard(int maxSessions) : sessions(maxSessions) {
+        }
+    };
+
+    std::vector<std::unique_ptr<Shard> > shards;
+    uint shardBits = 0;
+    qint64 sessionTtl = 0;
+
+    [[nodiscard]] Shard &shardOf(const QString &auth_id) const;
+
+    [[nodiscard]] QString insert(const QString &username, const QString &userVersion, qint64 deadline);
+
+public:
+    /// @brief constructor
+    /// @param config auth configuration
+    explicit ShardedAuthStorage(IAuthConfig *config = nullptr);
+
+    /// @brief create internal authentication identifier
+    /// @param username user name
+    /// @param userVersion user version
+    /// @return authentication identifier
+    [[nodiscard]] QString authenticate(const QString &username, const QString &userVersion) override;
+
+    /// @brief create internal authentication identifier, valid until deadline
+    /// @param username user name
+    /// @param userVersion user version
+    /// @param deadline time, after which identifier is invalid
+    /// @return authentication identifier
+    [[nodiscard]] QString authenticate(const QString &username, const QString &userVersion,
+                                       std::chrono::system_clock::time_point deadline) override;
+
+    /// @brief get user data by authentication identifier
+    /// @param auth_id authentication identifier
+    /// @return username and user version on success, or std::nullopt
+    [[nodiscard]] std::optional<QPair<QString, QString> > get(const QString &auth_id) override;
+
+    /// @brief remove authentication identifier
+    /// @param auth_id authentication identifier to remove
+    bool remove(const QString &auth_id) override;
+
+    /// @brief number of live sessions
+    [[nodiscard]] qint64 sessionCount() override;
+
+    /// @brief remove all sessions of users, scanning shards one by one
+    qint64 removeByUsers(const QSet<QString> &usernames) override;
+
+    /// @brief remove all sessions of users
+    /// @param usernames user names
+    /// @return identifiers of removed sessions
+    QStringList removeSessionsOf(const QSet<QString> &usernames);
+
+    /// @brief number of shards
+    [[nodiscard]] int shardCount() const;
+
+    /// @brief number of stored sessions
+    [[nodiscard]] int size() const;
+
+    /// @brief put session with known identifier, e.g. restored from disk
+    /// @param auth_id authentication identifier
+    /// @param username user name
+    /// @param userVersion user version
+    /// @param deadline milliseconds since epoch, 0 - never expires
+    void restore(const QString &auth_id, const QString &username, const QString &userVersion, qint64 deadline);
+
+    /// @brief visit all not expired sessions, shard by shard (every shard is consistent, storage as a whole is not)
+    /// @param callback called with identifier, username, user version and deadline of every session
+    void forEach(const std::function<void(const QString &auth_id, const QString &username,
+                                          const QString &userVersion, qint64 deadline)> &callback) const;
+};
+
+#endif // SHARDED_AUTH_STORAGE_H
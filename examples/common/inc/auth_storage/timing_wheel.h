@@ -0,0 +1,61 @@
+#ifndef TIMING_WHEEL_H
+#define TIMING_WHEEL_H
+
+#include <array>
+#include <vector>
+#include <QString>
+
+/// @brief TimingWheel
+/// Hierarchical timing wheel of keys with deadlines. Every level has 64 slots, slot of level N covers 64^N ticks, so
+/// 4 levels cover about 194 days with one second tick (later deadlines are parked in the last level and re-placed).
+/// Scheduling is O(1), advancing is O(1) per elapsed tick plus O(1) amortized per key (key is moved down at most once
+/// per level). Keys can't be cancelled: owner is expected to ignore keys, which are not due anymore.
+/// Wheel is not thread-safe.
+class TimingWheel {
+public:
+    static constexpr int LEVEL_BITS = 6;
+    static constexpr int SLOTS = 1 << LEVEL_BITS;
+    static constexpr int LEVELS = 4;
+
+private:
+    struct Item {
+        qint64 tick;
+        QString key;
+    };
+
+    std::array<std::array<std::vector<Item>, SLOTS>, LEVELS> slots;
+    qint64 resolution;
+    /// @brief last processed tick
+    qint64 current;
+    int count = 0;
+
+    /// @brief put item to slot by its distance from current tick
+    void place(Item &&item);
+
+    /// @brief move items of slot of given level to lower levels
+    void cascade(int level);
+
+public:
+    /// @brief constructor
+    /// @param now current time in milliseconds
+    /// @param resolution tick length in milliseconds
+    explicit TimingWheel(qint64 now, qint64 resolution = 1000);
+
+    /// @brief schedule key
+    /// @param key key to schedule
+    /// @param deadline time in milliseconds, key is returned by first `advance()` after it
+    void schedule(const QString &key, qint64 deadline);
+
+    /// @brief advance wheel to given time
+    /// @param now current time in milliseconds
+    /// @return keys with passed deadlines (rounded up to tick)
+    [[nodiscard]] std::vector<QString> advance(qint64 now);
+
+    /// @brief remove all keys
+    void clear();
+
+    /// @brief number of scheduled keys
+    [[nodiscard]] int size() const;
+};
+
+#endif // TIMING_WHEEL_H
@@ -0,0 +1,43 @@
+#ifndef BLOOM_FILTER_H
+#define BLOOM_FILTER_H
+
+#include <cstdint>
+#include <vector>
+#include <QByteArray>
+
+/// @brief BloomFilter
+/// Probabilistic set: `mightContain()` never returns false for added key, but may return true for key never added
+/// (with configured probability, while number of keys stays within capacity).
+/// Filter is not thread-safe.
+class BloomFilter {
+    std::vector<uint64_t> words;
+    uint64_t bitMask = 0;
+    int hashes = 1;
+    size_t count = 0;
+
+public:
+    /// @brief constructor
+    /// @param capacity expected number of keys
+    /// @param falsePositiveRate false positive probability at full capacity
+    explicit BloomFilter(size_t capacity = 1024, double falsePositiveRate = 0.01);
+
+    /// @brief add key to filter
+    /// @param key key to add
+    void add(const QByteArray &key);
+
+    /// @brief check key
+    /// @param key key to check
+    /// @return false if key was never added, true if key was probably added
+    [[nodiscard]] bool mightContain(const QByteArray &key) const;
+
+    /// @brief remove all keys
+    void clear();
+
+    /// @brief number of added keys (with repetitions)
+    [[nodiscard]] size_t size() const;
+
+    /// @brief size of bit array in bytes
+    [[nodiscard]] size_t memoryUsage() const;
+};
+
+#endif // BLOOM_FILTER_H
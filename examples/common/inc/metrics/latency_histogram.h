@@ -0,0 +1,57 @@
+#ifndef LATENCY_HISTOGRAM_H
+#define LATENCY_HISTOGRAM_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/// @brief LatencyHistogram
+/// HDR-style histogram of non-negative values (e.g. microseconds): every power of two is split into 128 linear
+/// buckets, so any recorded value is reported with relative error below 1% while memory stays fixed (~60 KiB)
+/// whatever the range of values. Percentiles are reported as highest value of their bucket, never below real one.
+/// Histogram is not thread-safe; histograms of different threads can be merged.
+class LatencyHistogram {
+    std::vector<uint64_t> counts;
+    uint64_t total = 0;
+    uint64_t minimum = UINT64_MAX;
+    uint64_t maximum = 0;
+    /// @brief sum of values, for mean
+    long double sum = 0;
+
+    [[nodiscard]] static size_t indexOf(uint64_t value);
+
+    [[nodiscard]] static uint64_t highestOf(size_t index);
+
+public:
+    LatencyHistogram();
+
+    /// @brief record value
+    /// @param value value to record
+    /// @param count number of occurrences
+    void record(uint64_t value, uint64_t count = 1);
+
+    /// @brief add all values of other histogram
+    void merge(const LatencyHistogram &other);
+
+    /// @brief remove all values
+    void clear();
+
+    /// @brief number of recorded values
+    [[nodiscard]] uint64_t count() const;
+
+    /// @brief smallest recorded value, 0 if histogram is empty
+    [[nodiscard]] uint64_t min() const;
+
+    /// @brief largest recorded value
+    [[nodiscard]] uint64_t max() const;
+
+    /// @brief mean of recorded values, 0 if histogram is empty
+    [[nodiscard]] double mean() const;
+
+    /// @brief value at percentile
+    /// @param percentile percentile in range [0, 100], e.g. 99.9
+    /// @return value, not less than `percentile`% of recorded values; 0 if histogram is empty
+    [[nodiscard]] uint64_t percentile(double percentile) const;
+};
+
+#endif // LATENCY_HISTOGRAM_H
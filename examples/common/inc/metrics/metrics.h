@@ -0,0 +1,150 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <QByteArray>
+#include <QMutex>
+#include <QString>
+
+/// @brief Metrics
+/// Process-wide registry of counters, latency histograms and gauges, exposed in Prometheus text format.
+/// Recording is lock-free: every counter and histogram keeps `SLOTS` cache-line aligned slots of relaxed atomics,
+/// every thread writes to its own slot, so threads don't share cache lines on hot path. Slots are summed on scrape.
+/// Histograms count durations in power-of-two buckets from 1 microsecond to ~33 seconds: these bounds are exported as
+/// `le` buckets, so percentiles over any window are computed by Prometheus (`histogram_quantile`).
+/// Metrics are created once (registration takes a lock) and live as long as the process, so hot paths keep references.
+/// Gauges are read by callback on scrape and unregistered by destroying their handle.
+class Metrics {
+public:
+    /// @brief number of per-thread slots; threads beyond it share slots
+    static constexpr int SLOTS = 32;
+
+    /// @brief Monotonic counter
+    class Counter {
+        struct alignas(64) Slot {
+            std::atomic<uint64_t> value{0};
+        };
+
+        Slot slots[SLOTS];
+
+    public:
+        /// @brief increment counter
+        void add(uint64_t count = 1);
+
+        /// @brief sum of all slots
+        [[nodiscard]] uint64_t value() const;
+    };
+
+    /// @brief Histogram of durations
+    class Histogram {
+    public:
+        /// @brief bucket `i` counts durations up to 2^i microseconds, last bucket counts longer ones
+        static constexpr int BUCKETS = 27;
+
+    private:
+        struct alignas(64) Slot {
+            std::atomic<uint64_t> buckets[BUCKETS] = {};
+            /// @brief nanoseconds
+            std::atomic<uint64_t> sum{0};
+        };
+
+        Slot slots[SLOTS];
+
+    public:
+        /// @brief record duration
+        void record(std::chrono::nanoseconds duration);
+
+        /// @brief sum of all slots
+        /// @param buckets non-cumulative bucket counts
+        /// @param sum sum of durations, nanoseconds
+        void read(uint64_t (&buckets)[BUCKETS], uint64_t &sum) const;
+    };
+
+    /// @brief Records time from construction to destruction into histogram
+    class Timer {
+        Histogram &histogram;
+        std::chrono::steady_clock::time_point start;
+
+    public:
+        Timer(const Timer &) = delete;
+
+        explicit Timer(Histogram &histogram);
+
+        ~Timer();
+    };
+
+    /// @brief Registration of gauge, gauge is removed with it
+    class Gauge {
+        friend class Metrics;
+        Metrics &metrics;
+        QString name;
+        QString labels;
+
+        Gauge(Metrics &metrics, QString name, QString labels);
+
+    public:
+        Gauge(const Gauge &) = delete;
+
+        ~Gauge();
+    };
+
+    Metrics(const Metrics &) = delete;
+
+    /// @brief registry of process
+    [[nodiscard]] static Metrics &instance();
+
+    /// @brief format label for series, with value escaped
+    /// @param name label name
+    /// @param value label value
+    /// @return `name="value"`
+    [[nodiscard]] static QString label(const QString &name, const QString &value);
+
+    /// @brief get or create counter
+    /// @param name metric name, should end with `_total`
+    /// @param help description of metric
+    /// @param labels labels of series (see `label()`), comma-separated
+    /// @param scale exported value is count multiplied by scale, e.g. 1e-6 for microseconds exported in seconds
+    /// @return counter, that lives as long as the process
+    Counter &counter(const QString &name, const QString &help, const QString &labels = QString(), double scale = 1);
+
+    /// @brief get or create histogram
+    /// @param name metric name, should end with `_seconds`
+    /// @param help description of metric
+    /// @param labels labels of series (see `label()`), comma-separated
+    /// @return histogram, that lives as long as the process
+    Histogram &histogram(const QString &name, const QString &help, const QString &labels = QString());
+
+    /// @brief register gauge. Callback is called on scrape under registry lock, so it must not use registry.
+    /// @param name metric name
+    /// @param help description of metric
+    /// @param labels labels of series (see `label()`), comma-separated
+    /// @param value callback, that returns current value
+    /// @return registration, gauge is removed when it is destroyed
+    [[nodiscard]] std::unique_ptr<Gauge> gauge(const QString &name, const QString &help, const QString &labels,
+                                               std::function<double()> value);
+
+    /// @brief all metrics in Prometheus text format 0.0.4
+    [[nodiscard]] QByteArray exposition() const;
+
+private:
+    struct Family {
+        QString help;
+        /// @brief scale of counters
+        double scale = 1;
+        std::map<QString, std::unique_ptr<Counter> > counters;
+        std::map<QString, std::unique_ptr<Histogram> > histograms;
+        std::map<QString, std::function<double()> > gauges;
+    };
+
+    mutable QMutex mutex;
+    std::map<QString, Family> families;
+
+    Metrics() = default;
+};
+
+#endif // METRICS_H
@@ -0,0 +1,22 @@
+#ifndef METRICS_SERVER_H
+#define METRICS_SERVER_H
+
+#include <QTcpServer>
+
+/// @brief MetricsServer
+/// HTTP endpoint for Prometheus: answers any GET request with **Metrics** of process in text format and closes
+/// connection; `GET /traces` answers with slow requests kept by **Tracer**, as Chrome trace-event JSON.
+/// It should listen on its own local port, separate from the service.
+class MetricsServer : public QTcpServer {
+    Q_OBJECT
+
+protected:
+    void incomingConnection(qintptr socketDescriptor) override;
+
+public:
+    /// @brief constructor
+    /// @param parent parent object
+    explicit MetricsServer(QObject *parent = nullptr);
+};
+
+#endif // METRICS_SERVER_H
@@ -0,0 +1,110 @@
+#ifndef TRACER_H
+#define TRACER_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <vector>
+#include <QByteArray>
+#include <QMutex>
+#include <QString>
+
+/// @brief Tracer
+/// Process-wide tracer of slow requests. Request scope (`Tracer::Request`) marks one call, stage spans
+/// (`Tracer::Span`) inside it are recorded into ring buffer of calling thread, without locks or allocations.
+/// When request ends and it took longer than threshold, its spans are sampled and kept in memory (last `MAX_TRACES`);
+/// kept traces are exported as Chrome trace-event JSON, that can be opened in `chrome://tracing` or Perfetto.
+/// Tracing is disabled until `configure()` is called with positive threshold, then spans cost two clock reads.
+class Tracer {
+public:
+    /// @brief spans in ring buffer of every thread; longer requests keep only their last spans
+    static constexpr size_t CAPACITY = 1024;
+    /// @brief slow requests kept in memory; older ones are dropped
+    static constexpr size_t MAX_TRACES = 256;
+
+    /// @brief Finished span
+    struct Event {
+        /// @brief stage name, string literal
+        const char *name;
+        /// @brief nanoseconds since tracer start
+        int64_t start;
+        int64_t end;
+    };
+
+    /// @brief Records stage of current request from construction to destruction. Outside of request it does nothing.
+    class Span {
+        const char *name;
+        int64_t start;
+
+    public:
+        Span(const Span &) = delete;
+
+        /// @brief constructor
+        /// @param name stage name, must be string literal (it isn't copied)
+        explicit Span(const char *name);
+
+        ~Span();
+    };
+
+    /// @brief Scope of one request on calling thread; request is kept when it is slow and sampled
+    class Request {
+        QString name;
+        int64_t start;
+        uint64_t first;
+        bool active;
+
+    public:
+        Request(const Request &) = delete;
+
+        /// @brief constructor
+        /// @param name request name, e.g. JSON-RPC method
+        explicit Request(QString name);
+
+        ~Request();
+    };
+
+    Tracer(const Tracer &) = delete;
+
+    /// @brief tracer of process
+    [[nodiscard]] static Tracer &instance();
+
+    /// @brief set what requests are kept
+    /// @param threshold requests longer than it are slow; zero or negative disables tracing
+    /// @param sampleRate share of slow requests, that are kept, in range [0, 1]
+    void configure(std::chrono::microseconds threshold, double sampleRate = 1);
+
+    /// @brief is tracing enabled
+    [[nodiscard]] bool enabled() const;
+
+    /// @brief kept traces in Chrome trace-event format
+    [[nodiscard]] QByteArray chromeTrace() const;
+
+private:
+    struct Trace {
+        QString name;
+        int thread;
+        int64_t start;
+        int64_t end;
+        /// @brief spans are lost, because request was longer than ring buffer
+        bool truncated;
+        std::vector<Event> events;
+    };
+
+    std::chrono::steady_clock::time_point epoch;
+    /// @brief nanoseconds, 0 if tracing is disabled
+    std::atomic<int64_t> threshold{0};
+    std::atomic<double> sampleRate{1};
+
+    mutable QMutex mutex;
+    std::deque<Trace> traces;
+
+    Tracer();
+
+    /// @brief nanoseconds since tracer start
+    [[nodiscard]] int64_t now() const;
+
+    void keep(Trace &&trace);
+};
+
+#endif // TRACER_H
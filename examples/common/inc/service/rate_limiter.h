@@ -0,0 +1,63 @@
+#ifndef RATE_LIMITER_H
+#define RATE_LIMITER_H
+
+#include <atomic>
+#include <list>
+#include <memory>
+#include <vector>
+#include <QHash>
+#include <QMutex>
+#include <QString>
+
+/// @brief RateLimiter
+/// Token buckets by key (user name, client address): every key gets `burst` requests at once and `rate` requests per
+/// second after that. Buckets are kept in LRU order and the least recently used one is dropped when there are
+/// `capacity` of them, so memory is bounded whatever keys come in. Dropped bucket is forgotten, i.e. key gets full
+/// burst again; capacity should exceed number of keys active within `burst / rate` seconds.
+/// Limiter is thread-safe: buckets are split into shards with a mutex per shard.
+class RateLimiter {
+    struct Bucket {
+        QString key;
+        double tokens = 0;
+        /// @brief milliseconds of monotonic clock, when tokens were refilled
+        qint64 updated = 0;
+    };
+
+    struct Shard {
+        QMutex mutex;
+        /// @brief most recently used first
+        std::list<Bucket> buckets;
+        QHash<QString, std::list<Bucket>::iterator> index;
+    };
+
+    std::vector<std::unique_ptr<Shard> > shards;
+    double rate;
+    double burst;
+    size_t shardCapacity;
+    std::atomic<quint64> rejectedCount{0};
+
+public:
+    RateLimiter(const RateLimiter &) = delete;
+
+    /// @brief constructor
+    /// @param rate requests per second
+    /// @param burst maximum number of requests at once (at least 1)
+    /// @param capacity maximum number of tracked keys
+    RateLimiter(double rate, double burst, size_t capacity = 65536);
+
+    /// @brief take one token of key
+    /// @param key limited key
+    /// @return false if request should be rejected
+    [[nodiscard]] bool tryAcquire(const QString &key);
+
+    /// @brief take one token of key at given time
+    /// @param key limited key
+    /// @param now milliseconds of monotonic clock
+    /// @return false if request should be rejected
+    [[nodiscard]] bool tryAcquire(const QString &key, qint64 now);
+
+    /// @brief number of rejected requests
+    [[nodiscard]] quint64 rejected() const;
+};
+
+#endif // RATE_LIMITER_H
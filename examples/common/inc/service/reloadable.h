@@ -0,0 +1,56 @@
+#ifndef RELOADABLE_H
+#define RELOADABLE_H
+
+#include <atomic>
+#include <memory>
+#include <QtGlobal>
+
+/// @brief Reloadable
+/// Value, that is replaced on reload of configuration and read by every request (e.g. JWT secret).
+/// `std::atomic_load` of shared pointer takes a lock of address-hashed mutex pool and touches reference count shared
+/// by all threads, so every thread keeps its own copy of pointer and loads it again only after version is changed:
+/// hot path reads one atomic. Calls in flight finish with the value they have read.
+template<typename T>
+class Reloadable {
+    /// @brief accessed with std::atomic_load / std::atomic_store only
+    std::shared_ptr<const T> value;
+    std::atomic<quint64> version{0};
+
+    /// @brief versions are unique across instances, so cache of destroyed instance at the same address never matches
+    static quint64 nextVersion() {
+        static std::atomic<quint64> versions{0};
+        return versions.fetch_add(1, std::memory_order_relaxed) + 1;
+    }
+
+public:
+    Reloadable(const Reloadable &) = delete;
+
+    explicit Reloadable(T initial) {
+        this->store(std::move(initial));
+    }
+
+    /// @brief replace value, thread-safe
+    void store(T replacement) {
+        std::atomic_store(&this->value, std::shared_ptr<const T>(std::make_shared<T>(std::move(replacement))));
+        this->version.store(nextVersion(), std::memory_order_release);
+    }
+
+    /// @brief current value, thread-safe
+    /// @return value, that stays valid until next `get()` of any Reloadable<T> in this thread
+    [[nodiscard]] const T &get() const {
+        thread_local struct {
+            const Reloadable *owner = nullptr;
+            quint64 version = 0;
+            std::shared_ptr<const T> value;
+        } cache;
+        const quint64 current = this->version.load(std::memory_order_acquire);
+        if (cache.owner != this || cache.version != current) {
+            cache.value = std::atomic_load(&this->value);
+            cache.owner = this;
+            cache.version = current;
+        }
+        return *cache.value;
+    }
+};
+
+#endif // RELOADABLE_H
@@ -0,0 +1,94 @@
+#ifndef REQUEST_EXECUTOR_H
+#define REQUEST_EXECUTOR_H
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <metrics/metrics.h>
+#include <QThreadPool>
+
+/// @brief RequestExecutor
+/// Fixed pool of worker threads, that execute service requests outside of I/O thread.
+/// Worker threads never expire, so per-thread resources (like SQL connections) live as long as the executor.
+/// Executor with capacity is bounded: `tryPost()` rejects job, if `capacity` jobs are already queued or running, so
+/// burst of expensive requests is turned away instead of growing the queue.
+/// Every job is measured: time spent in queue and time of execution. Named executor exports these counters as
+/// `jrpc_auth_executor_*_total{executor=<name>}` **Metrics**, and number of pending jobs as gauge. Counters of
+/// executors with the same name are summed and survive recreation of executor, so they stay monotonic.
+class RequestExecutor {
+public:
+    /// @brief Counters since executor start
+    struct Stats {
+        /// @brief finished jobs
+        quint64 completed = 0;
+        /// @brief jobs rejected by `tryPost()`
+        quint64 rejected = 0;
+        /// @brief jobs queued or running right now
+        int pending = 0;
+        /// @brief total time jobs spent in queue, microseconds
+        quint64 waitTotal = 0;
+        /// @brief maximum time job spent in queue, microseconds
+        quint64 waitMax = 0;
+        /// @brief total time of execution, microseconds
+        quint64 runTotal = 0;
+        /// @brief maximum time of execution, microseconds
+        quint64 runMax = 0;
+    };
+
+private:
+    QThreadPool pool;
+    /// @brief maximum number of pending jobs for `tryPost()`, 0 - unbounded
+    int capacity = 0;
+
+    std::atomic<int> pending{0};
+    std::atomic<quint64> completed{0};
+    std::atomic<quint64> rejected{0};
+    std::atomic<quint64> waitTotal{0};
+    std::atomic<quint64> waitMax{0};
+    std::atomic<quint64> runTotal{0};
+    std::atomic<quint64> runMax{0};
+
+    /// @brief exported counters, null if executor isn't named
+    Metrics::Counter *completedMetric = nullptr;
+    Metrics::Counter *rejectedMetric = nullptr;
+    /// @brief microseconds
+    Metrics::Counter *waitMetric = nullptr;
+    /// @brief microseconds
+    Metrics::Counter *runMetric = nullptr;
+    std::unique_ptr<Metrics::Gauge> pendingGauge;
+
+    /// @brief wrap job with measurements and start it
+    void start(std::function<void()> job);
+
+public:
+    RequestExecutor(const RequestExecutor &) = delete;
+
+    /// @brief constructor
+    /// @param threads number of worker threads
+    /// @param capacity maximum number of queued and running jobs accepted by `tryPost()`, 0 - unbounded
+    /// @param name name in metrics, empty - not exported
+    explicit RequestExecutor(int threads, int capacity = 0, const QString &name = QString());
+
+    /// @brief execute job on one of worker threads. Jobs are started in order of posting.
+    /// @param job job to execute
+    void post(std::function<void()> job);
+
+    /// @brief execute job on one of worker threads, if executor isn't full
+    /// @param job job to execute
+    /// @return false if job is rejected
+    [[nodiscard]] bool tryPost(std::function<void()> job);
+
+    /// @brief number of worker threads
+    [[nodiscard]] int threadCount() const;
+
+    /// @brief current counters
+    [[nodiscard]] Stats stats() const;
+
+    /// @brief wait for all posted jobs
+    void wait();
+
+    /// @brief wait for all posted jobs
+    ~RequestExecutor();
+};
+
+#endif // REQUEST_EXECUTOR_H
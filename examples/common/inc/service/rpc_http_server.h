@@ -0,0 +1,143 @@
+#ifndef RPC_HTTP_SERVER_H
+#define RPC_HTTP_SERVER_H
+
+#include <service/request_executor.h>
+#include <metrics/metrics.h>
+#include <qjsonrpc/qjsonrpcmessage.h>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <QHash>
+#include <QHostAddress>
+#include <QJsonArray>
+#include <QTcpServer>
+
+class QTcpSocket;
+
+/// @brief RpcHttpServer
+/// JSON-RPC 2.0 over HTTP server, that executes entries of batch request concurrently.
+/// Methods are registered by full name ("auth.login") together with names of their parameters; params may be given
+/// as array or as object. Every call (single or batch entry) is executed as separate job of worker pool, response to
+/// batch is sent once all its entries are done, in order of requests; notifications have no response entry.
+/// Without worker threads calls are executed in place, one after another.
+/// Expensive methods may be given their own bounded executor: their calls don't occupy server workers, and when that
+/// executor is full calls fail with "Server is busy" error right away.
+/// Methods may have admission check (e.g. rate limit), which runs in I/O thread before call is queued. Behind proxy
+/// address of client may be taken from header set by that proxy (e.g. X-Forwarded-For).
+/// Requests of one connection are answered in order (HTTP/1.1 keep-alive and pipelining are supported). Body is
+/// given by Content-Length or chunked transfer encoding, "Expect: 100-continue" is answered before body is read.
+/// While request of connection is executed, the connection is not read: pipelined requests wait in bounded socket
+/// buffer, so client sending faster than it is answered is throttled by TCP instead of growing server memory.
+/// Batch may contain at most 1000 entries.
+/// Every method has **Metrics**: execution time, number of error responses and number of calls rejected before
+/// execution (admission check or full executor).
+class RpcHttpServer : public QTcpServer {
+    Q_OBJECT
+
+public:
+    /// @brief Method handler, builds response (or error) for request
+    /// @param request request message
+    /// @param params parameters in order of registered names
+    using Method = std::function<QJsonRpcMessage(const QJsonRpcMessage &request, const QJsonArray &params)>;
+
+    /// @brief Admission check of call, executed in I/O thread before call is queued, so it must be cheap
+    /// @param params parameters in order of registered names
+    /// @param peer address of client
+    /// @return false to reject call with "Too many requests" error
+    using Guard = std::function<bool(const QJsonArray &params, const QHostAddress &peer)>;
+
+private:
+    struct Entry {
+        Method method;
+        QStringList params;
+        /// @brief dedicated bounded executor, or null to use workers of server
+        RequestExecutor *executor = nullptr;
+        Guard guard;
+        Metrics::Histogram *duration = nullptr;
+        Metrics::Counter *errors = nullptr;
+        Metrics::Counter *rejected = nullptr;
+    };
+
+    struct Batch;
+
+    struct Connection {
+        QByteArray buffer;
+        /// @brief request of this connection is being executed
+        bool busy = false;
+        /// @brief "100 Continue" is sent for buffered request
+        bool continued = false;
+    };
+
+    QHash<QString, Entry> methods;
+    QHash<QTcpSocket *, Connection> connections;
+    /// @brief lowercase name of header with address of client, or empty to use address of connection
+    QByteArray forwardedHeader;
+    /// @brief worker pool, or null to execute in place
+    std::unique_ptr<RequestExecutor> executor;
+
+    /// @brief parse and start buffered requests of connection
+    void process(QTcpSocket *socket);
+
+    /// @brief start execution of request body
+    /// @param peer address of client
+    void dispatch(QTcpSocket *socket, const QByteArray &body, bool keepAlive, const QHostAddress &peer);
+
+    /// @brief parameters of request in order of registered names
+    /// @return parameters, or std::nullopt if they don't match registered ones
+    [[nodiscard]] static std::optional<QJsonArray> paramsOf(const Entry &entry, const QJsonRpcMessage &request);
+
+    /// @brief run guard of method
+    /// @return false if call is rejected
+    [[nodiscard]] bool admit(const QJsonRpcMessage &request, const QHostAddress &peer) const;
+
+    /// @brief count call rejected before execution
+    void reject(const QJsonRpcMessage &request) const;
+
+    /// @brief executor for request, or null to execute it in place
+    [[nodiscard]] RequestExecutor *executorOf(const QJsonRpcMessage &request) const;
+
+    /// @brief execute one call
+    [[nodiscard]] QJsonRpcMessage call(const QJsonRpcMessage &request) const;
+
+    /// @brief send response to finished batch and continue with next request of connection
+    void finish(const std::shared_ptr<Batch> &batch);
+
+    /// @brief write HTTP response
+    static void reply(QTcpSocket *socket, int status, const QByteArray &reason, const QByteArray &body,
+                      bool keepAlive);
+
+protected:
+    void incomingConnection(qintptr socketDescriptor) override;
+
+public:
+    RpcHttpServer(const RpcHttpServer &) = delete;
+
+    /// @brief constructor
+    /// @param threads number of worker threads, 0 - execute calls in I/O thread
+    /// @param parent parent object
+    explicit RpcHttpServer(int threads, QObject *parent = nullptr);
+
+    /// @brief register method. Handler is called on worker thread, so it must be thread-safe.
+    /// @param name full method name
+    /// @param params names of parameters
+    /// @param method handler
+    /// @param executor executor for calls of this method (not owned), null - server workers
+    void addMethod(const QString &name, const QStringList &params, Method method,
+                   RequestExecutor *executor = nullptr);
+
+    /// @brief set admission check of registered method
+    /// @param name full method name
+    /// @param guard admission check
+    void setGuard(const QString &name, Guard guard);
+
+    /// @brief take address of client given to guards from header, e.g. "X-Forwarded-For". Only the last address of
+    /// header is used, the one added by the nearest proxy, so the header must be set by trusted proxy. Requests
+    /// without valid address in header keep address of connection.
+    /// @param header header name, empty - address of connection
+    void setForwardedHeader(const QString &header);
+
+    /// @brief wait for running calls, including calls on executors of methods
+    ~RpcHttpServer() override;
+};
+
+#endif // RPC_HTTP_SERVER_H
@@ -0,0 +1,43 @@
+#ifndef RPC_SERVICE_H
+#define RPC_SERVICE_H
+
+#include <qjsonrpc/qjsonrpcmessage.h>
+#include <service/request_executor.h>
+#include <service/rpc_http_server.h>
+#include <functional>
+#include <QJsonArray>
+#include <QObject>
+
+/// @brief RpcService
+/// Base of JSON-RPC services, which register their request handlers as methods of RpcHttpServer. Unavailable user
+/// storage is turned into JSON-RPC error.
+class RpcService : public QObject {
+    Q_OBJECT
+
+public:
+    /// @brief Request handler, builds response (or error) for request
+    using Handler = std::function<QJsonRpcMessage(const QJsonRpcMessage &request)>;
+
+    /// @brief Method implementation, builds response (or error) for request with parameters in order of names
+    using Method = std::function<QJsonRpcMessage(const QJsonRpcMessage &request, const QJsonArray &params)>;
+
+    explicit RpcService(QObject *parent = nullptr);
+
+protected:
+    /// @brief Call request handler, turning unavailable user storage into JSON-RPC error
+    /// @param handler request handler
+    /// @param request request message
+    /// @return response or error
+    [[nodiscard]] static QJsonRpcMessage callHandler(const Handler &handler, const QJsonRpcMessage &request);
+
+    /// @brief Register method in server, unavailable user storage is turned into JSON-RPC error
+    /// @param server JSON-RPC server
+    /// @param name full method name
+    /// @param params names of parameters
+    /// @param method method implementation, called on worker thread
+    /// @param executor executor for calls of this method (not owned), null - server workers
+    static void addMethod(RpcHttpServer *server, const QString &name, const QStringList &params, Method method,
+                          RequestExecutor *executor = nullptr);
+};
+
+#endif // RPC_SERVICE_H
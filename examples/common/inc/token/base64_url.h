@@ -0,0 +1,54 @@
+#ifndef BASE64_URL_H
+#define BASE64_URL_H
+
+#include <cstddef>
+#include <optional>
+#include <string>
+#include <string_view>
+
+/// Single base64url codec (RFC 4648, section 5) of the project: JWT segments, authentication identifiers and
+/// session keys are encoded and decoded here. Padding is never written.
+
+/// @brief number of characters of encoded bytes
+/// @param size number of bytes
+constexpr size_t base64UrlLength(const size_t size) {
+    return (size * 4 + 2) / 3;
+}
+
+/// @brief encode bytes as base64url without padding
+/// @param data bytes
+/// @param size number of bytes
+/// @param out buffer for `base64UrlLength(size)` characters
+void base64UrlEncode(const unsigned char *data, size_t size, char *out);
+
+/// @brief encode bytes as base64url without padding into UTF-16 characters (e.g. of QString)
+/// @param data bytes
+/// @param size number of bytes
+/// @param out buffer for `base64UrlLength(size)` characters
+void base64UrlEncode(const unsigned char *data, size_t size, char16_t *out);
+
+/// @brief decode base64url without padding
+/// @param in encoded characters
+/// @param length number of characters
+/// @param out buffer for `length * 3 / 4` bytes
+/// @return false if text isn't base64url, `out` is partly written then
+[[nodiscard]] bool base64UrlDecode(const char *in, size_t length, unsigned char *out);
+
+/// @brief decode base64url without padding from UTF-16 characters (e.g. of QString)
+/// @param in encoded characters
+/// @param length number of characters
+/// @param out buffer for `length * 3 / 4` bytes
+/// @return false if text isn't base64url, `out` is partly written then
+[[nodiscard]] bool base64UrlDecode(const char16_t *in, size_t length, unsigned char *out);
+
+/// @brief encode bytes as base64url without padding, as JWT segments are encoded
+/// @param data bytes
+/// @return encoded text
+[[nodiscard]] std::string base64UrlEncode(std::string_view data);
+
+/// @brief decode base64url without padding (padding is tolerated)
+/// @param data encoded text
+/// @return bytes, std::nullopt if text isn't base64url
+[[nodiscard]] std::optional<std::string> base64UrlDecode(std::string_view data);
+
+#endif // BASE64_URL_H
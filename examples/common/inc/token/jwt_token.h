@@ -0,0 +1,30 @@
+#ifndef JWT_TOKEN_H
+#define JWT_TOKEN_H
+
+#include <optional>
+#include <string_view>
+#include <QString>
+
+/// @brief create HS256 JWT token with "jti", "iss", "sub" and "iat" claims
+/// @param secret signing secret
+/// @param jti token identifier
+/// @param issuer service name
+/// @param username user name
+/// @return token in compact serialization
+[[nodiscard]] QString createJwtToken(const QString &secret, const QString &jti, const QString &issuer,
+                                     const QString &username);
+
+/// @brief verify HS256 JWT token
+/// @param jwt token in compact serialization
+/// @param secret signing secret
+/// @return "jti" claim if token is valid, otherwise std::nullopt
+[[nodiscard]] std::optional<QString> verifyJwtAndGetToken(const QString &jwt, const QString &secret) noexcept;
+
+/// @brief verify HS256 JWT token on its bytes: token is checked without conversions between UTF-16 and UTF-8,
+/// only "jti" claim is converted to QString for storage lookup
+/// @param jwt token in compact serialization
+/// @param secret signing secret in UTF-8
+/// @return "jti" claim if token is valid, otherwise std::nullopt
+[[nodiscard]] std::optional<QString> verifyJwtAndGetToken(std::string_view jwt, std::string_view secret) noexcept;
+
+#endif // JWT_TOKEN_H
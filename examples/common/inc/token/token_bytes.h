@@ -0,0 +1,38 @@
+#ifndef TOKEN_BYTES_H
+#define TOKEN_BYTES_H
+
+#include <optional>
+#include <string>
+#include <string_view>
+#include <QString>
+
+/// @brief TokenBytes
+/// Bytes of token, received as QString at JSON-RPC boundary. Tokens (JWT, session identifiers) are ASCII, so UTF-16
+/// units are narrowed to bytes without UTF-8 encoding, and tokens of usual size are kept on stack without allocation.
+/// Bytes refer to this object, so it can't be copied.
+class TokenBytes {
+public:
+    /// @brief tokens up to this size are kept on stack
+    static constexpr int INLINE_SIZE = 1024;
+
+    TokenBytes(const TokenBytes &) = delete;
+
+    TokenBytes &operator=(const TokenBytes &) = delete;
+
+    /// @brief constructor
+    /// @param token token text
+    explicit TokenBytes(const QString &token);
+
+    /// @brief bytes of token
+    /// @return bytes, std::nullopt if token has non-ASCII characters (it isn't valid token then)
+    [[nodiscard]] std::optional<std::string_view> view() const;
+
+private:
+    char inlineBytes[INLINE_SIZE];
+    /// @brief bytes of token longer than INLINE_SIZE
+    std::string heap;
+    std::string_view bytes;
+    bool ascii = true;
+};
+
+#endif // TOKEN_BYTES_H
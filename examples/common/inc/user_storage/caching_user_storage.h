@@ -0,0 +1,92 @@
+#ifndef CACHING_USER_STORAGE_H
+#define CACHING_USER_STORAGE_H
+
+#include <user_storage/iuser_storage.h>
+#include <auth_configuration/iuser_config.h>
+#include <metrics/metrics.h>
+#include <array>
+#include <list>
+#include <memory>
+#include <QHash>
+#include <QMutex>
+
+/// @brief CachingUserStorage
+/// Decorator for IUserStorage, that serves `getUserVersion()` from LRU cache in memory.
+/// Cached version can be stale for at most `cache_ttl` milliseconds, successful `authenticate()` refreshes the entry.
+/// If wrapped storage reports user changes (`onUsersChanged()`), changed users are dropped from cache at once, all
+/// users if changes are lost.
+/// Storage is thread-safe if wrapped storage is thread-safe. Hits and misses are counted in **Metrics**.
+/// parameters from configuration:
+/// - user.cache_ttl: milliseconds during which cached version is used (default - 5000)
+/// - user.cache_size: maximum number of cached users (default - 100000)
+class CachingUserStorage : public IUserStorage {
+    struct Entry {
+        QString username;
+        QString version;
+        qint64 expiresAt;
+    };
+
+    std::unique_ptr<IUserStorage> storage;
+    qint64 ttl;
+    int maxSize;
+
+    QMutex mutex;
+    /// @brief most recently used entries first
+    std::list<Entry> entries;
+    QHash<QString, std::list<Entry>::iterator> index;
+
+    /// @brief generations of user names (by hash), bumped by `invalidate()`, so lookup started before invalidation
+    /// doesn't put stale version back
+    std::array<quint64, 256> generations{};
+
+    Metrics::Counter &hits;
+    Metrics::Counter &misses;
+
+    /// @brief current generation of user name
+    [[nodiscard]] quint64 generationOf(const QString &username);
+
+    /// @brief cache version of user, unless user was invalidated since `generation` was read
+    void put(const QString &username, const QString &version, quint64 generation);
+
+public:
+    /// @brief constructor
+    /// @param storage wrapped storage
+    /// @param config user configuration
+    explicit CachingUserStorage(std::unique_ptr<IUserStorage> storage, IUserConfig *config = nullptr);
+
+    /// @brief Authenticate by wrapped storage, cache user version on success
+    /// @param username authentication user name
+    /// @param password authentication password
+    /// @return authentication version if success (can be hash of user data), otherwise std::nullopt.
+    [[nodiscard]] std::optional<QString> authenticate(const QString &username, const QString &password) override;
+
+    /// @brief Get user version from cache, or from wrapped storage on miss
+    /// @param username user name
+    /// @return user version if user exists, otherwise std::nullopt
+    [[nodiscard]] std::optional<QString> getUserVersion(const QString &username) override;
+
+    /// @brief Stream names of all users from wrapped storage
+    /// @param callback called for every user name
+    /// @return false if wrapped storage can't list users
+    bool forEachUsername(const std::function<void(const QString &)> &callback) override;
+
+    /// @brief Subscribe to changes of users of wrapped storage, listener is called after cache is invalidated
+    /// @param listener called with changed users
+    /// @return false if wrapped storage doesn't report changes
+    bool onUsersChanged(UsersChanged listener) override;
+
+    /// @brief drop cached version of user
+    /// @param username user name
+    void invalidate(const QString &username);
+
+    /// @brief drop all cached versions
+    void clear();
+
+    /// @brief number of cached users
+    [[nodiscard]] int size();
+
+    /// @brief destructor, wrapped storage (and its change feed) is stopped before cache is destroyed
+    ~CachingUserStorage() override;
+};
+
+#endif // CACHING_USER_STORAGE_H
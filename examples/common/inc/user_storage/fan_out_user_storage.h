@@ -0,0 +1,80 @@
+#ifndef FAN_OUT_USER_STORAGE_H
+#define FAN_OUT_USER_STORAGE_H
+
+#include <user_storage/iuser_storage.h>
+#include <auth_configuration/iuser_config.h>
+#include <metrics/metrics.h>
+#include <service/request_executor.h>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <vector>
+
+/// @brief FanOutUserStorage
+/// IUserStorage over several backends, that are queried concurrently on worker threads: the first backend, that
+/// knows the user, answers, so one slow backend doesn't add its latency to every request. Backends are expected
+/// to hold different users (or agree on user versions).
+/// Without hedge delay all backends are queried at once. With hedge delay backends are queried in order: the next
+/// one is started when the previous didn't answer within the delay, or answered that it doesn't know the user.
+/// Backend, that doesn't answer within timeout, is abandoned (its query finishes in background) and is treated as
+/// unavailable. If no backend knows the user and any of them was unavailable, UserStorageUnavailable is thrown.
+/// Every backend has its own bounded pool of workers, so abandoned queries of hung backend occupy only its workers.
+/// When all of them are busy and its queue is full, the backend is skipped as unavailable without waiting for timeout,
+/// while other backends are queried as usual.
+/// Storage is thread-safe if backends are thread-safe. Hedged queries and timeouts are counted in **Metrics**.
+/// parameters from configuration:
+/// - user.hedge_delay: milliseconds before the next backend is queried, 0 - all at once (default - 0)
+/// - user.backend_timeout: milliseconds to wait for every backend, 0 - no timeout (default - 0)
+/// - user.fan_out_threads: worker threads of every backend (default - 4)
+/// - user.fan_out_queue: queries waiting for worker of every backend (default - fan_out_threads)
+class FanOutUserStorage : public IUserStorage {
+    struct Call;
+
+    std::vector<std::unique_ptr<IUserStorage> > storages;
+    std::chrono::milliseconds hedgeDelay;
+    std::chrono::milliseconds timeout;
+
+    Metrics::Counter &hedged;
+    Metrics::Counter &timedOut;
+
+    /// @brief workers of every backend, declared last, so they wait for abandoned queries before backends are destroyed
+    std::vector<std::unique_ptr<RequestExecutor> > executors;
+
+    /// @brief query backends until the first answer with value
+    /// @param query request to one backend
+    /// @return first value, std::nullopt if no backend has it
+    /// @throw UserStorageUnavailable if no backend has value and any of them failed
+    std::optional<QString> query(const std::function<std::optional<QString>(IUserStorage &)> &query);
+
+public:
+    /// @brief constructor
+    /// @param storages backends, in order of hedging
+    /// @param config user configuration
+    /// @throw std::runtime_error if there are no backends
+    explicit FanOutUserStorage(std::vector<std::unique_ptr<IUserStorage> > storages, IUserConfig *config = nullptr);
+
+    /// @brief Authenticate by the first backend, that accepts user
+    /// @param username authentication user name
+    /// @param password authentication password
+    /// @return authentication version if success (can be hash of user data), otherwise std::nullopt.
+    /// @throw UserStorageUnavailable if no backend accepts user and any of them is unavailable
+    [[nodiscard]] std::optional<QString> authenticate(const QString &username, const QString &password) override;
+
+    /// @brief Get user version from the first backend, that knows user
+    /// @param username user name
+    /// @return user version if user exists, otherwise std::nullopt
+    /// @throw UserStorageUnavailable if no backend knows user and any of them is unavailable
+    [[nodiscard]] std::optional<QString> getUserVersion(const QString &username) override;
+
+    /// @brief Stream names of users of all backends, one after another
+    /// @param callback called for every user name
+    /// @return false if any backend can't list users
+    bool forEachUsername(const std::function<void(const QString &)> &callback) override;
+
+    /// @brief Subscribe to changes of users of all backends
+    /// @param listener called with changed users
+    /// @return false if no backend reports changes
+    bool onUsersChanged(UsersChanged listener) override;
+};
+
+#endif // FAN_OUT_USER_STORAGE_H
@@ -0,0 +1,105 @@
+#ifndef FILTERED_USER_STORAGE_H
+#define FILTERED_USER_STORAGE_H
+
+#include <user_storage/iuser_storage.h>
+#include <auth_configuration/iuser_config.h>
+#include <filter/bloom_filter.h>
+#include <metrics/metrics.h>
+#include <memory>
+#include <optional>
+#include <QMutex>
+#include <QReadWriteLock>
+#include <QStringList>
+#include <QWaitCondition>
+
+class QThread;
+
+/// @brief FilteredUserStorage
+/// Decorator for IUserStorage, that keeps BloomFilter of known user names, so requests for definitely unknown users
+/// are answered with std::nullopt at once, without SQL query and password hashing in wrapped storage.
+/// Filter is built on construction by streaming user names (`forEachUsername()`) and rebuilt in background every
+/// `filter_refresh` milliseconds, so removed users leave it and users created elsewhere join it. Users reported by
+/// change feed of wrapped storage (`onUsersChanged()`) are added at once, and if changes are lost, filter is rebuilt
+/// at once. Without change feed users created by the service itself should be `add()`-ed, so they are accepted
+/// before the next rebuild.
+/// If wrapped storage can't list users, or listing fails, every request is passed through (or the last filter is
+/// kept). Unknown users are answered faster than known ones, so login rate limits should stay on.
+/// Storage is thread-safe if wrapped storage is thread-safe. Rejected and passed requests are counted in **Metrics**.
+/// parameters from configuration:
+/// - user.filter_capacity: expected number of users, filter grows when it's exceeded (default - 1000000)
+/// - user.filter_false_positive: share of unknown users, that pass filter (default - 0.01)
+/// - user.filter_refresh: milliseconds between rebuilds, 0 - never (default - 60000)
+class FilteredUserStorage : public IUserStorage {
+    std::unique_ptr<IUserStorage> storage;
+    size_t capacity;
+    double falsePositiveRate;
+    int refreshInterval;
+
+    /// @brief guards filter and users added during rebuild
+    mutable QReadWriteLock lock;
+    /// @brief std::nullopt - users can't be listed, requests are passed through
+    std::optional<BloomFilter> filter;
+    /// @brief users added while filter is rebuilt, they are added to new filter too
+    QStringList added;
+    bool rebuilding = false;
+
+    Metrics::Counter &rejected;
+    Metrics::Counter &passed;
+
+    /// @brief serializes rebuilds
+    QMutex rebuildMutex;
+
+    QMutex stateMutex;
+    QWaitCondition wakeup;
+    bool stopping = false;
+    /// @brief rebuild without waiting for refresh interval
+    bool rebuildRequested = false;
+    std::unique_ptr<QThread> refresher;
+
+    /// @brief check user name by filter, counting result
+    [[nodiscard]] bool mightExist(const QString &username);
+
+    /// @brief rebuild by refresher thread as soon as possible, or right away if filter is never refreshed
+    void requestRebuild();
+
+    void run();
+
+public:
+    /// @brief constructor, filter is built before it returns
+    /// @param storage wrapped storage
+    /// @param config user configuration
+    explicit FilteredUserStorage(std::unique_ptr<IUserStorage> storage, IUserConfig *config = nullptr);
+
+    /// @brief Authenticate by wrapped storage, if user may exist
+    /// @param username authentication user name
+    /// @param password authentication password
+    /// @return authentication version if success (can be hash of user data), otherwise std::nullopt.
+    [[nodiscard]] std::optional<QString> authenticate(const QString &username, const QString &password) override;
+
+    /// @brief Get user version from wrapped storage, if user may exist
+    /// @param username user name
+    /// @return user version if user exists, otherwise std::nullopt
+    [[nodiscard]] std::optional<QString> getUserVersion(const QString &username) override;
+
+    /// @brief Stream names of all users from wrapped storage
+    /// @param callback called for every user name
+    /// @return false if wrapped storage can't list users
+    bool forEachUsername(const std::function<void(const QString &)> &callback) override;
+
+    /// @brief Subscribe to changes of users of wrapped storage
+    /// @param listener called with changed users
+    /// @return false if wrapped storage doesn't report changes
+    bool onUsersChanged(UsersChanged listener) override;
+
+    /// @brief accept new user before the next rebuild
+    /// @param username user name
+    void add(const QString &username);
+
+    /// @brief build filter from user names of wrapped storage and replace current one
+    /// @return false if users can't be listed, current filter is kept then
+    bool rebuild();
+
+    ~FilteredUserStorage() override;
+};
+
+#endif // FILTERED_USER_STORAGE_H
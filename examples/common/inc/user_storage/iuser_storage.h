@@ -1,22 +1,52 @@
 #ifndef IUSER_STORAGE_H
 #define IUSER_STORAGE_H
 
+#include <functional>
 #include <optional>
+#include <stdexcept>
+#include <QSet>
 #include <QString>
 
+/// @brief Thrown by user storage, when its backend is temporarily unavailable (e.g. no free database connection).
+class UserStorageUnavailable : public std::runtime_error {
+public:
+    using std::runtime_error::runtime_error;
+};
+
 class IUserStorage {
 public:
+    /// @brief Listener of user changes
+    /// @param usernames users, whose data (and so user version) is changed, who are added or removed; empty if changes
+    /// are lost (e.g. connection to database was down) and any user may be changed
+    using UsersChanged = std::function<void(const QSet<QString> &usernames)>;
+
     /// @brief Just authenticate
     /// @param username authentication user name 
     /// @param password authentication password
     /// @return authentication version if success (can be hash of user data), otherwise std::nullopt.
+    /// @throw UserStorageUnavailable if storage cannot answer right now
     [[nodiscard]] virtual std::optional<QString> authenticate(const QString &username, const QString &password) = 0;
 
     /// @brief Just get user version
     /// @param username user name
     /// @return user version if user exists, otherwise std::nullopt
+    /// @throw UserStorageUnavailable if storage cannot answer right now
     [[nodiscard]] virtual std::optional<QString> getUserVersion(const QString &username) = 0;
 
+    /// @brief Stream names of all users, e.g. to build filter of known users
+    /// @param callback called for every user name
+    /// @return false if storage can't list users or listing failed
+    virtual bool forEachUsername(const std::function<void(const QString &)> & /*callback*/) {
+        return false;
+    }
+
+    /// @brief Subscribe to changes of users. Listener may be called from any thread, while storage exists.
+    /// @param listener called with changed users
+    /// @return false if storage doesn't report changes
+    virtual bool onUsersChanged(UsersChanged /*listener*/) {
+        return false;
+    }
+
     virtual ~IUserStorage() = default;
 };
 
@@ -0,0 +1,58 @@
+#ifndef PASSWORD_HASHER_H
+#define PASSWORD_HASHER_H
+
+#include <QString>
+
+/// @brief PasswordHasher
+/// Hashes passwords the way they are stored in user database (hex):
+/// - Sha256: `SHA256(SALT ~ PASSWORD)`, where `~` - concatenation operator;
+/// - Pbkdf2: `PBKDF2-HMAC-SHA256(PASSWORD, SALT ~ USER)`, 32 bytes. Deliberately slow.
+/// - Scrypt: `scrypt(PASSWORD, SALT ~ USER, N, r, p)`, 32 bytes. Deliberately slow and memory-hard (128 * r * N bytes
+///   per hash), so guessing on GPU or ASIC costs much more than with PBKDF2.
+/// Hasher is immutable, so it is thread-safe.
+class PasswordHasher {
+public:
+    enum class Algorithm {
+        Sha256,
+        Pbkdf2,
+        Scrypt,
+    };
+
+    /// @brief cost parameters of scrypt
+    struct ScryptCost {
+        /// @brief CPU/memory cost, power of 2
+        quint64 n = 1 << 15;
+        /// @brief block size
+        quint64 r = 8;
+        /// @brief parallelization
+        quint64 p = 1;
+    };
+
+private:
+    Algorithm algorithm;
+    QString salt;
+    int iterations;
+    ScryptCost scrypt;
+
+public:
+    /// @brief constructor
+    /// @param algorithm hash algorithm
+    /// @param salt service-wide salt
+    /// @param iterations number of PBKDF2 iterations
+    /// @param scrypt cost of scrypt
+    /// @throw std::invalid_argument if scrypt cost is invalid
+    explicit PasswordHasher(Algorithm algorithm = Algorithm::Sha256, QString salt = QString(),
+                            int iterations = 100000, ScryptCost scrypt = {});
+
+    /// @brief hash password
+    /// @param username user name
+    /// @param password password
+    /// @return hash in hex
+    /// @throw std::runtime_error if scrypt fails (e.g. out of memory)
+    [[nodiscard]] QString hash(const QString &username, const QString &password) const;
+
+    /// @brief compare hashes in time independent of position of first mismatch
+    [[nodiscard]] static bool equal(const QString &left, const QString &right);
+};
+
+#endif // PASSWORD_HASHER_H
@@ -0,0 +1,155 @@
+#ifndef QSQL_CONNECTION_POOL_H
+#define QSQL_CONNECTION_POOL_H
+
+#include <metrics/metrics.h>
+#include <memory>
+#include <vector>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QMutex>
+#include <QObject>
+#include <QWaitCondition>
+#include <QtSql/qsqldatabase.h>
+#include <QtSql/qsqlquery.h>
+
+class QThread;
+
+/// @brief QSqlConnectionPool
+/// Bounded pool of database connections with health checks.
+/// Qt connections can be used only from the thread, that created them, so every pooled connection is bound to its
+/// thread: `acquire()` reuses idle connection of the calling thread, opens a new one while pool is below `maxSize`,
+/// otherwise waits for a free slot up to `acquireTimeout`. Idle connection of another thread can't be handed over, so
+/// while some thread waits, released connection is closed by its thread to free the slot for waiting one. Reopening
+/// costs a round trip or more, so `maxSize` should not be less than number of threads using the pool. Connections
+/// idle for longer than `idleTimeout` are closed by their thread (down to `minSize` connections in pool), connections
+/// of finished threads are closed when thread exits.
+/// Statements prepared through `Connection::prepared()` live as long as their connection, so every statement is parsed
+/// and planned once per connection (server-side, if driver supports prepared queries).
+class QSqlConnectionPool {
+public:
+    /// @brief Pool settings
+    struct Settings {
+        QString driver;
+        QString host;
+        QString port;
+        QString name;
+        QString user;
+        QString password;
+        /// @brief number of connections never closed by idle reaping
+        int minSize = 1;
+        /// @brief maximum number of open connections
+        int maxSize = 16;
+        /// @brief milliseconds after which idle connection is closed
+        int idleTimeout = 60000;
+        /// @brief milliseconds to wait for free connection
+        int acquireTimeout = 1000;
+        /// @brief milliseconds after which idle connection is checked before reuse
+        int validateInterval = 5000;
+    };
+
+private:
+    struct Entry {
+        QString name;
+        QThread *thread = nullptr;
+        bool busy = false;
+        QElapsedTimer idleSince;
+        /// @brief prepared statements by SQL text
+        QHash<QString, QSqlQuery> statements;
+    };
+
+public:
+    /// @brief Leased connection, returned to pool on destruction (in the thread, that acquired it)
+    class Connection {
+        QSqlConnectionPool *pool = nullptr;
+        Entry *entry = nullptr;
+
+        friend class QSqlConnectionPool;
+
+        Connection(QSqlConnectionPool *pool, Entry *entry);
+
+    public:
+        Connection() = default;
+
+        Connection(const Connection &) = delete;
+
+        Connection(Connection &&other) noexcept;
+
+        Connection &operator=(Connection &&other) noexcept;
+
+        /// @brief leased database connection
+        [[nodiscard]] QSqlDatabase database() const;
+
+        /// @brief name of leased connection, unique during connection lifetime
+        [[nodiscard]] QString name() const;
+
+        /// @brief get statement prepared on this connection, preparing it on first use
+        /// @param sql statement text
+        /// @return prepared statement, or nullptr if statement cannot be prepared
+        [[nodiscard]] QSqlQuery *prepared(const QString &sql);
+
+        /// @brief close and reopen connection, e.g. after connection error. Prepared statements are dropped.
+        /// @return true if connection is open again
+        bool reconnect();
+
+        /// @brief true if connection is leased
+        explicit operator bool() const;
+
+        ~Connection();
+    };
+
+    /// @brief **Metrics** of SQL statement
+    struct StatementMetrics {
+        /// @brief execution time, including wait for connection
+        Metrics::Histogram &duration;
+        /// @brief failed executions and unavailable database
+        Metrics::Counter &errors;
+    };
+
+    QSqlConnectionPool(const QSqlConnectionPool &) = delete;
+
+    /// @brief constructor
+    /// @param settings pool settings
+    explicit QSqlConnectionPool(Settings settings);
+
+    /// @brief lease connection for the calling thread
+    /// @return open connection, or empty one if database is unavailable or timeout expired
+    [[nodiscard]] Connection acquire();
+
+    /// @brief number of open connections
+    [[nodiscard]] int size() const;
+
+    /// @brief pool settings
+    [[nodiscard]] const Settings &settings() const;
+
+    /// @brief get metrics of statement, they are shared by all pools
+    /// @param statement statement name, e.g. "select_password"
+    [[nodiscard]] static StatementMetrics metricsOf(const QString &statement);
+
+    ~QSqlConnectionPool();
+
+private:
+    void release(Entry *entry);
+
+    /// @brief close idle connections of calling thread, called with locked mutex
+    void reapIdle();
+
+    /// @brief close all connections of calling thread (on thread exit)
+    void closeThread(QThread *thread);
+
+    /// @brief remove entry and its database, called with locked mutex from thread of entry
+    void removeEntry(Entry *entry);
+
+    [[nodiscard]] bool open(Entry *entry) const;
+
+    [[nodiscard]] bool validate(Entry *entry) const;
+
+    Settings config;
+    mutable QMutex mutex;
+    QWaitCondition released;
+    /// @brief number of threads waiting in `acquire()`
+    int waiters = 0;
+    std::vector<std::unique_ptr<Entry> > entries;
+    QHash<QThread *, QMetaObject::Connection> watchedThreads;
+};
+
+#endif // QSQL_CONNECTION_POOL_H
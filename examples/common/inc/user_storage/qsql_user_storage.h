@@ -3,7 +3,15 @@
 
 #include <user_storage/iuser_storage.h>
 #include <auth_configuration/iuser_config.h>
-#include <QtSql/qsqldatabase.h>
+#include <user_storage/qsql_connection_pool.h>
+#include <user_storage/password_hasher.h>
+#include <memory>
+#include <vector>
+#include <QMutex>
+#include <QWaitCondition>
+
+class QThread;
+class QTimer;
 
 /// @brief QSqlUserStorage
 /// Automatically connect to database. If connection fails, throw exception.
@@ -15,13 +23,86 @@
 /// - DATABASE_NAME: database name (default - "users")
 /// - DATABASE_USER: database user name (default - ${USER}|${USERNAME}, then default of driver)
 /// - DATABASE_PASSWORD: database user password (default - empty)
-/// Hash of pasword built from `HASH_OF(SALT ~ USER ~ PASSWORD)`, where `~` - concatenation operator.
-/// 
+/// Hash of password is selected by user.password_hash, see **PasswordHasher**:
+/// - "sha256" (default): `SHA256(SALT ~ PASSWORD)`;
+/// - "pbkdf2": PBKDF2 with user.pbkdf2_iterations iterations (default - 100000). Deliberately slow, so logins should
+///   be executed on their own bounded executor.
+/// - "scrypt": scrypt with user.scrypt_n (default - 32768), user.scrypt_r (default - 8) and user.scrypt_p
+///   (default - 1). Slow and memory-hard (32 MiB per login with defaults), so logins should be executed on their own
+///   bounded executor.
+/// Hash is stored in "password" column in hex.
+/// Storage is thread-safe: connections are leased from QSqlConnectionPool, every thread uses its own connections.
+/// Pool parameters from configuration:
+/// - user.pool_min: connections kept open when idle (default - 1)
+/// - user.pool_max: maximum number of open connections (default - 16)
+/// - user.pool_idle_timeout: milliseconds after which idle connection is closed (default - 60000)
+/// - user.pool_acquire_timeout: milliseconds to wait for free connection (default - 1000)
+/// - user.pool_validate_interval: milliseconds after which idle connection is checked before use (default - 5000)
+/// If no connection is available in time, methods throw UserStorageUnavailable. Query failed because of lost
+/// connection is retried once on reopened connection.
+/// For QSQLITE driver "name" is path to database file and "schema" should be "main".
+/// Changes of users are pushed to `onUsersChanged()` listeners, depending on user.change_feed (default - off):
+/// - "notify": driver notifications (Postgres LISTEN/NOTIFY) on channel user.change_channel (default -
+///   "users_changed"), trigger on users table sends changed user name as payload. Notifications are received on own
+///   connection in constructing thread, so that thread must run event loop. The connection is checked every
+///   user.pool_validate_interval milliseconds and reopened if broken, then listeners are told that all users may be
+///   changed, because notifications sent meanwhile are lost;
+/// - "poll": table "user_changes" (seq, username), appended by triggers on users table, is polled every
+///   user.change_poll_interval milliseconds (default - 1000). For QSQLITE table and triggers are created. Changes are
+///   deleted user.change_retention milliseconds after they are seen (default - 3600000, at least 10 poll intervals);
+///   if polling fails for longer, listeners are told that all users may be changed;
+/// - "auto": notifications if driver supports them, polling otherwise.
 class QSqlUserStorage : public IUserStorage {
 private:
-    QSqlDatabase db;
     QString schema;
-    QString salt;
+    PasswordHasher hasher;
+    /// @brief query of user password, prepared once per pooled connection
+    QString selectPasswordSql;
+    /// @brief query of all user names
+    QString selectUsernamesSql;
+    std::unique_ptr<QSqlConnectionPool> pool;
+
+    /// @brief change feed listeners and users notified, but not dispatched yet
+    QMutex listenersMutex;
+    std::vector<UsersChanged> listeners;
+    QSet<QString> notified;
+    /// @brief connection receiving notifications, empty if not listening
+    QString listenConnection;
+    /// @brief timer of listening connection check, in constructing thread
+    std::unique_ptr<QTimer> listenCheck;
+    /// @brief query of changes after given sequence number
+    QString selectChangesSql;
+    /// @brief query deleting changes up to given sequence number
+    QString deleteChangesSql;
+    int pollInterval = 1000;
+    int changeRetention = 3600000;
+
+    QMutex stateMutex;
+    QWaitCondition wakeup;
+    bool stopping = false;
+    std::unique_ptr<QThread> poller;
+
+    /// @brief subscribe to driver notifications on own connection
+    /// @return false if driver can't subscribe
+    bool listen(const QString &channel);
+
+    /// @brief reopen listening connection and subscribe again, if connection is broken
+    void checkListen(const QString &channel);
+
+    /// @brief create change table and triggers, for QSQLITE
+    void createChangeLog(QSqlDatabase &db, const QString &table);
+
+    /// @brief poll change table until destruction
+    /// @param last sequence number of the last change seen
+    void poll(qint64 last);
+
+    /// @brief call listeners
+    void dispatch(const QSet<QString> &usernames);
+
+    /// @brief get stored password hash (user version) of user
+    /// @param username user name
+    /// @return password hash if user exists, otherwise std::nullopt
+    [[nodiscard]] std::optional<QString> selectPassword(const QString &username);
 
 public:
     explicit QSqlUserStorage(IUserConfig *config = nullptr);
@@ -37,7 +118,17 @@ public:
     /// @return user version if user exists, otherwise std::nullopt
     [[nodiscard]] std::optional<QString> getUserVersion(const QString &username) override;
 
-    ~QSqlUserStorage() = default;
+    /// @brief Stream names of all users from users table, row by row
+    /// @param callback called for every user name
+    /// @return false if query failed or database is unavailable
+    bool forEachUsername(const std::function<void(const QString &)> &callback) override;
+
+    /// @brief Subscribe to changes of users
+    /// @param listener called with changed users, from notifying or polling thread
+    /// @return false if change feed is off
+    bool onUsersChanged(UsersChanged listener) override;
+
+    ~QSqlUserStorage() override;
 };
 
 #endif
@@ -0,0 +1,117 @@
+#include <token/base64_url.h>
+#include <algorithm>
+#include <cstdint>
+#include <type_traits>
+
+/// @brief character of 6-bit value, without table and branches, so loops over values are vectorized
+static constexpr int charOf(const int value) {
+    // A-Z, then a-z (+6), 0-9 (-75), '-' (-13), '_' (+49)
+    return value + 'A' + (value >= 26) * 6 - (value >= 52) * 75 - (value >= 62) * 13 + (value >= 63) * 49;
+}
+
+/// @brief 6-bit value of character, -1 if character isn't base64url
+static constexpr int valueOf(const uint32_t c) {
+    if (c >= 'A' && c <= 'Z') {
+        return static_cast<int>(c - 'A');
+    }
+    if (c >= 'a' && c <= 'z') {
+        return static_cast<int>(c - 'a' + 26);
+    }
+    if (c >= '0' && c <= '9') {
+        return static_cast<int>(c - '0' + 52);
+    }
+    if (c == '-') {
+        return 62;
+    }
+    if (c == '_') {
+        return 63;
+    }
+    return -1;
+}
+
+template<typename Char>
+static void encode(const unsigned char *data, const size_t size, Char *out) {
+    // 6-bit values are split out first, then mapped to characters, so compiler vectorizes the mapping loop
+    constexpr size_t MAX_CHUNK = 48;
+    unsigned char values[MAX_CHUNK / 3 * 4];
+    for (size_t done = 0; done < size; done += MAX_CHUNK) {
+        const size_t chunk = std::min(MAX_CHUNK, size - done);
+        const unsigned char *in = data + done;
+        size_t count = 0;
+        size_t i = 0;
+        for (; i + 2 < chunk; i += 3, count += 4) {
+            values[count] = in[i] >> 2;
+            values[count + 1] = ((in[i] & 0x03) << 4) | (in[i + 1] >> 4);
+            values[count + 2] = ((in[i + 1] & 0x0F) << 2) | (in[i + 2] >> 6);
+            values[count + 3] = in[i + 2] & 0x3F;
+        }
+        // chunks are multiple of 3 bytes, so only the last one has tail of 1 or 2 bytes
+        if (chunk - i == 1) {
+            values[count++] = in[i] >> 2;
+            values[count++] = (in[i] & 0x03) << 4;
+        } else if (chunk - i == 2) {
+            values[count++] = in[i] >> 2;
+            values[count++] = ((in[i] & 0x03) << 4) | (in[i + 1] >> 4);
+            values[count++] = (in[i + 1] & 0x0F) << 2;
+        }
+        Char *chars = out + done / 3 * 4;
+        for (size_t j = 0; j < count; ++j) {
+            chars[j] = static_cast<Char>(charOf(values[j]));
+        }
+    }
+}
+
+template<typename Char>
+static bool decode(const Char *in, const size_t length, unsigned char *out) {
+    if (length % 4 == 1) {
+        return false;
+    }
+    uint32_t chunk = 0;
+    int bits = 0;
+    for (size_t i = 0; i < length; ++i) {
+        const int value = valueOf(static_cast<std::make_unsigned_t<Char>>(in[i]));
+        if (value < 0) {
+            return false;
+        }
+        chunk = (chunk << 6) | static_cast<uint32_t>(value);
+        bits += 6;
+        if (bits >= 8) {
+            bits -= 8;
+            *out++ = static_cast<unsigned char>(chunk >> bits);
+        }
+    }
+    return true;
+}
+
+void base64UrlEncode(const unsigned char *data, const size_t size, char *out) {
+    encode(data, size, out);
+}
+
+void base64UrlEncode(const unsigned char *data, const size_t size, char16_t *out) {
+    encode(data, size, out);
+}
+
+bool base64UrlDecode(const char *in, const size_t length, unsigned char *out) {
+    return decode(in, length, out);
+}
+
+bool base64UrlDecode(const char16_t *in, const size_t length, unsigned char *out) {
+    return decode(in, length, out);
+}
+
+std::string base64UrlEncode(const std::string_view data) {
+    std::string result(base64UrlLength(data.size()), '\0');
+    encode(reinterpret_cast<const unsigned char *>(data.data()), data.size(), result.data());
+    return result;
+}
+
+std::optional<std::string> base64UrlDecode(std::string_view data) {
+    while (!data.empty() && data.back() == '=') {
+        data.remove_suffix(1);
+    }
+    std::string result(data.size() * 3 / 4, '\0');
+    if (!decode(data.data(), data.size(), reinterpret_cast<unsigned char *>(result.data()))) {
+        return std::nullopt;
+    }
+    return result;
+}
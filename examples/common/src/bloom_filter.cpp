@@ -0,0 +1,69 @@
+#include <filter/bloom_filter.h>
+#include <algorithm>
+#include <cmath>
+
+/// @brief 64-bit FNV-1a with splitmix64 finalizer
+static uint64_t hash64(const QByteArray &key) {
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (const char c: key) {
+        hash ^= static_cast<unsigned char>(c);
+        hash *= 0x100000001b3ull;
+    }
+    hash ^= hash >> 30;
+    hash *= 0xbf58476d1ce4e5b9ull;
+    hash ^= hash >> 27;
+    hash *= 0x94d049bb133111ebull;
+    hash ^= hash >> 31;
+    return hash;
+}
+
+BloomFilter::BloomFilter(const size_t capacity, const double falsePositiveRate) {
+    const double rate = std::min(std::max(falsePositiveRate, 1e-9), 0.5);
+    const double items = static_cast<double>(std::max<size_t>(capacity, 1));
+    // optimal size: m = -n * ln(p) / ln(2)^2, rounded up to power of two for masking
+    const double bits = std::ceil(-items * std::log(rate) / (std::log(2.0) * std::log(2.0)));
+    uint64_t size = 64;
+    while (static_cast<double>(size) < bits) {
+        size <<= 1;
+    }
+    this->words.assign(size / 64, 0);
+    this->bitMask = size - 1;
+    // optimal number of hashes: k = m / n * ln(2)
+    this->hashes = std::max(1, static_cast<int>(std::lround(static_cast<double>(size) / items * std::log(2.0))));
+    this->hashes = std::min(this->hashes, 16);
+}
+
+void BloomFilter::add(const QByteArray &key) {
+    const uint64_t hash = hash64(key);
+    const uint64_t step = (hash >> 32 | hash << 32) | 1;
+    for (int i = 0; i < this->hashes; ++i) {
+        const uint64_t bit = (hash + static_cast<uint64_t>(i) * step) & this->bitMask;
+        this->words[bit >> 6] |= 1ull << (bit & 63);
+    }
+    ++this->count;
+}
+
+bool BloomFilter::mightContain(const QByteArray &key) const {
+    const uint64_t hash = hash64(key);
+    const uint64_t step = (hash >> 32 | hash << 32) | 1;
+    for (int i = 0; i < this->hashes; ++i) {
+        const uint64_t bit = (hash + static_cast<uint64_t>(i) * step) & this->bitMask;
+        if (!(this->words[bit >> 6] & (1ull << (bit & 63)))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void BloomFilter::clear() {
+    std::fill(this->words.begin(), this->words.end(), 0);
+    this->count = 0;
+}
+
+size_t BloomFilter::size() const {
+    return this->count;
+}
+
+size_t BloomFilter::memoryUsage() const {
+    return this->words.size() * sizeof(uint64_t);
+}
@@ -0,0 +1,148 @@
+#include <user_storage/caching_user_storage.h>
+#include <QMutexLocker>
+#include <QVariant>
+#include <QDebug>
+#include <chrono>
+
+static qint64 nowMs() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/// @brief read integer option, written either as JSON number or as string
+static int configInt(IUserConfig *config, const QString &option, const int defaultValue) {
+    int result = defaultValue;
+    if (config) {
+        const QVariant value = config->getUserConfig(option);
+        bool ok = false;
+        int parsed = value.toString().toInt(&ok);
+        if (!ok) {
+            parsed = value.toInt(&ok);
+        }
+        if (ok) {
+            result = parsed;
+        }
+    }
+    qDebug().noquote() << "CachingUserStorage:" << option << "=" << result;
+    return result;
+}
+
+CachingUserStorage::CachingUserStorage(std::unique_ptr<IUserStorage> storage, IUserConfig *config)
+    : storage(std::move(storage)),
+      ttl(configInt(config, "cache_ttl", 5000)),
+      maxSize(qMax(1, configInt(config, "cache_size", 100000))),
+      hits(Metrics::instance().counter("jrpc_auth_user_cache_requests_total", "Lookups of user version cache.",
+                                       Metrics::label("result", "hit"))),
+      misses(Metrics::instance().counter("jrpc_auth_user_cache_requests_total", "Lookups of user version cache.",
+                                         Metrics::label("result", "miss"))) {
+    this->storage->onUsersChanged([this](const QSet<QString> &usernames) {
+        if (usernames.isEmpty()) {
+            this->clear();
+        }
+        for (const auto &username: usernames) {
+            this->invalidate(username);
+        }
+    });
+}
+
+std::optional<QString> CachingUserStorage::authenticate(const QString &username, const QString &password) {
+    const quint64 generation = this->generationOf(username);
+    auto version = this->storage->authenticate(username, password);
+    if (version) {
+        this->put(username, version.value(), generation);
+    }
+    return version;
+}
+
+std::optional<QString> CachingUserStorage::getUserVersion(const QString &username) {
+    quint64 generation;
+    {
+        QMutexLocker locker(&this->mutex);
+        generation = this->generations[qHash(username) % this->generations.size()];
+        const auto it = this->index.constFind(username);
+        if (it != this->index.constEnd()) {
+            const auto entry = it.value();
+            if (entry->expiresAt > nowMs()) {
+                this->entries.splice(this->entries.begin(), this->entries, entry);
+                this->hits.add();
+                return entry->version;
+            }
+            this->index.remove(username);
+            this->entries.erase(entry);
+        }
+    }
+
+    this->misses.add();
+    auto version = this->storage->getUserVersion(username);
+    if (version) {
+        this->put(username, version.value(), generation);
+    }
+    return version;
+}
+
+quint64 CachingUserStorage::generationOf(const QString &username) {
+    QMutexLocker locker(&this->mutex);
+    return this->generations[qHash(username) % this->generations.size()];
+}
+
+void CachingUserStorage::put(const QString &username, const QString &version, const quint64 generation) {
+    QMutexLocker locker(&this->mutex);
+    if (this->generations[qHash(username) % this->generations.size()] != generation) {
+        // user was changed while version was read, it may be the old one
+        return;
+    }
+    const qint64 expiresAt = nowMs() + this->ttl;
+
+    const auto it = this->index.constFind(username);
+    if (it != this->index.constEnd()) {
+        const auto entry = it.value();
+        entry->version = version;
+        entry->expiresAt = expiresAt;
+        this->entries.splice(this->entries.begin(), this->entries, entry);
+        return;
+    }
+
+    this->entries.push_front({username, version, expiresAt});
+    this->index.insert(username, this->entries.begin());
+
+    while (this->index.size() > this->maxSize) {
+        this->index.remove(this->entries.back().username);
+        this->entries.pop_back();
+    }
+}
+
+bool CachingUserStorage::forEachUsername(const std::function<void(const QString &)> &callback) {
+    return this->storage->forEachUsername(callback);
+}
+
+bool CachingUserStorage::onUsersChanged(UsersChanged listener) {
+    return this->storage->onUsersChanged(std::move(listener));
+}
+
+void CachingUserStorage::invalidate(const QString &username) {
+    QMutexLocker locker(&this->mutex);
+    ++this->generations[qHash(username) % this->generations.size()];
+    const auto it = this->index.constFind(username);
+    if (it != this->index.constEnd()) {
+        this->entries.erase(it.value());
+        this->index.erase(it);
+    }
+}
+
+void CachingUserStorage::clear() {
+    QMutexLocker locker(&this->mutex);
+    for (auto &generation: this->generations) {
+        ++generation;
+    }
+    this->index.clear();
+    this->entries.clear();
+}
+
+int CachingUserStorage::size() {
+    QMutexLocker locker(&this->mutex);
+    return this->index.size();
+}
+
+CachingUserStorage::~CachingUserStorage() {
+    this->storage.reset();
+}
@@ -0,0 +1,410 @@
+#include <auth_storage/compact_auth_storage.h>
+#include <auth_storage/random_token.h>
+#include <token/base64_url.h>
+#include <QDateTime>
+#include <QDebug>
+#include <QReadLocker>
+#include <QThread>
+#include <QVariant>
+#include <QWriteLocker>
+#include <cstring>
+
+/// @brief flag of `Slot::user`: user version is interned string
+static constexpr quint32 INTERNED_VERSION = 0x80000000u;
+/// @brief length of authentication identifier in base64url
+static constexpr int TOKEN_LENGTH = CompactAuthStorage::ID_SIZE / 3 * 4;
+/// @brief slots checked by expiry sweep on every write
+static constexpr int SWEEP_STEPS = 4;
+/// @brief sessions sampled to find eviction victim
+static constexpr int EVICTION_SAMPLES = 8;
+
+static QString encodeId(const std::array<uchar, CompactAuthStorage::ID_SIZE> &id) {
+    QString token(TOKEN_LENGTH, Qt::Uninitialized);
+    base64UrlEncode(id.data(), id.size(), reinterpret_cast<char16_t *>(token.data()));
+    return token;
+}
+
+static std::optional<std::array<uchar, CompactAuthStorage::ID_SIZE> > decodeId(const QString &token) {
+    if (token.size() != TOKEN_LENGTH) {
+        return std::nullopt;
+    }
+    std::array<uchar, CompactAuthStorage::ID_SIZE> id{};
+    if (!base64UrlDecode(reinterpret_cast<const char16_t *>(token.constData()), TOKEN_LENGTH, id.data())) {
+        return std::nullopt;
+    }
+    return id;
+}
+
+/// @brief identifiers are random, so their bytes are hash already
+static quint64 hashOf(const std::array<uchar, CompactAuthStorage::ID_SIZE> &id) {
+    quint64 hash;
+    std::memcpy(&hash, id.data(), sizeof(hash));
+    return hash;
+}
+
+/// @brief decode 64 lowercase hex characters
+static bool decodeDigest(const QString &version, std::array<uchar, CompactAuthStorage::DIGEST_SIZE> &digest) {
+    if (version.size() != CompactAuthStorage::DIGEST_SIZE * 2) {
+        return false;
+    }
+    const QChar *in = version.constData();
+    for (auto &byte: digest) {
+        int nibbles[2];
+        for (int &nibble: nibbles) {
+            const ushort c = in++->unicode();
+            if (c >= '0' && c <= '9') {
+                nibble = c - '0';
+            } else if (c >= 'a' && c <= 'f') {
+                nibble = c - 'a' + 10;
+            } else {
+                return false;
+            }
+        }
+        byte = static_cast<uchar>(nibbles[0] << 4 | nibbles[1]);
+    }
+    return true;
+}
+
+static quint32 nowSeconds() {
+    return static_cast<quint32>(QDateTime::currentSecsSinceEpoch());
+}
+
+/// @brief deadline in milliseconds to seconds, rounded up (0 stays "never")
+static quint32 toSeconds(const qint64 deadline) {
+    return deadline > 0 ? static_cast<quint32>((deadline + 999) / 1000) : 0;
+}
+
+static bool expired(const quint32 deadline, const quint32 now) {
+    return deadline != 0 && deadline <= now;
+}
+
+quint32 CompactAuthStorage::StringPool::acquire(const QString &string) {
+    const auto it = this->ids.constFind(string);
+    if (it != this->ids.constEnd()) {
+        ++this->refs[it.value()];
+        return it.value();
+    }
+
+    quint32 id;
+    if (!this->freeIds.empty()) {
+        id = this->freeIds.back();
+        this->freeIds.pop_back();
+        this->strings[id] = string;
+        this->refs[id] = 1;
+    } else {
+        id = static_cast<quint32>(this->strings.size());
+        this->strings.push_back(string);
+        this->refs.push_back(1);
+    }
+    this->ids.insert(string, id);
+    return id;
+}
+
+void CompactAuthStorage::StringPool::release(const quint32 id) {
+    if (--this->refs[id] == 0) {
+        this->ids.remove(this->strings[id]);
+        this->strings[id] = QString();
+        this->freeIds.push_back(id);
+    }
+}
+
+const QString &CompactAuthStorage::StringPool::at(const quint32 id) const {
+    return this->strings[id];
+}
+
+std::optional<quint32> CompactAuthStorage::StringPool::find(const QString &string) const {
+    const auto it = this->ids.constFind(string);
+    if (it == this->ids.constEnd()) {
+        return std::nullopt;
+    }
+    return it.value();
+}
+
+const CompactAuthStorage::Slot *CompactAuthStorage::Shard::find(const Id &id) const {
+    if (this->slots.empty()) {
+        return nullptr;
+    }
+    const size_t mask = this->slots.size() - 1;
+    for (size_t i = hashOf(id) & mask; this->slots[i].user != 0; i = (i + 1) & mask) {
+        if (this->slots[i].id == id) {
+            return &this->slots[i];
+        }
+    }
+    return nullptr;
+}
+
+void CompactAuthStorage::Shard::insert(const Slot &slot) {
+    // keep load factor below 3/4, so probe sequences stay short
+    if ((this->count + 1) * 4 > this->slots.size() * 3) {
+        this->rehash(qMax<size_t>(this->slots.size() * 2, 64));
+    }
+    const size_t mask = this->slots.size() - 1;
+    size_t i = hashOf(slot.id) & mask;
+    while (this->slots[i].user != 0) {
+        i = (i + 1) & mask;
+    }
+    this->slots[i] = slot;
+    ++this->count;
+}
+
+void CompactAuthStorage::Shard::erase(size_t index) {
+    this->release(this->slots[index]);
+    --this->count;
+
+    // backward shift deletion: no tombstones, so lookups never walk over removed sessions
+    const size_t mask = this->slots.size() - 1;
+    size_t next = index;
+    while (true) {
+        this->slots[index].user = 0;
+        do {
+            next = (next + 1) & mask;
+            if (this->slots[next].user == 0) {
+                return;
+            }
+            const size_t home = hashOf(this->slots[next].id) & mask;
+            // slot stays, if its home is cyclically in (index, next]
+            if (index <= next ? index < home && home <= next : index < home || home <= next) {
+                continue;
+            }
+            break;
+        } while (true);
+        this->slots[index] = this->slots[next];
+        index = next;
+    }
+}
+
+void CompactAuthStorage::Shard::release(const Slot &slot) {
+    this->users.release((slot.user & ~INTERNED_VERSION) - 1);
+    if (slot.user & INTERNED_VERSION) {
+        quint32 version;
+        std::memcpy(&version, slot.version.data(), sizeof(version));
+        this->versions.release(version);
+    }
+}
+
+void CompactAuthStorage::Shard::rehash(const size_t capacity) {
+    std::vector<Slot> old(capacity, Slot{});
+    old.swap(this->slots);
+    this->count = 0;
+    this->cursor = 0;
+    const size_t mask = capacity - 1;
+    for (const auto &slot: old) {
+        if (slot.user != 0) {
+            size_t i = hashOf(slot.id) & mask;
+            while (this->slots[i].user != 0) {
+                i = (i + 1) & mask;
+            }
+            this->slots[i] = slot;
+            ++this->count;
+        }
+    }
+}
+
+void CompactAuthStorage::Shard::sweep(const quint32 now) {
+    if (this->slots.empty()) {
+        return;
+    }
+    const size_t mask = this->slots.size() - 1;
+    for (int step = 0; step < SWEEP_STEPS; ++step) {
+        this->cursor &= mask;
+        const Slot &slot = this->slots[this->cursor];
+        if (slot.user != 0 && expired(slot.deadline, now)) {
+            // another session may be shifted into this slot, check it on next step
+            this->erase(this->cursor);
+        } else {
+            ++this->cursor;
+        }
+    }
+}
+
+void CompactAuthStorage::Shard::evict(const size_t start, const Id &keep) {
+    const size_t mask = this->slots.size() - 1;
+    size_t victim = this->slots.size();
+    int sampled = 0;
+    for (size_t i = start & mask, seen = 0; sampled < EVICTION_SAMPLES && seen < this->slots.size();
+         i = (i + 1) & mask, ++seen) {
+        const Slot &slot = this->slots[i];
+        if (slot.user == 0 || slot.id == keep) {
+            continue;
+        }
+        ++sampled;
+        // sessions, that never expire, are evicted last
+        if (victim == this->slots.size() || slot.deadline - 1 < this->slots[victim].deadline - 1) {
+            victim = i;
+        }
+    }
+    if (victim != this->slots.size()) {
+        this->erase(victim);
+    }
+}
+
+size_t CompactAuthStorage::Shard::eraseUsers(const QSet<QString> &usernames) {
+    QSet<quint32> users;
+    for (const auto &username: usernames) {
+        if (const auto id = this->users.find(username)) {
+            users.insert(id.value() + 1);
+        }
+    }
+    if (users.isEmpty()) {
+        return 0;
+    }
+
+    size_t erased = 0;
+    for (size_t i = 0; i < this->slots.size();) {
+        const quint32 user = this->slots[i].user & ~INTERNED_VERSION;
+        if (user != 0 && users.contains(user)) {
+            // another session may be shifted into this slot, check it again
+            this->erase(i);
+            ++erased;
+        } else {
+            ++i;
+        }
+    }
+    return erased;
+}
+
+CompactAuthStorage::CompactAuthStorage(IAuthConfig *config) {
+    int requested = 0;
+    int maxSessions = 0;
+    if (config) {
+        requested = config->getAuthConfig("shards").toInt();
+        maxSessions = config->getAuthConfig("max_sessions").toInt();
+        this->sessionTtl = qMax<qint64>(0, config->getAuthConfig("session_ttl").toLongLong());
+    }
+    if (requested <= 0) {
+        requested = 4 * qMax(1, QThread::idealThreadCount());
+    }
+
+    while ((1 << this->shardBits) < requested && this->shardBits < 16) {
+        ++this->shardBits;
+    }
+    const int count = 1 << this->shardBits;
+    if (maxSessions > 0) {
+        this->maxPerShard = qMax(1, (maxSessions + count - 1) / count);
+    }
+    this->shards.reserve(count);
+    for (int i = 0; i < count; ++i) {
+        this->shards.push_back(std::make_unique<Shard>());
+    }
+
+    qDebug().noquote() << "CompactAuthStorage: shards =" << count
+            << "session_ttl =" << this->sessionTtl << "max_sessions =" << maxSessions;
+}
+
+CompactAuthStorage::Shard &CompactAuthStorage::shardOf(const Id &id) const {
+    if (this->shardBits == 0) {
+        return *this->shards[0];
+    }
+    // shard is chosen by bytes, not used for slot index
+    quint64 hash;
+    std::memcpy(&hash, id.data() + sizeof(hash), sizeof(hash));
+    return *this->shards[hash >> (64 - this->shardBits)];
+}
+
+QString CompactAuthStorage::insert(const QString &username, const QString &userVersion, const qint64 deadline) {
+    Slot slot{};
+    slot.deadline = toSeconds(deadline);
+    const bool digest = decodeDigest(userVersion, slot.version);
+
+    while (true) {
+        randomBytes(slot.id.data(), slot.id.size());
+
+        Shard &shard = this->shardOf(slot.id);
+        QWriteLocker locker(&shard.lock);
+        // writes pay for expiry of their shard, so reads stay under shared lock
+        shard.sweep(nowSeconds());
+        if (shard.find(slot.id)) {
+            continue;
+        }
+
+        slot.user = shard.users.acquire(username) + 1;
+        if (!digest) {
+            const quint32 version = shard.versions.acquire(userVersion);
+            std::memcpy(slot.version.data(), &version, sizeof(version));
+            slot.user |= INTERNED_VERSION;
+        }
+        shard.insert(slot);
+        if (this->maxPerShard > 0 && shard.count > this->maxPerShard) {
+            quint64 random;
+            randomBytes(&random, sizeof(random));
+            shard.evict(random, slot.id);
+        }
+        return encodeId(slot.id);
+    }
+}
+
+QString CompactAuthStorage::authenticate(const QString &username, const QString &userVersion) {
+    const qint64 deadline = this->sessionTtl > 0 ? QDateTime::currentMSecsSinceEpoch() + this->sessionTtl : 0;
+    return this->insert(username, userVersion, deadline);
+}
+
+QString CompactAuthStorage::authenticate(const QString &username, const QString &userVersion,
+                                         const std::chrono::system_clock::time_point deadline) {
+    return this->insert(username, userVersion,
+                        std::chrono::duration_cast<std::chrono::milliseconds>(deadline.time_since_epoch()).count());
+}
+
+std::optional<QPair<QString, QString> > CompactAuthStorage::get(const QString &auth_id) {
+    const auto id = decodeId(auth_id);
+    if (!id) {
+        return std::nullopt;
+    }
+
+    Shard &shard = this->shardOf(id.value());
+    QReadLocker locker(&shard.lock);
+    const Slot *slot = shard.find(id.value());
+    if (!slot || expired(slot->deadline, nowSeconds())) {
+        return std::nullopt;
+    }
+
+    const QString &username = shard.users.at((slot->user & ~INTERNED_VERSION) - 1);
+    if (slot->user & INTERNED_VERSION) {
+        quint32 version;
+        std::memcpy(&version, slot->version.data(), sizeof(version));
+        return QPair<QString, QString>{username, shard.versions.at(version)};
+    }
+    const auto digest = QByteArray::fromRawData(reinterpret_cast<const char *>(slot->version.data()),
+                                                static_cast<int>(slot->version.size()));
+    return QPair<QString, QString>{username, QString::fromLatin1(digest.toHex())};
+}
+
+bool CompactAuthStorage::remove(const QString &auth_id) {
+    const auto id = decodeId(auth_id);
+    if (!id) {
+        return false;
+    }
+
+    Shard &shard = this->shardOf(id.value());
+    QWriteLocker locker(&shard.lock);
+    const quint32 now = nowSeconds();
+    shard.sweep(now);
+    const Slot *slot = shard.find(id.value());
+    if (!slot) {
+        return false;
+    }
+    const bool alive = !expired(slot->deadline, now);
+    shard.erase(static_cast<size_t>(slot - shard.slots.data()));
+    return alive;
+}
+
+qint64 CompactAuthStorage::sessionCount() {
+    return static_cast<qint64>(this->size());
+}
+
+qint64 CompactAuthStorage::removeByUsers(const QSet<QString> &usernames) {
+    qint64 removed = 0;
+    for (const auto &shard: this->shards) {
+        QWriteLocker locker(&shard->lock);
+        removed += static_cast<qint64>(shard->eraseUsers(usernames));
+    }
+    return removed;
+}
+
+size_t CompactAuthStorage::size() const {
+    size_t size = 0;
+    for (const auto &shard: this->shards) {
+        QReadLocker locker(&shard->lock);
+        size += shard->count;
+    }
+    return size;
+}
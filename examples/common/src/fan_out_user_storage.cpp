@@ -0,0 +1,199 @@
+#include <user_storage/fan_out_user_storage.h>
+#include <QDebug>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QVariant>
+#include <QWaitCondition>
+#include <algorithm>
+
+/// @brief Shared by caller and backend queries; queries may outlive the call, if they are abandoned
+struct FanOutUserStorage::Call {
+    enum class State { Idle, Running, Missing, Failed, TimedOut };
+
+    QMutex mutex;
+    QWaitCondition changed;
+    std::vector<State> states;
+    std::vector<std::chrono::steady_clock::time_point> started;
+    std::optional<QString> result;
+    /// @brief caller is gone, queries that didn't start yet are skipped
+    bool done = false;
+
+    explicit Call(const size_t backends) : states(backends, State::Idle), started(backends) {
+    }
+};
+
+/// @brief read integer option, written either as JSON number or as string
+static int configInt(IUserConfig *config, const QString &option, const int defaultValue) {
+    int result = defaultValue;
+    if (config) {
+        const QVariant value = config->getUserConfig(option);
+        bool ok = false;
+        int parsed = value.toString().toInt(&ok);
+        if (!ok) {
+            parsed = value.toInt(&ok);
+        }
+        if (ok) {
+            result = parsed;
+        }
+    }
+    qDebug().noquote() << "FanOutUserStorage:" << option << "=" << result;
+    return result;
+}
+
+static std::vector<std::unique_ptr<IUserStorage> > checked(std::vector<std::unique_ptr<IUserStorage> > storages) {
+    if (storages.empty()) {
+        throw std::runtime_error("FanOutUserStorage: no backends");
+    }
+    return storages;
+}
+
+FanOutUserStorage::FanOutUserStorage(std::vector<std::unique_ptr<IUserStorage> > storages, IUserConfig *config)
+    : storages(checked(std::move(storages))),
+      hedgeDelay(std::max(0, configInt(config, "hedge_delay", 0))),
+      timeout(std::max(0, configInt(config, "backend_timeout", 0))),
+      hedged(Metrics::instance().counter("jrpc_auth_user_hedged_total",
+                                         "User backends queried after hedge delay.")),
+      timedOut(Metrics::instance().counter("jrpc_auth_user_timeouts_total",
+                                           "User backend queries abandoned after timeout.")) {
+    const int threads = std::max(1, configInt(config, "fan_out_threads", 4));
+    const int queue = std::max(0, configInt(config, "fan_out_queue", threads));
+    for (size_t i = 0; i < this->storages.size(); ++i) {
+        this->executors.emplace_back(std::make_unique<RequestExecutor>(threads, threads + queue,
+                                                                       "user_backend_" + QString::number(i)));
+    }
+}
+
+std::optional<QString> FanOutUserStorage::query(const std::function<std::optional<QString>(IUserStorage &)> &query) {
+    using State = Call::State;
+    using Clock = std::chrono::steady_clock;
+    const size_t backends = this->storages.size();
+    const auto call = std::make_shared<Call>(backends);
+
+    // called with call->mutex locked
+    const auto launch = [&](const size_t i) {
+        call->states[i] = State::Running;
+        call->started[i] = Clock::now();
+        const bool posted = this->executors[i]->tryPost([call, i, query, storage = this->storages[i].get()]() {
+            {
+                QMutexLocker locker(&call->mutex);
+                if (call->done) {
+                    return;
+                }
+            }
+            std::optional<QString> result;
+            auto state = State::Missing;
+            try {
+                result = query(*storage);
+            } catch (const std::exception &e) {
+                qDebug() << "FanOutUserStorage: backend" << i << "failed:" << e.what();
+                state = State::Failed;
+            }
+
+            QMutexLocker locker(&call->mutex);
+            if (call->states[i] != State::Running) {
+                // abandoned after timeout
+                return;
+            }
+            call->states[i] = state;
+            if (result && !call->result) {
+                call->result = std::move(result);
+            }
+            call->changed.wakeAll();
+        });
+        if (!posted) {
+            // workers of backend are taken by earlier queries, that are still stuck
+            call->states[i] = State::Failed;
+        }
+    };
+
+    QMutexLocker locker(&call->mutex);
+    size_t launched = 0;
+    const size_t initial = this->hedgeDelay.count() > 0 ? 1 : backends;
+    for (; launched < initial; ++launched) {
+        launch(launched);
+    }
+
+    while (!call->result) {
+        const auto now = Clock::now();
+        auto wakeAt = Clock::time_point::max();
+        size_t running = 0;
+        for (size_t i = 0; i < launched; ++i) {
+            if (call->states[i] != State::Running) {
+                continue;
+            }
+            const auto deadline = call->started[i] + this->timeout;
+            if (this->timeout.count() > 0 && deadline <= now) {
+                call->states[i] = State::TimedOut;
+                this->timedOut.add();
+                continue;
+            }
+            ++running;
+            if (this->timeout.count() > 0) {
+                wakeAt = std::min(wakeAt, deadline);
+            }
+        }
+
+        if (launched < backends) {
+            // the next backend is started on hedge delay, or at once when no query is running
+            const auto hedgeAt = call->started[launched - 1] + this->hedgeDelay;
+            if (running == 0 || hedgeAt <= now) {
+                if (running != 0) {
+                    this->hedged.add();
+                }
+                launch(launched++);
+                continue;
+            }
+            wakeAt = std::min(wakeAt, hedgeAt);
+        } else if (running == 0) {
+            break;
+        }
+
+        if (wakeAt == Clock::time_point::max()) {
+            call->changed.wait(&call->mutex);
+        } else {
+            const auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(wakeAt - now).count() + 1;
+            call->changed.wait(&call->mutex, static_cast<unsigned long>(wait));
+        }
+    }
+    call->done = true;
+
+    if (call->result) {
+        return call->result;
+    }
+    if (std::any_of(call->states.begin(), call->states.end(), [](const State state) {
+        return state == State::Failed || state == State::TimedOut;
+    })) {
+        throw UserStorageUnavailable("No user backend answered");
+    }
+    return std::nullopt;
+}
+
+std::optional<QString> FanOutUserStorage::authenticate(const QString &username, const QString &password) {
+    // captured by value: abandoned queries outlive the call
+    return this->query([username, password](IUserStorage &storage) {
+        return storage.authenticate(username, password);
+    });
+}
+
+std::optional<QString> FanOutUserStorage::getUserVersion(const QString &username) {
+    return this->query([username](IUserStorage &storage) {
+        return storage.getUserVersion(username);
+    });
+}
+
+bool FanOutUserStorage::forEachUsername(const std::function<void(const QString &)> &callback) {
+    for (const auto &storage: this->storages) {
+        if (!storage->forEachUsername(callback)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool FanOutUserStorage::onUsersChanged(UsersChanged listener) {
+    bool subscribed = false;
+    for (const auto &storage: this->storages) {
+        subscribed = storage->onUsersChanged(listener) || subscribed;
+    }
+    return subscribed;
+}
@@ -0,0 +1,180 @@
+#include <user_storage/filtered_user_storage.h>
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QMutexLocker>
+#include <QReadLocker>
+#include <QThread>
+#include <QVariant>
+#include <QWriteLocker>
+
+/// @brief read number option, written either as JSON number or as string
+static double configNumber(IUserConfig *config, const QString &option, const double defaultValue) {
+    double result = defaultValue;
+    if (config) {
+        const QVariant value = config->getUserConfig(option);
+        bool ok = false;
+        const double parsed = value.toString().toDouble(&ok);
+        if (ok) {
+            result = parsed;
+        }
+    }
+    qDebug().noquote() << "FilteredUserStorage:" << option << "=" << result;
+    return result;
+}
+
+FilteredUserStorage::FilteredUserStorage(std::unique_ptr<IUserStorage> storage, IUserConfig *config)
+    : storage(std::move(storage)),
+      capacity(static_cast<size_t>(qMax(1.0, configNumber(config, "filter_capacity", 1000000)))),
+      falsePositiveRate(configNumber(config, "filter_false_positive", 0.01)),
+      refreshInterval(static_cast<int>(configNumber(config, "filter_refresh", 60000))),
+      rejected(Metrics::instance().counter("jrpc_auth_user_filter_requests_total", "Lookups of user names filter.",
+                                           Metrics::label("result", "rejected"))),
+      passed(Metrics::instance().counter("jrpc_auth_user_filter_requests_total", "Lookups of user names filter.",
+                                         Metrics::label("result", "passed"))) {
+    // users created elsewhere are accepted at once, not after the next rebuild; users added during the first build
+    // are carried into it
+    this->storage->onUsersChanged([this](const QSet<QString> &usernames) {
+        if (usernames.isEmpty()) {
+            this->requestRebuild();
+            return;
+        }
+        for (const auto &username: usernames) {
+            this->add(username);
+        }
+    });
+    this->rebuild();
+
+    if (this->refreshInterval > 0) {
+        this->refresher.reset(QThread::create([this]() {
+            this->run();
+        }));
+        this->refresher->start();
+    }
+}
+
+FilteredUserStorage::~FilteredUserStorage() {
+    if (this->refresher) {
+        {
+            QMutexLocker state(&this->stateMutex);
+            this->stopping = true;
+            this->wakeup.wakeAll();
+        }
+        this->refresher->wait();
+    }
+    // change listener uses the filter, so change feed of wrapped storage is stopped before filter is destroyed
+    this->storage.reset();
+}
+
+void FilteredUserStorage::requestRebuild() {
+    if (this->refreshInterval <= 0) {
+        this->rebuild();
+        return;
+    }
+    QMutexLocker state(&this->stateMutex);
+    this->rebuildRequested = true;
+    this->wakeup.wakeAll();
+}
+
+bool FilteredUserStorage::mightExist(const QString &username) {
+    QReadLocker locker(&this->lock);
+    if (!this->filter) {
+        return true;
+    }
+    if (!this->filter->mightContain(username.toUtf8())) {
+        this->rejected.add();
+        return false;
+    }
+    this->passed.add();
+    return true;
+}
+
+std::optional<QString> FilteredUserStorage::authenticate(const QString &username, const QString &password) {
+    if (!this->mightExist(username)) {
+        return std::nullopt;
+    }
+    return this->storage->authenticate(username, password);
+}
+
+std::optional<QString> FilteredUserStorage::getUserVersion(const QString &username) {
+    if (!this->mightExist(username)) {
+        return std::nullopt;
+    }
+    return this->storage->getUserVersion(username);
+}
+
+bool FilteredUserStorage::forEachUsername(const std::function<void(const QString &)> &callback) {
+    return this->storage->forEachUsername(callback);
+}
+
+bool FilteredUserStorage::onUsersChanged(UsersChanged listener) {
+    return this->storage->onUsersChanged(std::move(listener));
+}
+
+void FilteredUserStorage::add(const QString &username) {
+    QWriteLocker locker(&this->lock);
+    if (this->filter) {
+        this->filter->add(username.toUtf8());
+    }
+    if (this->rebuilding) {
+        this->added.append(username);
+    }
+}
+
+bool FilteredUserStorage::rebuild() {
+    QMutexLocker rebuildLocker(&this->rebuildMutex);
+    {
+        QWriteLocker locker(&this->lock);
+        this->rebuilding = true;
+        this->added.clear();
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    // users are streamed once more only if there are more of them than filter was sized for
+    for (;;) {
+        BloomFilter next(this->capacity, this->falsePositiveRate);
+        size_t count = 0;
+        const bool ok = this->storage->forEachUsername([&next, &count](const QString &username) {
+            next.add(username.toUtf8());
+            ++count;
+        });
+
+        if (ok && count > this->capacity) {
+            this->capacity = count + count / 2;
+            continue;
+        }
+
+        QWriteLocker locker(&this->lock);
+        this->rebuilding = false;
+        if (!ok) {
+            this->added.clear();
+            const char *fallback = this->filter ? "previous filter is kept" : "requests are passed through";
+            qDebug() << "FilteredUserStorage: user names are not listed," << fallback;
+            return false;
+        }
+        for (const auto &username: this->added) {
+            next.add(username.toUtf8());
+        }
+        this->added.clear();
+        this->filter = std::move(next);
+        qDebug() << "FilteredUserStorage: filter of" << count << "users is built in" << timer.elapsed() << "ms,"
+                << this->filter->memoryUsage() << "bytes";
+        return true;
+    }
+}
+
+void FilteredUserStorage::run() {
+    QMutexLocker state(&this->stateMutex);
+    while (!this->stopping) {
+        if (!this->rebuildRequested) {
+            this->wakeup.wait(&this->stateMutex, this->refreshInterval);
+        }
+        if (this->stopping) {
+            break;
+        }
+        this->rebuildRequested = false;
+        state.unlock();
+        this->rebuild();
+        state.relock();
+    }
+}
@@ -0,0 +1,53 @@
+#include <auth_storage/instrumented_auth_storage.h>
+#include <metrics/tracer.h>
+
+static Metrics::Histogram &durationOf(const QString &operation) {
+    return Metrics::instance().histogram("jrpc_auth_session_storage_duration_seconds",
+                                         "Time of session storage operations.", Metrics::label("operation", operation));
+}
+
+InstrumentedAuthStorage::InstrumentedAuthStorage(std::unique_ptr<IAuthStorage> storage)
+    : storage(std::move(storage)),
+      authenticateDuration(durationOf("authenticate")),
+      getDuration(durationOf("get")),
+      removeDuration(durationOf("remove")) {
+    if (this->storage->sessionCount() >= 0) {
+        this->sessions = Metrics::instance().gauge("jrpc_auth_sessions", "Number of live sessions.", QString(),
+                                                   [storage = this->storage.get()]() {
+                                                       return static_cast<double>(storage->sessionCount());
+                                                   });
+    }
+}
+
+QString InstrumentedAuthStorage::authenticate(const QString &username, const QString &userVersion) {
+    const Metrics::Timer timer(this->authenticateDuration);
+    const Tracer::Span span("session.authenticate");
+    return this->storage->authenticate(username, userVersion);
+}
+
+QString InstrumentedAuthStorage::authenticate(const QString &username, const QString &userVersion,
+                                              const std::chrono::system_clock::time_point deadline) {
+    const Metrics::Timer timer(this->authenticateDuration);
+    const Tracer::Span span("session.authenticate");
+    return this->storage->authenticate(username, userVersion, deadline);
+}
+
+std::optional<QPair<QString, QString> > InstrumentedAuthStorage::get(const QString &auth_id) {
+    const Metrics::Timer timer(this->getDuration);
+    const Tracer::Span span("session.get");
+    return this->storage->get(auth_id);
+}
+
+bool InstrumentedAuthStorage::remove(const QString &auth_id) {
+    const Metrics::Timer timer(this->removeDuration);
+    const Tracer::Span span("session.remove");
+    return this->storage->remove(auth_id);
+}
+
+qint64 InstrumentedAuthStorage::sessionCount() {
+    return this->storage->sessionCount();
+}
+
+qint64 InstrumentedAuthStorage::removeByUsers(const QSet<QString> &usernames) {
+    return this->storage->removeByUsers(usernames);
+}
@@ -1,80 +1,216 @@
 #include <auth_configuration/json_configuration.h>
+#include <QDebug>
+#include <QFile>
+#include <QFileInfo>
 #include <QJsonDocument>
-#include <jwt/json/json.hpp>
+#include <QJsonParseError>
+#include <QMutexLocker>
+#include <QSaveFile>
+#include <QTimer>
+#include <tuple>
 
+/// @brief setters called in a row are saved with one write
+static constexpr int SAVE_DELAY_MS = 100;
 
-JsonConfiguration::JsonConfiguration(const QString &configPath) : configPath(configPath) {
+static QHash<QString, QVariant> sectionOf(const QJsonObject &section) {
+    QHash<QString, QVariant> values;
+    values.reserve(section.size());
+    for (auto it = section.constBegin(); it != section.constEnd(); ++it) {
+        values.insert(it.key(), it.value().toVariant());
+    }
+    return values;
+}
+
+/// @brief keys of sections, that differ between snapshots, as "<section>.<name>"
+static QStringList changedKeys(const JsonConfiguration::Snapshot &before, const JsonConfiguration::Snapshot &after) {
+    QStringList changed;
+    for (const auto &[name, old, now]: {
+             std::tuple{"service", &before.service, &after.service},
+             std::tuple{"auth", &before.auth, &after.auth},
+             std::tuple{"user", &before.user, &after.user},
+         }) {
+        for (auto it = old->constBegin(); it != old->constEnd(); ++it) {
+            if (now->value(it.key()) != it.value()) {
+                changed.append(QString(name) + '.' + it.key());
+            }
+        }
+        for (auto it = now->constBegin(); it != now->constEnd(); ++it) {
+            if (!old->contains(it.key())) {
+                changed.append(QString(name) + '.' + it.key());
+            }
+        }
+    }
+    return changed;
+}
+
+JsonConfiguration::JsonConfiguration(const QString &configPath, QObject *parent)
+    : QObject(parent), configPath(configPath), current(std::make_shared<const Snapshot>()) {
     auto file = QFile(this->configPath);
     if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
         qDebug() << "Failed to open config file for read: " << configPath;
         return;
     }
 
-    const auto fileContent = file.readAll();
-    this->root = QJsonDocument::fromJson(fileContent).object();
+    this->content = file.readAll();
+    QString error;
+    if (auto snapshot = parse(this->content, error)) {
+        this->current = std::move(snapshot);
+    } else {
+        qDebug().noquote() << "Invalid config file" << configPath + ":" << error;
+    }
 }
 
-void JsonConfiguration::setServiceConfig(const QString &config, const QVariant &value) {
-    QJsonObject serviceObj = this->root.value("service").toObject();
-    serviceObj[config] = QJsonValue::fromVariant(value);
-    this->root["service"] = serviceObj;
+JsonConfiguration::~JsonConfiguration() {
+    this->flush();
+}
 
-    auto file = QFile(this->configPath);
-    if (!file.open(QIODevice::WriteOnly | QIODevice::Text)) {
-        qDebug() << "Configuration \"`service." + config + "\" doesn't saved.";
-        return;
+std::shared_ptr<const JsonConfiguration::Snapshot> JsonConfiguration::parse(const QByteArray &content,
+                                                                            QString &error) {
+    QJsonParseError parseError{};
+    const auto document = QJsonDocument::fromJson(content, &parseError);
+    if (parseError.error != QJsonParseError::NoError) {
+        error = parseError.errorString() + " at offset " + QString::number(parseError.offset);
+        return nullptr;
+    }
+    if (!document.isObject()) {
+        error = "root is not an object";
+        return nullptr;
     }
-    file.write(QJsonDocument(this->root).toJson());
-}
 
-QVariant JsonConfiguration::getServiceConfig(const QString &config) const {
-    const auto service = this->root["service"];
-    if (service.isNull() || !service.isObject()) {
-        return {};
+    auto snapshot = std::make_shared<Snapshot>();
+    snapshot->root = document.object();
+    for (const auto &[name, values]: {
+             std::pair{"service", &snapshot->service},
+             std::pair{"auth", &snapshot->auth},
+             std::pair{"user", &snapshot->user},
+         }) {
+        const QJsonValue section = snapshot->root.value(name);
+        if (section.isUndefined()) {
+            continue;
+        }
+        if (!section.isObject()) {
+            error = QString("\"%1\" is not an object").arg(name);
+            return nullptr;
+        }
+        *values = sectionOf(section.toObject());
     }
-    return service[config];
+    return snapshot;
 }
 
-void JsonConfiguration::setAuthConfig(const QString &config, const QVariant &value) {
-    QJsonObject authObj = this->root.value("auth").toObject();
-    authObj[config] = QJsonValue::fromVariant(value);
-    this->root["auth"] = authObj;
+std::shared_ptr<const JsonConfiguration::Snapshot> JsonConfiguration::snapshot() const {
+    return std::atomic_load(&this->current);
+}
 
-    auto file = QFile(this->configPath);
-    if (!file.open(QIODevice::WriteOnly | QIODevice::Text)) {
-        qDebug() << "Configuration \"`auth." + config + "\" doesn't saved.";
-        return;
+bool JsonConfiguration::watch() {
+    if (this->watcher) {
+        return true;
+    }
+    this->watcher = new QFileSystemWatcher(this);
+    // editors and atomic writes replace file, so its directory is watched too, to follow new file
+    const QString directory = QFileInfo(this->configPath).absolutePath();
+    if (!this->watcher->addPath(directory)) {
+        qDebug() << "Failed to watch config directory:" << directory;
+        return false;
     }
-    file.write(QJsonDocument(this->root).toJson());
+    this->watcher->addPath(this->configPath);
+
+    const auto changed = [this]() {
+        if (QFile::exists(this->configPath) && !this->watcher->files().contains(this->configPath)) {
+            this->watcher->addPath(this->configPath);
+        }
+        const auto before = this->snapshot();
+        if (this->reload()) {
+            emit this->reloaded(changedKeys(*before, *this->snapshot()));
+        }
+    };
+    connect(this->watcher, &QFileSystemWatcher::fileChanged, this, changed);
+    connect(this->watcher, &QFileSystemWatcher::directoryChanged, this, changed);
+    return true;
 }
 
-QVariant JsonConfiguration::getAuthConfig(const QString &config) const {
-    const auto service = this->root["auth"];
-    if (service.isNull() || !service.isObject()) {
-        return {};
+bool JsonConfiguration::reload() {
+    auto file = QFile(this->configPath);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        return false;
+    }
+    const QByteArray content = file.readAll();
+
+    QMutexLocker locker(&this->mutex);
+    if (content == this->content) {
+        return false;
+    }
+    QString error;
+    auto snapshot = parse(content, error);
+    if (!snapshot) {
+        qDebug().noquote() << "Config file" << this->configPath << "is not reloaded:" << error;
+        return false;
     }
-    return service[config];
+    this->content = content;
+    this->savePending = false;
+    std::atomic_store(&this->current, std::move(snapshot));
+    qDebug().noquote() << "Config file" << this->configPath << "is reloaded";
+    return true;
 }
 
-void JsonConfiguration::setUserConfig(const QString &config, const QVariant &value) {
-    QJsonObject userObj = this->root.value("user").toObject();
-    userObj[config] = QJsonValue::fromVariant(value);
-    this->root["user"] = userObj;
+void JsonConfiguration::flush() {
+    QMutexLocker locker(&this->mutex);
+    if (!this->savePending) {
+        return;
+    }
+    this->savePending = false;
 
-    auto file = QFile(this->configPath);
-    if (!file.open(QIODevice::WriteOnly | QIODevice::Text)) {
-        qDebug() << "Configuration \"`user." + config + "\" doesn't saved.";
+    const QByteArray content = QJsonDocument(this->snapshot()->root).toJson();
+    QSaveFile file(this->configPath);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Text) || file.write(content) != content.size()
+        || !file.commit()) {
+        qDebug() << "Configuration is not saved:" << file.errorString();
         return;
     }
-    file.write(QJsonDocument(this->root).toJson());
+    this->content = content;
 }
 
-QVariant JsonConfiguration::getUserConfig(const QString &config) const {
-    const auto userObj = this->root["user"];
-    if (userObj.isNull() || !userObj.isObject()) {
-        return {};
+void JsonConfiguration::set(const QString &section, const QString &config, const QVariant &value) {
+    QMutexLocker locker(&this->mutex);
+    auto snapshot = std::make_shared<Snapshot>(*this->snapshot());
+    QJsonObject object = snapshot->root.value(section).toObject();
+    object[config] = QJsonValue::fromVariant(value);
+    snapshot->root[section] = object;
+
+    auto &values = section == "service" ? snapshot->service : section == "auth" ? snapshot->auth : snapshot->user;
+    values.insert(config, object.value(config).toVariant());
+    std::atomic_store(&this->current, std::shared_ptr<const Snapshot>(std::move(snapshot)));
+
+    if (!this->savePending) {
+        this->savePending = true;
+        // setter may be called on worker thread without event loop, timer is started on thread of configuration
+        QMetaObject::invokeMethod(this, [this]() {
+            QTimer::singleShot(SAVE_DELAY_MS, this, &JsonConfiguration::flush);
+        }, Qt::QueuedConnection);
     }
-    return userObj[config];
+}
+
+void JsonConfiguration::setServiceConfig(const QString &config, const QVariant &value) {
+    this->set("service", config, value);
+}
+
+QVariant JsonConfiguration::getServiceConfig(const QString &config) const {
+    return this->snapshot()->service.value(config);
+}
+
+void JsonConfiguration::setAuthConfig(const QString &config, const QVariant &value) {
+    this->set("auth", config, value);
+}
+
+QVariant JsonConfiguration::getAuthConfig(const QString &config) const {
+    return this->snapshot()->auth.value(config);
+}
+
+void JsonConfiguration::setUserConfig(const QString &config, const QVariant &value) {
+    this->set("user", config, value);
+}
+
+QVariant JsonConfiguration::getUserConfig(const QString &config) const {
+    return this->snapshot()->user.value(config);
 }
 
 JsonConfiguration loadConfiguration() {
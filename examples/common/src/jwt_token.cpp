@@ -0,0 +1,131 @@
+#include <token/jwt_token.h>
+#include <token/base64_url.h>
+#include <token/token_bytes.h>
+#include <metrics/metrics.h>
+#include <metrics/tracer.h>
+#include <jwt/json/json.hpp>
+#include <openssl/crypto.h>
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
+#include <chrono>
+
+/// @brief encoded header of tokens created here, tokens with it don't need header parsing
+static const std::string &hs256Header() {
+    static const std::string header = base64UrlEncode(R"({"alg":"HS256","typ":"JWT"})");
+    return header;
+}
+
+/// @brief HMAC-SHA256 of data
+/// @return false if OpenSSL fails
+static bool hmacSha256(const std::string_view secret, const std::string_view data, unsigned char *mac,
+                       unsigned int *size) {
+    return HMAC(EVP_sha256(), secret.data(), static_cast<int>(secret.size()),
+                reinterpret_cast<const unsigned char *>(data.data()), data.size(), mac, size) != nullptr;
+}
+
+QString createJwtToken(const QString &secret, const QString &jti, const QString &issuer, const QString &username) {
+    static Metrics::Histogram &duration = Metrics::instance().histogram(
+        "jrpc_auth_jwt_duration_seconds", "Time to sign or verify JWT tokens.",
+        Metrics::label("algorithm", "HS256") + ',' + Metrics::label("operation", "sign"));
+    const Metrics::Timer timer(duration);
+    const Tracer::Span span("jwt.sign");
+
+    const auto issuedAt = std::chrono::duration_cast<std::chrono::seconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    const nlohmann::json payload = {
+        {"iat", issuedAt},
+        {"iss", issuer.toStdString()},
+        {"jti", jti.toStdString()},
+        {"sub", username.toStdString()},
+    };
+
+    std::string token = hs256Header();
+    token.push_back('.');
+    token += base64UrlEncode(payload.dump());
+
+    unsigned char mac[EVP_MAX_MD_SIZE];
+    unsigned int size = 0;
+    const QByteArray key = secret.toUtf8();
+    if (!hmacSha256(std::string_view(key.constData(), key.size()), token, mac, &size)) {
+        return {};
+    }
+    token.push_back('.');
+    token += base64UrlEncode(std::string_view(reinterpret_cast<const char *>(mac), size));
+    return QString::fromLatin1(token.data(), static_cast<int>(token.size()));
+}
+
+std::optional<QString> verifyJwtAndGetToken(const QString &jwt, const QString &secret) noexcept {
+    const TokenBytes bytes(jwt);
+    const auto token = bytes.view();
+    if (!token) {
+        return std::nullopt;
+    }
+    const QByteArray key = secret.toUtf8();
+    return verifyJwtAndGetToken(token.value(), std::string_view(key.constData(), key.size()));
+}
+
+std::optional<QString> verifyJwtAndGetToken(const std::string_view jwt, const std::string_view secret) noexcept {
+    static Metrics::Histogram &duration = Metrics::instance().histogram(
+        "jrpc_auth_jwt_duration_seconds", "Time to sign or verify JWT tokens.",
+        Metrics::label("algorithm", "HS256") + ',' + Metrics::label("operation", "verify"));
+    const Metrics::Timer timer(duration);
+    const Tracer::Span span("jwt.verify");
+
+    const size_t headerEnd = jwt.find('.');
+    if (headerEnd == std::string_view::npos) {
+        return std::nullopt;
+    }
+    const size_t payloadEnd = jwt.find('.', headerEnd + 1);
+    if (payloadEnd == std::string_view::npos || jwt.find('.', payloadEnd + 1) != std::string_view::npos) {
+        return std::nullopt;
+    }
+
+    try {
+        // header of own tokens is compared as is, others (e.g. issued before) are parsed
+        const std::string_view header = jwt.substr(0, headerEnd);
+        if (header != hs256Header()) {
+            const auto decoded = base64UrlDecode(header);
+            if (!decoded) {
+                return std::nullopt;
+            }
+            const auto headerJson = nlohmann::json::parse(decoded.value());
+            const auto alg = headerJson.find("alg");
+            if (alg == headerJson.end() || !alg->is_string() || alg->get_ref<const std::string &>() != "HS256") {
+                return std::nullopt;
+            }
+        }
+
+        const auto signature = base64UrlDecode(jwt.substr(payloadEnd + 1));
+        unsigned char mac[EVP_MAX_MD_SIZE];
+        unsigned int size = 0;
+        if (!signature || !hmacSha256(secret, jwt.substr(0, payloadEnd), mac, &size) || signature->size() != size
+            || CRYPTO_memcmp(signature->data(), mac, size) != 0) {
+            return std::nullopt;
+        }
+
+        const auto payload = base64UrlDecode(jwt.substr(headerEnd + 1, payloadEnd - headerEnd - 1));
+        if (!payload) {
+            return std::nullopt;
+        }
+        const auto payloadJson = nlohmann::json::parse(payload.value());
+        if (!payloadJson.is_object()) {
+            return std::nullopt;
+        }
+        const auto now = std::chrono::duration_cast<std::chrono::seconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+        const auto exp = payloadJson.find("exp");
+        const auto nbf = payloadJson.find("nbf");
+        if ((exp != payloadJson.end() && exp->is_number() && now > exp->get<int64_t>())
+            || (nbf != payloadJson.end() && nbf->is_number() && now < nbf->get<int64_t>())) {
+            return std::nullopt;
+        }
+        const auto jti = payloadJson.find("jti");
+        if (jti == payloadJson.end() || !jti->is_string()) {
+            return std::nullopt;
+        }
+        const std::string &value = jti->get_ref<const std::string &>();
+        return QString::fromUtf8(value.data(), static_cast<int>(value.size()));
+    } catch (const std::exception &) {
+        return std::nullopt;
+    }
+}
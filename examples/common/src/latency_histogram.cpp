@@ -0,0 +1,93 @@
+#include <metrics/latency_histogram.h>
+#include <algorithm>
+#include <cmath>
+
+/// @brief values below 2^SUB_BITS are counted exactly, every next power of two gets SUB / 2 buckets
+static constexpr int SUB_BITS = 8;
+static constexpr uint64_t SUB = 1ull << SUB_BITS;
+static constexpr uint64_t HALF = SUB / 2;
+/// @brief largest shift of 64-bit value
+static constexpr int SHIFTS = 64 - SUB_BITS + 1;
+
+static int highestBit(const uint64_t value) {
+    return 63 - __builtin_clzll(value);
+}
+
+size_t LatencyHistogram::indexOf(const uint64_t value) {
+    if (value < SUB) {
+        return value;
+    }
+    // value >> shift is in [HALF, SUB)
+    const int shift = highestBit(value) - SUB_BITS + 1;
+    return SUB + (shift - 1) * HALF + ((value >> shift) - HALF);
+}
+
+uint64_t LatencyHistogram::highestOf(const size_t index) {
+    if (index < SUB) {
+        return index;
+    }
+    const int shift = static_cast<int>((index - SUB) / HALF) + 1;
+    const uint64_t sub = (index - SUB) % HALF + HALF;
+    return ((sub + 1) << shift) - 1;
+}
+
+LatencyHistogram::LatencyHistogram() : counts(SUB + (SHIFTS - 1) * HALF, 0) {
+}
+
+void LatencyHistogram::record(const uint64_t value, const uint64_t count) {
+    this->counts[indexOf(value)] += count;
+    this->total += count;
+    this->minimum = std::min(this->minimum, value);
+    this->maximum = std::max(this->maximum, value);
+    this->sum += static_cast<long double>(value) * count;
+}
+
+void LatencyHistogram::merge(const LatencyHistogram &other) {
+    for (size_t i = 0; i < this->counts.size(); ++i) {
+        this->counts[i] += other.counts[i];
+    }
+    this->total += other.total;
+    this->minimum = std::min(this->minimum, other.minimum);
+    this->maximum = std::max(this->maximum, other.maximum);
+    this->sum += other.sum;
+}
+
+void LatencyHistogram::clear() {
+    std::fill(this->counts.begin(), this->counts.end(), 0);
+    this->total = 0;
+    this->minimum = UINT64_MAX;
+    this->maximum = 0;
+    this->sum = 0;
+}
+
+uint64_t LatencyHistogram::count() const {
+    return this->total;
+}
+
+uint64_t LatencyHistogram::min() const {
+    return this->total == 0 ? 0 : this->minimum;
+}
+
+uint64_t LatencyHistogram::max() const {
+    return this->maximum;
+}
+
+double LatencyHistogram::mean() const {
+    return this->total == 0 ? 0 : static_cast<double>(this->sum / this->total);
+}
+
+uint64_t LatencyHistogram::percentile(const double percentile) const {
+    if (this->total == 0) {
+        return 0;
+    }
+    const double clamped = std::min(std::max(percentile, 0.0), 100.0);
+    const auto rank = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(clamped / 100.0 * this->total)));
+    uint64_t seen = 0;
+    for (size_t i = 0; i < this->counts.size(); ++i) {
+        seen += this->counts[i];
+        if (seen >= rank) {
+            return std::min(highestOf(i), this->maximum);
+        }
+    }
+    return this->maximum;
+}
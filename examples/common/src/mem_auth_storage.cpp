@@ -1,37 +1,52 @@
 #include <auth_storage/mem_auth_storage.h>
+#include <auth_storage/random_token.h>
+#include <QDateTime>
+#include <QVariant>
 
-static QString randomToken(std::mt19937 &gen) {
-    const static std::string chars = "0123456789abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ";
-    std::uniform_int_distribution<> dis(0, static_cast<int>(chars.size() - 1));
-    std::string token;
-    for (int i = 0; i < 32; ++i) {
-        token.push_back(chars[dis(gen)]);
-    }
-    return QString::fromStdString(token);
+static qint64 toMs(const std::chrono::system_clock::time_point &time) {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(time.time_since_epoch()).count();
 }
 
-MemAuthStorage::MemAuthStorage(const uint64_t seed) : gen(seed) {
-    if (seed == -1) {
-        this->gen.seed(std::random_device{}());
+MemAuthStorage::MemAuthStorage(IAuthConfig *config)
+    : token2user(config ? config->getAuthConfig("max_sessions").toInt() : 0) {
+    if (config) {
+        this->sessionTtl = qMax<qint64>(0, config->getAuthConfig("session_ttl").toLongLong());
     }
 }
 
-QString MemAuthStorage::authenticate(const QString &username, const QString &userVersion) {
-    QString token = randomToken(this->gen);
+QString MemAuthStorage::insert(const QString &username, const QString &userVersion, const qint64 deadline) {
+    this->token2user.expire(QDateTime::currentMSecsSinceEpoch());
+    // collision of 192 random bits is practically impossible, check keeps identifiers unique anyway
+    QString token = randomToken();
     while (this->token2user.contains(token)) {
-        token = randomToken(this->gen);
+        token = randomToken();
     }
-    this->token2user[token] = {username, userVersion};
+    this->token2user.insert(token, username, userVersion, deadline);
     return token;
 }
 
+QString MemAuthStorage::authenticate(const QString &username, const QString &userVersion) {
+    const qint64 deadline = this->sessionTtl > 0 ? QDateTime::currentMSecsSinceEpoch() + this->sessionTtl : 0;
+    return this->insert(username, userVersion, deadline);
+}
+
+QString MemAuthStorage::authenticate(const QString &username, const QString &userVersion,
+                                     const std::chrono::system_clock::time_point deadline) {
+    return this->insert(username, userVersion, toMs(deadline));
+}
+
 std::optional<QPair<QString, QString> > MemAuthStorage::get(const QString &auth_id) {
-    if (this->token2user.contains(auth_id)) {
-        return this->token2user[auth_id];
-    }
-    return std::nullopt;
+    return this->token2user.get(auth_id, QDateTime::currentMSecsSinceEpoch());
 }
 
 bool MemAuthStorage::remove(const QString &auth_id) {
-    return this->token2user.remove(auth_id);
+    return this->token2user.remove(auth_id, QDateTime::currentMSecsSinceEpoch());
+}
+
+qint64 MemAuthStorage::sessionCount() {
+    return this->token2user.size();
+}
+
+qint64 MemAuthStorage::removeByUsers(const QSet<QString> &usernames) {
+    return this->token2user.removeUsers(usernames, QDateTime::currentMSecsSinceEpoch()).size();
 }
@@ -0,0 +1,155 @@
+#include <metrics/metrics.h>
+#include <QMutexLocker>
+#include <algorithm>
+#include <cmath>
+#include <iterator>
+
+/// @brief slot of calling thread
+static int slotOf() {
+    static std::atomic<int> next{0};
+    thread_local const int slot = next.fetch_add(1, std::memory_order_relaxed) % Metrics::SLOTS;
+    return slot;
+}
+
+/// @brief `{labels}` or `{labels,extra}`, empty if there are no labels
+static QString series(const QString &labels, const QString &extra = QString()) {
+    if (labels.isEmpty() && extra.isEmpty()) {
+        return {};
+    }
+    if (labels.isEmpty() || extra.isEmpty()) {
+        return '{' + labels + extra + '}';
+    }
+    return '{' + labels + ',' + extra + '}';
+}
+
+void Metrics::Counter::add(const uint64_t count) {
+    this->slots[slotOf()].value.fetch_add(count, std::memory_order_relaxed);
+}
+
+uint64_t Metrics::Counter::value() const {
+    uint64_t value = 0;
+    for (const auto &slot: this->slots) {
+        value += slot.value.load(std::memory_order_relaxed);
+    }
+    return value;
+}
+
+void Metrics::Histogram::record(const std::chrono::nanoseconds duration) {
+    const auto nanoseconds = static_cast<uint64_t>(std::max<int64_t>(0, duration.count()));
+    // smallest i with duration <= 2^i microseconds
+    const uint64_t microseconds = (nanoseconds + 999) / 1000;
+    const int bucket = microseconds <= 1 ? 0 : std::min(BUCKETS - 1, 64 - __builtin_clzll(microseconds - 1));
+
+    Slot &slot = this->slots[slotOf()];
+    slot.buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+    slot.sum.fetch_add(nanoseconds, std::memory_order_relaxed);
+}
+
+void Metrics::Histogram::read(uint64_t (&buckets)[BUCKETS], uint64_t &sum) const {
+    std::fill(std::begin(buckets), std::end(buckets), 0);
+    sum = 0;
+    for (const auto &slot: this->slots) {
+        for (int i = 0; i < BUCKETS; ++i) {
+            buckets[i] += slot.buckets[i].load(std::memory_order_relaxed);
+        }
+        sum += slot.sum.load(std::memory_order_relaxed);
+    }
+}
+
+Metrics::Timer::Timer(Histogram &histogram) : histogram(histogram), start(std::chrono::steady_clock::now()) {
+}
+
+Metrics::Timer::~Timer() {
+    this->histogram.record(std::chrono::steady_clock::now() - this->start);
+}
+
+Metrics::Gauge::Gauge(Metrics &metrics, QString name, QString labels)
+    : metrics(metrics), name(std::move(name)), labels(std::move(labels)) {
+}
+
+Metrics::Gauge::~Gauge() {
+    QMutexLocker locker(&this->metrics.mutex);
+    this->metrics.families[this->name].gauges.erase(this->labels);
+}
+
+Metrics &Metrics::instance() {
+    static Metrics metrics;
+    return metrics;
+}
+
+QString Metrics::label(const QString &name, const QString &value) {
+    QString escaped = value;
+    escaped.replace('\\', "\\\\").replace('"', "\\\"").replace('\n', "\\n");
+    return name + "=\"" + escaped + '"';
+}
+
+Metrics::Counter &Metrics::counter(const QString &name, const QString &help, const QString &labels,
+                                   const double scale) {
+    QMutexLocker locker(&this->mutex);
+    Family &family = this->families[name];
+    family.help = help;
+    family.scale = scale;
+    auto &counter = family.counters[labels];
+    if (!counter) {
+        counter = std::make_unique<Counter>();
+    }
+    return *counter;
+}
+
+Metrics::Histogram &Metrics::histogram(const QString &name, const QString &help, const QString &labels) {
+    QMutexLocker locker(&this->mutex);
+    Family &family = this->families[name];
+    family.help = help;
+    auto &histogram = family.histograms[labels];
+    if (!histogram) {
+        histogram = std::make_unique<Histogram>();
+    }
+    return *histogram;
+}
+
+std::unique_ptr<Metrics::Gauge> Metrics::gauge(const QString &name, const QString &help, const QString &labels,
+                                               std::function<double()> value) {
+    QMutexLocker locker(&this->mutex);
+    Family &family = this->families[name];
+    family.help = help;
+    family.gauges[labels] = std::move(value);
+    return std::unique_ptr<Gauge>(new Gauge(*this, name, labels));
+}
+
+QByteArray Metrics::exposition() const {
+    QMutexLocker locker(&this->mutex);
+    QString text;
+    for (const auto &[name, family]: this->families) {
+        if (family.counters.empty() && family.histograms.empty() && family.gauges.empty()) {
+            continue;
+        }
+        const char *type = !family.counters.empty() ? "counter" : !family.histograms.empty() ? "histogram" : "gauge";
+        text += "# HELP " + name + ' ' + family.help + '\n';
+        text += "# TYPE " + name + ' ' + type + '\n';
+
+        for (const auto &[labels, counter]: family.counters) {
+            const QString value = family.scale == 1 ? QString::number(counter->value())
+                                                    : QString::number(counter->value() * family.scale, 'g', 15);
+            text += name + series(labels) + ' ' + value + '\n';
+        }
+        for (const auto &[labels, histogram]: family.histograms) {
+            uint64_t buckets[Histogram::BUCKETS];
+            uint64_t sum = 0;
+            histogram->read(buckets, sum);
+            uint64_t count = 0;
+            for (int i = 0; i < Histogram::BUCKETS; ++i) {
+                count += buckets[i];
+                const QString le = i + 1 < Histogram::BUCKETS
+                                       ? QString::number(std::ldexp(1e-6, i), 'g', 10)
+                                       : QStringLiteral("+Inf");
+                text += name + "_bucket" + series(labels, "le=\"" + le + '"') + ' ' + QString::number(count) + '\n';
+            }
+            text += name + "_sum" + series(labels) + ' ' + QString::number(sum / 1e9, 'g', 10) + '\n';
+            text += name + "_count" + series(labels) + ' ' + QString::number(count) + '\n';
+        }
+        for (const auto &[labels, value]: family.gauges) {
+            text += name + series(labels) + ' ' + QString::number(value(), 'g', 15) + '\n';
+        }
+    }
+    return text.toUtf8();
+}
@@ -0,0 +1,44 @@
+#include <metrics/metrics_server.h>
+#include <metrics/metrics.h>
+#include <metrics/tracer.h>
+#include <QTcpSocket>
+
+/// @brief scrape requests are small, anything larger is dropped
+static constexpr int MAX_REQUEST_SIZE = 8 * 1024;
+
+MetricsServer::MetricsServer(QObject *parent) : QTcpServer(parent) {
+}
+
+void MetricsServer::incomingConnection(const qintptr socketDescriptor) {
+    auto *socket = new QTcpSocket(this);
+    if (!socket->setSocketDescriptor(socketDescriptor)) {
+        delete socket;
+        return;
+    }
+    connect(socket, &QTcpSocket::disconnected, socket, &QObject::deleteLater);
+    connect(socket, &QTcpSocket::readyRead, socket, [socket]() {
+        // request is read until end of headers
+        if (socket->bytesAvailable() > MAX_REQUEST_SIZE) {
+            socket->abort();
+            return;
+        }
+        if (!socket->peek(MAX_REQUEST_SIZE).contains("\r\n\r\n")) {
+            return;
+        }
+        const QByteArray request = socket->readAll();
+        QByteArray response;
+        if (request.startsWith("GET /traces ") || request.startsWith("GET /traces?")) {
+            const QByteArray body = Tracer::instance().chromeTrace();
+            response = "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\n"
+                       "Content-Length: " + QByteArray::number(body.size()) + "\r\nConnection: close\r\n\r\n" + body;
+        } else if (request.startsWith("GET ")) {
+            const QByteArray body = Metrics::instance().exposition();
+            response = "HTTP/1.1 200 OK\r\nContent-Type: text/plain; version=0.0.4; charset=utf-8\r\n"
+                       "Content-Length: " + QByteArray::number(body.size()) + "\r\nConnection: close\r\n\r\n" + body;
+        } else {
+            response = "HTTP/1.1 405 Method Not Allowed\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+        }
+        socket->write(response);
+        socket->disconnectFromHost();
+    });
+}
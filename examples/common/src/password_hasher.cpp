@@ -0,0 +1,59 @@
+#include <user_storage/password_hasher.h>
+#include <metrics/tracer.h>
+#include <QCryptographicHash>
+#include <QPasswordDigestor>
+#include <openssl/evp.h>
+#include <stdexcept>
+
+/// @brief memory limit of scrypt: its buffers (128 * r * (N + p) bytes) and some slack
+static quint64 scryptMemory(const PasswordHasher::ScryptCost &cost) {
+    return 128 * cost.r * (cost.n + cost.p + 2) + 1024 * 1024;
+}
+
+PasswordHasher::PasswordHasher(const Algorithm algorithm, QString salt, const int iterations, const ScryptCost scrypt)
+    : algorithm(algorithm), salt(std::move(salt)), iterations(qMax(1, iterations)), scrypt(scrypt) {
+    // without output buffer parameters are only checked
+    if (this->algorithm == Algorithm::Scrypt
+        && EVP_PBE_scrypt(nullptr, 0, nullptr, 0, scrypt.n, scrypt.r, scrypt.p, scryptMemory(scrypt), nullptr, 0)
+        != 1) {
+        throw std::invalid_argument("Invalid scrypt cost: N must be power of 2, N, r and p must fit memory limits");
+    }
+}
+
+QString PasswordHasher::hash(const QString &username, const QString &password) const {
+    const Tracer::Span span("password.hash");
+    if (this->algorithm == Algorithm::Scrypt) {
+        const QByteArray secret = password.toUtf8();
+        const QByteArray userSalt = (this->salt + username).toUtf8();
+        unsigned char key[32];
+        if (EVP_PBE_scrypt(secret.constData(), secret.size(),
+                           reinterpret_cast<const unsigned char *>(userSalt.constData()), userSalt.size(),
+                           this->scrypt.n, this->scrypt.r, this->scrypt.p, scryptMemory(this->scrypt),
+                           key, sizeof(key)) != 1) {
+            throw std::runtime_error("scrypt failed");
+        }
+        return QString::fromLatin1(QByteArray(reinterpret_cast<const char *>(key), sizeof(key)).toHex());
+    }
+    if (this->algorithm == Algorithm::Pbkdf2) {
+        // salt is unique per user, so equal passwords give different hashes
+        return QString::fromLatin1(QPasswordDigestor::deriveKeyPbkdf2(
+            QCryptographicHash::Sha256, password.toUtf8(), (this->salt + username).toUtf8(),
+            this->iterations, 32).toHex());
+    }
+
+    QCryptographicHash hash(QCryptographicHash::Sha256);
+    hash.addData(this->salt.toUtf8());
+    hash.addData(password.toUtf8());
+    return QString::fromLatin1(hash.result().toHex());
+}
+
+bool PasswordHasher::equal(const QString &left, const QString &right) {
+    if (left.size() != right.size()) {
+        return false;
+    }
+    ushort difference = 0;
+    for (int i = 0; i < left.size(); ++i) {
+        difference |= static_cast<ushort>(left[i].unicode() ^ right[i].unicode());
+    }
+    return difference == 0;
+}
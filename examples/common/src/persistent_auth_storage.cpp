@@ -0,0 +1,585 @@
+#include <auth_storage/persistent_auth_storage.h>
+#include <QDateTime>
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QSaveFile>
+#include <QThread>
+#include <QVariant>
+#include <QtEndian>
+#include <array>
+#include <cstring>
+#include <stdexcept>
+#include <fcntl.h>
+#include <unistd.h>
+
+static const QString SNAPSHOT = "sessions.snapshot";
+static const QString LOG = "sessions.log";
+static const QString PREVIOUS_LOG = "sessions.log.1";
+static const QByteArray SNAPSHOT_MAGIC("JRPCAS01");
+/// @brief snapshot is written by chunks of this size
+static constexpr int CHUNK_SIZE = 1 << 20;
+
+enum RecordType : quint8 {
+    Add = 1,
+    Remove = 2,
+};
+
+/// @brief CRC-32 (IEEE), to detect torn log records
+static quint32 crc32(const char *data, const qint64 size) {
+    static const auto table = [] {
+        std::array<quint32, 256> table{};
+        for (quint32 i = 0; i < 256; ++i) {
+            quint32 crc = i;
+            for (int bit = 0; bit < 8; ++bit) {
+                crc = crc & 1 ? 0xEDB88320u ^ (crc >> 1) : crc >> 1;
+            }
+            table[i] = crc;
+        }
+        return table;
+    }();
+    quint32 crc = 0xFFFFFFFFu;
+    for (qint64 i = 0; i < size; ++i) {
+        crc = table[(crc ^ static_cast<uchar>(data[i])) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+template<typename T>
+static void put(QByteArray &out, const T value) {
+    const T little = qToLittleEndian(value);
+    out.append(reinterpret_cast<const char *>(&little), sizeof(little));
+}
+
+/// @brief session encoding: deadline, sizes of identifier, username and version, then their UTF-8 bytes
+static void putSession(QByteArray &out, const QString &auth_id, const QString &username, const QString &userVersion,
+                       const qint64 deadline) {
+    const QByteArray id = auth_id.toUtf8();
+    const QByteArray user = username.toUtf8();
+    const QByteArray version = userVersion.toUtf8();
+    put<qint64>(out, deadline);
+    put<quint32>(out, static_cast<quint32>(id.size()));
+    put<quint32>(out, static_cast<quint32>(user.size()));
+    put<quint32>(out, static_cast<quint32>(version.size()));
+    out += id;
+    out += user;
+    out += version;
+}
+
+/// @brief log record: body size, body checksum, body (type and session)
+static QByteArray makeRecord(const RecordType type, const QString &auth_id, const QString &username = QString(),
+                             const QString &userVersion = QString(), const qint64 deadline = 0) {
+    QByteArray body;
+    put<quint8>(body, type);
+    putSession(body, auth_id, username, userVersion, deadline);
+
+    QByteArray record;
+    record.reserve(body.size() + 8);
+    put<quint32>(record, static_cast<quint32>(body.size()));
+    put<quint32>(record, crc32(body.constData(), body.size()));
+    record += body;
+    return record;
+}
+
+/// @brief bounds-checked reader of mapped file
+class Reader {
+    const uchar *data;
+    qint64 size;
+    qint64 pos = 0;
+
+public:
+    Reader(const uchar *data, const qint64 size) : data(data), size(size) {
+    }
+
+    template<typename T>
+    bool get(T &value) {
+        if (this->size - this->pos < static_cast<qint64>(sizeof(T))) {
+            return false;
+        }
+        std::memcpy(&value, this->data + this->pos, sizeof(T));
+        value = qFromLittleEndian(value);
+        this->pos += sizeof(T);
+        return true;
+    }
+
+    bool bytes(const quint32 count, const char *&out) {
+        if (this->size - this->pos < static_cast<qint64>(count)) {
+            return false;
+        }
+        out = reinterpret_cast<const char *>(this->data + this->pos);
+        this->pos += count;
+        return true;
+    }
+
+    [[nodiscard]] qint64 position() const {
+        return this->pos;
+    }
+
+    [[nodiscard]] bool atEnd() const {
+        return this->pos >= this->size;
+    }
+};
+
+struct StoredSession {
+    QString id;
+    QString username;
+    QString userVersion;
+    qint64 deadline = 0;
+};
+
+static bool getSession(Reader &reader, StoredSession &session) {
+    quint32 idSize, userSize, versionSize;
+    const char *id, *user, *version;
+    if (!reader.get(session.deadline) || !reader.get(idSize) || !reader.get(userSize) || !reader.get(versionSize)
+        || !reader.bytes(idSize, id) || !reader.bytes(userSize, user) || !reader.bytes(versionSize, version)) {
+        return false;
+    }
+    session.id = QString::fromUtf8(id, static_cast<int>(idSize));
+    session.username = QString::fromUtf8(user, static_cast<int>(userSize));
+    session.userVersion = QString::fromUtf8(version, static_cast<int>(versionSize));
+    return true;
+}
+
+static bool alive(const qint64 deadline, const qint64 now) {
+    return deadline == 0 || deadline > now;
+}
+
+/// @brief make renames in directory durable
+static void syncDirectory(const QString &path) {
+    const int fd = ::open(QFile::encodeName(path).constData(), O_RDONLY);
+    if (fd >= 0) {
+        ::fsync(fd);
+        ::close(fd);
+    }
+}
+
+/// @brief append log `from` to log `to`; on failure `to` is truncated back, so no torn record is left in its middle
+static bool appendLog(const QString &from, const QString &to, const bool sync) {
+    QFile source(from);
+    QFile target(to);
+    if (!source.open(QIODevice::ReadOnly) || !target.open(QIODevice::WriteOnly | QIODevice::Append)) {
+        return false;
+    }
+    const qint64 size = target.size();
+    bool ok = true;
+    while (ok && !source.atEnd()) {
+        const QByteArray chunk = source.read(CHUNK_SIZE);
+        ok = !chunk.isEmpty() && target.write(chunk) == chunk.size();
+    }
+    ok = ok && target.flush() && (!sync || ::fdatasync(target.handle()) == 0);
+    if (!ok) {
+        target.resize(size);
+    }
+    return ok;
+}
+
+static int positiveOr(const QVariant &value, const int defaultValue) {
+    const int result = value.toInt();
+    return result > 0 ? result : defaultValue;
+}
+
+PersistentAuthStorage::PersistentAuthStorage(IAuthConfig *config) {
+    const QString dir = config ? config->getAuthConfig("persistence_dir").toString() : QString();
+    if (dir.isEmpty()) {
+        throw std::runtime_error("auth.persistence_dir is not set");
+    }
+    if (!QDir().mkpath(dir)) {
+        throw std::runtime_error("Failed to create auth.persistence_dir: " + dir.toStdString());
+    }
+    this->directory = QDir(dir);
+    this->storage = std::make_unique<ShardedAuthStorage>(config);
+
+    const QString mode = config->getAuthConfig("fsync").toString();
+    if (mode == "interval") {
+        this->syncMode = SyncMode::Interval;
+    } else if (mode == "none") {
+        this->syncMode = SyncMode::None;
+    } else if (!mode.isEmpty() && mode != "batch") {
+        qDebug().noquote() << "PersistentAuthStorage: unknown auth.fsync" << mode << "- using batch";
+    }
+    this->syncInterval = positiveOr(config->getAuthConfig("fsync_interval"), this->syncInterval);
+    this->snapshotInterval = positiveOr(config->getAuthConfig("snapshot_interval"), this->snapshotInterval);
+    if (const qint64 size = config->getAuthConfig("log_max_size").toLongLong(); size > 0) {
+        this->logMaxSize = size;
+    }
+    this->sessionTtl = qMax<qint64>(0, config->getAuthConfig("session_ttl").toLongLong());
+
+    QElapsedTimer timer;
+    timer.start();
+    const bool interrupted = this->load();
+
+    this->log.setFileName(this->path(LOG));
+    // records are batched in buffer already; unbuffered file keeps nothing of failed write
+    if (!this->log.open(QIODevice::WriteOnly | QIODevice::Append | QIODevice::Unbuffered)) {
+        throw std::runtime_error("Failed to open session log: " + this->log.errorString().toStdString());
+    }
+    this->logSize = this->log.size();
+    qDebug().noquote() << "PersistentAuthStorage: restored" << this->storage->size() << "sessions in"
+            << timer.elapsed() << "ms";
+
+    // previous run crashed while writing snapshot: nobody writes yet, so settle it right away
+    if (interrupted && this->writeSnapshot()) {
+        QFile::remove(this->path(PREVIOUS_LOG));
+        this->log.resize(0);
+        this->logSize = 0;
+    }
+
+    this->worker.reset(QThread::create([this]() {
+        this->run();
+    }));
+    this->worker->start();
+}
+
+QString PersistentAuthStorage::path(const QString &name) const {
+    return this->directory.filePath(name);
+}
+
+bool PersistentAuthStorage::load() {
+    const bool interrupted = QFile::exists(this->path(PREVIOUS_LOG));
+    const qint64 sessions = this->loadSnapshot(SNAPSHOT);
+    const qint64 records = this->replayLog(PREVIOUS_LOG) + this->replayLog(LOG);
+    qDebug().noquote() << "PersistentAuthStorage: snapshot sessions =" << sessions << "log records =" << records;
+    return interrupted;
+}
+
+qint64 PersistentAuthStorage::loadSnapshot(const QString &fileName) {
+    QFile file(this->path(fileName));
+    if (!file.exists()) {
+        return 0;
+    }
+    if (!file.open(QIODevice::ReadOnly)) {
+        throw std::runtime_error("Failed to open session snapshot: " + file.errorString().toStdString());
+    }
+    const qint64 size = file.size();
+    if (size == 0) {
+        return 0;
+    }
+    uchar *data = file.map(0, size);
+    if (!data) {
+        throw std::runtime_error("Failed to map session snapshot: " + file.errorString().toStdString());
+    }
+
+    Reader reader(data, size);
+    const char *magic;
+    if (!reader.bytes(SNAPSHOT_MAGIC.size(), magic)
+        || std::memcmp(magic, SNAPSHOT_MAGIC.constData(), SNAPSHOT_MAGIC.size()) != 0) {
+        file.unmap(data);
+        throw std::runtime_error("Invalid session snapshot: " + file.fileName().toStdString());
+    }
+
+    const qint64 now = QDateTime::currentMSecsSinceEpoch();
+    qint64 count = 0;
+    StoredSession session;
+    while (!reader.atEnd()) {
+        if (!getSession(reader, session)) {
+            qDebug().noquote() << "PersistentAuthStorage: snapshot is truncated at" << reader.position();
+            break;
+        }
+        if (alive(session.deadline, now)) {
+            this->storage->restore(session.id, session.username, session.userVersion, session.deadline);
+            ++count;
+        }
+    }
+    file.unmap(data);
+    return count;
+}
+
+qint64 PersistentAuthStorage::replayLog(const QString &fileName) {
+    QFile file(this->path(fileName));
+    if (!file.exists()) {
+        return 0;
+    }
+    if (!file.open(QIODevice::ReadWrite)) {
+        throw std::runtime_error("Failed to open session log: " + file.errorString().toStdString());
+    }
+    const qint64 size = file.size();
+    if (size == 0) {
+        return 0;
+    }
+    uchar *data = file.map(0, size);
+    if (!data) {
+        throw std::runtime_error("Failed to map session log: " + file.errorString().toStdString());
+    }
+
+    const qint64 now = QDateTime::currentMSecsSinceEpoch();
+    Reader reader(data, size);
+    qint64 valid = 0;
+    qint64 count = 0;
+    StoredSession session;
+    while (!reader.atEnd()) {
+        quint32 bodySize, checksum;
+        const char *body;
+        if (!reader.get(bodySize) || !reader.get(checksum) || !reader.bytes(bodySize, body)
+            || crc32(body, bodySize) != checksum) {
+            break;
+        }
+        Reader record(reinterpret_cast<const uchar *>(body), bodySize);
+        quint8 type;
+        if (!record.get(type) || !getSession(record, session)) {
+            break;
+        }
+        if (type == RecordType::Add && alive(session.deadline, now)) {
+            this->storage->restore(session.id, session.username, session.userVersion, session.deadline);
+        } else if (type == RecordType::Remove) {
+            this->storage->remove(session.id);
+        }
+        valid = reader.position();
+        ++count;
+    }
+    file.unmap(data);
+
+    if (valid < size) {
+        // torn write of the last records, following appends must not be hidden behind it
+        qDebug().noquote() << "PersistentAuthStorage: dropping" << size - valid << "broken bytes of" << fileName;
+        file.resize(valid);
+    }
+    return count;
+}
+
+bool PersistentAuthStorage::append(const QByteArray &record) {
+    QMutexLocker locker(&this->logMutex);
+    this->buffer += record;
+    const quint64 sequence = ++this->appended;
+    if (this->syncMode != SyncMode::Batch) {
+        return true;
+    }
+    // group commit: one caller writes and syncs records of all waiting callers
+    while (this->written < sequence) {
+        if (this->failed >= sequence) {
+            // record stays buffered for the next write, but the caller can't wait for it
+            return false;
+        }
+        if (this->writing) {
+            this->logWritten.wait(&this->logMutex);
+        } else {
+            this->flush(locker, true);
+        }
+    }
+    return true;
+}
+
+bool PersistentAuthStorage::flush(QMutexLocker &locker, const bool sync) {
+    while (this->writing) {
+        this->logWritten.wait(&this->logMutex);
+    }
+    if (this->buffer.isEmpty()) {
+        return true;
+    }
+
+    QByteArray data;
+    data.swap(this->buffer);
+    const quint64 last = this->appended;
+    const qint64 size = this->logSize;
+    this->writing = true;
+    locker.unlock();
+
+    bool ok = this->log.write(data) == data.size();
+    if (ok && sync) {
+        ok = ::fdatasync(this->log.handle()) == 0;
+    }
+    if (!ok) {
+        qDebug().noquote() << "PersistentAuthStorage: failed to write session log:" << this->log.errorString();
+        // torn record in the middle would hide following ones on replay
+        if (!this->log.resize(size)) {
+            qDebug().noquote() << "PersistentAuthStorage: failed to truncate session log:" << this->log.errorString();
+        }
+    }
+
+    locker.relock();
+    if (ok) {
+        this->logSize += data.size();
+        this->written = last;
+    } else {
+        this->buffer.prepend(data);
+        this->failed = last;
+    }
+    this->writing = false;
+    this->logWritten.wakeAll();
+    return ok;
+}
+
+QString PersistentAuthStorage::logCreated(const QString &token, const QString &username, const QString &userVersion,
+                                          const qint64 deadline) {
+    if (this->append(makeRecord(RecordType::Add, token, username, userVersion, deadline))) {
+        return token;
+    }
+    // login isn't durable, so it fails; removal follows the buffered record, in case it's written later
+    this->storage->remove(token);
+    this->append(makeRecord(RecordType::Remove, token));
+    return {};
+}
+
+void PersistentAuthStorage::snapshot() {
+    // switch log: records buffered from now on go to the new log
+    {
+        QMutexLocker locker(&this->logMutex);
+        while (this->writing) {
+            this->logWritten.wait(&this->logMutex);
+        }
+        this->writing = true;
+        locker.unlock();
+
+        if (this->syncMode != SyncMode::None) {
+            ::fdatasync(this->log.handle());
+        }
+        this->log.close();
+        // log left by failed snapshot holds records, that are in no snapshot: it is kept until the next snapshot is
+        // durable, and the current log is added to it
+        const bool renamed = QFile::exists(this->path(PREVIOUS_LOG))
+                                 ? appendLog(this->path(LOG), this->path(PREVIOUS_LOG),
+                                             this->syncMode != SyncMode::None) && QFile::remove(this->path(LOG))
+                                 : QFile::rename(this->path(LOG), this->path(PREVIOUS_LOG));
+        if (!renamed) {
+            qDebug().noquote() << "PersistentAuthStorage: failed to rotate session log";
+        }
+        this->log.setFileName(this->path(LOG));
+        if (!this->log.open(QIODevice::WriteOnly | QIODevice::Append | QIODevice::Unbuffered)) {
+            qDebug().noquote() << "PersistentAuthStorage: failed to open session log:" << this->log.errorString();
+        }
+        syncDirectory(this->directory.absolutePath());
+
+        locker.relock();
+        this->logSize = this->log.size();
+        this->writing = false;
+        this->logWritten.wakeAll();
+        if (!renamed) {
+            return;
+        }
+    }
+
+    if (this->writeSnapshot()) {
+        QFile::remove(this->path(PREVIOUS_LOG));
+    }
+}
+
+bool PersistentAuthStorage::writeSnapshot() {
+    QSaveFile file(this->path(SNAPSHOT));
+    if (!file.open(QIODevice::WriteOnly)) {
+        qDebug().noquote() << "PersistentAuthStorage: failed to write snapshot:" << file.errorString();
+        return false;
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    qint64 count = 0;
+    QByteArray chunk = SNAPSHOT_MAGIC;
+    chunk.reserve(CHUNK_SIZE + 4096);
+    this->storage->forEach([&](const QString &auth_id, const QString &username, const QString &userVersion,
+                               const qint64 deadline) {
+        putSession(chunk, auth_id, username, userVersion, deadline);
+        ++count;
+        if (chunk.size() >= CHUNK_SIZE) {
+            file.write(chunk);
+            chunk.clear();
+        }
+    });
+    file.write(chunk);
+
+    if (!file.flush() || (this->syncMode != SyncMode::None && ::fsync(file.handle()) != 0) || !file.commit()) {
+        qDebug().noquote() << "PersistentAuthStorage: failed to write snapshot:" << file.errorString();
+        file.cancelWriting();
+        return false;
+    }
+    syncDirectory(this->directory.absolutePath());
+    qDebug().noquote() << "PersistentAuthStorage: snapshot of" << count << "sessions in" << timer.elapsed() << "ms";
+    return true;
+}
+
+void PersistentAuthStorage::run() {
+    QElapsedTimer sinceSnapshot;
+    sinceSnapshot.start();
+
+    QMutexLocker state(&this->stateMutex);
+    while (!this->stopping) {
+        this->wakeup.wait(&this->stateMutex, this->syncMode == SyncMode::Batch ? 1000 : this->syncInterval);
+        if (this->stopping) {
+            break;
+        }
+        state.unlock();
+
+        qint64 size;
+        {
+            QMutexLocker locker(&this->logMutex);
+            if (this->syncMode != SyncMode::Batch) {
+                this->flush(locker, this->syncMode == SyncMode::Interval);
+            }
+            size = this->logSize + this->buffer.size();
+        }
+        if (size > 0 && (sinceSnapshot.elapsed() >= this->snapshotInterval || size >= this->logMaxSize)) {
+            this->snapshot();
+            sinceSnapshot.restart();
+        }
+
+        state.relock();
+    }
+}
+
+QString PersistentAuthStorage::authenticate(const QString &username, const QString &userVersion) {
+    const qint64 deadline = this->sessionTtl > 0 ? QDateTime::currentMSecsSinceEpoch() + this->sessionTtl : 0;
+    // storage is changed before logging, so snapshot taken after log switch contains every change of the old log
+    const QString token = deadline > 0
+                              ? this->storage->authenticate(username, userVersion,
+                                                            std::chrono::system_clock::time_point(
+                                                                std::chrono::milliseconds(deadline)))
+                              : this->storage->authenticate(username, userVersion);
+    return this->logCreated(token, username, userVersion, deadline);
+}
+
+QString PersistentAuthStorage::authenticate(const QString &username, const QString &userVersion,
+                                            const std::chrono::system_clock::time_point deadline) {
+    const QString token = this->storage->authenticate(username, userVersion, deadline);
+    return this->logCreated(token, username, userVersion,
+                            std::chrono::duration_cast<std::chrono::milliseconds>(
+                                deadline.time_since_epoch()).count());
+}
+
+std::optional<QPair<QString, QString> > PersistentAuthStorage::get(const QString &auth_id) {
+    return this->storage->get(auth_id);
+}
+
+bool PersistentAuthStorage::remove(const QString &auth_id) {
+    const bool removed = this->storage->remove(auth_id);
+    if (removed) {
+        this->append(makeRecord(RecordType::Remove, auth_id));
+    }
+    return removed;
+}
+
+qint64 PersistentAuthStorage::sessionCount() {
+    return this->storage->size();
+}
+
+qint64 PersistentAuthStorage::removeByUsers(const QSet<QString> &usernames) {
+    const QStringList removed = this->storage->removeSessionsOf(usernames);
+    // one append, so removals are synced at once and not one by one
+    QByteArray records;
+    for (const auto &auth_id: removed) {
+        records += makeRecord(RecordType::Remove, auth_id);
+    }
+    if (!records.isEmpty()) {
+        this->append(records);
+    }
+    return removed.size();
+}
+
+PersistentAuthStorage::~PersistentAuthStorage() {
+    {
+        QMutexLocker state(&this->stateMutex);
+        this->stopping = true;
+        this->wakeup.wakeAll();
+    }
+    if (this->worker) {
+        this->worker->wait();
+    }
+
+    qint64 size;
+    {
+        QMutexLocker locker(&this->logMutex);
+        this->flush(locker, this->syncMode != SyncMode::None);
+        // records, that can't be written, are covered by snapshot
+        size = this->logSize + this->buffer.size();
+    }
+    // next start loads snapshot only
+    if (size > 0) {
+        this->snapshot();
+    }
+}
@@ -0,0 +1,596 @@
+#include <auth_storage/qsql_auth_storage.h>
+#include <auth_storage/random_token.h>
+#include <metrics/tracer.h>
+#include <user_storage/iuser_storage.h>
+#include <QtSql/qsqldriver.h>
+#include <QtSql/qsqlerror.h>
+#include <QtSql/qsqlquery.h>
+#include <QDateTime>
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QReadLocker>
+#include <QThread>
+#include <QVariant>
+#include <QWriteLocker>
+#include <vector>
+
+/// @brief rows per multi-row statement, keeps number of bound values below SQLite limit (999)
+static constexpr int MAX_ROWS = 200;
+/// @brief milliseconds between removals of expired sessions from database
+static constexpr int PURGE_INTERVAL = 60000;
+
+static QString userOption(const IUserConfig *config, const char *option, const QString &defaultValue = QString()) {
+    const QString value = config ? config->getUserConfig(option).toString() : QString();
+    return value.isEmpty() || value == QLatin1String("default") ? defaultValue : value;
+}
+
+static qint64 authOption(const IAuthConfig *config, const char *option, const qint64 defaultValue) {
+    const qint64 value = config ? config->getAuthConfig(option).toLongLong() : 0;
+    return value > 0 ? value : defaultValue;
+}
+
+/// @brief `<prefix><row>, <row>, ...<suffix>` with `count` rows
+static QString repeated(const QString &prefix, const QString &row, const int count, const QString &suffix = QString()) {
+    QString sql = prefix;
+    for (int i = 0; i < count; ++i) {
+        if (i > 0) {
+            sql += ", ";
+        }
+        sql += row;
+    }
+    return sql + suffix;
+}
+
+static bool alive(const qint64 deadline, const qint64 now) {
+    return deadline == 0 || deadline > now;
+}
+
+QSqlAuthStorage::QSqlAuthStorage(IUserConfig *userConfig, IAuthConfig *authConfig) {
+    QSqlConnectionPool::Settings settings;
+    settings.driver = userOption(userConfig, "driver", "qpsql").toUpper();
+    settings.host = userOption(userConfig, "host");
+    settings.port = userOption(userConfig, "port");
+    settings.name = userOption(userConfig, "name", "users");
+    settings.user = userOption(userConfig, "user");
+    settings.password = userOption(userConfig, "password");
+    settings.minSize = userOption(userConfig, "pool_min", QString::number(settings.minSize)).toInt();
+    settings.maxSize = userOption(userConfig, "pool_max", QString::number(settings.maxSize)).toInt();
+    settings.idleTimeout = userOption(userConfig, "pool_idle_timeout", QString::number(settings.idleTimeout)).toInt();
+    settings.acquireTimeout = userOption(userConfig, "pool_acquire_timeout",
+                                         QString::number(settings.acquireTimeout)).toInt();
+    settings.validateInterval = userOption(userConfig, "pool_validate_interval",
+                                           QString::number(settings.validateInterval)).toInt();
+    const QString schema = userOption(userConfig, "schema", "public");
+
+    this->sessionTtl = authOption(authConfig, "session_ttl", 0);
+    this->flushInterval = static_cast<int>(authOption(authConfig, "sql_flush_interval", this->flushInterval));
+    this->batchSize = static_cast<int>(authOption(authConfig, "sql_batch_size", this->batchSize));
+    this->cacheTtl = authOption(authConfig, "sql_cache_ttl", this->cacheTtl);
+    this->cacheSize = static_cast<int>(authOption(authConfig, "sql_cache_size", this->cacheSize));
+    this->maxPending = static_cast<int>(authOption(authConfig, "sql_max_pending", this->maxPending));
+    this->maxAttempts = static_cast<int>(authOption(authConfig, "sql_max_attempts", this->maxAttempts));
+    qDebug().noquote() << "QSqlAuthStorage: flush interval =" << this->flushInterval << "batch size ="
+            << this->batchSize << "cache ttl =" << this->cacheTtl << "cache size =" << this->cacheSize
+            << "max pending =" << this->maxPending << "max attempts =" << this->maxAttempts;
+
+    this->pool = std::make_unique<QSqlConnectionPool>(std::move(settings));
+    {
+        auto connection = this->pool->acquire();
+        if (!connection) {
+            throw std::runtime_error("Failed to connect to session database");
+        }
+        const QString table = connection.database().driver()->escapeIdentifier(schema + ".sessions",
+                                                                              QSqlDriver::TableName);
+        QSqlQuery query(connection.database());
+        if (!query.exec("CREATE TABLE IF NOT EXISTS " + table + " (id VARCHAR(64) PRIMARY KEY, "
+                        "username VARCHAR(255) NOT NULL, user_version VARCHAR(255) NOT NULL, "
+                        "deadline BIGINT NOT NULL)")) {
+            throw std::runtime_error("Failed to create sessions table: " + query.lastError().text().toStdString());
+        }
+        // sessions of changed users are deleted by username; SQLite takes schema with index name, not with table
+        const QSqlDriver *driver = connection.database().driver();
+        const bool sqlite = connection.database().driverName() == QLatin1String("QSQLITE");
+        const QString index = driver->escapeIdentifier(schema + (sqlite ? "." : "_") + "sessions_username",
+                                                       QSqlDriver::TableName);
+        const QString indexed = sqlite ? driver->escapeIdentifier("sessions", QSqlDriver::TableName) : table;
+        if (!query.exec("CREATE INDEX IF NOT EXISTS " + index + " ON " + indexed + " (username)")) {
+            // e.g. MySQL can't create index "if not exists", sessions are found by scan then
+            qDebug() << "QSqlAuthStorage: failed to create index of sessions by user:" << query.lastError().text();
+        }
+
+        this->insertSql = "INSERT INTO " + table + " (id, username, user_version, deadline) VALUES ";
+        this->deleteSql = "DELETE FROM " + table + " WHERE id IN (";
+        this->deleteUsersSql = "DELETE FROM " + table + " WHERE username IN (";
+        this->selectSql = "SELECT username, user_version, deadline FROM " + table + " WHERE id = :id";
+        this->purgeSql = "DELETE FROM " + table + " WHERE deadline > 0 AND deadline <= :now";
+    }
+
+    this->writer.reset(QThread::create([this]() {
+        this->run();
+    }));
+    this->writer->start();
+}
+
+QString QSqlAuthStorage::insert(const QString &username, const QString &userVersion, const qint64 deadline) {
+    const QString token = randomToken();
+    bool full;
+    {
+        QWriteLocker locker(&this->lock);
+        if (this->pendingInserts.size() + this->pendingDeletes.size() >= this->maxPending) {
+            qDebug() << "QSqlAuthStorage: too many buffered changes, session is not created";
+            return {};
+        }
+        this->pendingInserts.insert(token, {username, userVersion, deadline});
+        full = this->pendingInserts.size() + this->pendingDeletes.size() >= this->batchSize;
+    }
+    if (full) {
+        QMutexLocker state(&this->stateMutex);
+        this->wakeup.wakeOne();
+    }
+    return token;
+}
+
+QString QSqlAuthStorage::authenticate(const QString &username, const QString &userVersion) {
+    const qint64 deadline = this->sessionTtl > 0 ? QDateTime::currentMSecsSinceEpoch() + this->sessionTtl : 0;
+    return this->insert(username, userVersion, deadline);
+}
+
+QString QSqlAuthStorage::authenticate(const QString &username, const QString &userVersion,
+                                      const std::chrono::system_clock::time_point deadline) {
+    return this->insert(username, userVersion,
+                        std::chrono::duration_cast<std::chrono::milliseconds>(deadline.time_since_epoch()).count());
+}
+
+std::optional<QPair<QString, QString> > QSqlAuthStorage::get(const QString &auth_id) {
+    const qint64 now = QDateTime::currentMSecsSinceEpoch();
+    const auto result = [now](const Session &session) -> std::optional<QPair<QString, QString> > {
+        if (!alive(session.deadline, now)) {
+            return std::nullopt;
+        }
+        return QPair<QString, QString>{session.username, session.userVersion};
+    };
+
+    quint64 removals;
+    {
+        QReadLocker locker(&this->lock);
+        if (this->pendingDeletes.contains(auth_id) || this->flushingDeletes.contains(auth_id)) {
+            return std::nullopt;
+        }
+        removals = this->removals;
+        for (const auto *inserts: {&this->pendingInserts, &this->flushingInserts}) {
+            const auto it = inserts->constFind(auth_id);
+            if (it != inserts->constEnd()) {
+                return result(it.value());
+            }
+        }
+        const auto it = this->cache.constFind(auth_id);
+        if (it != this->cache.constEnd() && now - it->cachedAt < this->cacheTtl) {
+            return result(it->session);
+        }
+    }
+
+    // missing sessions aren't cached: session may be created by another instance right now
+    const auto session = this->select(auth_id);
+    if (!session || !alive(session->deadline, now)) {
+        return std::nullopt;
+    }
+
+    QWriteLocker locker(&this->lock);
+    if (this->pendingDeletes.contains(auth_id) || this->flushingDeletes.contains(auth_id)) {
+        return std::nullopt;
+    }
+    // removal written while the row was read may be of this session, row is not cached then
+    if (this->removals == removals) {
+        this->cachePut(auth_id, session.value(), now);
+    }
+    return result(session.value());
+}
+
+bool QSqlAuthStorage::remove(const QString &auth_id) {
+    {
+        QWriteLocker locker(&this->lock);
+        // not written yet, so nothing to remove from database
+        if (this->pendingInserts.remove(auth_id)) {
+            return true;
+        }
+        if (this->pendingDeletes.contains(auth_id) || this->flushingDeletes.contains(auth_id)) {
+            return false;
+        }
+        if (this->pendingInserts.size() + this->pendingDeletes.size() >= this->maxPending) {
+            throw UserStorageUnavailable("Too many buffered session changes");
+        }
+        if (this->flushingInserts.contains(auth_id)) {
+            this->pendingDeletes.insert(auth_id);
+            return true;
+        }
+    }
+
+    if (!this->get(auth_id)) {
+        return false;
+    }
+
+    QWriteLocker locker(&this->lock);
+    this->cache.remove(auth_id);
+    this->pendingDeletes.insert(auth_id);
+    return true;
+}
+
+qint64 QSqlAuthStorage::removeByUsers(const QSet<QString> &usernames) {
+    if (usernames.isEmpty()) {
+        return 0;
+    }
+
+    const auto dropCached = [this, &usernames]() {
+        for (auto it = this->cache.begin(); it != this->cache.end();) {
+            if (usernames.contains(it->session.username)) {
+                it = this->cache.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    };
+
+    qint64 removed = 0;
+    {
+        QWriteLocker locker(&this->lock);
+        // not written yet, so nothing to remove from database
+        for (auto it = this->pendingInserts.begin(); it != this->pendingInserts.end();) {
+            if (usernames.contains(it->username)) {
+                it = this->pendingInserts.erase(it);
+                ++removed;
+            } else {
+                ++it;
+            }
+        }
+        // sessions being written right now are deleted by the next flush
+        for (auto it = this->flushingInserts.constBegin(); it != this->flushingInserts.constEnd(); ++it) {
+            if (usernames.contains(it->username) && !this->pendingDeletes.contains(it.key())) {
+                this->pendingDeletes.insert(it.key());
+                ++removed;
+            }
+        }
+        dropCached();
+    }
+
+    static const auto metrics = QSqlConnectionPool::metricsOf("delete_user_sessions");
+    const Metrics::Timer timer(metrics.duration);
+    const Tracer::Span span("sql.delete_user_sessions");
+
+    const std::vector<QString> users(usernames.cbegin(), usernames.cend());
+    qint64 deleted = 0;
+    bool written = false;
+    if (auto connection = this->pool->acquire()) {
+        for (int attempt = 0; attempt < 2 && !written; ++attempt) {
+            deleted = 0;
+            written = true;
+            for (size_t first = 0; written && first < users.size(); first += MAX_ROWS) {
+                const int rows = static_cast<int>(qMin<size_t>(MAX_ROWS, users.size() - first));
+                QSqlQuery *query = connection.prepared(repeated(this->deleteUsersSql, "?", rows, ")"));
+                if (!query) {
+                    written = false;
+                    break;
+                }
+                for (int i = 0; i < rows; ++i) {
+                    query->bindValue(i, users[first + i]);
+                }
+                written = query->exec();
+                if (written) {
+                    deleted += query->numRowsAffected();
+                } else {
+                    qDebug() << "QSqlAuthStorage: failed to remove sessions of users:" << query->lastError().text();
+                }
+                query->finish();
+            }
+            if (!written && !connection.reconnect()) {
+                break;
+            }
+        }
+    }
+
+    QWriteLocker locker(&this->lock);
+    // rows read before the statement aren't cached after it, the ones cached already are dropped
+    ++this->removals;
+    dropCached();
+    if (!written) {
+        metrics.errors.add();
+        return -1;
+    }
+    return removed + deleted;
+}
+
+void QSqlAuthStorage::cachePut(const QString &auth_id, const Session &session, const qint64 now) {
+    // session removed while its insert was written is deleted by the next flush
+    if (this->pendingDeletes.contains(auth_id)) {
+        return;
+    }
+    if (this->cache.size() >= this->cacheSize && !this->cache.contains(auth_id)) {
+        // any entry: cached sessions are re-read from database anyway
+        this->cache.erase(this->cache.begin());
+    }
+    this->cache.insert(auth_id, {session, now});
+}
+
+void QSqlAuthStorage::cacheRemoved(const QString &auth_id) {
+    this->cache.remove(auth_id);
+    ++this->removals;
+}
+
+std::optional<QSqlAuthStorage::Session> QSqlAuthStorage::select(const QString &auth_id) {
+    static const auto metrics = QSqlConnectionPool::metricsOf("select_session");
+    const Metrics::Timer timer(metrics.duration);
+    const Tracer::Span span("sql.select_session");
+
+    auto connection = this->pool->acquire();
+    if (!connection) {
+        metrics.errors.add();
+        throw UserStorageUnavailable("Session database is unavailable");
+    }
+
+    for (int attempt = 0; attempt < 2; ++attempt) {
+        QSqlQuery *query = connection.prepared(this->selectSql);
+        if (!query) {
+            if (!connection.reconnect()) {
+                break;
+            }
+            continue;
+        }
+
+        query->bindValue(":id", auth_id);
+        if (query->exec()) {
+            std::optional<Session> session;
+            if (query->next()) {
+                session = Session{query->value(0).toString(), query->value(1).toString(), query->value(2).toLongLong()};
+            }
+            query->finish();
+            return session;
+        }
+
+        const QSqlError error = query->lastError();
+        metrics.errors.add();
+        qDebug() << "QSqlAuthStorage: failed to read session:" << error.text();
+        query->finish();
+        if (error.type() != QSqlError::ConnectionError || !connection.reconnect()) {
+            break;
+        }
+    }
+    throw UserStorageUnavailable("Failed to read session");
+}
+
+QSqlAuthStorage::WriteResult QSqlAuthStorage::write(QSqlConnectionPool::Connection &connection,
+                                                    const QHash<QString, Session> &inserts,
+                                                    const QSet<QString> &deletes) {
+    QSqlDatabase db = connection.database();
+    if (!db.transaction()) {
+        qDebug() << "QSqlAuthStorage: failed to start transaction:" << db.lastError().text();
+        return WriteResult::ConnectionError;
+    }
+
+    // statements with the same number of rows are prepared once per connection
+    WriteResult result = WriteResult::Ok;
+    const auto execute = [&connection, &result](const QString &sql, const std::vector<QVariant> &values) {
+        QSqlQuery *query = connection.prepared(sql);
+        if (!query) {
+            result = WriteResult::ConnectionError;
+            return false;
+        }
+        for (int i = 0; i < static_cast<int>(values.size()); ++i) {
+            query->bindValue(i, values[i]);
+        }
+        const bool ok = query->exec();
+        if (!ok) {
+            const QSqlError error = query->lastError();
+            qDebug() << "QSqlAuthStorage: failed to write sessions:" << error.text();
+            result = error.type() == QSqlError::ConnectionError ? WriteResult::ConnectionError
+                                                                : WriteResult::DataError;
+        }
+        query->finish();
+        return ok;
+    };
+
+    std::vector<QVariant> values;
+    int rows = 0;
+    const auto flushInserts = [&]() {
+        const bool ok = rows == 0 || execute(repeated(this->insertSql, "(?, ?, ?, ?)", rows), values);
+        values.clear();
+        rows = 0;
+        return ok;
+    };
+    for (auto it = inserts.constBegin(); it != inserts.constEnd(); ++it) {
+        values.insert(values.end(), {it.key(), it->username, it->userVersion, it->deadline});
+        if (++rows == MAX_ROWS && !flushInserts()) {
+            db.rollback();
+            return result;
+        }
+    }
+    if (!flushInserts()) {
+        db.rollback();
+        return result;
+    }
+
+    const auto flushDeletes = [&]() {
+        const bool ok = rows == 0 || execute(repeated(this->deleteSql, "?", rows, ")"), values);
+        values.clear();
+        rows = 0;
+        return ok;
+    };
+    for (const auto &auth_id: deletes) {
+        values.emplace_back(auth_id);
+        if (++rows == MAX_ROWS && !flushDeletes()) {
+            db.rollback();
+            return result;
+        }
+    }
+    if (!flushDeletes()) {
+        db.rollback();
+        return result;
+    }
+
+    if (!db.commit()) {
+        const QSqlError error = db.lastError();
+        qDebug() << "QSqlAuthStorage: failed to commit sessions:" << error.text();
+        db.rollback();
+        return error.type() == QSqlError::ConnectionError ? WriteResult::ConnectionError : WriteResult::DataError;
+    }
+    return WriteResult::Ok;
+}
+
+bool QSqlAuthStorage::failed(const QString &auth_id) {
+    if (++this->failedAttempts[auth_id] < this->maxAttempts) {
+        return false;
+    }
+    this->failedAttempts.remove(auth_id);
+    static Metrics::Counter &dropped = Metrics::instance().counter(
+        "jrpc_auth_sql_dropped_changes_total", "Session changes dropped after repeated data errors.");
+    dropped.add();
+    return true;
+}
+
+void QSqlAuthStorage::writeRows(QSqlConnectionPool::Connection &connection) {
+    const qint64 now = QDateTime::currentMSecsSinceEpoch();
+    for (auto it = this->flushingInserts.begin(); it != this->flushingInserts.end();) {
+        const WriteResult result = this->write(connection, {{it.key(), it.value()}}, {});
+        if (result == WriteResult::ConnectionError) {
+            return;
+        }
+        if (result == WriteResult::Ok) {
+            this->failedAttempts.remove(it.key());
+            QWriteLocker locker(&this->lock);
+            this->cachePut(it.key(), it.value(), now);
+        } else if (!this->failed(it.key())) {
+            ++it;
+            continue;
+        } else {
+            qDebug() << "QSqlAuthStorage: dropping session of" << it->username << "after" << this->maxAttempts
+                    << "failed writes";
+        }
+        QWriteLocker locker(&this->lock);
+        it = this->flushingInserts.erase(it);
+    }
+    for (auto it = this->flushingDeletes.begin(); it != this->flushingDeletes.end();) {
+        const WriteResult result = this->write(connection, {}, {*it});
+        if (result == WriteResult::ConnectionError) {
+            return;
+        }
+        if (result == WriteResult::Ok) {
+            this->failedAttempts.remove(*it);
+            QWriteLocker locker(&this->lock);
+            this->cacheRemoved(*it);
+        } else if (!this->failed(*it)) {
+            ++it;
+            continue;
+        } else {
+            qDebug() << "QSqlAuthStorage: dropping removal of session after" << this->maxAttempts << "failed writes";
+        }
+        QWriteLocker locker(&this->lock);
+        it = this->flushingDeletes.erase(it);
+    }
+}
+
+void QSqlAuthStorage::flush() {
+    {
+        QWriteLocker locker(&this->lock);
+        if (this->pendingInserts.isEmpty() && this->pendingDeletes.isEmpty()) {
+            return;
+        }
+        this->flushingInserts.swap(this->pendingInserts);
+        this->flushingDeletes.swap(this->pendingDeletes);
+    }
+
+    static const auto metrics = QSqlConnectionPool::metricsOf("write_sessions");
+    WriteResult result = WriteResult::ConnectionError;
+    {
+        const Metrics::Timer timer(metrics.duration);
+        auto connection = this->pool->acquire();
+        if (connection) {
+            result = this->write(connection, this->flushingInserts, this->flushingDeletes);
+            if (result == WriteResult::ConnectionError && connection.reconnect()) {
+                result = this->write(connection, this->flushingInserts, this->flushingDeletes);
+            }
+            if (result == WriteResult::DataError) {
+                // some row is rejected, others shouldn't wait for it
+                this->writeRows(connection);
+            }
+        }
+    }
+    if (result != WriteResult::Ok) {
+        metrics.errors.add();
+    }
+
+    QWriteLocker locker(&this->lock);
+    const qint64 now = QDateTime::currentMSecsSinceEpoch();
+    for (auto it = this->flushingInserts.constBegin(); it != this->flushingInserts.constEnd(); ++it) {
+        if (result == WriteResult::Ok) {
+            this->cachePut(it.key(), it.value(), now);
+        } else if (!this->pendingDeletes.remove(it.key())) {
+            // removed while being written: both changes cancel out
+            this->pendingInserts.insert(it.key(), it.value());
+        }
+    }
+    if (result == WriteResult::Ok) {
+        for (const auto &auth_id: this->flushingDeletes) {
+            this->cacheRemoved(auth_id);
+        }
+        this->failedAttempts.clear();
+    } else {
+        this->pendingDeletes.unite(this->flushingDeletes);
+        // rows cancelled while waiting for retry aren't counted anymore
+        for (auto it = this->failedAttempts.begin(); it != this->failedAttempts.end();) {
+            if (this->pendingInserts.contains(it.key()) || this->pendingDeletes.contains(it.key())) {
+                ++it;
+            } else {
+                it = this->failedAttempts.erase(it);
+            }
+        }
+        qDebug() << "QSqlAuthStorage:" << this->pendingInserts.size() + this->pendingDeletes.size()
+                << "changes are kept for retry";
+    }
+    this->flushingInserts.clear();
+    this->flushingDeletes.clear();
+}
+
+void QSqlAuthStorage::run() {
+    QElapsedTimer sincePurge;
+    sincePurge.start();
+
+    QMutexLocker state(&this->stateMutex);
+    while (!this->stopping) {
+        this->wakeup.wait(&this->stateMutex, this->flushInterval);
+        state.unlock();
+
+        this->flush();
+        if (sincePurge.hasExpired(PURGE_INTERVAL)) {
+            static const auto metrics = QSqlConnectionPool::metricsOf("purge_sessions");
+            const Metrics::Timer timer(metrics.duration);
+            if (auto connection = this->pool->acquire()) {
+                if (QSqlQuery *query = connection.prepared(this->purgeSql)) {
+                    query->bindValue(":now", QDateTime::currentMSecsSinceEpoch());
+                    if (!query->exec()) {
+                        metrics.errors.add();
+                        qDebug() << "QSqlAuthStorage: failed to purge sessions:" << query->lastError().text();
+                    }
+                    query->finish();
+                }
+            }
+            sincePurge.restart();
+        }
+
+        state.relock();
+    }
+    state.unlock();
+    // changes buffered during the last flush
+    this->flush();
+    QReadLocker locker(&this->lock);
+    if (const int lost = this->pendingInserts.size() + this->pendingDeletes.size(); lost > 0) {
+        qDebug() << "QSqlAuthStorage:" << lost << "changes are not written on shutdown";
+    }
+}
+
+QSqlAuthStorage::~QSqlAuthStorage() {
+    {
+        QMutexLocker state(&this->stateMutex);
+        this->stopping = true;
+        this->wakeup.wakeAll();
+    }
+    // writer flushes the rest before exit
+    this->writer->wait();
+}
@@ -0,0 +1,250 @@
+#include <user_storage/qsql_connection_pool.h>
+#include <QtSql/qsqlerror.h>
+#include <QtSql/qsqlquery.h>
+#include <QAtomicInt>
+#include <QThread>
+#include <QDebug>
+#include <algorithm>
+
+#define DO_IF_NOT_EMPTY(x, y) if (!x.isEmpty()) { y(x); }
+#define DO_IF_NOT_EMPTY_AS_INT(x, y) if (!x.isEmpty()) { y(x.toInt()); }
+
+QSqlConnectionPool::Connection::Connection(QSqlConnectionPool *pool, Entry *entry) : pool(pool), entry(entry) {
+}
+
+QSqlConnectionPool::Connection::Connection(Connection &&other) noexcept : pool(other.pool), entry(other.entry) {
+    other.pool = nullptr;
+    other.entry = nullptr;
+}
+
+QSqlConnectionPool::Connection &QSqlConnectionPool::Connection::operator=(Connection &&other) noexcept {
+    std::swap(this->pool, other.pool);
+    std::swap(this->entry, other.entry);
+    return *this;
+}
+
+QSqlDatabase QSqlConnectionPool::Connection::database() const {
+    if (!this->entry) {
+        return {};
+    }
+    return QSqlDatabase::database(this->entry->name, false);
+}
+
+QString QSqlConnectionPool::Connection::name() const {
+    return this->entry ? this->entry->name : QString();
+}
+
+QSqlQuery *QSqlConnectionPool::Connection::prepared(const QString &sql) {
+    if (!this->entry) {
+        return nullptr;
+    }
+    auto it = this->entry->statements.find(sql);
+    if (it == this->entry->statements.end()) {
+        QSqlQuery query(this->database());
+        query.setForwardOnly(true);
+        if (!query.prepare(sql)) {
+            qDebug() << "QSqlConnectionPool: failed to prepare statement:" << query.lastError().text();
+            return nullptr;
+        }
+        it = this->entry->statements.insert(sql, query);
+    }
+    return &it.value();
+}
+
+bool QSqlConnectionPool::Connection::reconnect() {
+    return this->pool && this->pool->open(this->entry);
+}
+
+QSqlConnectionPool::Connection::operator bool() const {
+    return this->entry != nullptr;
+}
+
+QSqlConnectionPool::Connection::~Connection() {
+    if (this->pool && this->entry) {
+        this->pool->release(this->entry);
+    }
+}
+
+QSqlConnectionPool::QSqlConnectionPool(Settings settings) : config(std::move(settings)) {
+    this->config.maxSize = qMax(1, this->config.maxSize);
+    this->config.minSize = qBound(0, this->config.minSize, this->config.maxSize);
+}
+
+QSqlConnectionPool::StatementMetrics QSqlConnectionPool::metricsOf(const QString &statement) {
+    Metrics &metrics = Metrics::instance();
+    const QString label = Metrics::label("statement", statement);
+    return {
+        metrics.histogram("jrpc_auth_sql_duration_seconds",
+                          "Execution time of SQL statements, including wait for connection.", label),
+        metrics.counter("jrpc_auth_sql_errors_total", "Failed SQL statements.", label),
+    };
+}
+
+QSqlConnectionPool::Connection QSqlConnectionPool::acquire() {
+    QThread *const thread = QThread::currentThread();
+    QElapsedTimer waited;
+    waited.start();
+
+    QMutexLocker locker(&this->mutex);
+    while (true) {
+        this->reapIdle();
+
+        // reuse idle connection of this thread
+        const auto idle = std::find_if(this->entries.begin(), this->entries.end(), [thread](const auto &entry) {
+            return entry->thread == thread && !entry->busy;
+        });
+        if (idle != this->entries.end()) {
+            Entry *entry = idle->get();
+            entry->busy = true;
+            const bool stale = entry->idleSince.hasExpired(this->config.validateInterval);
+            locker.unlock();
+
+            if (stale && !this->validate(entry) && !this->open(entry)) {
+                locker.relock();
+                this->removeEntry(entry);
+                return {};
+            }
+            return {this, entry};
+        }
+
+        // open new connection
+        if (static_cast<int>(this->entries.size()) < this->config.maxSize) {
+            static QAtomicInt counter;
+            auto created = std::make_unique<Entry>();
+            created->name = this->config.name + "/" + QString::number(counter.fetchAndAddRelaxed(1));
+            created->thread = thread;
+            created->busy = true;
+            Entry *entry = created.get();
+            this->entries.push_back(std::move(created));
+
+            if (!this->watchedThreads.contains(thread)) {
+                // `finished` is emitted from the finishing thread itself, so its connections are closed in place.
+                this->watchedThreads.insert(thread, QObject::connect(thread, &QThread::finished, [this, thread]() {
+                    this->closeThread(thread);
+                }));
+            }
+            locker.unlock();
+
+            {
+                QSqlDatabase db = QSqlDatabase::addDatabase(this->config.driver, entry->name);
+                DO_IF_NOT_EMPTY_AS_INT(this->config.port, db.setPort);
+                DO_IF_NOT_EMPTY(this->config.host, db.setHostName);
+                DO_IF_NOT_EMPTY(this->config.user, db.setUserName);
+                DO_IF_NOT_EMPTY(this->config.password, db.setPassword);
+                db.setDatabaseName(this->config.name);
+            }
+            if (!this->open(entry)) {
+                locker.relock();
+                this->removeEntry(entry);
+                return {};
+            }
+            return {this, entry};
+        }
+
+        // wait for released slot
+        const qint64 remaining = this->config.acquireTimeout - waited.elapsed();
+        bool woken = false;
+        if (remaining > 0) {
+            ++this->waiters;
+            woken = this->released.wait(&this->mutex, static_cast<unsigned long>(remaining));
+            --this->waiters;
+        }
+        if (!woken) {
+            qDebug() << "QSqlConnectionPool: no free connection in" << this->config.acquireTimeout << "ms";
+            return {};
+        }
+    }
+}
+
+int QSqlConnectionPool::size() const {
+    QMutexLocker locker(&this->mutex);
+    return static_cast<int>(this->entries.size());
+}
+
+const QSqlConnectionPool::Settings &QSqlConnectionPool::settings() const {
+    return this->config;
+}
+
+QSqlConnectionPool::~QSqlConnectionPool() {
+    QMutexLocker locker(&this->mutex);
+    for (const auto &connection: this->watchedThreads) {
+        QObject::disconnect(connection);
+    }
+    this->watchedThreads.clear();
+
+    // connections of other threads cannot be closed from here, they are released at process exit
+    QThread *const thread = QThread::currentThread();
+    for (size_t i = 0; i < this->entries.size();) {
+        if (this->entries[i]->thread == thread) {
+            this->removeEntry(this->entries[i].get());
+        } else {
+            ++i;
+        }
+    }
+}
+
+void QSqlConnectionPool::release(Entry *entry) {
+    QMutexLocker locker(&this->mutex);
+    if (this->waiters > 0 && static_cast<int>(this->entries.size()) >= this->config.maxSize) {
+        // waiting thread can't use connection of this one, so slot is freed for it (lease ends on its own thread)
+        this->removeEntry(entry);
+        return;
+    }
+    entry->busy = false;
+    entry->idleSince.start();
+    this->released.wakeAll();
+}
+
+void QSqlConnectionPool::reapIdle() {
+    QThread *const thread = QThread::currentThread();
+    for (size_t i = 0; i < this->entries.size() && static_cast<int>(this->entries.size()) > this->config.minSize;) {
+        Entry *entry = this->entries[i].get();
+        if (entry->thread == thread && !entry->busy && entry->idleSince.hasExpired(this->config.idleTimeout)) {
+            this->removeEntry(entry);
+        } else {
+            ++i;
+        }
+    }
+}
+
+void QSqlConnectionPool::closeThread(QThread *thread) {
+    QMutexLocker locker(&this->mutex);
+    for (size_t i = 0; i < this->entries.size();) {
+        if (this->entries[i]->thread == thread) {
+            this->removeEntry(this->entries[i].get());
+        } else {
+            ++i;
+        }
+    }
+    this->watchedThreads.remove(thread);
+}
+
+void QSqlConnectionPool::removeEntry(Entry *entry) {
+    const QString name = entry->name;
+    entry->statements.clear();
+    this->entries.erase(std::find_if(this->entries.begin(), this->entries.end(), [entry](const auto &item) {
+        return item.get() == entry;
+    }));
+    QSqlDatabase::removeDatabase(name);
+    this->released.wakeAll();
+}
+
+bool QSqlConnectionPool::open(Entry *entry) const {
+    entry->statements.clear();
+    QSqlDatabase db = QSqlDatabase::database(entry->name, false);
+    db.close();
+    if (!db.open()) {
+        qDebug() << "QSqlConnectionPool: failed to open connection:" << db.lastError().text();
+        return false;
+    }
+    return true;
+}
+
+bool QSqlConnectionPool::validate(Entry *entry) const {
+    QSqlQuery query(QSqlDatabase::database(entry->name, false));
+    if (!query.exec("SELECT 1")) {
+        qDebug() << "QSqlConnectionPool: connection" << entry->name << "is broken:" << query.lastError().text();
+        return false;
+    }
+    return true;
+}
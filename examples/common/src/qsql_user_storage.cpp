@@ -1,8 +1,11 @@
 #include <user_storage/qsql_user_storage.h>
+#include <metrics/tracer.h>
 #include <QtSql/qsqlquery.h>
 #include <QtSql/qsqldriver.h>
 #include <QtSql/qsqlerror.h>
-#include <QCryptographicHash>
+#include <QElapsedTimer>
+#include <QThread>
+#include <QTimer>
 #include <QVariant>
 #include <QDebug>
 
@@ -10,6 +13,9 @@
 #define DO_ELSE(x, y) else { y(x); }
 #define DO_IF_NOT_EMPTY_AS_INT(x, y) if (!x.isEmpty()) { y(x.toInt()); }
 
+/// @brief notifications arriving together are dispatched at once
+static constexpr int NOTIFY_BATCH_MS = 50;
+
 #define SET_FROM_CONFIG(var, config, option) \
     do { \
         QString str; \
@@ -39,112 +45,427 @@
         qDebug().noquote() << "QSqlUserStorage:" << option << "=" << var; \
     } while (false)
 
-const QCryptographicHash::Algorithm &getHashAlgorithm() {
-    const static QCryptographicHash::Algorithm algorithm = QCryptographicHash::Sha256; // TODO: move to config
-    return algorithm;
+/// @brief Default constructor
+QSqlUserStorage::QSqlUserStorage(IUserConfig *config) {
+    QSqlConnectionPool::Settings settings;
+    QString minSize;
+    QString maxSize;
+    QString idleTimeout;
+    QString acquireTimeout;
+    QString validateInterval;
+    QString salt;
+    QString passwordHash;
+    QString pbkdf2Iterations;
+    QString scryptN;
+    QString scryptR;
+    QString scryptP;
+    QString changeFeed;
+    QString changeChannel;
+    QString pollInterval;
+    QString changeRetention;
+
+    /// Compiler will optimise `if (config)` in release build.
+    SET_FROM_CONFIG(settings.host, config, "host");
+    SET_FROM_CONFIG(settings.port, config, "port");
+    SET_FROM_CONFIG(settings.user, config, "user");
+    SET_FROM_CONFIG_OR(this->schema, config, "schema", "public");
+    SET_FROM_CONFIG(settings.password, config, "password");
+    SET_FROM_CONFIG_OR(settings.driver, config, "driver", "qpsql");
+    SET_FROM_CONFIG_OR(settings.name, config, "name", "users");
+    SET_FROM_CONFIG_OR(salt, config, "salt", "SOME_PASSWORD_SALT");
+    SET_FROM_CONFIG_OR(passwordHash, config, "password_hash", "sha256");
+    SET_FROM_CONFIG_OR(pbkdf2Iterations, config, "pbkdf2_iterations", "100000");
+    SET_FROM_CONFIG_OR(scryptN, config, "scrypt_n", "32768");
+    SET_FROM_CONFIG_OR(scryptR, config, "scrypt_r", "8");
+    SET_FROM_CONFIG_OR(scryptP, config, "scrypt_p", "1");
+    SET_FROM_CONFIG_OR(minSize, config, "pool_min", QString::number(settings.minSize));
+    SET_FROM_CONFIG_OR(maxSize, config, "pool_max", QString::number(settings.maxSize));
+    SET_FROM_CONFIG_OR(idleTimeout, config, "pool_idle_timeout", QString::number(settings.idleTimeout));
+    SET_FROM_CONFIG_OR(acquireTimeout, config, "pool_acquire_timeout", QString::number(settings.acquireTimeout));
+    SET_FROM_CONFIG_OR(validateInterval, config, "pool_validate_interval",
+                       QString::number(settings.validateInterval));
+    SET_FROM_CONFIG_OR(changeFeed, config, "change_feed", "off");
+    SET_FROM_CONFIG_OR(changeChannel, config, "change_channel", "users_changed");
+    SET_FROM_CONFIG_OR(pollInterval, config, "change_poll_interval", "1000");
+    SET_FROM_CONFIG_OR(changeRetention, config, "change_retention", "3600000");
+
+    /// qpsql -> QPSQL
+    settings.driver = settings.driver.toUpper();
+    settings.minSize = minSize.toInt();
+    settings.maxSize = maxSize.toInt();
+    settings.idleTimeout = idleTimeout.toInt();
+    settings.acquireTimeout = acquireTimeout.toInt();
+    settings.validateInterval = validateInterval.toInt();
+
+    if (passwordHash == QLatin1String("pbkdf2")) {
+        this->hasher = PasswordHasher(PasswordHasher::Algorithm::Pbkdf2, salt, pbkdf2Iterations.toInt());
+    } else if (passwordHash == QLatin1String("scrypt")) {
+        this->hasher = PasswordHasher(PasswordHasher::Algorithm::Scrypt, salt, 0,
+                                      {scryptN.toULongLong(), scryptR.toULongLong(), scryptP.toULongLong()});
+    } else if (passwordHash == QLatin1String("sha256")) {
+        this->hasher = PasswordHasher(PasswordHasher::Algorithm::Sha256, salt);
+    } else {
+        throw std::runtime_error("Unknown password hash: " + passwordHash.toStdString());
+    }
+
+    this->pool = std::make_unique<QSqlConnectionPool>(std::move(settings));
+
+    /// Open connection of constructing thread right away, so invalid configuration is reported on start.
+    const auto connection = this->pool->acquire();
+    if (!connection) {
+        throw std::runtime_error("Failed to connect to user database");
+    }
+
+    /// Statement text is built once, connections prepare it once and reuse it.
+    const QString safeTable = connection.database().driver()->escapeIdentifier(this->schema + ".users",
+                                                                               QSqlDriver::TableName);
+    this->selectPasswordSql = "SELECT password FROM " + safeTable + " WHERE username = :username";
+    this->selectUsernamesSql = "SELECT username FROM " + safeTable;
+
+    if (changeFeed == QLatin1String("off")) {
+        return;
+    }
+    if (changeFeed != QLatin1String("notify") && changeFeed != QLatin1String("poll")
+        && changeFeed != QLatin1String("auto")) {
+        throw std::runtime_error("Unknown user change feed: " + changeFeed.toStdString());
+    }
+    const bool notifications = connection.database().driver()->hasFeature(QSqlDriver::EventNotifications);
+    if (changeFeed == QLatin1String("notify") || (changeFeed == QLatin1String("auto") && notifications)) {
+        if (!this->listen(changeChannel)) {
+            throw std::runtime_error("Failed to subscribe to user changes: " + changeChannel.toStdString());
+        }
+        return;
+    }
+
+    const QString changesTable = connection.database().driver()->escapeIdentifier(this->schema + ".user_changes",
+                                                                                  QSqlDriver::TableName);
+    if (connection.database().driverName() == QLatin1String("QSQLITE")) {
+        QSqlDatabase db = connection.database();
+        this->createChangeLog(db, changesTable);
+    }
+    this->selectChangesSql = "SELECT seq, username FROM " + changesTable + " WHERE seq > :seq ORDER BY seq";
+    this->deleteChangesSql = "DELETE FROM " + changesTable + " WHERE seq <= :seq";
+    this->pollInterval = qMax(1, pollInterval.toInt());
+    // a regular poll must never look like a gap, in which changes could be deleted unseen
+    this->changeRetention = qMax(10 * this->pollInterval, changeRetention.toInt());
+
+    // changes made before construction are skipped: nothing is cached and no session is open yet
+    QSqlQuery query(connection.database());
+    if (!query.exec("SELECT MAX(seq) FROM " + changesTable)) {
+        throw std::runtime_error("Failed to read user change log: " + query.lastError().text().toStdString());
+    }
+    const qint64 last = query.next() ? query.value(0).toLongLong() : 0;
+    this->poller.reset(QThread::create([this, last]() {
+        this->poll(last);
+    }));
+    this->poller->start();
 }
 
-static QString computePasswordHash(const QString &password, const QString &salt) {
-    const QCryptographicHash::Algorithm algorithm = getHashAlgorithm();
+QSqlUserStorage::~QSqlUserStorage() {
+    this->listenCheck.reset();
+    if (this->poller) {
+        {
+            QMutexLocker state(&this->stateMutex);
+            this->stopping = true;
+            this->wakeup.wakeAll();
+        }
+        this->poller->wait();
+    }
+    if (!this->listenConnection.isEmpty()) {
+        {
+            QSqlDatabase db = QSqlDatabase::database(this->listenConnection, false);
+            db.close();
+        }
+        QSqlDatabase::removeDatabase(this->listenConnection);
+    }
+}
 
-    if (QCryptographicHash::hashLength(algorithm) > 512) {
-        throw std::runtime_error("Hash length is too long");
+bool QSqlUserStorage::listen(const QString &channel) {
+    static QAtomicInt counter;
+    const auto &settings = this->pool->settings();
+    const QString name = "QSqlUserStorage/listen/" + QString::number(counter.fetchAndAddRelaxed(1));
+    {
+        QSqlDatabase db = QSqlDatabase::addDatabase(settings.driver, name);
+        DO_IF_NOT_EMPTY_AS_INT(settings.port, db.setPort);
+        DO_IF_NOT_EMPTY(settings.host, db.setHostName);
+        DO_IF_NOT_EMPTY(settings.user, db.setUserName);
+        DO_IF_NOT_EMPTY(settings.password, db.setPassword);
+        db.setDatabaseName(settings.name);
+        if (!db.open() || !db.driver()->subscribeToNotification(channel)) {
+            qDebug() << "QSqlUserStorage: failed to listen" << channel << ":" << db.lastError().text();
+            db.close();
+        } else {
+            this->listenConnection = name;
+        }
+    }
+    if (this->listenConnection.isEmpty()) {
+        QSqlDatabase::removeDatabase(name);
+        return false;
     }
 
-    QCryptographicHash hash(algorithm);
+    QSqlDriver *driver = QSqlDatabase::database(name, false).driver();
+    // notifications are delivered on the thread of constructor, payload is name of changed user
+    const auto notification = QOverload<const QString &, QSqlDriver::NotificationSource, const QVariant &>::of(
+        &QSqlDriver::notification);
+    QObject::connect(driver, notification, driver, [this, driver](const QString &, QSqlDriver::NotificationSource,
+                                                                  const QVariant &payload) {
+        const QString username = payload.toString();
+        if (username.isEmpty()) {
+            qDebug() << "QSqlUserStorage: change notification without user name is ignored";
+            return;
+        }
+        QMutexLocker locker(&this->listenersMutex);
+        if (this->notified.isEmpty()) {
+            QTimer::singleShot(NOTIFY_BATCH_MS, driver, [this]() {
+                QSet<QString> usernames;
+                {
+                    QMutexLocker locker(&this->listenersMutex);
+                    usernames.swap(this->notified);
+                }
+                this->dispatch(usernames);
+            });
+        }
+        this->notified.insert(username);
+    });
+    qDebug().noquote() << "QSqlUserStorage: listening to user changes on" << channel;
 
-    hash.addData(salt.toUtf8());
-    hash.addData(password.toUtf8());
+    // dropped connection doesn't report itself, so it is checked like idle pooled ones
+    this->listenCheck = std::make_unique<QTimer>();
+    QObject::connect(this->listenCheck.get(), &QTimer::timeout, this->listenCheck.get(), [this, channel]() {
+        this->checkListen(channel);
+    });
+    this->listenCheck->start(qMax(1, settings.validateInterval));
+    return true;
+}
 
-    return QString::fromUtf8(hash.result().toHex()); // max 1024 bytes
+void QSqlUserStorage::checkListen(const QString &channel) {
+    QSqlDatabase db = QSqlDatabase::database(this->listenConnection, false);
+    if (db.isOpen()) {
+        {
+            QSqlQuery query(db);
+            if (query.exec("SELECT 1")) {
+                return;
+            }
+            qDebug() << "QSqlUserStorage: listening connection is broken:" << query.lastError().text();
+        }
+        db.close();
+    }
+    // driver object is kept by close(), so connected notification handler keeps working after reopening
+    if (!db.open() || !db.driver()->subscribeToNotification(channel)) {
+        qDebug() << "QSqlUserStorage: failed to listen" << channel << ":" << db.lastError().text();
+        db.close();
+        return;
+    }
+    qDebug().noquote() << "QSqlUserStorage: listening to user changes on" << channel << "again";
+    // changes notified while connection was down are lost
+    this->dispatch({});
 }
 
-/// @brief Default constructor
-QSqlUserStorage::QSqlUserStorage(IUserConfig *config) {
-    QString host;
-    QString driver;
-    QString port;
-    QString name;
-    QString user;
-    QString password;
-    this->schema;
+void QSqlUserStorage::createChangeLog(QSqlDatabase &db, const QString &table) {
+    QSqlQuery query(db);
+    // triggers of SQLite can't name schema of table, so they are bound to "users" of the same database
+    const QStringList statements = {
+        "CREATE TABLE IF NOT EXISTS " + table
+        + " (seq INTEGER PRIMARY KEY AUTOINCREMENT, username VARCHAR(255) NOT NULL)",
+        "CREATE TRIGGER IF NOT EXISTS users_changed_insert AFTER INSERT ON users"
+        " BEGIN INSERT INTO user_changes (username) VALUES (NEW.username); END",
+        "CREATE TRIGGER IF NOT EXISTS users_changed_update AFTER UPDATE ON users"
+        " BEGIN INSERT INTO user_changes (username) VALUES (OLD.username); END",
+        "CREATE TRIGGER IF NOT EXISTS users_changed_delete AFTER DELETE ON users"
+        " BEGIN INSERT INTO user_changes (username) VALUES (OLD.username); END",
+    };
+    for (const auto &statement: statements) {
+        if (!query.exec(statement)) {
+            throw std::runtime_error("Failed to create user change log: " + query.lastError().text().toStdString());
+        }
+    }
+}
 
-    /// Compiler will optimise `if (config)` in release build.
-    SET_FROM_CONFIG(host, config, "host");
-    SET_FROM_CONFIG(port, config, "port");
-    SET_FROM_CONFIG(user, config, "user");
-    SET_FROM_CONFIG_OR(this->schema, config, "schema", "public");
-    SET_FROM_CONFIG(password, config, "password");
-    SET_FROM_CONFIG_OR(driver, config, "driver", "qpsql");
-    SET_FROM_CONFIG_OR(name, config, "name", "users");
-    SET_FROM_CONFIG_OR(this->salt, config, "salt", "SOME_PASSWORD_SALT");
+void QSqlUserStorage::poll(qint64 last) {
+    static const auto metrics = QSqlConnectionPool::metricsOf("select_user_changes");
+    static const auto deleteMetrics = QSqlConnectionPool::metricsOf("delete_user_changes");
 
-    /// qpsql -> QPSQL
-    driver = driver.toUpper();
+    // changes seen one retention period ago are deleted: every instance polling the table has seen them by then
+    qint64 seen = last;
+    QElapsedTimer pruned;
+    pruned.start();
+    QElapsedTimer polled;
+    polled.start();
 
-    this->db = QSqlDatabase::addDatabase(driver, name);
+    QMutexLocker state(&this->stateMutex);
+    while (!this->stopping) {
+        state.unlock();
 
-    DO_IF_NOT_EMPTY_AS_INT(port, this->db.setPort);
-    DO_IF_NOT_EMPTY(host, this->db.setHostName);
-    DO_IF_NOT_EMPTY(user, this->db.setUserName);
-    DO_IF_NOT_EMPTY(password, this->db.setPassword);
-    this->db.setDatabaseName(name);
+        QSet<QString> changed;
+        bool lost = false;
+        if (auto connection = this->pool->acquire()) {
+            bool selected = false;
+            {
+                const Metrics::Timer timer(metrics.duration);
+                if (QSqlQuery *query = connection.prepared(this->selectChangesSql)) {
+                    query->bindValue(":seq", last);
+                    if (query->exec()) {
+                        selected = true;
+                        while (query->next()) {
+                            last = qMax(last, query->value(0).toLongLong());
+                            changed.insert(query->value(1).toString());
+                        }
+                    } else {
+                        metrics.errors.add();
+                        qDebug() << "QSqlUserStorage: failed to poll user changes:" << query->lastError().text();
+                    }
+                    query->finish();
+                }
+            }
+            if (selected) {
+                // other instances may have deleted changes, that this one had no chance to read
+                lost = polled.hasExpired(this->changeRetention);
+                polled.restart();
+            }
+            if (selected && pruned.hasExpired(this->changeRetention)) {
+                const Metrics::Timer timer(deleteMetrics.duration);
+                if (QSqlQuery *query = connection.prepared(this->deleteChangesSql)) {
+                    query->bindValue(":seq", seen);
+                    if (!query->exec()) {
+                        deleteMetrics.errors.add();
+                        qDebug() << "QSqlUserStorage: failed to delete user changes:" << query->lastError().text();
+                    }
+                    query->finish();
+                }
+                seen = last;
+                pruned.restart();
+            }
+        }
+        if (lost) {
+            this->dispatch({});
+        } else if (!changed.isEmpty()) {
+            this->dispatch(changed);
+        }
 
-    if (!db.open()) {
-        throw std::runtime_error(this->db.lastError().text().toStdString());
+        state.relock();
+        if (!this->stopping) {
+            this->wakeup.wait(&this->stateMutex, this->pollInterval);
+        }
     }
 }
 
-std::optional<QString> QSqlUserStorage::authenticate(const QString &username, const QString &password) {
-    QSqlQuery query(this->db);
-    const QString hashed = computePasswordHash(password, this->salt);
-    const QString safeTable = this->db.driver()->escapeIdentifier(this->schema + ".users", QSqlDriver::TableName);
+void QSqlUserStorage::dispatch(const QSet<QString> &usernames) {
+    std::vector<UsersChanged> listeners;
+    {
+        QMutexLocker locker(&this->listenersMutex);
+        listeners = this->listeners;
+    }
+    if (usernames.isEmpty()) {
+        qDebug() << "QSqlUserStorage: changes are lost, all users may be changed";
+    } else {
+        qDebug() << "QSqlUserStorage:" << usernames.size() << "users are changed";
+    }
+    for (const auto &listener: listeners) {
+        listener(usernames);
+    }
+}
+
+bool QSqlUserStorage::onUsersChanged(UsersChanged listener) {
+    if (this->listenConnection.isEmpty() && !this->poller) {
+        return false;
+    }
+    QMutexLocker locker(&this->listenersMutex);
+    this->listeners.push_back(std::move(listener));
+    return true;
+}
 
-    query.prepare("SELECT password FROM " + safeTable + " WHERE username = :username");
+std::optional<QString> QSqlUserStorage::selectPassword(const QString &username) {
+    static const auto metrics = QSqlConnectionPool::metricsOf("select_password");
+    const Metrics::Timer timer(metrics.duration);
+    const Tracer::Span span("sql.select_password");
 
-    query.bindValue(":username", username);
+    auto connection = this->pool->acquire();
+    if (!connection) {
+        metrics.errors.add();
+        throw UserStorageUnavailable("User database is unavailable");
+    }
 
-    if (query.exec()) {
-        if (query.next()) {
-            if (query.value(0).toString() == hashed) {
-                return query.value(0).toString();
+    for (int attempt = 0; attempt < 2; ++attempt) {
+        QSqlQuery *query = connection.prepared(this->selectPasswordSql);
+        if (!query) {
+            if (!connection.reconnect()) {
+                break;
+            }
+            continue;
+        }
+
+        query->bindValue(":username", username);
+
+        if (query->exec()) {
+            std::optional<QString> password;
+            if (query->next()) {
+                password = query->value(0).toString();
             } else {
-                qDebug() << "Password does not match for user:" << username;
-                qDebug() << "Hash in the database:" << query.value(0).toString() << " Provided hash:" << hashed;
+                qDebug() << "User not found:" << username;
             }
-        } else {
-            qDebug() << "User not found:" << username;
+            query->finish();
+            return password;
+        }
+
+        const QSqlError error = query->lastError();
+        metrics.errors.add();
+        qDebug() << "Error executing request:" << error.text();
+        qDebug() << "Request completed:" << query->lastQuery();
+        qDebug() << "Associated values:" << query->boundValues();
+        query->finish();
+
+        if (error.type() != QSqlError::ConnectionError || !connection.reconnect()) {
+            break;
         }
-    } else {
-        qDebug() << "Error executing request:" << query.lastError().text();
     }
 
-    qDebug() << "Request completed:" << query.lastQuery();
-    qDebug() << "Associated values:" << query.boundValues();
+    return std::nullopt;
+}
+
+std::optional<QString> QSqlUserStorage::authenticate(const QString &username, const QString &password) {
+    // hash is computed for unknown users too, so response time doesn't reveal them
+    const QString hashed = this->hasher.hash(username, password);
+    const auto stored = this->selectPassword(username);
+
+    if (stored) {
+        if (PasswordHasher::equal(stored.value(), hashed)) {
+            return stored;
+        }
+        qDebug() << "Password does not match for user:" << username;
+    }
 
     return std::nullopt;
 }
 
 std::optional<QString> QSqlUserStorage::getUserVersion(const QString &username) {
-    QSqlQuery query(this->db);
-    const QString safeTable = this->db.driver()->escapeIdentifier(this->schema + ".users", QSqlDriver::TableName);
+    return this->selectPassword(username);
+}
 
-    query.prepare("SELECT password FROM " + safeTable + " WHERE username = :username");
+bool QSqlUserStorage::forEachUsername(const std::function<void(const QString &)> &callback) {
+    static const auto metrics = QSqlConnectionPool::metricsOf("select_usernames");
+    const Metrics::Timer timer(metrics.duration);
 
-    query.bindValue(":username", username);
+    auto connection = this->pool->acquire();
+    if (!connection) {
+        metrics.errors.add();
+        return false;
+    }
 
-    if (query.exec()) {
-        if (query.next()) {
-            return query.value(0).toString();
-        } else {
-            qDebug() << "User not found:" << username;
-        }
-    } else {
+    // rows are fetched one by one, whole table is never held in memory
+    QSqlQuery query(connection.database());
+    query.setForwardOnly(true);
+    if (!query.exec(this->selectUsernamesSql)) {
+        metrics.errors.add();
         qDebug() << "Error executing request:" << query.lastError().text();
+        return false;
     }
-
-    qDebug() << "Request completed:" << query.lastQuery();
-    qDebug() << "Associated values:" << query.boundValues();
-
-    return std::nullopt;
+    while (query.next()) {
+        callback(query.value(0).toString());
+    }
+    const bool ok = !query.lastError().isValid();
+    if (!ok) {
+        metrics.errors.add();
+        qDebug() << "Error reading user names:" << query.lastError().text();
+    }
+    return ok;
 }
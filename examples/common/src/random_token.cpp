@@ -0,0 +1,74 @@
+#include <auth_storage/random_token.h>
+#include <token/base64_url.h>
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#if defined(__linux__)
+#include <sys/random.h>
+#include <cerrno>
+#else
+#include <random>
+#endif
+
+/// @brief bytes drawn from OS by one system call: 170 identifiers
+static constexpr size_t BLOCK_SIZE = 4096;
+
+/// @brief fill buffer from OS generator, without buffering
+static void drawFromOs(unsigned char *data, size_t size) {
+#if defined(__linux__)
+    while (size > 0) {
+        // large requests may return less, or be interrupted by signal
+        const ssize_t drawn = getrandom(data, size, 0);
+        if (drawn < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw std::runtime_error("getrandom failed: " + std::string(std::strerror(errno)));
+        }
+        data += drawn;
+        size -= static_cast<size_t>(drawn);
+    }
+#else
+    /// random_device is backed by OS generator on supported platforms
+    thread_local std::random_device device;
+    while (size > 0) {
+        const unsigned int value = device();
+        const size_t chunk = std::min(size, sizeof(value));
+        std::memcpy(data, &value, chunk);
+        data += chunk;
+        size -= chunk;
+    }
+#endif
+}
+
+void randomBytes(void *data, const size_t size) {
+    /// One buffer per thread, so generation doesn't need a lock.
+    /// Buffer is not reset on fork(): the service doesn't fork after start.
+    thread_local struct {
+        unsigned char bytes[BLOCK_SIZE];
+        size_t next = BLOCK_SIZE;
+    } block;
+
+    auto *out = static_cast<unsigned char *>(data);
+    if (size > BLOCK_SIZE) {
+        drawFromOs(out, size);
+        return;
+    }
+    if (BLOCK_SIZE - block.next < size) {
+        drawFromOs(block.bytes, BLOCK_SIZE);
+        block.next = 0;
+    }
+    std::memcpy(out, block.bytes + block.next, size);
+    // bytes are given out once, used ones aren't kept in memory
+    std::memset(block.bytes + block.next, 0, size);
+    block.next += size;
+}
+
+QString randomToken() {
+    unsigned char bytes[RANDOM_TOKEN_BYTES];
+    randomBytes(bytes, sizeof(bytes));
+    QString token(RANDOM_TOKEN_LENGTH, Qt::Uninitialized);
+    base64UrlEncode(bytes, sizeof(bytes), reinterpret_cast<char16_t *>(token.data()));
+    return token;
+}
@@ -0,0 +1,50 @@
+#include <service/rate_limiter.h>
+#include <QMutexLocker>
+#include <chrono>
+
+static constexpr size_t SHARDS = 16;
+
+RateLimiter::RateLimiter(const double rate, const double burst, const size_t capacity)
+    : rate(rate), burst(qMax(1.0, burst)), shardCapacity(qMax<size_t>(1, capacity / SHARDS)) {
+    this->shards.reserve(SHARDS);
+    for (size_t i = 0; i < SHARDS; ++i) {
+        this->shards.push_back(std::make_unique<Shard>());
+    }
+}
+
+bool RateLimiter::tryAcquire(const QString &key) {
+    const auto now = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+    return this->tryAcquire(key, now);
+}
+
+bool RateLimiter::tryAcquire(const QString &key, const qint64 now) {
+    Shard &shard = *this->shards[qHash(key) % SHARDS];
+    QMutexLocker locker(&shard.mutex);
+
+    auto it = shard.index.find(key);
+    if (it == shard.index.end()) {
+        if (shard.buckets.size() >= this->shardCapacity) {
+            shard.index.remove(shard.buckets.back().key);
+            shard.buckets.pop_back();
+        }
+        shard.buckets.push_front({key, this->burst, now});
+        it = shard.index.insert(key, shard.buckets.begin());
+    } else {
+        shard.buckets.splice(shard.buckets.begin(), shard.buckets, it.value());
+    }
+
+    Bucket &bucket = *it.value();
+    bucket.tokens = qMin(this->burst, bucket.tokens + static_cast<double>(now - bucket.updated) * this->rate / 1000.0);
+    bucket.updated = now;
+    if (bucket.tokens < 1.0) {
+        this->rejectedCount.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    bucket.tokens -= 1.0;
+    return true;
+}
+
+quint64 RateLimiter::rejected() const {
+    return this->rejectedCount.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,117 @@
+#include <service/request_executor.h>
+#include <QRunnable>
+#include <QDebug>
+#include <chrono>
+
+namespace {
+    class FunctionRunnable : public QRunnable {
+        std::function<void()> job;
+
+    public:
+        explicit FunctionRunnable(std::function<void()> job) : job(std::move(job)) {
+        }
+
+        void run() override {
+            this->job();
+        }
+    };
+
+    quint64 microsecondsSince(const std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    void updateMax(std::atomic<quint64> &max, const quint64 value) {
+        quint64 current = max.load(std::memory_order_relaxed);
+        while (value > current && !max.compare_exchange_weak(current, value, std::memory_order_relaxed)) {
+        }
+    }
+}
+
+RequestExecutor::RequestExecutor(const int threads, const int capacity, const QString &name)
+    : capacity(qMax(0, capacity)) {
+    this->pool.setMaxThreadCount(qMax(1, threads));
+    this->pool.setExpiryTimeout(-1);
+    qDebug().noquote() << "RequestExecutor: threads =" << this->pool.maxThreadCount() << "capacity ="
+            << (this->capacity > 0 ? QString::number(this->capacity) : "unbounded");
+
+    if (name.isEmpty()) {
+        return;
+    }
+    Metrics &metrics = Metrics::instance();
+    const QString label = Metrics::label("executor", name);
+    this->pendingGauge = metrics.gauge("jrpc_auth_executor_pending", "Jobs queued or running.", label, [this]() {
+        return static_cast<double>(this->pending.load(std::memory_order_relaxed));
+    });
+    this->completedMetric = &metrics.counter("jrpc_auth_executor_completed_total", "Finished jobs.", label);
+    this->rejectedMetric = &metrics.counter("jrpc_auth_executor_rejected_total",
+                                            "Jobs rejected because executor was full.", label);
+    this->waitMetric = &metrics.counter("jrpc_auth_executor_wait_seconds_total", "Total time jobs spent in queue.",
+                                        label, 1e-6);
+    this->runMetric = &metrics.counter("jrpc_auth_executor_run_seconds_total", "Total time of job execution.",
+                                       label, 1e-6);
+}
+
+void RequestExecutor::start(std::function<void()> job) {
+    const auto queued = std::chrono::steady_clock::now();
+    this->pool.start(new FunctionRunnable([this, queued, job = std::move(job)]() {
+        const quint64 wait = microsecondsSince(queued);
+        const auto started = std::chrono::steady_clock::now();
+        job();
+        const quint64 run = microsecondsSince(started);
+
+        this->waitTotal.fetch_add(wait, std::memory_order_relaxed);
+        this->runTotal.fetch_add(run, std::memory_order_relaxed);
+        updateMax(this->waitMax, wait);
+        updateMax(this->runMax, run);
+        this->completed.fetch_add(1, std::memory_order_relaxed);
+        if (this->completedMetric) {
+            this->completedMetric->add();
+            this->waitMetric->add(wait);
+            this->runMetric->add(run);
+        }
+        this->pending.fetch_sub(1, std::memory_order_relaxed);
+    }));
+}
+
+void RequestExecutor::post(std::function<void()> job) {
+    this->pending.fetch_add(1, std::memory_order_relaxed);
+    this->start(std::move(job));
+}
+
+bool RequestExecutor::tryPost(std::function<void()> job) {
+    if (this->pending.fetch_add(1, std::memory_order_relaxed) >= this->capacity && this->capacity > 0) {
+        this->pending.fetch_sub(1, std::memory_order_relaxed);
+        this->rejected.fetch_add(1, std::memory_order_relaxed);
+        if (this->rejectedMetric) {
+            this->rejectedMetric->add();
+        }
+        return false;
+    }
+    this->start(std::move(job));
+    return true;
+}
+
+int RequestExecutor::threadCount() const {
+    return this->pool.maxThreadCount();
+}
+
+RequestExecutor::Stats RequestExecutor::stats() const {
+    Stats stats;
+    stats.completed = this->completed.load(std::memory_order_relaxed);
+    stats.rejected = this->rejected.load(std::memory_order_relaxed);
+    stats.pending = this->pending.load(std::memory_order_relaxed);
+    stats.waitTotal = this->waitTotal.load(std::memory_order_relaxed);
+    stats.waitMax = this->waitMax.load(std::memory_order_relaxed);
+    stats.runTotal = this->runTotal.load(std::memory_order_relaxed);
+    stats.runMax = this->runMax.load(std::memory_order_relaxed);
+    return stats;
+}
+
+void RequestExecutor::wait() {
+    this->pool.waitForDone();
+}
+
+RequestExecutor::~RequestExecutor() {
+    this->pendingGauge.reset();
+    this->pool.waitForDone();
+}
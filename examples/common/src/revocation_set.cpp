@@ -0,0 +1,70 @@
+#include <auth_storage/revocation_set.h>
+#include <QReadLocker>
+#include <QWriteLocker>
+
+/// @brief how often expired revocations are purged
+static constexpr qint64 PURGE_INTERVAL_MS = 30000;
+
+static qint64 toMs(const std::chrono::system_clock::time_point &time) {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(time.time_since_epoch()).count();
+}
+
+RevocationSet::RevocationSet(const size_t capacity) : filter(capacity), capacity(capacity) {
+}
+
+void RevocationSet::revoke(const QString &jti, const std::chrono::system_clock::time_point expiration) {
+    const qint64 now = toMs(std::chrono::system_clock::now());
+    const qint64 expiresAt = toMs(expiration);
+    if (expiresAt <= now) {
+        return;
+    }
+
+    const QByteArray key = jti.toUtf8();
+    QWriteLocker locker(&this->lock);
+    if (now >= this->nextPurge || this->filter.size() >= this->capacity) {
+        this->purge(now);
+    }
+
+    auto it = this->revoked.find(key);
+    if (it == this->revoked.end()) {
+        this->revoked.insert(key, expiresAt);
+        this->filter.add(key);
+    } else if (it.value() < expiresAt) {
+        it.value() = expiresAt;
+    }
+}
+
+bool RevocationSet::isRevoked(const QString &jti) const {
+    const QByteArray key = jti.toUtf8();
+    QReadLocker locker(&this->lock);
+    if (!this->filter.mightContain(key)) {
+        return false;
+    }
+    const auto it = this->revoked.constFind(key);
+    return it != this->revoked.constEnd() && it.value() > toMs(std::chrono::system_clock::now());
+}
+
+int RevocationSet::size() const {
+    QReadLocker locker(&this->lock);
+    return this->revoked.size();
+}
+
+void RevocationSet::purge(const qint64 now) {
+    for (auto it = this->revoked.begin(); it != this->revoked.end();) {
+        if (it.value() <= now) {
+            it = this->revoked.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    // grow filter if live revocations don't fit into it
+    while (static_cast<size_t>(this->revoked.size()) * 2 > this->capacity) {
+        this->capacity *= 2;
+    }
+    this->filter = BloomFilter(this->capacity);
+    for (auto it = this->revoked.constBegin(); it != this->revoked.constEnd(); ++it) {
+        this->filter.add(it.key());
+    }
+    this->nextPurge = now + PURGE_INTERVAL_MS;
+}
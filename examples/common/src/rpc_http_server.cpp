@@ -0,0 +1,483 @@
+#include <service/rpc_http_server.h>
+#include <metrics/tracer.h>
+#include <QDebug>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QPointer>
+#include <QTcpSocket>
+#include <atomic>
+#include <vector>
+
+/// @brief maximum size of request headers
+static constexpr int MAX_HEADER_SIZE = 64 * 1024;
+/// @brief maximum size of request body
+static constexpr qint64 MAX_BODY_SIZE = 4 * 1024 * 1024;
+/// @brief maximum number of entries in batch request, the same as number of tokens in batch methods
+static constexpr int MAX_BATCH = 1000;
+
+/// @brief state of chunked body in buffer
+enum class Chunked {
+    Complete,
+    Incomplete,
+    Invalid,
+    TooLarge,
+};
+
+/// @brief decode chunked body, that starts at `start` of buffer
+/// @param buffer received data
+/// @param start offset of body
+/// @param body decoded body
+/// @param end offset after body (and trailers), if complete
+static Chunked decodeChunked(const QByteArray &buffer, int start, QByteArray &body, int &end) {
+    body.clear();
+    int position = start;
+    while (true) {
+        const int lineEnd = buffer.indexOf("\r\n", position);
+        if (lineEnd < 0) {
+            return buffer.size() - position > 1024 ? Chunked::Invalid : Chunked::Incomplete;
+        }
+        // chunk extensions after ';' are ignored
+        QByteArray sizeLine = buffer.mid(position, lineEnd - position);
+        const int extension = sizeLine.indexOf(';');
+        if (extension >= 0) {
+            sizeLine.truncate(extension);
+        }
+        bool ok = false;
+        const qint64 size = sizeLine.trimmed().toLongLong(&ok, 16);
+        if (!ok || size < 0) {
+            return Chunked::Invalid;
+        }
+        if (body.size() + size > MAX_BODY_SIZE) {
+            return Chunked::TooLarge;
+        }
+        position = lineEnd + 2;
+
+        if (size == 0) {
+            // trailers, up to empty line
+            while (true) {
+                const int trailerEnd = buffer.indexOf("\r\n", position);
+                if (trailerEnd < 0) {
+                    return Chunked::Incomplete;
+                }
+                if (trailerEnd - position > MAX_HEADER_SIZE) {
+                    return Chunked::Invalid;
+                }
+                const bool last = trailerEnd == position;
+                position = trailerEnd + 2;
+                if (last) {
+                    end = position;
+                    return Chunked::Complete;
+                }
+            }
+        }
+
+        if (buffer.size() < position + size + 2) {
+            return Chunked::Incomplete;
+        }
+        if (buffer.mid(position + static_cast<int>(size), 2) != "\r\n") {
+            return Chunked::Invalid;
+        }
+        body += buffer.mid(position, static_cast<int>(size));
+        position += static_cast<int>(size) + 2;
+    }
+}
+
+struct RpcHttpServer::Batch {
+    QPointer<QTcpSocket> socket;
+    bool keepAlive = true;
+    /// @brief request was array, so response is array too
+    bool array = false;
+    std::vector<QJsonRpcMessage> requests;
+    /// @brief responses in order of requests, empty for notifications
+    std::vector<QJsonObject> responses;
+    std::atomic<int> remaining{0};
+    /// @brief executed on worker threads, so connection is resumed after response
+    bool deferred = false;
+};
+
+/// @brief error response, for messages that cannot create it themselves
+static QJsonObject errorObject(const int code, const QString &message) {
+    return QJsonObject{
+        {"jsonrpc", "2.0"},
+        {"id", QJsonValue()},
+        {"error", QJsonObject{{"code", code}, {"message", message}, {"data", QJsonValue()}}},
+    };
+}
+
+RpcHttpServer::RpcHttpServer(const int threads, QObject *parent) : QTcpServer(parent) {
+    if (threads > 0) {
+        this->executor = std::make_unique<RequestExecutor>(threads, 0, "workers");
+    }
+}
+
+void RpcHttpServer::addMethod(const QString &name, const QStringList &params, Method method,
+                              RequestExecutor *executor) {
+    Metrics &metrics = Metrics::instance();
+    const QString label = Metrics::label("method", name);
+    Entry entry{std::move(method), params, executor, {}};
+    entry.duration = &metrics.histogram("jrpc_auth_rpc_duration_seconds", "Execution time of JSON-RPC calls.", label);
+    entry.errors = &metrics.counter("jrpc_auth_rpc_errors_total", "JSON-RPC calls answered with error.", label);
+    entry.rejected = &metrics.counter("jrpc_auth_rpc_rejected_total",
+                                      "JSON-RPC calls rejected before execution (rate limit, full executor).", label);
+    this->methods.insert(name, std::move(entry));
+}
+
+void RpcHttpServer::setGuard(const QString &name, Guard guard) {
+    const auto it = this->methods.find(name);
+    if (it != this->methods.end()) {
+        it->guard = std::move(guard);
+    }
+}
+
+void RpcHttpServer::setForwardedHeader(const QString &header) {
+    this->forwardedHeader = header.trimmed().toLower().toLatin1();
+}
+
+void RpcHttpServer::incomingConnection(const qintptr socketDescriptor) {
+    auto *socket = new QTcpSocket(this);
+    if (!socket->setSocketDescriptor(socketDescriptor)) {
+        qDebug() << "RpcHttpServer: failed to accept connection:" << socket->errorString();
+        delete socket;
+        return;
+    }
+
+    // socket stops reading from network when its buffer is full, that bounds memory of busy connection
+    socket->setReadBufferSize(MAX_HEADER_SIZE + MAX_BODY_SIZE);
+    this->connections.insert(socket, {});
+    connect(socket, &QTcpSocket::readyRead, this, [this, socket]() {
+        const auto it = this->connections.find(socket);
+        // data arrived while request is executed is read after response
+        if (it == this->connections.end() || it->busy) {
+            return;
+        }
+        it->buffer += socket->readAll();
+        this->process(socket);
+    });
+    connect(socket, &QTcpSocket::disconnected, this, [this, socket]() {
+        this->connections.remove(socket);
+        socket->deleteLater();
+    });
+}
+
+void RpcHttpServer::process(QTcpSocket *socket) {
+    while (true) {
+        // connection may be closed by previous response
+        const auto it = this->connections.find(socket);
+        if (it == this->connections.end() || it->busy) {
+            return;
+        }
+        QByteArray &buffer = it->buffer;
+
+        const int headerEnd = buffer.indexOf("\r\n\r\n");
+        if (headerEnd < 0) {
+            if (buffer.size() > MAX_HEADER_SIZE) {
+                reply(socket, 431, "Request Header Fields Too Large", {}, false);
+            }
+            return;
+        }
+
+        const QList<QByteArray> lines = buffer.left(headerEnd).split('\n');
+        const QList<QByteArray> requestLine = lines.first().trimmed().split(' ');
+        if (requestLine.size() != 3) {
+            reply(socket, 400, "Bad Request", {}, false);
+            return;
+        }
+
+        bool keepAlive = requestLine[2] == "HTTP/1.1";
+        qint64 length = -1;
+        bool chunked = false;
+        bool expectContinue = false;
+        QHostAddress peer = socket->peerAddress();
+        for (int i = 1; i < lines.size(); ++i) {
+            const QByteArray &line = lines[i];
+            const int colon = line.indexOf(':');
+            if (colon < 0) {
+                continue;
+            }
+            const QByteArray header = line.left(colon).trimmed().toLower();
+            const QByteArray value = line.mid(colon + 1).trimmed().toLower();
+            if (header == "content-length") {
+                bool ok = false;
+                length = value.toLongLong(&ok);
+                if (!ok || length < 0) {
+                    reply(socket, 400, "Bad Request", {}, false);
+                    return;
+                }
+            } else if (header == "connection") {
+                keepAlive = value == "keep-alive" || (keepAlive && value != "close");
+            } else if (header == "transfer-encoding") {
+                if (value != "chunked") {
+                    reply(socket, 501, "Not Implemented", {}, false);
+                    return;
+                }
+                chunked = true;
+            } else if (header == "expect") {
+                if (value != "100-continue") {
+                    reply(socket, 417, "Expectation Failed", {}, false);
+                    return;
+                }
+                expectContinue = true;
+            } else if (!this->forwardedHeader.isEmpty() && header == this->forwardedHeader) {
+                // earlier addresses are given by client itself, so they aren't trusted
+                const QHostAddress forwarded(QString::fromLatin1(value.mid(value.lastIndexOf(',') + 1).trimmed()));
+                if (!forwarded.isNull()) {
+                    peer = forwarded;
+                }
+            }
+        }
+        if (length > MAX_BODY_SIZE) {
+            reply(socket, 413, "Payload Too Large", {}, false);
+            return;
+        }
+        const bool post = requestLine[0] == "POST";
+        if (chunked) {
+            // length is ignored, if both are given
+            length = -1;
+        } else if (length < 0) {
+            if (post) {
+                reply(socket, 411, "Length Required", {}, false);
+                return;
+            }
+            length = 0;
+        }
+
+        const int bodyStart = headerEnd + 4;
+        QByteArray body;
+        int requestEnd = bodyStart + static_cast<int>(qMax<qint64>(length, 0));
+        const Chunked state = chunked ? decodeChunked(buffer, bodyStart, body, requestEnd) : Chunked::Complete;
+        if (state == Chunked::Invalid) {
+            reply(socket, 400, "Bad Request", {}, false);
+            return;
+        }
+        if (state == Chunked::TooLarge) {
+            reply(socket, 413, "Payload Too Large", {}, false);
+            return;
+        }
+        if (state == Chunked::Incomplete || buffer.size() < requestEnd) {
+            // client waits for permission to send body
+            if (expectContinue && !it->continued) {
+                it->continued = true;
+                socket->write("HTTP/1.1 100 Continue\r\n\r\n");
+            }
+            return;
+        }
+        if (!chunked) {
+            body = buffer.mid(bodyStart, static_cast<int>(length));
+        }
+        buffer.remove(0, requestEnd);
+        it->continued = false;
+
+        if (!post) {
+            reply(socket, 405, "Method Not Allowed", {}, keepAlive);
+            continue;
+        }
+
+        it->busy = true;
+        this->dispatch(socket, body, keepAlive, peer);
+    }
+}
+
+void RpcHttpServer::dispatch(QTcpSocket *socket, const QByteArray &body, const bool keepAlive,
+                             const QHostAddress &peer) {
+    auto batch = std::make_shared<Batch>();
+    batch->socket = socket;
+    batch->keepAlive = keepAlive;
+
+    QJsonParseError error{};
+    const QJsonDocument document = QJsonDocument::fromJson(body, &error);
+    if (error.error != QJsonParseError::NoError || (!document.isArray() && !document.isObject())) {
+        batch->responses.push_back(errorObject(QJsonRpc::ParseError, "Parse error"));
+    } else if (document.isArray() && document.array().isEmpty()) {
+        batch->responses.push_back(errorObject(QJsonRpc::InvalidRequest, "Invalid request"));
+    } else if (document.isArray() && document.array().size() > MAX_BATCH) {
+        batch->responses.push_back(errorObject(QJsonRpc::InvalidRequest, "Too many requests in batch"));
+    } else {
+        batch->array = document.isArray();
+        const QJsonArray entries = batch->array ? document.array() : QJsonArray{document.object()};
+        for (const auto &entry: entries) {
+            batch->requests.push_back(QJsonRpcMessage::fromObject(entry.toObject()));
+        }
+        batch->responses.resize(batch->requests.size());
+    }
+
+    // one extra count is held by this function, so batch can't finish while jobs are posted
+    batch->remaining = static_cast<int>(batch->requests.size()) + 1;
+    for (size_t i = 0; i < batch->requests.size(); ++i) {
+        const QJsonRpcMessage &request = batch->requests[i];
+        if (!this->admit(request, peer)) {
+            this->reject(request);
+            batch->responses[i] = request.createErrorResponse(QJsonRpc::InternalError, "Too many requests").toObject();
+            batch->remaining.fetch_sub(1, std::memory_order_acq_rel);
+            continue;
+        }
+
+        RequestExecutor *executor = this->executorOf(request);
+        if (!executor) {
+            batch->responses[i] = this->call(request).toObject();
+            batch->remaining.fetch_sub(1, std::memory_order_acq_rel);
+            continue;
+        }
+
+        const auto job = [this, batch, i]() {
+            batch->responses[i] = this->call(batch->requests[i]).toObject();
+            if (batch->remaining.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                batch->deferred = true;
+                // socket belongs to I/O thread, so respond from there
+                QMetaObject::invokeMethod(this, [this, batch]() {
+                    this->finish(batch);
+                }, Qt::QueuedConnection);
+            }
+        };
+        // server workers are unbounded, so only dedicated executor may reject
+        if (!executor->tryPost(job)) {
+            this->reject(request);
+            batch->responses[i] = request.createErrorResponse(QJsonRpc::InternalError, "Server is busy").toObject();
+            batch->remaining.fetch_sub(1, std::memory_order_acq_rel);
+        }
+    }
+
+    if (batch->remaining.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        this->finish(batch);
+    }
+}
+
+void RpcHttpServer::reject(const QJsonRpcMessage &request) const {
+    const auto it = this->methods.constFind(request.method());
+    if (it != this->methods.constEnd()) {
+        it->rejected->add();
+    }
+}
+
+RequestExecutor *RpcHttpServer::executorOf(const QJsonRpcMessage &request) const {
+    const auto it = this->methods.constFind(request.method());
+    // unknown method is answered with error in place
+    if (it == this->methods.constEnd()) {
+        return nullptr;
+    }
+    return it->executor ? it->executor : this->executor.get();
+}
+
+std::optional<QJsonArray> RpcHttpServer::paramsOf(const Entry &entry, const QJsonRpcMessage &request) {
+    QJsonArray params;
+    const QJsonValue given = request.params();
+    if (given.isArray()) {
+        params = given.toArray();
+    } else if (given.isObject()) {
+        const QJsonObject named = given.toObject();
+        for (const auto &name: entry.params) {
+            if (!named.contains(name)) {
+                break;
+            }
+            params.append(named.value(name));
+        }
+    }
+    if (params.size() != entry.params.size()) {
+        return std::nullopt;
+    }
+    return params;
+}
+
+bool RpcHttpServer::admit(const QJsonRpcMessage &request, const QHostAddress &peer) const {
+    const auto it = this->methods.constFind(request.method());
+    if (it == this->methods.constEnd() || !it->guard) {
+        return true;
+    }
+    // invalid params are reported by call
+    const auto params = paramsOf(it.value(), request);
+    return !params || it->guard(params.value(), peer);
+}
+
+QJsonRpcMessage RpcHttpServer::call(const QJsonRpcMessage &request) const {
+    if (request.type() != QJsonRpcMessage::Request && request.type() != QJsonRpcMessage::Notification) {
+        return QJsonRpcMessage::fromObject(errorObject(QJsonRpc::InvalidRequest, "Invalid request"));
+    }
+
+    const auto it = this->methods.constFind(request.method());
+    if (it == this->methods.constEnd()) {
+        return request.createErrorResponse(QJsonRpc::MethodNotFound, "Method not found");
+    }
+
+    const auto params = paramsOf(it.value(), request);
+    if (!params) {
+        return request.createErrorResponse(QJsonRpc::InvalidParams, "Invalid params");
+    }
+
+    const Metrics::Timer timer(*it->duration);
+    const Tracer::Request trace(request.method());
+    try {
+        QJsonRpcMessage response = it->method(request, params.value());
+        if (response.type() == QJsonRpcMessage::Error) {
+            it->errors->add();
+        }
+        return response;
+    } catch (const std::exception &e) {
+        it->errors->add();
+        qDebug() << "RpcHttpServer:" << request.method() << "failed:" << e.what();
+        return request.createErrorResponse(QJsonRpc::InternalError, "Internal error");
+    }
+}
+
+void RpcHttpServer::finish(const std::shared_ptr<Batch> &batch) {
+    QTcpSocket *socket = batch->socket.data();
+    const auto it = this->connections.find(socket);
+    if (!socket || it == this->connections.end()) {
+        return;
+    }
+    it->busy = false;
+
+    QJsonArray responses;
+    for (size_t i = 0; i < batch->responses.size(); ++i) {
+        // notifications have no response
+        if (i < batch->requests.size() && batch->requests[i].type() == QJsonRpcMessage::Notification) {
+            continue;
+        }
+        responses.append(batch->responses[i]);
+    }
+
+    if (responses.isEmpty()) {
+        reply(socket, 204, "No Content", {}, batch->keepAlive);
+    } else if (batch->array) {
+        reply(socket, 200, "OK", QJsonDocument(responses).toJson(QJsonDocument::Compact), batch->keepAlive);
+    } else {
+        reply(socket, 200, "OK", QJsonDocument(responses.first().toObject()).toJson(QJsonDocument::Compact),
+              batch->keepAlive);
+    }
+
+    // requests, that arrived while this one was executed
+    if (batch->deferred) {
+        // connection may be closed by response
+        const auto current = this->connections.find(socket);
+        if (current != this->connections.end()) {
+            current->buffer += socket->readAll();
+        }
+        this->process(socket);
+    }
+}
+
+void RpcHttpServer::reply(QTcpSocket *socket, const int status, const QByteArray &reason, const QByteArray &body,
+                          const bool keepAlive) {
+    QByteArray response = "HTTP/1.1 " + QByteArray::number(status) + ' ' + reason + "\r\n";
+    if (status != 204) {
+        if (!body.isEmpty()) {
+            response += "Content-Type: application/json\r\n";
+        }
+        response += "Content-Length: " + QByteArray::number(body.size()) + "\r\n";
+    }
+    response += keepAlive ? "Connection: keep-alive\r\n\r\n" : "Connection: close\r\n\r\n";
+    response += body;
+
+    socket->write(response);
+    if (!keepAlive) {
+        socket->disconnectFromHost();
+    }
+}
+
+RpcHttpServer::~RpcHttpServer() {
+    // calls reference methods of this server
+    this->executor.reset();
+    for (const auto &entry: this->methods) {
+        if (entry.executor) {
+            entry.executor->wait();
+        }
+    }
+}
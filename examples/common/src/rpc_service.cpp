@@ -0,0 +1,25 @@
+#include <service/rpc_service.h>
+#include <user_storage/iuser_storage.h>
+#include <QDebug>
+
+RpcService::RpcService(QObject *parent) : QObject(parent) {
+}
+
+QJsonRpcMessage RpcService::callHandler(const Handler &handler, const QJsonRpcMessage &request) {
+    try {
+        return handler(request);
+    } catch (const UserStorageUnavailable &e) {
+        qDebug() << "User storage is unavailable:" << e.what();
+        return request.createErrorResponse(QJsonRpc::InternalError, "User storage is unavailable");
+    }
+}
+
+void RpcService::addMethod(RpcHttpServer *server, const QString &name, const QStringList &params, Method method,
+                           RequestExecutor *executor) {
+    server->addMethod(name, params, [method = std::move(method)](const QJsonRpcMessage &request,
+                                                                 const QJsonArray &values) {
+        return callHandler([&method, &values](const QJsonRpcMessage &message) {
+            return method(message, values);
+        }, request);
+    }, executor);
+}
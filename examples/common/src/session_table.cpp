@@ -0,0 +1,119 @@
+#include <auth_storage/session_table.h>
+#include <QDateTime>
+
+SessionTable::SessionTable(const int maxSessions)
+    : wheel(QDateTime::currentMSecsSinceEpoch()), maxSessions(qMax(0, maxSessions)) {
+}
+
+bool SessionTable::contains(const QString &key) const {
+    return this->sessions.contains(key);
+}
+
+void SessionTable::insert(const QString &key, const QString &username, const QString &userVersion,
+                          const qint64 deadline) {
+    const quint64 sequence = this->nextSequence++;
+    this->sessions.insert(key, {username, userVersion, deadline, sequence});
+    if (deadline > 0) {
+        this->wheel.schedule(key, deadline);
+    }
+    if (this->maxSessions > 0) {
+        this->order.emplace_back(key, sequence);
+        this->evict();
+    }
+    this->compact();
+}
+
+std::optional<QPair<QString, QString> > SessionTable::get(const QString &key, const qint64 now) const {
+    const auto it = this->sessions.constFind(key);
+    if (it == this->sessions.constEnd() || (it->deadline > 0 && it->deadline <= now)) {
+        return std::nullopt;
+    }
+    return QPair<QString, QString>{it->username, it->userVersion};
+}
+
+bool SessionTable::remove(const QString &key, const qint64 now) {
+    const auto it = this->sessions.find(key);
+    if (it == this->sessions.end()) {
+        return false;
+    }
+    const bool alive = it->deadline == 0 || it->deadline > now;
+    this->sessions.erase(it);
+    this->compact();
+    return alive;
+}
+
+QStringList SessionTable::removeUsers(const QSet<QString> &usernames, const qint64 now) {
+    QStringList removed;
+    for (auto it = this->sessions.begin(); it != this->sessions.end();) {
+        if (!usernames.contains(it->username)) {
+            ++it;
+            continue;
+        }
+        if (it->deadline == 0 || it->deadline > now) {
+            removed.append(it.key());
+        }
+        it = this->sessions.erase(it);
+    }
+    this->compact();
+    return removed;
+}
+
+void SessionTable::expire(const qint64 now) {
+    for (const auto &key: this->wheel.advance(now)) {
+        // key may be removed already or reused by newer session
+        const auto it = this->sessions.find(key);
+        if (it != this->sessions.end() && it->deadline > 0 && it->deadline <= now) {
+            this->sessions.erase(it);
+        }
+    }
+}
+
+int SessionTable::size() const {
+    return this->sessions.size();
+}
+
+void SessionTable::forEach(const qint64 now,
+                           const std::function<void(const QString &key, const QString &username,
+                                                    const QString &userVersion, qint64 deadline)> &callback) const {
+    for (auto it = this->sessions.constBegin(); it != this->sessions.constEnd(); ++it) {
+        if (it->deadline == 0 || it->deadline > now) {
+            callback(it.key(), it->username, it->userVersion, it->deadline);
+        }
+    }
+}
+
+void SessionTable::evict() {
+    while (this->sessions.size() > this->maxSessions && !this->order.empty()) {
+        const auto entry = this->order.front();
+        this->order.pop_front();
+        const auto it = this->sessions.find(entry.first);
+        if (it != this->sessions.end() && it->sequence == entry.second) {
+            this->sessions.erase(it);
+        }
+    }
+}
+
+void SessionTable::compact() {
+    // both structures are rebuilt after at least as many removals as there are live sessions, so O(1) amortized
+    const auto limit = static_cast<size_t>(this->sessions.size()) * 2 + 64;
+
+    if (static_cast<size_t>(this->wheel.size()) > limit) {
+        this->wheel.clear();
+        for (auto it = this->sessions.constBegin(); it != this->sessions.constEnd(); ++it) {
+            if (it->deadline > 0) {
+                this->wheel.schedule(it.key(), it->deadline);
+            }
+        }
+    }
+
+    if (this->order.size() > limit) {
+        std::deque<QPair<QString, quint64> > live;
+        for (const auto &entry: this->order) {
+            const auto it = this->sessions.constFind(entry.first);
+            if (it != this->sessions.constEnd() && it->sequence == entry.second) {
+                live.push_back(entry);
+            }
+        }
+        this->order.swap(live);
+    }
+}
@@ -0,0 +1,136 @@
+#include <auth_storage/sharded_auth_storage.h>
+#include <auth_storage/random_token.h>
+#include <QReadLocker>
+#include <QWriteLocker>
+#include <QThread>
+#include <QVariant>
+#include <QDateTime>
+#include <QDebug>
+
+static qint64 toMs(const std::chrono::system_clock::time_point &time) {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(time.time_since_epoch()).count();
+}
+
+ShardedAuthStorage::ShardedAuthStorage(IAuthConfig *config) {
+    int requested = 0;
+    int maxSessions = 0;
+    if (config) {
+        requested = config->getAuthConfig("shards").toInt();
+        maxSessions = config->getAuthConfig("max_sessions").toInt();
+        this->sessionTtl = qMax<qint64>(0, config->getAuthConfig("session_ttl").toLongLong());
+    }
+    if (requested <= 0) {
+        requested = 4 * qMax(1, QThread::idealThreadCount());
+    }
+
+    while ((1 << this->shardBits) < requested && this->shardBits < 16) {
+        ++this->shardBits;
+    }
+    const int count = this->shardCount();
+    const int perShard = maxSessions > 0 ? qMax(1, (maxSessions + count - 1) / count) : 0;
+    this->shards.reserve(count);
+    for (int i = 0; i < count; ++i) {
+        this->shards.push_back(std::make_unique<Shard>(perShard));
+    }
+
+    qDebug().noquote() << "ShardedAuthStorage: shards =" << count
+            << "session_ttl =" << this->sessionTtl << "max_sessions =" << maxSessions;
+}
+
+ShardedAuthStorage::Shard &ShardedAuthStorage::shardOf(const QString &auth_id) const {
+    if (this->shardBits == 0) {
+        return *this->shards[0];
+    }
+    /// Fibonacci hashing: take high bits, so shard index doesn't correlate with bucket index inside QHash.
+    const uint hash = qHash(auth_id) * 0x9E3779B1u;
+    return *this->shards[hash >> (32 - this->shardBits)];
+}
+
+QString ShardedAuthStorage::insert(const QString &username, const QString &userVersion, const qint64 deadline) {
+    while (true) {
+        QString token = randomToken();
+        Shard &shard = this->shardOf(token);
+        QWriteLocker locker(&shard.lock);
+        // writes pay for expiry of their shard, so reads stay under shared lock
+        shard.sessions.expire(QDateTime::currentMSecsSinceEpoch());
+        if (!shard.sessions.contains(token)) {
+            shard.sessions.insert(token, username, userVersion, deadline);
+            return token;
+        }
+    }
+}
+
+QString ShardedAuthStorage::authenticate(const QString &username, const QString &userVersion) {
+    const qint64 deadline = this->sessionTtl > 0 ? QDateTime::currentMSecsSinceEpoch() + this->sessionTtl : 0;
+    return this->insert(username, userVersion, deadline);
+}
+
+QString ShardedAuthStorage::authenticate(const QString &username, const QString &userVersion,
+                                         const std::chrono::system_clock::time_point deadline) {
+    return this->insert(username, userVersion, toMs(deadline));
+}
+
+std::optional<QPair<QString, QString> > ShardedAuthStorage::get(const QString &auth_id) {
+    Shard &shard = this->shardOf(auth_id);
+    QReadLocker locker(&shard.lock);
+    return shard.sessions.get(auth_id, QDateTime::currentMSecsSinceEpoch());
+}
+
+bool ShardedAuthStorage::remove(const QString &auth_id) {
+    Shard &shard = this->shardOf(auth_id);
+    QWriteLocker locker(&shard.lock);
+    const qint64 now = QDateTime::currentMSecsSinceEpoch();
+    shard.sessions.expire(now);
+    return shard.sessions.remove(auth_id, now);
+}
+
+qint64 ShardedAuthStorage::sessionCount() {
+    return this->size();
+}
+
+qint64 ShardedAuthStorage::removeByUsers(const QSet<QString> &usernames) {
+    return this->removeSessionsOf(usernames).size();
+}
+
+QStringList ShardedAuthStorage::removeSessionsOf(const QSet<QString> &usernames) {
+    QStringList removed;
+    if (usernames.isEmpty()) {
+        return removed;
+    }
+    const qint64 now = QDateTime::currentMSecsSinceEpoch();
+    for (const auto &shard: this->shards) {
+        QWriteLocker locker(&shard->lock);
+        removed += shard->sessions.removeUsers(usernames, now);
+    }
+    return removed;
+}
+
+int ShardedAuthStorage::shardCount() const {
+    return 1 << this->shardBits;
+}
+
+int ShardedAuthStorage::size() const {
+    int size = 0;
+    for (const auto &shard: this->shards) {
+        QReadLocker locker(&shard->lock);
+        size += shard->sessions.size();
+    }
+    return size;
+}
+
+void ShardedAuthStorage::restore(const QString &auth_id, const QString &username, const QString &userVersion,
+                                 const qint64 deadline) {
+    Shard &shard = this->shardOf(auth_id);
+    QWriteLocker locker(&shard.lock);
+    shard.sessions.insert(auth_id, username, userVersion, deadline);
+}
+
+void ShardedAuthStorage::forEach(
+    const std::function<void(const QString &auth_id, const QString &username, const QString &userVersion,
+                             qint64 deadline)> &callback) const {
+    const qint64 now = QDateTime::currentMSecsSinceEpoch();
+    for (const auto &shard: this->shards) {
+        QReadLocker locker(&shard->lock);
+        shard->sessions.forEach(now, callback);
+    }
+}
@@ -0,0 +1,86 @@
+#include <auth_storage/timing_wheel.h>
+#include <algorithm>
+
+/// @brief farthest distance in ticks, that fits into wheel
+static constexpr qint64 SPAN = static_cast<qint64>(1) << (TimingWheel::LEVEL_BITS * TimingWheel::LEVELS);
+
+TimingWheel::TimingWheel(const qint64 now, const qint64 resolution)
+    : resolution(std::max<qint64>(resolution, 1)), current(now / this->resolution) {
+}
+
+void TimingWheel::place(Item &&item) {
+    // too far deadlines are parked in the last slot, that fits, and placed again when it's cascaded
+    const qint64 tick = std::min(item.tick, this->current + SPAN - 1);
+    const qint64 distance = tick - this->current;
+    int level = 0;
+    while (level < LEVELS - 1 && distance >= static_cast<qint64>(1) << (LEVEL_BITS * (level + 1))) {
+        ++level;
+    }
+    const auto slot = static_cast<size_t>((tick >> (LEVEL_BITS * level)) & (SLOTS - 1));
+    this->slots[level][slot].push_back(std::move(item));
+}
+
+void TimingWheel::cascade(const int level) {
+    const auto slot = static_cast<size_t>((this->current >> (LEVEL_BITS * level)) & (SLOTS - 1));
+    std::vector<Item> items;
+    items.swap(this->slots[level][slot]);
+    for (auto &item: items) {
+        this->place(std::move(item));
+    }
+}
+
+void TimingWheel::schedule(const QString &key, const qint64 deadline) {
+    // current tick is processed already, so nearest possible tick is the next one
+    const qint64 tick = std::max((deadline + this->resolution - 1) / this->resolution, this->current + 1);
+    this->place({tick, key});
+    ++this->count;
+}
+
+std::vector<QString> TimingWheel::advance(const qint64 now) {
+    std::vector<QString> due;
+    const qint64 target = now / this->resolution;
+    if (this->count == 0) {
+        this->current = std::max(this->current, target);
+        return due;
+    }
+
+    while (this->current < target && this->count > 0) {
+        ++this->current;
+
+        // when lower level wraps, items of next slot of upper level move down (starting from the highest level,
+        // because its items may land into slot of lower level, that is cascaded right after)
+        int top = 0;
+        while (top < LEVELS - 1 && (this->current & ((static_cast<qint64>(1) << (LEVEL_BITS * (top + 1))) - 1)) == 0) {
+            ++top;
+        }
+        for (int level = top; level > 0; --level) {
+            this->cascade(level);
+        }
+
+        std::vector<Item> items;
+        items.swap(this->slots[0][static_cast<size_t>(this->current & (SLOTS - 1))]);
+        for (auto &item: items) {
+            if (item.tick <= this->current) {
+                due.push_back(std::move(item.key));
+                --this->count;
+            } else {
+                this->place(std::move(item));
+            }
+        }
+    }
+    this->current = std::max(this->current, target);
+    return due;
+}
+
+void TimingWheel::clear() {
+    for (auto &level: this->slots) {
+        for (auto &slot: level) {
+            slot.clear();
+        }
+    }
+    this->count = 0;
+}
+
+int TimingWheel::size() const {
+    return this->count;
+}
@@ -0,0 +1,27 @@
+#include <token/token_bytes.h>
+
+TokenBytes::TokenBytes(const QString &token) {
+    const int size = token.size();
+    char *out = this->inlineBytes;
+    if (size > INLINE_SIZE) {
+        this->heap.resize(static_cast<size_t>(size));
+        out = &this->heap[0];
+    }
+    // no branch per character: non-ASCII units are detected by OR of all of them
+    const QChar *in = token.constData();
+    ushort all = 0;
+    for (int i = 0; i < size; ++i) {
+        const ushort unit = in[i].unicode();
+        all |= unit;
+        out[i] = static_cast<char>(unit);
+    }
+    this->ascii = all < 0x80;
+    this->bytes = std::string_view(out, static_cast<size_t>(size));
+}
+
+std::optional<std::string_view> TokenBytes::view() const {
+    if (!this->ascii) {
+        return std::nullopt;
+    }
+    return this->bytes;
+}
@@ -0,0 +1,142 @@
+#include <metrics/tracer.h>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QMutexLocker>
+#include <algorithm>
+#include <random>
+
+/// @brief Spans of calling thread; `next` only grows, event `i` is stored at `i % CAPACITY`
+struct Ring {
+    Tracer::Event events[Tracer::CAPACITY];
+    uint64_t next = 0;
+    /// @brief spans are recorded only inside of request
+    bool inRequest = false;
+    int thread;
+
+    Ring() {
+        static std::atomic<int> threads{0};
+        this->thread = threads.fetch_add(1, std::memory_order_relaxed) + 1;
+    }
+};
+
+static Ring &ring() {
+    thread_local Ring ring;
+    return ring;
+}
+
+Tracer::Span::Span(const char *name) : name(name), start(-1) {
+    if (ring().inRequest) {
+        this->start = Tracer::instance().now();
+    }
+}
+
+Tracer::Span::~Span() {
+    Ring &ring = ::ring();
+    // request may end before span, e.g. span outlives request scope
+    if (this->start < 0 || !ring.inRequest) {
+        return;
+    }
+    ring.events[ring.next % CAPACITY] = {this->name, this->start, Tracer::instance().now()};
+    ++ring.next;
+}
+
+Tracer::Request::Request(QString name) : name(std::move(name)), start(0), first(0), active(false) {
+    Ring &ring = ::ring();
+    // nested request (e.g. batch call) belongs to outer one
+    if (!Tracer::instance().enabled() || ring.inRequest) {
+        return;
+    }
+    ring.inRequest = true;
+    this->active = true;
+    this->first = ring.next;
+    this->start = Tracer::instance().now();
+}
+
+Tracer::Request::~Request() {
+    if (!this->active) {
+        return;
+    }
+    Tracer &tracer = Tracer::instance();
+    Ring &ring = ::ring();
+    ring.inRequest = false;
+
+    const int64_t end = tracer.now();
+    const int64_t threshold = tracer.threshold.load(std::memory_order_relaxed);
+    if (threshold <= 0 || end - this->start < threshold) {
+        return;
+    }
+    thread_local std::minstd_rand random(std::random_device{}());
+    const double sampleRate = tracer.sampleRate.load(std::memory_order_relaxed);
+    if (sampleRate < 1 && std::uniform_real_distribution<double>(0, 1)(random) >= sampleRate) {
+        return;
+    }
+
+    const uint64_t first = std::max(this->first, ring.next > CAPACITY ? ring.next - CAPACITY : 0);
+    Trace trace{this->name, ring.thread, this->start, end, first != this->first, {}};
+    trace.events.reserve(ring.next - first);
+    for (uint64_t i = first; i < ring.next; ++i) {
+        trace.events.push_back(ring.events[i % CAPACITY]);
+    }
+    tracer.keep(std::move(trace));
+}
+
+Tracer::Tracer() : epoch(std::chrono::steady_clock::now()) {
+}
+
+Tracer &Tracer::instance() {
+    static Tracer tracer;
+    return tracer;
+}
+
+void Tracer::configure(const std::chrono::microseconds threshold, const double sampleRate) {
+    const int64_t nanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(threshold).count();
+    this->sampleRate.store(std::min(std::max(sampleRate, 0.0), 1.0), std::memory_order_relaxed);
+    this->threshold.store(std::max<int64_t>(nanoseconds, 0), std::memory_order_relaxed);
+}
+
+bool Tracer::enabled() const {
+    return this->threshold.load(std::memory_order_relaxed) > 0;
+}
+
+int64_t Tracer::now() const {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - this->epoch).count();
+}
+
+void Tracer::keep(Trace &&trace) {
+    QMutexLocker locker(&this->mutex);
+    if (this->traces.size() >= MAX_TRACES) {
+        this->traces.pop_front();
+    }
+    this->traces.push_back(std::move(trace));
+}
+
+/// @brief complete event ("ph": "X"), times are in microseconds
+static QJsonObject completeEvent(const QString &name, const int thread, const int64_t start, const int64_t end) {
+    return {
+        {"name", name},
+        {"cat", "jrpc_auth"},
+        {"ph", "X"},
+        {"ts", start / 1000.0},
+        {"dur", (end - start) / 1000.0},
+        {"pid", 1},
+        {"tid", thread},
+    };
+}
+
+QByteArray Tracer::chromeTrace() const {
+    QJsonArray events;
+    {
+        QMutexLocker locker(&this->mutex);
+        for (const auto &trace: this->traces) {
+            QJsonObject request = completeEvent(trace.name, trace.thread, trace.start, trace.end);
+            request["args"] = QJsonObject{{"truncated", trace.truncated}};
+            events.append(request);
+            for (const auto &event: trace.events) {
+                events.append(completeEvent(event.name, trace.thread, event.start, event.end));
+            }
+        }
+    }
+    return QJsonDocument(QJsonObject{{"traceEvents", events}, {"displayTimeUnit", "ms"}})
+            .toJson(QJsonDocument::Compact);
+}
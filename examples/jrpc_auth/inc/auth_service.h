@@ -1,10 +1,16 @@
 #ifndef AUTH_SERVICE_H
 #define AUTH_SERVICE_H
 
-#include <qjsonrpc/qjsonrpcservice.h>
 #include <auth_storage/iauth_storage.h>
 #include <user_storage/iuser_storage.h>
 #include <auth_configuration/iservice_config.h>
+#include <service/request_executor.h>
+#include <service/rpc_service.h>
+#include <service/rate_limiter.h>
+#include <service/reloadable.h>
+#include <functional>
+#include <QHash>
+#include <QJsonArray>
 
 typedef struct AuthServiceSettings {
     std::unique_ptr<IAuthStorage> authStorage;
@@ -13,19 +19,44 @@ typedef struct AuthServiceSettings {
     ~AuthServiceSettings() = default;
 } AuthServiceSettings;
 
-class AuthService : public QJsonRpcService {
+class AuthService : public RpcService {
     Q_OBJECT
-    Q_CLASSINFO("serviceName", "auth")
 
 public:
     AuthService(const AuthService &) = delete;
 
     /// @brief Constructor
     /// @param settings authentication settings
+    /// @param config service configuration. If "service.login_threads" is greater than 0, logins are executed on their
+    /// own pool of that size, which accepts at most "service.login_queue" (default 64) waiting logins. Login attempts
+    /// may be limited by token buckets per pair of user name and client address ("service.login_user_rate" per second,
+    /// "service.login_user_burst" at once) and per client address ("service.login_peer_rate",
+    /// "service.login_peer_burst"), "service.login_limiter_size" keys of each are tracked; limits are off unless rate
+    /// is set.
     explicit AuthService(AuthServiceSettings &&settings, const IServiceConfig *config = nullptr, QObject *parent = nullptr);
 
-public Q_SLOTS:
+    /// @brief Destructor, drains login pool and stops change feeds of user storages first
+    ~AuthService() override;
+
+    /// @brief Register methods of this service in server, that executes batch requests concurrently.
+    /// Methods are executed on worker threads of the server, so all storages must be thread-safe.
+    /// @param server JSON-RPC server
+    void registerMethods(RpcHttpServer *server);
+
+    /// @brief Apply "service.secret" and "service.name" of changed configuration. Tokens issued with previous secret
+    /// become invalid, calls in flight finish with previous values.
+    /// @param config service configuration
+    void reconfigure(const IServiceConfig *config);
+
+private:
+    /// @brief Admission control of login, checked before any storage is queried
+    /// @param username user name
+    /// @param peer client address, or null if unknown
+    /// @return false if login should be rejected
+    [[nodiscard]] bool admitLogin(const QString &username, const QHostAddress &peer) const;
+
     /// @brief Get authentication token for user
+    /// @param request request message
     /// @param username user name
     /// @param password user password
     /// @return token on success, otherwise error.
@@ -55,9 +86,11 @@ public Q_SLOTS:
     ///     "jsonrpc": "2.0"
     /// }
     /// @endcode
-    QJsonObject login(const QString &username, const QString &password);
+    [[nodiscard]] QJsonRpcMessage loginImpl(const QJsonRpcMessage &request, const QString &username,
+                                            const QString &password);
 
     /// @brief Logout user
+    /// @param request request message
     /// @param token authentication token
     /// @return true if success(false if token not found).
     ///
@@ -69,9 +102,10 @@ public Q_SLOTS:
     ///     "result": true
     /// }
     /// @endcode
-    bool logout(const QString &token);
+    [[nodiscard]] QJsonRpcMessage logoutImpl(const QJsonRpcMessage &request, const QString &token);
 
     /// @brief Check authentication token
+    /// @param request request message
     /// @param token authentication token
     /// @return true if success(false if token not found).
     ///
@@ -83,9 +117,10 @@ public Q_SLOTS:
     ///     "result": true
     /// }
     /// @endcode
-    bool checkAuth(const QString &token);
+    [[nodiscard]] QJsonRpcMessage checkAuthImpl(const QJsonRpcMessage &request, const QString &token);
 
     /// @brief Get user identity
+    /// @param request request message
     /// @param token authentication token
     /// @return user identity.
     ///
@@ -111,14 +146,102 @@ public Q_SLOTS:
     ///     "jsonrpc": "2.0"
     /// }
     /// @endcode
-    QJsonObject getIdentity(const QString &token);
+    [[nodiscard]] QJsonRpcMessage getIdentityImpl(const QJsonRpcMessage &request, const QString &token);
+
+    /// @brief Check several authentication tokens at once
+    /// @param request request message
+    /// @param tokens authentication tokens (at most 1000)
+    /// @return array of results in order of tokens: true if token is valid.
+    /// Identical tokens are checked once, user version is read once per distinct user.
+    ///
+    /// Request example:
+    /// @code{.json}
+    /// {
+    ///     "id": 503,
+    ///     "jsonrpc": "2.0",
+    ///     "method": "auth.checkAuthBatch",
+    ///     "params": [["eyJhbGciOiJIUzI1NiIsInR5cCI6IkpXVCJ9...", "invalid"]]
+    /// }
+    /// @endcode
+    /// Response example:
+    /// @code{.json}
+    /// {
+    ///     "id": 503,
+    ///     "jsonrpc": "2.0",
+    ///     "result": [true, false]
+    /// }
+    /// @endcode
+    [[nodiscard]] QJsonRpcMessage checkAuthBatchImpl(const QJsonRpcMessage &request, const QVariantList &tokens);
+
+    /// @brief Get user identities for several authentication tokens at once
+    /// @param request request message
+    /// @param tokens authentication tokens (at most 1000)
+    /// @return array of identities in order of tokens, null for invalid token.
+    /// Identical tokens are checked once.
+    ///
+    /// Response example:
+    /// @code{.json}
+    /// {
+    ///     "id": 503,
+    ///     "jsonrpc": "2.0",
+    ///     "result": [{"username": "admin"}, null]
+    /// }
+    /// @endcode
+    /// Error example:
+    /// @code{.json}
+    /// {
+    ///     "error": {
+    ///         "code": -32602,
+    ///         "data": null,
+    ///         "message": "Too many tokens"
+    ///     },
+    ///     "id": 1,
+    ///     "jsonrpc": "2.0"
+    /// }
+    /// @endcode
+    [[nodiscard]] QJsonRpcMessage getIdentityBatchImpl(const QJsonRpcMessage &request, const QVariantList &tokens);
+
+    /// @brief Session of token in batch request
+    struct BatchSession {
+        QString jti;
+        QString username;
+        QString userVersion;
+    };
+
+    /// @brief Verify token on its bytes with secret converted once, see `verifyJwtAndGetToken()`
+    /// @param token token from request
+    /// @return "jti" claim if token is valid, otherwise std::nullopt
+    [[nodiscard]] std::optional<QString> verifyToken(const QString &token) const;
+
+    /// @brief Verify distinct tokens of batch and look up their sessions
+    /// @param tokens authentication tokens, may repeat
+    /// @return sessions by token, tokens without valid session are absent
+    [[nodiscard]] QHash<QString, BatchSession> lookupSessions(const QVariantList &tokens) const;
 
 private:
     std::vector<std::unique_ptr<IUserStorage> > users;
 
     std::unique_ptr<IAuthStorage> auths;
 
-    QString secret, name;
+    /// @brief Settings of token signing, that may change on reload of configuration
+    struct Signing {
+        QString secret, name;
+        /// @brief Secret in UTF-8, so tokens are verified without converting it per call
+        QByteArray secretUtf8;
+    };
+
+    /// @brief Signing settings of configuration
+    [[nodiscard]] static Signing signingOf(const IServiceConfig *config);
+
+    Reloadable<Signing> signing;
+
+    /// @brief Login attempts by user name and client address, null if not limited
+    std::unique_ptr<RateLimiter> userLimiter;
+    /// @brief Login attempts by client address, null if not limited
+    std::unique_ptr<RateLimiter> peerLimiter;
+
+    /// @brief Bounded pool for logins (password hashing), so burst of logins can't starve token checks
+    std::unique_ptr<RequestExecutor> loginPool;
 };
 
 
@@ -1,61 +1,133 @@
 #include <auth_service.h>
-#include <qjsonrpc/qjsonrpcservice.h>
-#include <jwt/jwt.hpp>
+#include <metrics/tracer.h>
+#include <QDebug>
+#include <QSet>
+#include <token/jwt_token.h>
+#include <token/token_bytes.h>
 
-static QString createJwtToken(const QString &secret, const QString &jti, const QString &issuer, const QString &username) {
-    jwt::jwt_object data{jwt::params::algorithm("HS256"), jwt::params::secret(secret.toStdString())};
-    auto current_time = std::chrono::system_clock::now();
+/// @brief maximum number of tokens in batch request
+static constexpr int MAX_BATCH = 1000;
 
-    data.add_claim(jwt::registered_claims::jti, jti.toStdString());
-    data.add_claim(jwt::registered_claims::issuer, issuer.toStdString());
-    data.add_claim(jwt::registered_claims::subject, username.toStdString());
-    data.add_claim(jwt::registered_claims::issued_at, current_time);
-
-    data.secret(secret.toStdString());
-    return QString::fromStdString(data.signature());
-}
-
-static std::optional<QString> verifyJwtAndGetToken(const QString &jwt,
-                                                   const QString &secret) noexcept {
-    std::error_code ec;
-    jwt::jwt_object data = jwt::decode(
-            jwt.toStdString(),
-            jwt::params::algorithms({"HS256"}),
-            ec, jwt::params::secret(secret.toStdString()), jwt::params::verify(true));
-
-    if (ec) {
-        return std::nullopt;
+/// @brief Create login limiter from "service.login_<kind>_rate" and "service.login_<kind>_burst", if rate is set
+static std::unique_ptr<RateLimiter> makeLoginLimiter(const IServiceConfig *config, const QString &kind) {
+    const double rate = config ? config->getServiceConfig("login_" + kind + "_rate").toDouble() : 0;
+    if (rate <= 0) {
+        return nullptr;
     }
-    return QString::fromStdString(data.payload().get_claim_value<std::string>(jwt::registered_claims::jti));
+    const double burst = config->getServiceConfig("login_" + kind + "_burst").toDouble();
+    const int size = config->getServiceConfig("login_limiter_size").toInt();
+    qDebug().noquote() << "AuthService: login limit by" << kind << "=" << rate << "per second";
+    return std::make_unique<RateLimiter>(rate, burst > 0 ? burst : rate, size > 0 ? size : 65536);
 }
 
 AuthService::AuthService(
         AuthServiceSettings &&settings,
         const IServiceConfig *config,
         QObject *parent
-) : QJsonRpcService(parent),
+) : RpcService(parent),
     auths(std::move(settings.authStorage)),
     users(std::move(settings.userStorages)),
-    name(config ? config->getServiceConfig("name").toString() : "auth"),
-    secret(config ? config->getServiceConfig("secret").toString() : "SOME_JWT_SECRET") {
+    signing(signingOf(config)) {
+    this->userLimiter = makeLoginLimiter(config, "user");
+    this->peerLimiter = makeLoginLimiter(config, "peer");
+
+    const int loginThreads = config ? config->getServiceConfig("login_threads").toInt() : 0;
+    if (loginThreads > 0) {
+        const QVariant loginQueue = config->getServiceConfig("login_queue");
+        const int queue = loginQueue.isValid() ? loginQueue.toInt() : 64;
+        this->loginPool = std::make_unique<RequestExecutor>(loginThreads, loginThreads + queue, "login");
+    }
+
+    // sessions of changed users are dropped at once, not on their next check
+    for (const auto &user: this->users) {
+        user->onUsersChanged([this](const QSet<QString> &usernames) {
+            // lost changes leave sessions to the version check
+            if (usernames.isEmpty()) {
+                return;
+            }
+            const qint64 removed = this->auths->removeByUsers(usernames);
+            if (removed > 0) {
+                qDebug() << "Sessions of changed users are removed:" << removed;
+            } else if (removed < 0) {
+                qDebug() << "Sessions of changed users are not removed, they are rejected by version check";
+            }
+        });
+    }
 }
 
-QJsonObject AuthService::login(const QString &username, const QString &password) {
-    auto request = currentRequest();
+AuthService::Signing AuthService::signingOf(const IServiceConfig *config) {
+    Signing signing;
+    signing.name = config ? config->getServiceConfig("name").toString() : "auth";
+    signing.secret = config ? config->getServiceConfig("secret").toString() : "SOME_JWT_SECRET";
+    signing.secretUtf8 = signing.secret.toUtf8();
+    return signing;
+}
+
+void AuthService::reconfigure(const IServiceConfig *config) {
+    Signing signing = signingOf(config);
+    const Signing &current = this->signing.get();
+    if (signing.secret == current.secret && signing.name == current.name) {
+        return;
+    }
+    qDebug().noquote() << "AuthService: signing settings are changed, name =" << signing.name;
+    this->signing.store(std::move(signing));
+}
+
+AuthService::~AuthService() {
+    // requests in flight and change listeners use storages, so they are stopped before storages are destroyed
+    this->loginPool.reset();
+    this->users.clear();
+}
+
+void AuthService::registerMethods(RpcHttpServer *server) {
+    addMethod(server, "auth.login", {"username", "password"}, [this](const QJsonRpcMessage &request,
+                                                                     const QJsonArray &params) {
+        return this->loginImpl(request, params[0].toString(), params[1].toString());
+    }, this->loginPool.get());
+    server->setGuard("auth.login", [this](const QJsonArray &params, const QHostAddress &peer) {
+        return this->admitLogin(params[0].toString(), peer);
+    });
+    addMethod(server, "auth.logout", {"token"}, [this](const QJsonRpcMessage &request, const QJsonArray &params) {
+        return this->logoutImpl(request, params[0].toString());
+    });
+    addMethod(server, "auth.checkAuth", {"token"}, [this](const QJsonRpcMessage &request, const QJsonArray &params) {
+        return this->checkAuthImpl(request, params[0].toString());
+    });
+    addMethod(server, "auth.getIdentity", {"token"}, [this](const QJsonRpcMessage &request, const QJsonArray &params) {
+        return this->getIdentityImpl(request, params[0].toString());
+    });
+    addMethod(server, "auth.checkAuthBatch", {"tokens"}, [this](const QJsonRpcMessage &request,
+                                                                const QJsonArray &params) {
+        return this->checkAuthBatchImpl(request, params[0].toArray().toVariantList());
+    });
+    addMethod(server, "auth.getIdentityBatch", {"tokens"}, [this](const QJsonRpcMessage &request,
+                                                                  const QJsonArray &params) {
+        return this->getIdentityBatchImpl(request, params[0].toArray().toVariantList());
+    });
+}
+
+bool AuthService::admitLogin(const QString &username, const QHostAddress &peer) const {
+    if (this->peerLimiter && !peer.isNull() && !this->peerLimiter->tryAcquire(peer.toString())) {
+        return false;
+    }
+    // user bucket is per client too, so anonymous caller can't lock user out for everyone
+    return !this->userLimiter || this->userLimiter->tryAcquire(username + QLatin1Char('\n') + peer.toString());
+}
+
+QJsonRpcMessage AuthService::loginImpl(const QJsonRpcMessage &request, const QString &username,
+                                       const QString &password) {
     for (auto &user: users) {
         auto auth = user->authenticate(username, password);
         if (auth.has_value()) {
             QString token = this->auths->authenticate(username, auth.value());
-            QString jwtToken = createJwtToken(this->secret, token, this->name, username);
+            const Signing &signing = this->signing.get();
+            QString jwtToken = createJwtToken(signing.secret, token, signing.name, username);
 
             if (token.isEmpty()) {
-                const auto error = request.request().createErrorResponse(
-                    QJsonRpc::InternalError, "Internal server error");
-                emit result(error);
-                return {};
+                return request.createErrorResponse(QJsonRpc::InternalError, "Internal server error");
             }
 
-            return QJsonObject::fromVariantMap({
+            return request.createResponse(QJsonObject::fromVariantMap({
                 {"token", jwtToken},
                 {
                     "user",
@@ -63,53 +135,134 @@ QJsonObject AuthService::login(const QString &username, const QString &password)
                         {"username", username},
                     }))
                 }
-            });
+            }));
         }
     }
-    const auto error = request.request().createErrorResponse(QJsonRpc::InternalError, "Invalid username or password");
-    emit result(error);
-    return {};
+    return request.createErrorResponse(QJsonRpc::InternalError, "Invalid username or password");
 }
 
-bool AuthService::logout(const QString &token) {
-    auto jti = verifyJwtAndGetToken(token, this->secret);
+QJsonRpcMessage AuthService::logoutImpl(const QJsonRpcMessage &request, const QString &token) {
+    auto jti = this->verifyToken(token);
     if (!jti) {
-        return false;
+        return request.createResponse(false);
     }
-    return this->auths->remove(jti.value());
+    return request.createResponse(this->auths->remove(jti.value()));
 }
 
-bool AuthService::checkAuth(const QString &token) {
-    auto jti = verifyJwtAndGetToken(token, this->secret);
+QJsonRpcMessage AuthService::checkAuthImpl(const QJsonRpcMessage &request, const QString &token) {
+    auto jti = this->verifyToken(token);
     if (!jti) {
-        return false;
+        return request.createResponse(false);
     }
     auto user = this->auths->get(jti.value());
     if (!user) {
-        return false;
+        return request.createResponse(false);
     }
-    for (auto &ustorage: this->users) {
-        if (ustorage->getUserVersion(user->first) == user->second) {
-            return true;
+    {
+        const Tracer::Span span("user.version");
+        for (auto &ustorage: this->users) {
+            if (ustorage->getUserVersion(user->first) == user->second) {
+                return request.createResponse(true);
+            }
         }
     }
     this->auths->remove(jti.value());
-    return false;
+    return request.createResponse(false);
 }
 
-QJsonObject AuthService::getIdentity(const QString &token) {
-    auto request = currentRequest();
-    auto jti = verifyJwtAndGetToken(token, this->secret);
+QJsonRpcMessage AuthService::getIdentityImpl(const QJsonRpcMessage &request, const QString &token) {
+    auto jti = this->verifyToken(token);
     if (!jti) {
-        auto error = request.request().createErrorResponse(QJsonRpc::InvalidParams, "Invalid token");
-        emit result(error);
-        return {};
+        return request.createErrorResponse(QJsonRpc::InvalidParams, "Invalid token");
     }
     auto user = auths->get(jti.value());
     if (!user) {
-        auto error = request.request().createErrorResponse(QJsonRpc::InvalidParams, "Is out of use");
-        emit result(error);
-        return {};
+        return request.createErrorResponse(QJsonRpc::InvalidParams, "Is out of use");
+    }
+    return request.createResponse(QJsonObject{{"username", user->first}});
+}
+
+std::optional<QString> AuthService::verifyToken(const QString &token) const {
+    // token is converted to bytes on stack, only "jti" is converted back for storage lookup
+    const TokenBytes bytes(token);
+    const auto view = bytes.view();
+    if (!view) {
+        return std::nullopt;
+    }
+    const QByteArray &secret = this->signing.get().secretUtf8;
+    return verifyJwtAndGetToken(view.value(), std::string_view(secret.constData(), secret.size()));
+}
+
+QHash<QString, AuthService::BatchSession> AuthService::lookupSessions(const QVariantList &tokens) const {
+    QHash<QString, BatchSession> sessions;
+    QSet<QString> checked;
+    for (const auto &value: tokens) {
+        const QString token = value.toString();
+        if (checked.contains(token)) {
+            continue;
+        }
+        checked.insert(token);
+
+        const auto jti = this->verifyToken(token);
+        if (!jti) {
+            continue;
+        }
+        if (const auto user = this->auths->get(jti.value())) {
+            sessions.insert(token, {jti.value(), user->first, user->second});
+        }
+    }
+    return sessions;
+}
+
+QJsonRpcMessage AuthService::checkAuthBatchImpl(const QJsonRpcMessage &request, const QVariantList &tokens) {
+    if (tokens.size() > MAX_BATCH) {
+        return request.createErrorResponse(QJsonRpc::InvalidParams, "Too many tokens");
+    }
+
+    const auto sessions = this->lookupSessions(tokens);
+    // current versions of every distinct user from all storages
+    QHash<QString, QStringList> versions;
+    QSet<QString> valid;
+    for (auto it = sessions.constBegin(); it != sessions.constEnd(); ++it) {
+        auto current = versions.find(it->username);
+        if (current == versions.end()) {
+            QStringList userVersions;
+            for (auto &ustorage: this->users) {
+                if (auto version = ustorage->getUserVersion(it->username)) {
+                    userVersions.append(version.value());
+                }
+            }
+            current = versions.insert(it->username, userVersions);
+        }
+
+        if (current->contains(it->userVersion)) {
+            valid.insert(it.key());
+        } else {
+            this->auths->remove(it->jti);
+        }
+    }
+
+    QJsonArray result;
+    for (const auto &token: tokens) {
+        result.append(valid.contains(token.toString()));
+    }
+    return request.createResponse(result);
+}
+
+QJsonRpcMessage AuthService::getIdentityBatchImpl(const QJsonRpcMessage &request, const QVariantList &tokens) {
+    if (tokens.size() > MAX_BATCH) {
+        return request.createErrorResponse(QJsonRpc::InvalidParams, "Too many tokens");
+    }
+
+    const auto sessions = this->lookupSessions(tokens);
+    QJsonArray result;
+    for (const auto &token: tokens) {
+        const auto it = sessions.constFind(token.toString());
+        if (it == sessions.constEnd()) {
+            result.append(QJsonValue());
+        } else {
+            result.append(QJsonObject{{"username", it->username}});
+        }
     }
-    return {{"username", user->first}};
+    return request.createResponse(result);
 }
@@ -1,10 +1,19 @@
 #ifndef AUTH_SERVICE_H
 #define AUTH_SERVICE_H
 
-#include <qjsonrpc/qjsonrpcservice.h>
 #include <auth_storage/iauth_storage.h>
+#include <auth_storage/revocation_set.h>
 #include <user_storage/iuser_storage.h>
 #include <auth_configuration/iservice_config.h>
+#include <service/request_executor.h>
+#include <service/rpc_service.h>
+#include <service/rate_limiter.h>
+#include <service/reloadable.h>
+#include <rs256_engine.h>
+#include <chrono>
+#include <functional>
+#include <QHash>
+#include <QJsonArray>
 
 typedef struct AuthServiceSettings {
     std::unique_ptr<IAuthStorage> authStorage;
@@ -13,20 +22,47 @@ typedef struct AuthServiceSettings {
     ~AuthServiceSettings() = default;
 } AuthServiceSettings;
 
-class AuthService : public QJsonRpcService {
+class AuthService : public RpcService {
     Q_OBJECT
-    Q_CLASSINFO("serviceName", "auth")
 
 public:
     AuthService(const AuthService &) = delete;
 
     /// @brief Constructor
     /// @param settings authentication settings
+    /// @param config service configuration. If "service.login_threads" is greater than 0, logins are executed on their
+    /// own pool of that size, which accepts at most "service.login_queue" (default 64) waiting logins. Login attempts
+    /// may be limited by token buckets per pair of user name and client address ("service.login_user_rate" per second,
+    /// "service.login_user_burst" at once) and per client address ("service.login_peer_rate",
+    /// "service.login_peer_burst"), "service.login_limiter_size" keys of each are tracked; limits are off unless rate
+    /// is set. If "service.stateless_access" is true, access tokens are checked by signature, expiration and revocation
+    /// set only, without auth storage lookup. Refresh token can be used "service.refresh_delay" seconds after login
+    /// (default 600).
     explicit AuthService(AuthServiceSettings &&settings, const IServiceConfig *config = nullptr,
                          QObject *parent = nullptr);
 
-public Q_SLOTS:
+    /// @brief Destructor, drains login pool and stops change feeds of user storages first
+    ~AuthService() override;
+
+    /// @brief Register methods of this service in server, that executes batch requests concurrently.
+    /// Methods are executed on worker threads of the server, so all storages must be thread-safe.
+    /// @param server JSON-RPC server
+    void registerMethods(RpcHttpServer *server);
+
+    /// @brief Apply "service.name" of changed configuration, calls in flight finish with previous name. Signing keys
+    /// are parsed once, so changed keys need restart.
+    /// @param config service configuration
+    void reconfigure(const IServiceConfig *config);
+
+private:
+    /// @brief Admission control of login, checked before any storage is queried
+    /// @param username user name
+    /// @param peer client address, or null if unknown
+    /// @return false if login should be rejected
+    [[nodiscard]] bool admitLogin(const QString &username, const QHostAddress &peer) const;
+
     /// @brief Create new authentication token pair (access and refresh)
+    /// @param request request message
     /// @param username user name
     /// @param password user password
     /// @param audience service name to create token
@@ -61,9 +97,11 @@ public Q_SLOTS:
     ///     "jsonrpc": "2.0"
     /// }
     /// @endcode
-    QJsonObject login(const QString &username, const QString &password, const QString &audience);
+    [[nodiscard]] QJsonRpcMessage loginImpl(const QJsonRpcMessage &request, const QString &username,
+                                            const QString &password, const QString &audience);
 
     /// @brief Refresh authentication token
+    /// @param request request message
     /// @param token authentication refresh token
     /// @return new token pair on success, otherwise error.
     /// Token - JWT token, that contains "iss"(username), "sub"(service name), "jti"(token id) and "exp"(expiration date).
@@ -93,9 +131,10 @@ public Q_SLOTS:
     ///     "jsonrpc": "2.0"
     /// }
     /// @endcode
-    QJsonObject refresh(const QString &token);
+    [[nodiscard]] QJsonRpcMessage refreshImpl(const QJsonRpcMessage &request, const QString &token);
 
     /// @brief Logout user
+    /// @param request request message
     /// @param token authentication token
     /// @return true if success(false if token not found).
     ///
@@ -107,9 +146,10 @@ public Q_SLOTS:
     ///     "result": true
     /// }
     /// @endcode
-    bool logout(const QString &token);
+    [[nodiscard]] QJsonRpcMessage logoutImpl(const QJsonRpcMessage &request, const QString &token);
 
     /// @brief Check authentication token
+    /// @param request request message
     /// @param token authentication token
     /// @return true if success(false if token not found).
     ///
@@ -121,9 +161,10 @@ public Q_SLOTS:
     ///     "result": true
     /// }
     /// @endcode
-    bool checkAuth(const QString &token);
+    [[nodiscard]] QJsonRpcMessage checkAuthImpl(const QJsonRpcMessage &request, const QString &token);
 
     /// @brief Get user identity
+    /// @param request request message
     /// @param token authentication token
     /// @return user identity.
     ///
@@ -149,10 +190,79 @@ public Q_SLOTS:
     ///     "jsonrpc": "2.0"
     /// }
     /// @endcode
-    QJsonObject getIdentity(const QString &token);
+    [[nodiscard]] QJsonRpcMessage getIdentityImpl(const QJsonRpcMessage &request, const QString &token);
 
-private:
-    [[nodiscard]] QPair<QString, QString> createTokens(const QString &username, const QString &audience) const;
+    /// @brief Check several access tokens at once
+    /// @param request request message
+    /// @param tokens access tokens (at most 1000)
+    /// @return array of results in order of tokens: true if token is valid.
+    /// Identical tokens are verified once.
+    ///
+    /// Request example:
+    /// @code{.json}
+    /// {
+    ///     "id": 503,
+    ///     "jsonrpc": "2.0",
+    ///     "method": "auth.checkAuthBatch",
+    ///     "params": [["eyJhbGciOiJSUzI1NiIsInR5cCI6IkpXVCJ9...", "invalid"]]
+    /// }
+    /// @endcode
+    /// Response example:
+    /// @code{.json}
+    /// {
+    ///     "id": 503,
+    ///     "jsonrpc": "2.0",
+    ///     "result": [true, false]
+    /// }
+    /// @endcode
+    [[nodiscard]] QJsonRpcMessage checkAuthBatchImpl(const QJsonRpcMessage &request, const QVariantList &tokens);
+
+    /// @brief Get user identities for several access tokens at once
+    /// @param request request message
+    /// @param tokens access tokens (at most 1000)
+    /// @return array of identities in order of tokens, null for invalid token.
+    /// Identical tokens are verified once.
+    ///
+    /// Response example:
+    /// @code{.json}
+    /// {
+    ///     "id": 503,
+    ///     "jsonrpc": "2.0",
+    ///     "result": [{"username": "admin"}, null]
+    /// }
+    /// @endcode
+    /// Error example:
+    /// @code{.json}
+    /// {
+    ///     "error": {
+    ///         "code": -32602,
+    ///         "data": null,
+    ///         "message": "Too many tokens"
+    ///     },
+    ///     "id": 1,
+    ///     "jsonrpc": "2.0"
+    /// }
+    /// @endcode
+    [[nodiscard]] QJsonRpcMessage getIdentityBatchImpl(const QJsonRpcMessage &request, const QVariantList &tokens);
+
+    /// @brief Verify token on its bytes, without converting it to UTF-8 string
+    /// @param token token from request
+    /// @return token claims if token is valid, otherwise std::nullopt
+    [[nodiscard]] std::optional<JwtClaims> verifyToken(const QString &token) const;
+
+    /// @brief Verify distinct tokens of batch
+    /// @param tokens access tokens, may repeat
+    /// @return usernames by token, invalid tokens are absent
+    [[nodiscard]] QHash<QString, QString> lookupIdentities(const QVariantList &tokens) const;
+
+    /// @brief Create session and token pair for it
+    /// @param username user name
+    /// @param userVersion user version, stored in session
+    /// @param audience token audience
+    /// @return refresh and access tokens, or std::nullopt if session cannot be stored
+    [[nodiscard]] std::optional<QPair<QString, QString> > createTokens(const QString &username,
+                                                                       const QString &userVersion,
+                                                                       const QString &audience) const;
 
     [[nodiscard]] std::optional<QPair<QString, QString> > newPairFromRefresh(const QString &refreshToken) const;
 
@@ -160,10 +270,22 @@ private:
     std::vector<std::unique_ptr<IUserStorage> > users;
 
     std::unique_ptr<IAuthStorage> auths;
-    /// @brief Service signing keys
-    QString privateKey, publicKey;
-    /// @brief Current service name
-    QString serviceName;
+    /// @brief Service signing keys, parsed once
+    std::unique_ptr<Rs256Engine> engine;
+    /// @brief Current service name, follows reload of configuration
+    Reloadable<QString> serviceName;
+    /// @brief Delay before refresh token can be used
+    std::chrono::seconds refreshDelay;
+    /// @brief Tokens revoked by logout and refresh, used in stateless mode only (otherwise null)
+    std::unique_ptr<RevocationSet> revocations;
+
+    /// @brief Login attempts by user name and client address, null if not limited
+    std::unique_ptr<RateLimiter> userLimiter;
+    /// @brief Login attempts by client address, null if not limited
+    std::unique_ptr<RateLimiter> peerLimiter;
+
+    /// @brief Bounded pool for logins (password hashing), so burst of logins can't starve token checks
+    std::unique_ptr<RequestExecutor> loginPool;
 };
 
 
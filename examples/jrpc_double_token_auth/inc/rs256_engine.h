@@ -0,0 +1,65 @@
+#ifndef RS256_ENGINE_H
+#define RS256_ENGINE_H
+
+#include <chrono>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+
+typedef struct evp_pkey_st EVP_PKEY;
+
+/// @brief Claims of service tokens
+struct JwtClaims {
+    std::string jti;
+    std::string issuer;
+    std::string subject;
+    std::string audience;
+    /// @brief "ref" claim: true for refresh token
+    bool refresh = false;
+    std::chrono::system_clock::time_point issuedAt;
+    std::chrono::system_clock::time_point notBefore;
+    std::chrono::system_clock::time_point expiration;
+};
+
+/// @brief Rs256Engine
+/// Signs and verifies RS256 JWT tokens. PEM keys are parsed once in constructor, every thread keeps digest contexts
+/// initialized with these keys and only copies them per token, so neither signing nor verification parses keys.
+/// Engine is thread-safe.
+class Rs256Engine {
+public:
+    Rs256Engine(const Rs256Engine &) = delete;
+
+    /// @brief constructor
+    /// @param privateKeyPem private key in PEM format
+    /// @param publicKeyPem public key in PEM format
+    /// @throw std::runtime_error if any key cannot be parsed
+    Rs256Engine(const std::string &privateKeyPem, const std::string &publicKeyPem);
+
+    /// @brief create signed token
+    /// @param claims token claims
+    /// @return token in compact serialization
+    [[nodiscard]] std::string sign(const JwtClaims &claims) const;
+
+    /// @brief verify token signature, "exp" and "nbf" claims
+    /// @param token token in compact serialization
+    /// @return token claims if token is valid, otherwise std::nullopt
+    [[nodiscard]] std::optional<JwtClaims> verify(std::string_view token) const;
+
+    ~Rs256Engine();
+
+private:
+    struct ThreadContexts;
+
+    /// @brief digest contexts of calling thread, initialized with keys of this engine
+    [[nodiscard]] ThreadContexts &contexts() const;
+
+    EVP_PKEY *privateKey = nullptr;
+    EVP_PKEY *publicKey = nullptr;
+    /// @brief unique engine id, to tell thread contexts of different engines apart
+    uint64_t id;
+    /// @brief encoded header, same for all tokens
+    std::string header;
+};
+
+#endif // RS256_ENGINE_H
@@ -1,26 +1,91 @@
 #include <QtCore>
 #include <auth_service.h>
-#include <qjsonrpc/qjsonrpchttpserver.h>
+#include <service/rpc_http_server.h>
 #include <user_storage/qsql_user_storage.h>
-#include <auth_storage/mem_auth_storage.h>
+#include <user_storage/caching_user_storage.h>
+#include <user_storage/filtered_user_storage.h>
+#include <auth_storage/sharded_auth_storage.h>
+#include <auth_storage/compact_auth_storage.h>
+#include <auth_storage/persistent_auth_storage.h>
+#include <auth_storage/qsql_auth_storage.h>
+#include <auth_storage/instrumented_auth_storage.h>
 #include <auth_configuration/json_configuration.h>
+#include <metrics/metrics_server.h>
+#include <metrics/tracer.h>
 
 int main(int argc, char *argv[]) {
     QCoreApplication app(argc, argv);
 
-    QJsonRpcHttpServer rpcServer;
-    AuthServiceSettings authSettings;
     JsonConfiguration configuration = loadConfiguration();
+    // entries of batch request are executed concurrently on server workers
+    RpcHttpServer rpcServer(configuration.getServiceConfig("threads").toInt());
+    // behind gateway all clients share its address, so the real one is taken from header set by gateway
+    rpcServer.setForwardedHeader(configuration.getServiceConfig("forwarded_header").toString());
+    AuthServiceSettings authSettings;
 
-    authSettings.authStorage = std::make_unique<MemAuthStorage>();
-    authSettings.userStorages.emplace_back(std::move(std::make_unique<QSqlUserStorage>(&configuration)));
+    const QString storage = configuration.getAuthConfig("storage").toString();
+    if (storage == "persistent") {
+        authSettings.authStorage = std::make_unique<PersistentAuthStorage>(&configuration);
+    } else if (storage == "sql") {
+        authSettings.authStorage = std::make_unique<QSqlAuthStorage>(&configuration, &configuration);
+    } else if (storage == "compact") {
+        authSettings.authStorage = std::make_unique<CompactAuthStorage>(&configuration);
+    } else {
+        authSettings.authStorage = std::make_unique<ShardedAuthStorage>(&configuration);
+    }
+    authSettings.authStorage = std::make_unique<InstrumentedAuthStorage>(std::move(authSettings.authStorage));
+    std::unique_ptr<IUserStorage> userStorage = std::make_unique<CachingUserStorage>(
+        std::make_unique<QSqlUserStorage>(&configuration), &configuration);
+    // unknown user names are rejected before cache, database and password hashing
+    if (configuration.getUserConfig("username_filter").toBool()) {
+        userStorage = std::make_unique<FilteredUserStorage>(std::move(userStorage), &configuration);
+    }
+    authSettings.userStorages.emplace_back(std::move(userStorage));
 
-    rpcServer.addService(new AuthService(std::move(authSettings), &configuration, &rpcServer));
-    if (!rpcServer.listen(QHostAddress::LocalHost, 7777)) {
+    auto *service = new AuthService(std::move(authSettings), &configuration, &rpcServer);
+    service->registerMethods(&rpcServer);
+    const QVariant port = configuration.getServiceConfig("port");
+    if (!rpcServer.listen(QHostAddress::LocalHost, port.isValid() ? port.toInt() : 7777)) {
         qDebug() << "Failed to start Json-RPC HTTP server";
         qDebug() << rpcServer.errorString();
         return 1;
     }
 
+    // slow requests are traced, if threshold is set; tracing follows config file changes
+    const auto configureTracer = [&configuration]() {
+        const auto snapshot = configuration.snapshot();
+        const double threshold = snapshot->service.value("trace_threshold_ms").toDouble();
+        const QVariant sampleRate = snapshot->service.value("trace_sample_rate");
+        Tracer::instance().configure(std::chrono::microseconds(static_cast<qint64>(threshold * 1000)),
+                                     sampleRate.isValid() ? sampleRate.toDouble() : 1);
+    };
+    configureTracer();
+    // the rest of configuration is read once at start, so changes of it are reported
+    static const QSet<QString> RELOADED = {"service.trace_threshold_ms", "service.trace_sample_rate", "service.name"};
+    QObject::connect(&configuration, &JsonConfiguration::reloaded, service,
+                     [&configuration, service, configureTracer](const QStringList &changed) {
+        configureTracer();
+        service->reconfigure(&configuration);
+        QStringList restart;
+        for (const auto &key: changed) {
+            if (!RELOADED.contains(key)) {
+                restart.append(key);
+            }
+        }
+        if (!restart.isEmpty()) {
+            qDebug().noquote() << "Config keys take effect after restart:" << restart.join(", ");
+        }
+    });
+    configuration.watch();
+
+    // Prometheus endpoint on its own port, so it isn't exposed together with the service
+    MetricsServer metricsServer;
+    if (const int metricsPort = configuration.getServiceConfig("metrics_port").toInt(); metricsPort > 0) {
+        if (!metricsServer.listen(QHostAddress::LocalHost, metricsPort)) {
+            qDebug() << "Failed to start metrics server:" << metricsServer.errorString();
+            return 1;
+        }
+    }
+
     return app.exec();
 }
@@ -1,72 +1,97 @@
 #include <auth_service.h>
+#include <metrics/tracer.h>
+#include <token/token_bytes.h>
 #include <QFile>
-#include <qjsonrpc/qjsonrpcservice.h>
-#include <jwt/jwt.hpp>
+#include <QDebug>
+#include <QSet>
+
+/// @brief lifetime of access token
+static constexpr auto ACCESS_LIFETIME = std::chrono::minutes(5);
+/// @brief lifetime of refresh token
+static constexpr auto REFRESH_LIFETIME = std::chrono::hours(24);
+/// @brief default delay before refresh token can be used
+static constexpr auto REFRESH_DELAY = std::chrono::minutes(10);
+/// @brief maximum number of tokens in batch request
+static constexpr int MAX_BATCH = 1000;
 
 static QString createTokenImpl(
-    const QString &secret, const QString &jti, const QString &issuer,
+    const Rs256Engine &engine, const QString &jti, const QString &issuer,
     const QString &subject, const QString &audience, bool refresh,
     const std::chrono::system_clock::time_point &issued_at,
     const std::chrono::system_clock::time_point &not_before,
     const std::chrono::system_clock::time_point &expiration
 ) {
-    jwt::jwt_object jwt_object{
-        jwt::params::algorithm("RS256"),
-        jwt::params::secret(secret.toStdString()),
-    };
+    JwtClaims claims;
+    claims.audience = audience.toStdString();
+    claims.expiration = expiration;
+    claims.issuedAt = issued_at;
+    claims.issuer = issuer.toStdString();
+    claims.jti = jti.toStdString();
+    claims.notBefore = not_before;
+    claims.subject = subject.toStdString();
+    claims.refresh = refresh;
 
-    jwt_object.add_claim(jwt::registered_claims::audience, audience.toStdString());
-    jwt_object.add_claim(jwt::registered_claims::expiration, expiration);
-    jwt_object.add_claim(jwt::registered_claims::issued_at, issued_at);
-    jwt_object.add_claim(jwt::registered_claims::issuer, issuer.toStdString());
-    jwt_object.add_claim(jwt::registered_claims::jti, jti.toStdString());
-    jwt_object.add_claim(jwt::registered_claims::not_before, not_before);
-    jwt_object.add_claim(jwt::registered_claims::subject, subject.toStdString());
-    jwt_object.add_claim("ref", refresh);
+    return QString::fromStdString(engine.sign(claims));
+}
 
-    return QString::fromStdString(jwt_object.signature());
+/// @brief Create login limiter from "service.login_<kind>_rate" and "service.login_<kind>_burst", if rate is set
+static std::unique_ptr<RateLimiter> makeLoginLimiter(const IServiceConfig *config, const QString &kind) {
+    const double rate = config ? config->getServiceConfig("login_" + kind + "_rate").toDouble() : 0;
+    if (rate <= 0) {
+        return nullptr;
+    }
+    const double burst = config->getServiceConfig("login_" + kind + "_burst").toDouble();
+    const int size = config->getServiceConfig("login_limiter_size").toInt();
+    qDebug().noquote() << "AuthService: login limit by" << kind << "=" << rate << "per second";
+    return std::make_unique<RateLimiter>(rate, burst > 0 ? burst : rate, size > 0 ? size : 65536);
 }
 
-QPair<QString, QString> AuthService::createTokens(const QString &username, const QString &audience) const {
+std::optional<QPair<QString, QString> > AuthService::createTokens(const QString &username,
+                                                                  const QString &userVersion,
+                                                                  const QString &audience) const {
     QPair<QString, QString> pair;
-    const QString token = this->auths->authenticate(username, audience);
+    const auto now = std::chrono::system_clock::now();
+    // session is useless after refresh token expires
+    const QString token = this->auths->authenticate(username, userVersion, now + REFRESH_LIFETIME);
+    if (token.isEmpty()) {
+        return std::nullopt;
+    }
 
+    const QString &issuer = this->serviceName.get();
     // refresh
-    pair.first = createTokenImpl(this->privateKey, token, this->serviceName,
+    pair.first = createTokenImpl(*this->engine, token, issuer,
                                  username, audience, true,
-                                 std::chrono::system_clock::now(),
-                                 std::chrono::system_clock::now() + std::chrono::minutes(10),
-                                 std::chrono::system_clock::now() + std::chrono::hours(24));
+                                 now, now + this->refreshDelay, now + REFRESH_LIFETIME);
     // access
-    pair.second = createTokenImpl(this->privateKey, token, this->serviceName,
+    pair.second = createTokenImpl(*this->engine, token, issuer,
                                   username, audience, false,
-                                  std::chrono::system_clock::now(),
-                                  std::chrono::system_clock::now(),
-                                  std::chrono::system_clock::now() + std::chrono::minutes(5));
+                                  now, now, now + ACCESS_LIFETIME);
 
     return pair;
 }
 
+std::optional<JwtClaims> AuthService::verifyToken(const QString &token) const {
+    const TokenBytes bytes(token);
+    const auto view = bytes.view();
+    if (!view) {
+        return std::nullopt;
+    }
+    return this->engine->verify(view.value());
+}
+
 std::optional<QPair<QString, QString> > AuthService::newPairFromRefresh(const QString &refreshToken) const {
     // parse refresh token
-    std::error_code ec;
-    jwt::jwt_object data = jwt::decode(
-        refreshToken.toStdString(),
-        jwt::params::algorithms({"RS256"}),
-        ec,
-        jwt::params::secret(this->publicKey.toStdString()));
+    const auto claims = this->verifyToken(refreshToken);
 
     // if refresh token is invalid, return
-    if (ec || !data.payload().get_claim_value<bool>("ref")) {
+    if (!claims || !claims->refresh) {
         return std::nullopt;
     }
 
     // get all claims from refresh token
-    const auto jti = QString::fromStdString(data.payload().get_claim_value<std::string>(jwt::registered_claims::jti));
-    const auto audience = QString::fromStdString(
-        data.payload().get_claim_value<std::string>(jwt::registered_claims::audience));
-    const auto username = QString::fromStdString(
-        data.payload().get_claim_value<std::string>(jwt::registered_claims::subject));
+    const auto jti = QString::fromStdString(claims->jti);
+    const auto audience = QString::fromStdString(claims->audience);
+    const auto username = QString::fromStdString(claims->subject);
 
     // if jti is not exists, return
     const auto user = this->auths->get(jti);
@@ -74,15 +99,24 @@ std::optional<QPair<QString, QString> > AuthService::newPairFromRefresh(const QS
         return std::nullopt;
     }
 
-    // remove jti anyway
-    this->auths->remove(jti);
+    // refresh token is used once: of concurrent refreshes with it only the one, that removed jti, continues
+    if (!this->auths->remove(jti)) {
+        return std::nullopt;
+    }
+    // access token of this pair may be still alive
+    if (this->revocations) {
+        this->revocations->revoke(jti, std::chrono::system_clock::now() + ACCESS_LIFETIME);
+    }
 
     // if user version is changed, return
     auto found = false;
-    for (const auto &ustorage: this->users) {
-        if (ustorage->getUserVersion(user->first) != user->second) {
-            found = true;
-            break;
+    {
+        const Tracer::Span span("user.version");
+        for (const auto &ustorage: this->users) {
+            if (ustorage->getUserVersion(user->first) == user->second) {
+                found = true;
+                break;
+            }
         }
     }
     if (!found) {
@@ -90,27 +124,30 @@ std::optional<QPair<QString, QString> > AuthService::newPairFromRefresh(const QS
     }
 
     // create new tokens
-    return this->createTokens(username, audience);
+    return this->createTokens(username, user->second, audience);
 }
 
 AuthService::AuthService(
     AuthServiceSettings &&settings,
     const IServiceConfig *config,
     QObject *parent
-) : QJsonRpcService(parent),
+) : RpcService(parent),
     users(std::move(settings.userStorages)),
     auths(std::move(settings.authStorage)),
     serviceName(config ? config->getServiceConfig("name").toString() : "auth") {
     const auto privateKeyPath = config->getServiceConfig("private_key").toString();
     const auto publicKeyPath = config->getServiceConfig("public_key").toString();
 
+    // keys are parsed once, tokens are signed and verified with parsed keys
+    QByteArray privateKey;
+    QByteArray publicKey;
     // private key
     {
         auto file = QFile(privateKeyPath);
         if (!file.open(QIODevice::ReadOnly)) {
             qFatal("Failed to open private key file for read: `%s`", privateKeyPath.toStdString().c_str());
         }
-        this->privateKey = file.readAll();
+        privateKey = file.readAll();
         file.close();
     }
     // public key
@@ -119,122 +156,238 @@ AuthService::AuthService(
         if (!file.open(QIODevice::ReadOnly)) {
             qFatal("Failed to open public key file for read: `%s`", publicKeyPath.toStdString().c_str());
         }
-        this->publicKey = file.readAll();
+        publicKey = file.readAll();
         file.close();
     }
+    try {
+        this->engine = std::make_unique<Rs256Engine>(privateKey.toStdString(), publicKey.toStdString());
+    } catch (const std::runtime_error &e) {
+        qFatal("Failed to load signing keys: %s", e.what());
+    }
+
+    const QVariant refreshDelay = config ? config->getServiceConfig("refresh_delay") : QVariant();
+    this->refreshDelay = refreshDelay.isValid() ? std::chrono::seconds(qMax(0, refreshDelay.toInt())) : REFRESH_DELAY;
+
+    if (config && config->getServiceConfig("stateless_access").toBool()) {
+        this->revocations = std::make_unique<RevocationSet>();
+    }
+
+    this->userLimiter = makeLoginLimiter(config, "user");
+    this->peerLimiter = makeLoginLimiter(config, "peer");
+
+    const int loginThreads = config ? config->getServiceConfig("login_threads").toInt() : 0;
+    if (loginThreads > 0) {
+        const QVariant loginQueue = config->getServiceConfig("login_queue");
+        const int queue = loginQueue.isValid() ? loginQueue.toInt() : 64;
+        this->loginPool = std::make_unique<RequestExecutor>(loginThreads, loginThreads + queue, "login");
+    }
+
+    // sessions of changed users are dropped at once, not on their next check
+    for (const auto &user: this->users) {
+        user->onUsersChanged([this](const QSet<QString> &usernames) {
+            // lost changes leave sessions to the version check
+            if (usernames.isEmpty()) {
+                return;
+            }
+            const qint64 removed = this->auths->removeByUsers(usernames);
+            if (removed > 0) {
+                qDebug() << "Sessions of changed users are removed:" << removed;
+            } else if (removed < 0) {
+                qDebug() << "Sessions of changed users are not removed, they are rejected by version check";
+            }
+        });
+    }
 }
 
-QJsonObject AuthService::login(const QString &username, const QString &password, const QString &audience) {
-    const auto request = currentRequest();
+void AuthService::reconfigure(const IServiceConfig *config) {
+    const QString name = config->getServiceConfig("name").toString();
+    if (name != this->serviceName.get()) {
+        qDebug().noquote() << "AuthService: service name is changed to" << name;
+        this->serviceName.store(name);
+    }
+}
+
+AuthService::~AuthService() {
+    // requests in flight and change listeners use storages, so they are stopped before storages are destroyed
+    this->loginPool.reset();
+    this->users.clear();
+}
 
+void AuthService::registerMethods(RpcHttpServer *server) {
+    addMethod(server, "auth.login", {"username", "password", "audience"}, [this](const QJsonRpcMessage &request,
+                                                                                 const QJsonArray &params) {
+        return this->loginImpl(request, params[0].toString(), params[1].toString(), params[2].toString());
+    }, this->loginPool.get());
+    server->setGuard("auth.login", [this](const QJsonArray &params, const QHostAddress &peer) {
+        return this->admitLogin(params[0].toString(), peer);
+    });
+    addMethod(server, "auth.refresh", {"token"}, [this](const QJsonRpcMessage &request, const QJsonArray &params) {
+        return this->refreshImpl(request, params[0].toString());
+    });
+    addMethod(server, "auth.logout", {"token"}, [this](const QJsonRpcMessage &request, const QJsonArray &params) {
+        return this->logoutImpl(request, params[0].toString());
+    });
+    addMethod(server, "auth.checkAuth", {"token"}, [this](const QJsonRpcMessage &request, const QJsonArray &params) {
+        return this->checkAuthImpl(request, params[0].toString());
+    });
+    addMethod(server, "auth.getIdentity", {"token"}, [this](const QJsonRpcMessage &request, const QJsonArray &params) {
+        return this->getIdentityImpl(request, params[0].toString());
+    });
+    addMethod(server, "auth.checkAuthBatch", {"tokens"}, [this](const QJsonRpcMessage &request,
+                                                                const QJsonArray &params) {
+        return this->checkAuthBatchImpl(request, params[0].toArray().toVariantList());
+    });
+    addMethod(server, "auth.getIdentityBatch", {"tokens"}, [this](const QJsonRpcMessage &request,
+                                                                  const QJsonArray &params) {
+        return this->getIdentityBatchImpl(request, params[0].toArray().toVariantList());
+    });
+}
+
+bool AuthService::admitLogin(const QString &username, const QHostAddress &peer) const {
+    if (this->peerLimiter && !peer.isNull() && !this->peerLimiter->tryAcquire(peer.toString())) {
+        return false;
+    }
+    // user bucket is per client too, so anonymous caller can't lock user out for everyone
+    return !this->userLimiter || this->userLimiter->tryAcquire(username + QLatin1Char('\n') + peer.toString());
+}
+
+QJsonRpcMessage AuthService::loginImpl(const QJsonRpcMessage &request, const QString &username,
+                                       const QString &password, const QString &audience) {
     for (const auto &user: users) {
         if (const auto auth = user->authenticate(username, password); auth.has_value()) {
-            const QString token = this->auths->authenticate(username, auth.value());
-            QPair<QString, QString> pair = this->createTokens(username, audience);
-
-            if (token.isEmpty()) {
-                const auto error = request.request().createErrorResponse(
-                    QJsonRpc::InternalError, "Internal server error");
-                emit result(error);
-                return {};
+            const auto pair = this->createTokens(username, auth.value(), audience);
+            if (!pair) {
+                return request.createErrorResponse(QJsonRpc::InternalError, "Internal server error");
             }
 
-            return QJsonObject::fromVariantMap({
-                {"refresh", pair.first},
-                {"access", pair.second},
+            return request.createResponse(QJsonObject::fromVariantMap({
+                {"refresh", pair->first},
+                {"access", pair->second},
                 {
                     "user",
                     QVariant::fromValue(QVariantMap({
                         {"username", username},
                     }))
                 }
-            });
+            }));
         }
     }
-    const auto error = request.request().createErrorResponse(QJsonRpc::InternalError, "Invalid username or password");
-    emit result(error);
-    return {};
+    return request.createErrorResponse(QJsonRpc::InternalError, "Invalid username or password");
 }
 
-QJsonObject AuthService::refresh(const QString &token) {
-    const auto request = currentRequest();
+QJsonRpcMessage AuthService::refreshImpl(const QJsonRpcMessage &request, const QString &token) {
     const auto pair = this->newPairFromRefresh(token);
     if (!pair) {
-        const auto error = request.request().createErrorResponse(
-            QJsonRpc::InvalidParams, "Invalid refresh token");
-        emit result(error);
-        return {};
+        return request.createErrorResponse(QJsonRpc::InvalidParams, "Invalid refresh token");
     }
 
-    return QJsonObject::fromVariantMap({
+    return request.createResponse(QJsonObject::fromVariantMap({
         {"refresh", pair->first},
         {"access", pair->second},
-    });
+    }));
 }
 
-bool AuthService::logout(const QString &token) {
-    const auto request = currentRequest();
-    std::error_code ec;
-    jwt::jwt_object data = jwt::decode(
-        token.toStdString(),
-        jwt::params::algorithms({"RS256"}),
-        ec,
-        jwt::params::secret(this->publicKey.toStdString()));
-
-    if (ec) {
-        const auto error = request.request().createErrorResponse(
-            QJsonRpc::InvalidParams, "Invalid token");
-        emit result(error);
-        return {};
+QJsonRpcMessage AuthService::logoutImpl(const QJsonRpcMessage &request, const QString &token) {
+    const auto claims = this->verifyToken(token);
+    if (!claims) {
+        return request.createErrorResponse(QJsonRpc::InvalidParams, "Invalid token");
     }
 
-    QString jti = QString::fromStdString(data.payload().get_claim_value<std::string>(jwt::registered_claims::jti));
-    return this->auths->remove(jti);
+    const auto jti = QString::fromStdString(claims->jti);
+    if (this->revocations) {
+        this->revocations->revoke(jti, std::chrono::system_clock::now() + ACCESS_LIFETIME);
+    }
+    return request.createResponse(this->auths->remove(jti));
 }
 
-bool AuthService::checkAuth(const QString &token) {
-    const auto request = currentRequest();
-    std::error_code ec;
-    jwt::jwt_object data = jwt::decode(
-        token.toStdString(),
-        jwt::params::algorithms({"RS256"}),
-        ec,
-        jwt::params::secret(this->publicKey.toStdString()));
-
-    if (ec) {
-        const auto error = request.request().createErrorResponse(
-            QJsonRpc::InvalidParams, "Invalid token");
-        emit result(error);
-        return {};
+QJsonRpcMessage AuthService::checkAuthImpl(const QJsonRpcMessage &request, const QString &token) {
+    const auto claims = this->verifyToken(token);
+    if (!claims) {
+        return request.createErrorResponse(QJsonRpc::InvalidParams, "Invalid token");
     }
 
-    QString jti = QString::fromStdString(data.payload().get_claim_value<std::string>(jwt::registered_claims::jti));
-    return this->auths->get(jti).has_value();
+    const auto jti = QString::fromStdString(claims->jti);
+    if (this->revocations) {
+        // signature, "exp" and "nbf" are checked already, so only revocation is left
+        return request.createResponse(!claims->refresh && !this->revocations->isRevoked(jti));
+    }
+    return request.createResponse(this->auths->get(jti).has_value());
 }
 
-QJsonObject AuthService::getIdentity(const QString &token) {
-    const auto request = currentRequest();
-    std::error_code ec;
-    jwt::jwt_object data = jwt::decode(
-        token.toStdString(),
-        jwt::params::algorithms({"RS256"}),
-        ec,
-        jwt::params::secret(this->publicKey.toStdString()));
+QJsonRpcMessage AuthService::getIdentityImpl(const QJsonRpcMessage &request, const QString &token) {
+    const auto claims = this->verifyToken(token);
+    if (!claims) {
+        return request.createErrorResponse(QJsonRpc::InvalidParams, "Invalid token");
+    }
 
-    if (ec) {
-        const auto error = request.request().createErrorResponse(
-            QJsonRpc::InvalidParams, "Invalid token");
-        emit result(error);
-        return {};
+    const auto jti = QString::fromStdString(claims->jti);
+    if (this->revocations) {
+        if (claims->refresh || this->revocations->isRevoked(jti)) {
+            return request.createErrorResponse(QJsonRpc::InvalidParams, "Invalid token");
+        }
+        return request.createResponse(QJsonObject{{"username", QString::fromStdString(claims->subject)}});
     }
 
-    const auto jti = QString::fromStdString(data.payload().get_claim_value<std::string>(jwt::registered_claims::jti));
     auto user = this->auths->get(jti);
     if (!user) {
-        const auto error = request.request().createErrorResponse(
-            QJsonRpc::InternalError, "Internal server error");
-        emit result(error);
-        return {};
+        return request.createErrorResponse(QJsonRpc::InternalError, "Internal server error");
+    }
+    return request.createResponse(QJsonObject{{"username", user->first}});
+}
+
+QHash<QString, QString> AuthService::lookupIdentities(const QVariantList &tokens) const {
+    QHash<QString, QString> identities;
+    QSet<QString> checked;
+    for (const auto &value: tokens) {
+        const QString token = value.toString();
+        if (checked.contains(token)) {
+            continue;
+        }
+        checked.insert(token);
+
+        const auto claims = this->verifyToken(token);
+        if (!claims) {
+            continue;
+        }
+        const auto jti = QString::fromStdString(claims->jti);
+        if (this->revocations) {
+            if (!claims->refresh && !this->revocations->isRevoked(jti)) {
+                identities.insert(token, QString::fromStdString(claims->subject));
+            }
+        } else if (const auto user = this->auths->get(jti)) {
+            identities.insert(token, user->first);
+        }
+    }
+    return identities;
+}
+
+QJsonRpcMessage AuthService::checkAuthBatchImpl(const QJsonRpcMessage &request, const QVariantList &tokens) {
+    if (tokens.size() > MAX_BATCH) {
+        return request.createErrorResponse(QJsonRpc::InvalidParams, "Too many tokens");
+    }
+
+    const auto identities = this->lookupIdentities(tokens);
+    QJsonArray result;
+    for (const auto &token: tokens) {
+        result.append(identities.contains(token.toString()));
+    }
+    return request.createResponse(result);
+}
+
+QJsonRpcMessage AuthService::getIdentityBatchImpl(const QJsonRpcMessage &request, const QVariantList &tokens) {
+    if (tokens.size() > MAX_BATCH) {
+        return request.createErrorResponse(QJsonRpc::InvalidParams, "Too many tokens");
+    }
+
+    const auto identities = this->lookupIdentities(tokens);
+    QJsonArray result;
+    for (const auto &token: tokens) {
+        const auto it = identities.constFind(token.toString());
+        if (it == identities.constEnd()) {
+            result.append(QJsonValue());
+        } else {
+            result.append(QJsonObject{{"username", it.value()}});
+        }
     }
-    return {{"username", user->first}};
+    return request.createResponse(result);
 }
@@ -0,0 +1,210 @@
+#include <rs256_engine.h>
+#include <metrics/metrics.h>
+#include <metrics/tracer.h>
+#include <token/base64_url.h>
+#include <jwt/json/json.hpp>
+#include <openssl/bio.h>
+#include <openssl/evp.h>
+#include <openssl/pem.h>
+#include <atomic>
+#include <stdexcept>
+
+namespace {
+    int64_t toSeconds(const std::chrono::system_clock::time_point &time) {
+        return std::chrono::duration_cast<std::chrono::seconds>(time.time_since_epoch()).count();
+    }
+
+    std::chrono::system_clock::time_point fromSeconds(const int64_t seconds) {
+        return std::chrono::system_clock::time_point(std::chrono::seconds(seconds));
+    }
+
+    EVP_PKEY *readKey(const std::string &pem, const bool isPrivate) {
+        BIO *bio = BIO_new_mem_buf(pem.data(), static_cast<int>(pem.size()));
+        if (!bio) {
+            throw std::runtime_error("Failed to allocate key buffer");
+        }
+        EVP_PKEY *key = isPrivate
+                            ? PEM_read_bio_PrivateKey(bio, nullptr, nullptr, nullptr)
+                            : PEM_read_bio_PUBKEY(bio, nullptr, nullptr, nullptr);
+        BIO_free(bio);
+        if (!key) {
+            throw std::runtime_error(isPrivate ? "Invalid private key" : "Invalid public key");
+        }
+        return key;
+    }
+
+    std::atomic<uint64_t> engineCounter{1};
+}
+
+struct Rs256Engine::ThreadContexts {
+    uint64_t engine = 0;
+    EVP_MD_CTX *signTemplate = nullptr;
+    EVP_MD_CTX *verifyTemplate = nullptr;
+    EVP_MD_CTX *work = nullptr;
+
+    void reset() {
+        EVP_MD_CTX_free(this->signTemplate);
+        EVP_MD_CTX_free(this->verifyTemplate);
+        EVP_MD_CTX_free(this->work);
+        this->signTemplate = nullptr;
+        this->verifyTemplate = nullptr;
+        this->work = nullptr;
+        this->engine = 0;
+    }
+
+    ~ThreadContexts() {
+        this->reset();
+    }
+};
+
+Rs256Engine::Rs256Engine(const std::string &privateKeyPem, const std::string &publicKeyPem)
+    : id(engineCounter.fetch_add(1)),
+      header(base64UrlEncode(R"({"alg":"RS256","typ":"JWT"})")) {
+    this->privateKey = readKey(privateKeyPem, true);
+    try {
+        this->publicKey = readKey(publicKeyPem, false);
+    } catch (...) {
+        EVP_PKEY_free(this->privateKey);
+        throw;
+    }
+}
+
+Rs256Engine::ThreadContexts &Rs256Engine::contexts() const {
+    thread_local ThreadContexts contexts;
+    if (contexts.engine != this->id) {
+        contexts.reset();
+        contexts.signTemplate = EVP_MD_CTX_new();
+        contexts.verifyTemplate = EVP_MD_CTX_new();
+        contexts.work = EVP_MD_CTX_new();
+        if (!contexts.signTemplate || !contexts.verifyTemplate || !contexts.work
+            || EVP_DigestSignInit(contexts.signTemplate, nullptr, EVP_sha256(), nullptr, this->privateKey) != 1
+            || EVP_DigestVerifyInit(contexts.verifyTemplate, nullptr, EVP_sha256(), nullptr, this->publicKey) != 1) {
+            contexts.reset();
+            throw std::runtime_error("Failed to initialize RS256 digest context");
+        }
+        contexts.engine = this->id;
+    }
+    return contexts;
+}
+
+std::string Rs256Engine::sign(const JwtClaims &claims) const {
+    static Metrics::Histogram &duration = Metrics::instance().histogram(
+        "jrpc_auth_jwt_duration_seconds", "Time to sign or verify JWT tokens.",
+        Metrics::label("algorithm", "RS256") + ',' + Metrics::label("operation", "sign"));
+    const Metrics::Timer timer(duration);
+    const Tracer::Span span("jwt.sign");
+
+    const nlohmann::json payload = {
+        {"aud", claims.audience},
+        {"exp", toSeconds(claims.expiration)},
+        {"iat", toSeconds(claims.issuedAt)},
+        {"iss", claims.issuer},
+        {"jti", claims.jti},
+        {"nbf", toSeconds(claims.notBefore)},
+        {"ref", claims.refresh},
+        {"sub", claims.subject},
+    };
+
+    std::string token = this->header;
+    token.push_back('.');
+    token += base64UrlEncode(payload.dump());
+
+    ThreadContexts &ctx = this->contexts();
+    size_t length = 0;
+    if (EVP_MD_CTX_copy_ex(ctx.work, ctx.signTemplate) != 1
+        || EVP_DigestSignUpdate(ctx.work, token.data(), token.size()) != 1
+        || EVP_DigestSignFinal(ctx.work, nullptr, &length) != 1) {
+        throw std::runtime_error("Failed to sign token");
+    }
+    std::string signature(length, '\0');
+    if (EVP_DigestSignFinal(ctx.work, reinterpret_cast<unsigned char *>(signature.data()), &length) != 1) {
+        throw std::runtime_error("Failed to sign token");
+    }
+    signature.resize(length);
+
+    token.push_back('.');
+    token += base64UrlEncode(signature);
+    return token;
+}
+
+std::optional<JwtClaims> Rs256Engine::verify(const std::string_view token) const {
+    static Metrics::Histogram &duration = Metrics::instance().histogram(
+        "jrpc_auth_jwt_duration_seconds", "Time to sign or verify JWT tokens.",
+        Metrics::label("algorithm", "RS256") + ',' + Metrics::label("operation", "verify"));
+    const Metrics::Timer timer(duration);
+    const Tracer::Span span("jwt.verify");
+
+    const size_t headerEnd = token.find('.');
+    if (headerEnd == std::string_view::npos) {
+        return std::nullopt;
+    }
+    const size_t payloadEnd = token.find('.', headerEnd + 1);
+    if (payloadEnd == std::string_view::npos || token.find('.', payloadEnd + 1) != std::string_view::npos) {
+        return std::nullopt;
+    }
+
+    const auto header = base64UrlDecode(token.substr(0, headerEnd));
+    const auto payload = base64UrlDecode(token.substr(headerEnd + 1, payloadEnd - headerEnd - 1));
+    const auto signature = base64UrlDecode(token.substr(payloadEnd + 1));
+    if (!header || !payload || !signature) {
+        return std::nullopt;
+    }
+
+    try {
+        const auto headerJson = nlohmann::json::parse(header.value());
+        const auto alg = headerJson.find("alg");
+        if (alg == headerJson.end() || !alg->is_string() || alg->get<std::string>() != "RS256") {
+            return std::nullopt;
+        }
+
+        ThreadContexts &ctx = this->contexts();
+        if (EVP_MD_CTX_copy_ex(ctx.work, ctx.verifyTemplate) != 1
+            || EVP_DigestVerifyUpdate(ctx.work, token.data(), payloadEnd) != 1
+            || EVP_DigestVerifyFinal(ctx.work, reinterpret_cast<const unsigned char *>(signature->data()),
+                                     signature->size()) != 1) {
+            return std::nullopt;
+        }
+
+        const auto payloadJson = nlohmann::json::parse(payload.value());
+        if (!payloadJson.is_object()) {
+            return std::nullopt;
+        }
+        const auto text = [&payloadJson](const char *name) {
+            const auto it = payloadJson.find(name);
+            return it != payloadJson.end() && it->is_string() ? it->get<std::string>() : std::string();
+        };
+        const auto seconds = [&payloadJson](const char *name) -> std::optional<int64_t> {
+            const auto it = payloadJson.find(name);
+            if (it == payloadJson.end() || !it->is_number()) {
+                return std::nullopt;
+            }
+            return it->get<int64_t>();
+        };
+
+        const int64_t now = toSeconds(std::chrono::system_clock::now());
+        const auto exp = seconds("exp");
+        const auto nbf = seconds("nbf");
+        if ((exp && now > exp.value()) || (nbf && now < nbf.value())) {
+            return std::nullopt;
+        }
+
+        JwtClaims claims;
+        claims.jti = text("jti");
+        claims.issuer = text("iss");
+        claims.subject = text("sub");
+        claims.audience = text("aud");
+        const auto ref = payloadJson.find("ref");
+        claims.refresh = ref != payloadJson.end() && ref->is_boolean() && ref->get<bool>();
+        claims.issuedAt = fromSeconds(seconds("iat").value_or(0));
+        claims.notBefore = fromSeconds(nbf.value_or(0));
+        claims.expiration = fromSeconds(exp.value_or(0));
+        return claims;
+    } catch (const nlohmann::json::exception &) {
+        return std::nullopt;
+    }
+}
+
+Rs256Engine::~Rs256Engine() {
+    EVP_PKEY_free(this->privateKey);
+    EVP_PKEY_free(this->publicKey);
+}
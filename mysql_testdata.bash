@@ -18,6 +18,8 @@ DATABASE_NAME=$(extract_json "$json_config" '.user.name' | tr -d '\n')
 DATABASE_USER=$(extract_json "$json_config" '.user.user' | tr -d '\n')
 DATABASE_PASSWORD=$(extract_json "$json_config" '.user.password' | tr -d '\n')
 SOME_PASSWORD_SALT=$(extract_json "$json_config" '.user.salt' | tr -d '\n')
+PASSWORD_HASH=$(extract_json "$json_config" '.user.password_hash // "sha256"' | tr -d '\n')
+PBKDF2_ITERATIONS=$(extract_json "$json_config" '.user.pbkdf2_iterations // "100000"' | tr -d '\n')
 
 function psql_make_url() {
   echo "postgres://$DATABASE_USER:$DATABASE_PASSWORD@$DATABASE_HOST:$DATABASE_PORT/$DATABASE_NAME"
@@ -46,12 +48,19 @@ function get_schema() {
 }
 
 function calculate_hash() {
-  local password salt
+  local username password salt
 
-  password="$1"
+  username="$1"
+  password="$2"
   salt=$(get_salt)
 
-  printf "%s" "$salt$password" | sha256sum | awk '{print $1}'
+  if [ "$PASSWORD_HASH" = "pbkdf2" ]; then
+    # PBKDF2-HMAC-SHA256 with salt ~ username, 32 bytes
+    python3 -c 'import hashlib, sys; print(hashlib.pbkdf2_hmac("sha256", sys.argv[1].encode(), sys.argv[2].encode(), int(sys.argv[3])).hex())' \
+      "$password" "$salt$username" "$PBKDF2_ITERATIONS"
+  else
+    printf "%s" "$salt$password" | sha256sum | awk '{print $1}'
+  fi
 }
 
 function create_schema() {
@@ -79,7 +88,7 @@ function drop_users_table() {
 function add_user() {
   local username password
   username="$1"
-  password=$(calculate_hash "$2")
+  password=$(calculate_hash "$1" "$2")
   schema=$(get_schema)
   pqsql_make_request "INSERT INTO $schema.users (username, password) VALUES ('$username', '$password')"
 }
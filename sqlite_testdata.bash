@@ -0,0 +1,116 @@
+#!/bin/bash
+
+# Same as mysql_testdata.bash, but for local QSQLITE database.
+# Configuration should contain: "user": { "driver": "qsqlite", "name": "<path to database file>", "schema": "main" }
+
+# include .env
+set -a
+source .env
+set +a
+
+function extract_json() {
+  local json="$1" path="$2"
+  echo "$json" | jq -r "$path"
+}
+
+json_config=$(cat "$JRPC_AUTH_CONFIG_PATH")
+DATABASE_NAME=$(extract_json "$json_config" '.user.name' | tr -d '\n')
+SOME_PASSWORD_SALT=$(extract_json "$json_config" '.user.salt' | tr -d '\n')
+PASSWORD_HASH=$(extract_json "$json_config" '.user.password_hash // "sha256"' | tr -d '\n')
+PBKDF2_ITERATIONS=$(extract_json "$json_config" '.user.pbkdf2_iterations // "100000"' | tr -d '\n')
+
+function sqlite_make_request() {
+  local query="$*"
+  sqlite3 "$DATABASE_NAME" "$query"
+}
+
+function get_salt() {
+  if [ -z "$SOME_PASSWORD_SALT" ]; then
+    echo "SOME_PASSWORD_SALT"
+  else
+    echo "$SOME_PASSWORD_SALT"
+  fi
+}
+
+function calculate_hash() {
+  local username password salt
+
+  username="$1"
+  password="$2"
+  salt=$(get_salt)
+
+  if [ "$PASSWORD_HASH" = "pbkdf2" ]; then
+    # PBKDF2-HMAC-SHA256 with salt ~ username, 32 bytes
+    python3 -c 'import hashlib, sys; print(hashlib.pbkdf2_hmac("sha256", sys.argv[1].encode(), sys.argv[2].encode(), int(sys.argv[3])).hex())' \
+      "$password" "$salt$username" "$PBKDF2_ITERATIONS"
+  else
+    printf "%s" "$salt$password" | sha256sum | awk '{print $1}'
+  fi
+}
+
+function create_users_table() {
+  sqlite_make_request "CREATE TABLE IF NOT EXISTS users (
+  id INTEGER PRIMARY KEY AUTOINCREMENT,
+  username VARCHAR(255),
+  password VARCHAR(255)
+)"
+}
+
+function drop_users_table() {
+  sqlite_make_request "DROP TABLE IF EXISTS users"
+}
+
+function add_user() {
+  local username password
+  username="$1"
+  password=$(calculate_hash "$1" "$2")
+  sqlite_make_request "INSERT INTO users (username, password) VALUES ('$username', '$password')"
+}
+
+# make from $1... "[\"$1\", \"$2\", \"$3\", ...]"
+to_json_array() {
+    local args=("$@")
+    local result="["
+    local i
+    for ((i=0; i<${#args[@]}; i++)); do
+        result+="\"${args[i]}\""
+        [ $i -lt $((${#args[@]}-1)) ] && result+=", "
+    done
+    result+="]"
+    echo "$result"
+}
+
+function extract_token() {
+  local json="$1"
+  echo "$json" | jq -r '.result.token // ""'
+}
+
+function extract_result() {
+  local json="$1"
+  echo "$json" | jq -r '.result'
+}
+
+function json_rpc_request() {
+  local method params request
+  method="$1"
+  shift
+  params=$(to_json_array "$@")
+  request="{\"jsonrpc\": \"2.0\", \"method\": \"$method\", \"params\": $params, \"id\": 1}"
+
+  curl -s -X POST \
+    -H 'Content-Type: application/json' \
+    -H 'Accept: application/json' \
+    --max-time 10 \
+    --data-raw "$request" \
+    'http://127.0.0.1:7777'
+}
+
+drop_users_table
+create_users_table
+add_user "admin" "admin"
+
+token=$(extract_token "$(json_rpc_request "auth.login" "admin" "admin")")
+echo "Token: $token"
+echo "Test checkAuth with valid token: $(extract_result "$(json_rpc_request "auth.checkAuth" "$token")")"
+echo "Logout: $(extract_result "$(json_rpc_request "auth.logout" "$token")")"
+echo "Test checkAuth after logout: $(extract_result "$(json_rpc_request "auth.checkAuth" "$token")")"
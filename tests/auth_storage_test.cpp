@@ -0,0 +1,349 @@
+#include <map_configuration.h>
+#include <auth_storage/compact_auth_storage.h>
+#include <auth_storage/persistent_auth_storage.h>
+#include <auth_storage/qsql_auth_storage.h>
+#include <QFile>
+#include <QRandomGenerator>
+#include <QTemporaryDir>
+#include <QtSql/qsqldatabase.h>
+#include <QtSql/qsqlquery.h>
+#include <QtTest>
+#include <memory>
+
+/// @brief valid identifier of CompactAuthStorage, that is never issued in tests
+static const QString MISSING(32, 'A');
+
+/// @brief 64 lowercase hex characters, like SHA-256 of **QSqlUserStorage**, stored by CompactAuthStorage as bytes
+static const QString DIGEST = "3e5b1d5cd6c1d6f2a9e9c1d6c2a7b9f1e5d3c4b2a1f0e9d8c7b6a5f4e3d2c1b0";
+
+/// @brief Deletion and expiry of CompactAuthStorage, durability of PersistentAuthStorage, buffered writes of
+/// QSqlAuthStorage
+class AuthStorageTest : public QObject {
+    Q_OBJECT
+
+    QTemporaryDir directory;
+
+    /// @brief configuration of QSqlAuthStorage in database of the test
+    [[nodiscard]] MapConfiguration sqlConfiguration() const;
+
+    /// @brief user names of stored sessions, read by own connection
+    [[nodiscard]] QStringList storedUsers() const;
+
+private Q_SLOTS:
+    void init();
+
+    void cleanup();
+
+    void compactKeepsSessionsAfterRemovals();
+
+    void compactRemovesSessionsOfUsers();
+
+    void compactKeepsUserVersions();
+
+    void compactRejectsAndSweepsExpiredSessions();
+
+    void compactEvictsAboveMaxSessions();
+
+    void persistentRestoresSessions();
+
+    void persistentDropsSessionsWithoutLog();
+
+    void sqlBuffersSessionsUntilFlush();
+
+    void sqlFlushesFullBatch();
+
+    void sqlDoesNotWriteRemovedBufferedSession();
+
+    void sqlRemovesWrittenSession();
+
+    void sqlRemovesSessionsOfUsers();
+};
+
+MapConfiguration AuthStorageTest::sqlConfiguration() const {
+    MapConfiguration configuration;
+    configuration.user = {{"driver", "qsqlite"}, {"name", this->directory.filePath("sessions.sqlite")},
+                          {"schema", "main"}};
+    return configuration;
+}
+
+QStringList AuthStorageTest::storedUsers() const {
+    QStringList users;
+    {
+        QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE", "check");
+        db.setDatabaseName(this->directory.filePath("sessions.sqlite"));
+        db.open();
+        QSqlQuery query("SELECT username FROM sessions ORDER BY username", db);
+        while (query.next()) {
+            users.append(query.value(0).toString());
+        }
+    }
+    QSqlDatabase::removeDatabase("check");
+    return users;
+}
+
+void AuthStorageTest::init() {
+    QVERIFY(this->directory.isValid());
+}
+
+void AuthStorageTest::cleanup() {
+    QDir(this->directory.path()).removeRecursively();
+    QDir().mkpath(this->directory.path());
+}
+
+void AuthStorageTest::compactKeepsSessionsAfterRemovals() {
+    // one shard, so every removal shifts slots of the same table
+    MapConfiguration config;
+    config.auth["shards"] = 1;
+    CompactAuthStorage storage(&config);
+
+    QHash<QString, QString> sessions;
+    for (int i = 0; i < 5000; ++i) {
+        sessions.insert(storage.authenticate(QString("user%1").arg(i % 50), "version"), QString("user%1").arg(i % 50));
+    }
+    QCOMPARE(sessions.size(), 5000);
+
+    QRandomGenerator random(42);
+    QStringList removed;
+    for (auto it = sessions.begin(); it != sessions.end();) {
+        if (random.bounded(2) == 0) {
+            QVERIFY(storage.remove(it.key()));
+            removed.append(it.key());
+            it = sessions.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    QCOMPARE(storage.size(), static_cast<size_t>(sessions.size()));
+    for (auto it = sessions.constBegin(); it != sessions.constEnd(); ++it) {
+        QVERIFY(storage.get(it.key()) == (QPair<QString, QString>{it.value(), "version"}));
+    }
+    for (const auto &token: removed) {
+        QVERIFY(!storage.get(token));
+        QVERIFY(!storage.remove(token));
+    }
+}
+
+void AuthStorageTest::compactRemovesSessionsOfUsers() {
+    MapConfiguration config;
+    config.auth["shards"] = 1;
+    CompactAuthStorage storage(&config);
+
+    QHash<QString, QString> sessions;
+    for (int i = 0; i < 2000; ++i) {
+        sessions.insert(storage.authenticate(QString("user%1").arg(i % 20), "version"), QString("user%1").arg(i % 20));
+    }
+
+    const QSet<QString> changed{"user3", "user7", "user11", "unknown"};
+    QCOMPARE(storage.removeByUsers(changed), static_cast<qint64>(300));
+    QCOMPARE(storage.size(), static_cast<size_t>(1700));
+    for (auto it = sessions.constBegin(); it != sessions.constEnd(); ++it) {
+        if (changed.contains(it.value())) {
+            QVERIFY(!storage.get(it.key()));
+        } else {
+            QVERIFY(storage.get(it.key()) == (QPair<QString, QString>{it.value(), "version"}));
+        }
+    }
+    QCOMPARE(storage.removeByUsers(changed), static_cast<qint64>(0));
+
+    // names of removed users are released, new sessions intern them again
+    const QString token = storage.authenticate("user3", "version");
+    QVERIFY(storage.get(token) == (QPair<QString, QString>{"user3", "version"}));
+}
+
+void AuthStorageTest::compactKeepsUserVersions() {
+    CompactAuthStorage storage;
+    // lowercase hex digest is stored as bytes, everything else is interned as it is
+    for (const QString &version: {DIGEST, DIGEST.toUpper(), DIGEST.left(63), QString("version"), QString()}) {
+        const QString token = storage.authenticate("user", version);
+        QVERIFY2(storage.get(token) == (QPair<QString, QString>{"user", version}), qPrintable(version));
+    }
+}
+
+void AuthStorageTest::compactRejectsAndSweepsExpiredSessions() {
+    MapConfiguration config;
+    config.auth["shards"] = 1;
+    CompactAuthStorage storage(&config);
+
+    const auto past = std::chrono::system_clock::now() - std::chrono::seconds(10);
+    QStringList expired;
+    for (int i = 0; i < 10; ++i) {
+        expired.append(storage.authenticate("user", "version", past));
+    }
+    const QString alive = storage.authenticate("user", "version",
+                                               std::chrono::system_clock::now() + std::chrono::hours(1));
+    const QString forever = storage.authenticate("user", "version");
+
+    for (const auto &token: expired) {
+        QVERIFY(!storage.get(token));
+    }
+    QVERIFY(!storage.remove(expired.takeFirst()));
+
+    // every write sweeps a few slots, so writes to the shard drop the rest of expired sessions
+    for (int i = 0; i < 100 && storage.size() > 2; ++i) {
+        QVERIFY(!storage.remove(MISSING));
+    }
+    QCOMPARE(storage.size(), static_cast<size_t>(2));
+    QVERIFY(storage.get(alive));
+    QVERIFY(storage.get(forever));
+}
+
+void AuthStorageTest::compactEvictsAboveMaxSessions() {
+    MapConfiguration config;
+    config.auth["shards"] = 1;
+    config.auth["max_sessions"] = 100;
+    CompactAuthStorage storage(&config);
+
+    const auto now = std::chrono::system_clock::now();
+    for (int i = 0; i < 300; ++i) {
+        const QString token = storage.authenticate("user", "version", now + std::chrono::minutes(i + 1));
+        // just created session is never evicted
+        QVERIFY(storage.get(token));
+        QVERIFY(storage.size() <= 100);
+    }
+    QCOMPARE(storage.size(), static_cast<size_t>(100));
+}
+
+void AuthStorageTest::persistentRestoresSessions() {
+    MapConfiguration config;
+    config.auth["persistence_dir"] = this->directory.path();
+
+    QStringList tokens;
+    {
+        PersistentAuthStorage storage(&config);
+        for (int i = 0; i < 100; ++i) {
+            tokens.append(storage.authenticate(QString("user%1").arg(i), "version"));
+            QVERIFY(!tokens.last().isEmpty());
+        }
+        QVERIFY(storage.remove(tokens[0]));
+        QCOMPARE(storage.removeByUsers({"user1"}), static_cast<qint64>(1));
+    }
+
+    PersistentAuthStorage storage(&config);
+    QCOMPARE(storage.sessionCount(), static_cast<qint64>(98));
+    QVERIFY(!storage.get(tokens[0]));
+    QVERIFY(!storage.get(tokens[1]));
+    for (int i = 2; i < tokens.size(); ++i) {
+        QVERIFY(storage.get(tokens[i]) == (QPair<QString, QString>{QString("user%1").arg(i), "version"}));
+    }
+}
+
+void AuthStorageTest::persistentDropsSessionsWithoutLog() {
+    if (!QFile::link("/dev/full", this->directory.filePath("sessions.log"))) {
+        QSKIP("/dev/full is not available");
+    }
+    MapConfiguration config;
+    config.auth["persistence_dir"] = this->directory.path();
+    {
+        PersistentAuthStorage storage(&config);
+        for (int i = 0; i < 10; ++i) {
+            QVERIFY(storage.authenticate("user", "version").isEmpty());
+        }
+        QCOMPARE(storage.sessionCount(), static_cast<qint64>(0));
+    }
+    // final snapshot replaces broken log, storage is usable again
+    PersistentAuthStorage storage(&config);
+    QCOMPARE(storage.sessionCount(), static_cast<qint64>(0));
+    QVERIFY(!storage.authenticate("user", "version").isEmpty());
+}
+
+void AuthStorageTest::sqlBuffersSessionsUntilFlush() {
+    MapConfiguration writerConfig = this->sqlConfiguration();
+    writerConfig.auth["sql_flush_interval"] = 3600000;
+    MapConfiguration readerConfig = this->sqlConfiguration();
+    readerConfig.auth["sql_cache_ttl"] = 1;
+
+    auto writer = std::make_unique<QSqlAuthStorage>(&writerConfig, &writerConfig);
+    QSqlAuthStorage reader(&readerConfig, &readerConfig);
+    const QString token = writer->authenticate("alice", "v1");
+    QVERIFY(writer->get(token) == (QPair<QString, QString>{"alice", "v1"}));
+    QVERIFY(!reader.get(token));
+    QVERIFY(this->storedUsers().isEmpty());
+
+    // buffered changes are written on shutdown
+    writer.reset();
+    QVERIFY(reader.get(token) == (QPair<QString, QString>{"alice", "v1"}));
+    QCOMPARE(this->storedUsers(), QStringList{"alice"});
+}
+
+void AuthStorageTest::sqlFlushesFullBatch() {
+    MapConfiguration config = this->sqlConfiguration();
+    config.auth["sql_flush_interval"] = 3600000;
+    config.auth["sql_batch_size"] = 3;
+    QSqlAuthStorage storage(&config, &config);
+
+    (void) storage.authenticate("alice", "v1");
+    (void) storage.authenticate("bob", "v1");
+    QTest::qWait(50);
+    QVERIFY(this->storedUsers().isEmpty());
+    (void) storage.authenticate("carol", "v1");
+    QTRY_COMPARE(this->storedUsers(), (QStringList{"alice", "bob", "carol"}));
+}
+
+void AuthStorageTest::sqlDoesNotWriteRemovedBufferedSession() {
+    MapConfiguration config = this->sqlConfiguration();
+    config.auth["sql_flush_interval"] = 3600000;
+    QString token;
+    {
+        QSqlAuthStorage storage(&config, &config);
+        token = storage.authenticate("alice", "v1");
+        const QString kept = storage.authenticate("bob", "v1");
+        QVERIFY(storage.remove(token));
+        QVERIFY(!storage.get(token));
+        QVERIFY(!storage.remove(token));
+        QVERIFY(storage.get(kept));
+    }
+    QCOMPARE(this->storedUsers(), QStringList{"bob"});
+}
+
+void AuthStorageTest::sqlRemovesWrittenSession() {
+    MapConfiguration writerConfig = this->sqlConfiguration();
+    MapConfiguration readerConfig = this->sqlConfiguration();
+    readerConfig.auth["sql_cache_ttl"] = 1;
+    QSqlAuthStorage writer(&writerConfig, &writerConfig);
+    QSqlAuthStorage reader(&readerConfig, &readerConfig);
+
+    const QString token = writer.authenticate("alice", "v1");
+    QTRY_VERIFY(reader.get(token));
+
+    // removal is buffered too, but this instance doesn't serve the session anymore
+    QVERIFY(writer.remove(token));
+    QVERIFY(!writer.get(token));
+    QVERIFY(!writer.remove(token));
+    QTRY_VERIFY(!reader.get(token));
+    QTRY_VERIFY(this->storedUsers().isEmpty());
+}
+
+void AuthStorageTest::sqlRemovesSessionsOfUsers() {
+    MapConfiguration config = this->sqlConfiguration();
+    QString writtenAlice, writtenBob;
+    {
+        QSqlAuthStorage storage(&config, &config);
+        writtenAlice = storage.authenticate("alice", "v1");
+        writtenBob = storage.authenticate("bob", "v1");
+    }
+    QCOMPARE(this->storedUsers(), (QStringList{"alice", "bob"}));
+
+    config.auth["sql_flush_interval"] = 3600000;
+    {
+        QSqlAuthStorage storage(&config, &config);
+        const QString pendingAlice = storage.authenticate("alice", "v2");
+        const QString pendingBob = storage.authenticate("bob", "v2");
+        // written session is cached, removal drops it from cache too
+        QVERIFY(storage.get(writtenAlice));
+
+        QCOMPARE(storage.removeByUsers({}), static_cast<qint64>(0));
+        QCOMPARE(storage.removeByUsers({"alice", "unknown"}), static_cast<qint64>(2));
+        QVERIFY(!storage.get(writtenAlice));
+        QVERIFY(!storage.get(pendingAlice));
+        QVERIFY(storage.get(writtenBob) == (QPair<QString, QString>{"bob", "v1"}));
+        QVERIFY(storage.get(pendingBob) == (QPair<QString, QString>{"bob", "v2"}));
+        // written sessions are deleted right away, not on flush
+        QCOMPARE(this->storedUsers(), QStringList{"bob"});
+    }
+    QCOMPARE(this->storedUsers(), (QStringList{"bob", "bob"}));
+}
+
+QTEST_GUILESS_MAIN(AuthStorageTest)
+
+#include "auth_storage_test.moc"
@@ -0,0 +1,39 @@
+#ifndef MAP_CONFIGURATION_H
+#define MAP_CONFIGURATION_H
+
+#include <auth_configuration/iuser_config.h>
+#include <auth_configuration/iauth_config.h>
+#include <auth_configuration/iservice_config.h>
+#include <QVariantHash>
+
+/// @brief In-memory configuration for tests and benchmarks
+class MapConfiguration : public IUserConfig, public IAuthConfig, public IServiceConfig {
+public:
+    QVariantHash service, auth, user;
+
+    void setServiceConfig(const QString &config, const QVariant &value) override {
+        this->service[config] = value;
+    }
+
+    [[nodiscard]] QVariant getServiceConfig(const QString &config) const override {
+        return this->service.value(config);
+    }
+
+    void setAuthConfig(const QString &config, const QVariant &value) override {
+        this->auth[config] = value;
+    }
+
+    [[nodiscard]] QVariant getAuthConfig(const QString &config) const override {
+        return this->auth.value(config);
+    }
+
+    void setUserConfig(const QString &config, const QVariant &value) override {
+        this->user[config] = value;
+    }
+
+    [[nodiscard]] QVariant getUserConfig(const QString &config) const override {
+        return this->user.value(config);
+    }
+};
+
+#endif // MAP_CONFIGURATION_H
@@ -0,0 +1,248 @@
+#include <service/rpc_http_server.h>
+#include <QElapsedTimer>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QTcpSocket>
+#include <QThread>
+#include <QtTest>
+#include <memory>
+
+/// @brief calls from this client address are rejected by guard
+static const QHostAddress BLOCKED("192.0.2.1");
+
+static const QByteArray ECHO = R"({"jsonrpc": "2.0", "id": 1, "method": "test.echo", "params": [42]})";
+
+/// @brief status codes and bodies of complete responses in data
+static QList<QPair<int, QByteArray> > parseResponses(const QByteArray &data) {
+    QList<QPair<int, QByteArray> > responses;
+    int position = 0;
+    while (true) {
+        const int headerEnd = data.indexOf("\r\n\r\n", position);
+        if (headerEnd < 0) {
+            return responses;
+        }
+        const QList<QByteArray> lines = data.mid(position, headerEnd - position).split('\n');
+        const int status = lines.first().split(' ').value(1).toInt();
+        int length = 0;
+        for (const auto &line: lines) {
+            if (line.toLower().startsWith("content-length:")) {
+                length = line.mid(line.indexOf(':') + 1).trimmed().toInt();
+            }
+        }
+        if (data.size() < headerEnd + 4 + length) {
+            return responses;
+        }
+        responses.append({status, data.mid(headerEnd + 4, length)});
+        position = headerEnd + 4 + length;
+    }
+}
+
+/// @brief read from socket until `expected` responses arrived, connection is closed or timeout expired
+static void receive(QTcpSocket &socket, QByteArray &received, const int expected) {
+    QElapsedTimer timer;
+    timer.start();
+    while (parseResponses(received).size() < expected && timer.elapsed() < 5000) {
+        const bool ready = socket.waitForReadyRead(100);
+        received += socket.readAll();
+        if (!ready && socket.state() != QAbstractSocket::ConnectedState) {
+            return;
+        }
+    }
+}
+
+static QByteArray post(const QByteArray &body, const QByteArray &headers = QByteArray()) {
+    return "POST / HTTP/1.1\r\nHost: localhost\r\n" + headers + "Content-Length: " + QByteArray::number(body.size())
+           + "\r\n\r\n" + body;
+}
+
+/// @brief JSON-RPC result of response body
+static QJsonValue resultOf(const QByteArray &body) {
+    return QJsonDocument::fromJson(body).object().value("result");
+}
+
+/// @brief JSON-RPC error code of response body, 0 if there is no error
+static int errorOf(const QByteArray &body) {
+    return QJsonDocument::fromJson(body).object().value("error").toObject().value("code").toInt();
+}
+
+/// @brief HTTP parser of RpcHttpServer over loopback: pipelining, chunked body, "Expect: 100-continue", limits of
+/// body and batch, malformed requests, client address from forwarded header
+class RpcHttpServerTest : public QObject {
+    Q_OBJECT
+
+    std::unique_ptr<QThread> serverThread;
+    RpcHttpServer *server = nullptr;
+    quint16 port = 0;
+
+    /// @brief send parts of request one after another, so they arrive separately
+    /// @param parts parts of request
+    /// @param expected number of responses to wait for
+    /// @param interim wait for one interim response (e.g. "100 Continue") after each part but the last one
+    /// @return complete responses
+    QList<QPair<int, QByteArray> > exchange(const QList<QByteArray> &parts, int expected, bool interim = false);
+
+private Q_SLOTS:
+    void initTestCase();
+
+    void cleanupTestCase();
+
+    void call();
+
+    void pipelined();
+
+    void chunked();
+
+    void expectContinue();
+
+    void forwarded();
+
+    void rejected_data();
+
+    void rejected();
+};
+
+QList<QPair<int, QByteArray> > RpcHttpServerTest::exchange(const QList<QByteArray> &parts, const int expected,
+                                                           const bool interim) {
+    QTcpSocket socket;
+    socket.connectToHost(QHostAddress::LocalHost, this->port);
+    if (!socket.waitForConnected(1000)) {
+        return {};
+    }
+    QByteArray received;
+    for (int i = 0; i < parts.size(); ++i) {
+        socket.write(parts[i]);
+        socket.waitForBytesWritten(1000);
+        if (i + 1 < parts.size()) {
+            if (interim) {
+                receive(socket, received, i + 1);
+            } else {
+                QThread::msleep(5);
+            }
+        }
+    }
+    receive(socket, received, expected);
+    return parseResponses(received);
+}
+
+/// @brief server runs event loop of its own thread, so client of the test may block
+void RpcHttpServerTest::initTestCase() {
+    this->serverThread = std::make_unique<QThread>();
+    this->serverThread->start();
+    this->server = new RpcHttpServer(2);
+    this->server->addMethod("test.echo", {"value"}, [](const QJsonRpcMessage &request, const QJsonArray &params) {
+        return request.createResponse(params[0]);
+    });
+    this->server->setGuard("test.echo", [](const QJsonArray &, const QHostAddress &peer) {
+        return peer != BLOCKED;
+    });
+    this->server->setForwardedHeader("X-Forwarded-For");
+    this->server->moveToThread(this->serverThread.get());
+    bool listening = false;
+    QMetaObject::invokeMethod(this->server, [this, &listening]() {
+        listening = this->server->listen(QHostAddress::LocalHost, 0);
+        this->port = this->server->serverPort();
+    }, Qt::BlockingQueuedConnection);
+    QVERIFY(listening);
+}
+
+void RpcHttpServerTest::cleanupTestCase() {
+    QMetaObject::invokeMethod(this->server, [this]() {
+        delete this->server;
+    }, Qt::BlockingQueuedConnection);
+    this->server = nullptr;
+    this->serverThread->quit();
+    this->serverThread->wait();
+    this->serverThread.reset();
+}
+
+void RpcHttpServerTest::call() {
+    const auto responses = this->exchange({post(ECHO)}, 1);
+    QCOMPARE(responses.size(), 1);
+    QCOMPARE(responses[0].first, 200);
+    QCOMPARE(resultOf(responses[0].second), QJsonValue(42));
+}
+
+void RpcHttpServerTest::pipelined() {
+    const QByteArray second = R"({"jsonrpc": "2.0", "id": 2, "method": "test.echo", "params": {"value": 7}})";
+    const auto responses = this->exchange({post(ECHO) + post(second)}, 2);
+    // answered in order of requests
+    QCOMPARE(responses.size(), 2);
+    QCOMPARE(resultOf(responses[0].second), QJsonValue(42));
+    QCOMPARE(resultOf(responses[1].second), QJsonValue(7));
+}
+
+void RpcHttpServerTest::chunked() {
+    const QByteArray request = "POST / HTTP/1.1\r\nHost: localhost\r\nTransfer-Encoding: chunked\r\n\r\n"
+                               + QByteArray::number(20, 16) + ";ext=1\r\n" + ECHO.left(20) + "\r\n"
+                               + QByteArray::number(ECHO.size() - 20, 16) + "\r\n" + ECHO.mid(20) + "\r\n0\r\n\r\n";
+    // request is split in the middle of the first chunk, so parser waits for the rest
+    const int split = request.indexOf("\r\n\r\n") + 20;
+    const auto responses = this->exchange({request.left(split), request.mid(split)}, 1);
+    QCOMPARE(responses.size(), 1);
+    QCOMPARE(responses[0].first, 200);
+    QCOMPARE(resultOf(responses[0].second), QJsonValue(42));
+}
+
+void RpcHttpServerTest::expectContinue() {
+    const QByteArray request = post(ECHO, "Expect: 100-continue\r\n");
+    const int bodyStart = request.indexOf("\r\n\r\n") + 4;
+
+    // "100 Continue" is sent before body
+    const auto headers = this->exchange({request.left(bodyStart)}, 1);
+    QCOMPARE(headers.size(), 1);
+    QCOMPARE(headers[0].first, 100);
+
+    const auto responses = this->exchange({request.left(bodyStart), request.mid(bodyStart)}, 2, true);
+    QCOMPARE(responses.size(), 2);
+    QCOMPARE(responses[1].first, 200);
+    QCOMPARE(resultOf(responses[1].second), QJsonValue(42));
+}
+
+void RpcHttpServerTest::forwarded() {
+    // only the last address is set by trusted proxy
+    const QByteArray blocked = post(ECHO, "X-Forwarded-For: 10.0.0.1, 192.0.2.1\r\n");
+    const QByteArray spoofed = post(ECHO, "X-Forwarded-For: 192.0.2.1, 10.0.0.1\r\n");
+    const auto responses = this->exchange({blocked + spoofed}, 2);
+    QCOMPARE(responses.size(), 2);
+    QCOMPARE(errorOf(responses[0].second), static_cast<int>(QJsonRpc::InternalError));
+    QCOMPARE(resultOf(responses[1].second), QJsonValue(42));
+}
+
+void RpcHttpServerTest::rejected_data() {
+    QTest::addColumn<QByteArray>("request");
+    QTest::addColumn<int>("status");
+    QTest::addColumn<int>("error");
+
+    QByteArray batch = "[";
+    for (int i = 0; i <= 1000; ++i) {
+        batch += (i > 0 ? "," : "") + ECHO;
+    }
+    batch += "]";
+    QTest::newRow("no content length") << QByteArray("POST / HTTP/1.1\r\nHost: localhost\r\n\r\n" + ECHO) << 411 << 0;
+    QTest::newRow("oversize body")
+            << QByteArray("POST / HTTP/1.1\r\nHost: localhost\r\nContent-Length: 5000000\r\n\r\n") << 413 << 0;
+    QTest::newRow("invalid chunk") << QByteArray("POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\nzz\r\n") << 400
+                                   << 0;
+    QTest::newRow("unknown encoding") << QByteArray("POST / HTTP/1.1\r\nTransfer-Encoding: gzip\r\n\r\n") << 501 << 0;
+    QTest::newRow("empty batch") << post("[]") << 200 << static_cast<int>(QJsonRpc::InvalidRequest);
+    QTest::newRow("oversize batch") << post(batch) << 200 << static_cast<int>(QJsonRpc::InvalidRequest);
+    QTest::newRow("invalid json") << post("{\"jsonrpc\": ") << 200 << static_cast<int>(QJsonRpc::ParseError);
+}
+
+/// @brief malformed request is answered with one response of given status (and JSON-RPC error code for 200)
+void RpcHttpServerTest::rejected() {
+    QFETCH(QByteArray, request);
+    QFETCH(int, status);
+    QFETCH(int, error);
+
+    const auto responses = this->exchange({request}, 1);
+    QCOMPARE(responses.size(), 1);
+    QCOMPARE(responses[0].first, status);
+    if (status == 200) {
+        QCOMPARE(errorOf(responses[0].second), error);
+    }
+}
+
+QTEST_GUILESS_MAIN(RpcHttpServerTest)
+
+#include "rpc_http_server_test.moc"
@@ -0,0 +1,175 @@
+#include <auth_storage/session_table.h>
+#include <auth_storage/timing_wheel.h>
+#include <QDateTime>
+#include <QHash>
+#include <QRandomGenerator>
+#include <QSet>
+#include <QtTest>
+
+/// @brief Expiry of TimingWheel and SessionTable, eviction and removal by user of SessionTable
+class SessionTableTest : public QObject {
+    Q_OBJECT
+
+private Q_SLOTS:
+    void wheelReturnsKeyOnItsTick();
+
+    void wheelSchedulesPastDeadlineToNextTick();
+
+    void wheelCascadesFarDeadlines_data();
+
+    void wheelCascadesFarDeadlines();
+
+    void wheelReturnsEveryKeyOnce();
+
+    void tableExpiresSessions();
+
+    void tableKeepsReusedKey();
+
+    void tableRemovesAliveSessionOnly();
+
+    void tableEvictsOldestLiveSession();
+
+    void tableRemovesSessionsOfUsers();
+};
+
+void SessionTableTest::wheelReturnsKeyOnItsTick() {
+    TimingWheel wheel(0, 1000);
+    // deadline is rounded up to tick 2
+    wheel.schedule("a", 1500);
+    QCOMPARE(wheel.size(), 1);
+    QVERIFY(wheel.advance(1999).empty());
+    QCOMPARE(wheel.advance(2000), std::vector<QString>{"a"});
+    QCOMPARE(wheel.size(), 0);
+    QVERIFY(wheel.advance(100000).empty());
+}
+
+void SessionTableTest::wheelSchedulesPastDeadlineToNextTick() {
+    TimingWheel wheel(10000, 1000);
+    wheel.schedule("late", 5000);
+    QVERIFY(wheel.advance(10999).empty());
+    QCOMPARE(wheel.advance(11000), std::vector<QString>{"late"});
+}
+
+void SessionTableTest::wheelCascadesFarDeadlines_data() {
+    QTest::addColumn<qint64>("deadline");
+    constexpr qint64 SPAN = static_cast<qint64>(1) << (TimingWheel::LEVEL_BITS * TimingWheel::LEVELS);
+    QTest::newRow("level 1") << static_cast<qint64>(TimingWheel::SLOTS + 6);
+    QTest::newRow("level 2") << static_cast<qint64>(TimingWheel::SLOTS * TimingWheel::SLOTS + 7);
+    QTest::newRow("level 3") << static_cast<qint64>(TimingWheel::SLOTS * TimingWheel::SLOTS * TimingWheel::SLOTS + 8);
+    QTest::newRow("beyond span") << SPAN + 100;
+}
+
+void SessionTableTest::wheelCascadesFarDeadlines() {
+    QFETCH(qint64, deadline);
+    TimingWheel wheel(0, 1);
+    wheel.schedule("far", deadline);
+    QVERIFY(wheel.advance(deadline - 1).empty());
+    QCOMPARE(wheel.advance(deadline), std::vector<QString>{"far"});
+}
+
+void SessionTableTest::wheelReturnsEveryKeyOnce() {
+    constexpr qint64 RESOLUTION = 10;
+    TimingWheel wheel(0, RESOLUTION);
+    QRandomGenerator random(42);
+    QHash<QString, qint64> deadlines;
+    for (int i = 0; i < 1000; ++i) {
+        const qint64 deadline = random.bounded(1, 300000);
+        deadlines.insert(QString::number(i), deadline);
+        wheel.schedule(QString::number(i), deadline);
+    }
+
+    QSet<QString> returned;
+    qint64 previous = 0;
+    for (qint64 now = 37; now < 300000 + 37; now += 37) {
+        for (const auto &key: wheel.advance(now)) {
+            QVERIFY2(!returned.contains(key), qPrintable(key));
+            returned.insert(key);
+            // key is due on tick of its deadline rounded up, not earlier and not later
+            const qint64 tick = (deadlines.take(key) + RESOLUTION - 1) / RESOLUTION;
+            QVERIFY(tick <= now / RESOLUTION);
+            QVERIFY(tick > previous / RESOLUTION);
+        }
+        previous = now;
+    }
+    QVERIFY(deadlines.isEmpty());
+    QCOMPARE(wheel.size(), 0);
+}
+
+void SessionTableTest::tableExpiresSessions() {
+    const qint64 now = QDateTime::currentMSecsSinceEpoch();
+    SessionTable table;
+    table.insert("a", "alice", "v1", now + 1000);
+    table.insert("b", "bob", "v2", 0);
+
+    QVERIFY(table.get("a", now) == (QPair<QString, QString>{"alice", "v1"}));
+    // expired session is rejected before it is dropped
+    QVERIFY(!table.get("a", now + 1000));
+    table.expire(now + 999);
+    QCOMPARE(table.size(), 2);
+    table.expire(now + 2000);
+    QCOMPARE(table.size(), 1);
+    QVERIFY(!table.contains("a"));
+    QVERIFY(table.get("b", now + 1000000000) == (QPair<QString, QString>{"bob", "v2"}));
+}
+
+void SessionTableTest::tableKeepsReusedKey() {
+    const qint64 now = QDateTime::currentMSecsSinceEpoch();
+    SessionTable table;
+    table.insert("a", "alice", "v1", now + 1000);
+    QVERIFY(table.remove("a", now));
+    table.insert("a", "alice", "v2", 0);
+    // wheel still holds deadline of removed session, it must not expire the new one
+    table.expire(now + 2000);
+    QVERIFY(table.get("a", now + 2000) == (QPair<QString, QString>{"alice", "v2"}));
+}
+
+void SessionTableTest::tableRemovesAliveSessionOnly() {
+    const qint64 now = QDateTime::currentMSecsSinceEpoch();
+    SessionTable table;
+    table.insert("a", "alice", "v1", now + 1000);
+    QVERIFY(!table.remove("a", now + 1000));
+    QVERIFY(!table.contains("a"));
+    QVERIFY(!table.remove("missing", now));
+}
+
+void SessionTableTest::tableEvictsOldestLiveSession() {
+    SessionTable table(2);
+    table.insert("a", "alice", "v", 0);
+    table.insert("b", "bob", "v", 0);
+    table.insert("c", "carol", "v", 0);
+    QCOMPARE(table.size(), 2);
+    QVERIFY(!table.contains("a"));
+
+    // removed session is skipped in queue, the oldest live one is evicted
+    QVERIFY(table.remove("b", 0));
+    table.insert("d", "dave", "v", 0);
+    QCOMPARE(table.size(), 2);
+    table.insert("e", "eve", "v", 0);
+    QCOMPARE(table.size(), 2);
+    QVERIFY(!table.contains("c"));
+    QVERIFY(table.contains("d"));
+    QVERIFY(table.contains("e"));
+}
+
+void SessionTableTest::tableRemovesSessionsOfUsers() {
+    const qint64 now = QDateTime::currentMSecsSinceEpoch();
+    SessionTable table;
+    table.insert("a", "alice", "v", now + 1000);
+    table.insert("b", "alice", "v", 0);
+    table.insert("c", "bob", "v", 0);
+
+    // expired session is removed too, but isn't reported
+    QCOMPARE(table.removeUsers({"alice"}, now + 2000), QStringList{"b"});
+    QCOMPARE(table.size(), 1);
+    QVERIFY(table.contains("c"));
+
+    QStringList visited;
+    table.forEach(now, [&visited](const QString &key, const QString &, const QString &, qint64) {
+        visited.append(key);
+    });
+    QCOMPARE(visited, QStringList{"c"});
+}
+
+QTEST_GUILESS_MAIN(SessionTableTest)
+
+#include "session_table_test.moc"
@@ -0,0 +1,182 @@
+#include <token/base64_url.h>
+#include <token/jwt_token.h>
+#include <user_storage/password_hasher.h>
+#include <rs256_engine.h>
+#include <jwt/jwt.hpp>
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
+#include <QtTest>
+#include <fstream>
+#include <sstream>
+
+static const QString SECRET = "SOME_JWT_SECRET";
+
+static std::string readKey(const char *name) {
+    std::ifstream file(std::string(KEY_DIR) + "/" + name);
+    std::stringstream content;
+    content << file.rdbuf();
+    return content.str();
+}
+
+/// @brief token of given header and payload, signed by HMAC-SHA256 with SECRET whatever header says
+static QString signHs256(const nlohmann::json &header, const nlohmann::json &payload) {
+    const std::string data = base64UrlEncode(header.dump()) + '.' + base64UrlEncode(payload.dump());
+    const std::string key = SECRET.toStdString();
+    unsigned char mac[EVP_MAX_MD_SIZE];
+    unsigned int size = 0;
+    HMAC(EVP_sha256(), key.data(), static_cast<int>(key.size()), reinterpret_cast<const unsigned char *>(data.data()),
+         data.size(), mac, &size);
+    const std::string signature = base64UrlEncode(std::string_view(reinterpret_cast<const char *>(mac), size));
+    return QString::fromStdString(data + '.' + signature);
+}
+
+static qint64 nowSeconds() {
+    return std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch())
+            .count();
+}
+
+/// @brief Verification of HS256 tokens, base64url codec and password hashing against reference values
+class TokenTest : public QObject {
+    Q_OBJECT
+
+private Q_SLOTS:
+    void acceptsValidToken();
+
+    void acceptsTokenOfCppJwt();
+
+    void rejectsToken_data();
+
+    void rejectsToken();
+
+    void base64UrlVectors_data();
+
+    void base64UrlVectors();
+
+    void base64UrlRejectsInvalidText();
+
+    void scryptMatchesRfc7914();
+};
+
+void TokenTest::acceptsValidToken() {
+    const QString jwt = createJwtToken(SECRET, "token", "jrpc_auth", "user");
+    QVERIFY(verifyJwtAndGetToken(jwt, SECRET) == QString("token"));
+    const QByteArray bytes = jwt.toLatin1();
+    const QByteArray secret = SECRET.toUtf8();
+    QVERIFY(verifyJwtAndGetToken(std::string_view(bytes.constData(), bytes.size()),
+                                 std::string_view(secret.constData(), secret.size())) == QString("token"));
+
+    const nlohmann::json claims = {{"jti", "token"}, {"sub", "user"}, {"iat", nowSeconds()}};
+    QVERIFY(verifyJwtAndGetToken(signHs256({{"alg", "HS256"}, {"typ", "JWT"}}, claims), SECRET) == QString("token"));
+}
+
+void TokenTest::acceptsTokenOfCppJwt() {
+    jwt::jwt_object issued{jwt::params::algorithm("HS256"), jwt::params::secret(SECRET.toStdString()),
+                           jwt::params::payload({{"jti", "token"}, {"sub", "user"}})};
+    QVERIFY(verifyJwtAndGetToken(QString::fromStdString(issued.signature()), SECRET) == QString("token"));
+}
+
+void TokenTest::rejectsToken_data() {
+    QTest::addColumn<QString>("token");
+
+    const qint64 now = nowSeconds();
+    const nlohmann::json hs256 = {{"alg", "HS256"}, {"typ", "JWT"}};
+    const nlohmann::json claims = {{"jti", "token"}, {"sub", "user"}, {"iat", now}};
+    nlohmann::json expired = claims;
+    expired["exp"] = now - 60;
+    nlohmann::json early = claims;
+    early["nbf"] = now + 3600;
+
+    const QString valid = createJwtToken(SECRET, "token", "jrpc_auth", "user");
+    const int headerEnd = valid.indexOf('.');
+    const int payloadEnd = valid.indexOf('.', headerEnd + 1);
+    QString tampered = valid;
+    tampered.replace(headerEnd + 1, payloadEnd - headerEnd - 1,
+                     QString::fromStdString(base64UrlEncode(R"({"jti":"other","sub":"admin"})")));
+    QString nonAscii = valid;
+    nonAscii[headerEnd + 1] = QChar(0x0436);
+
+    JwtClaims rs256;
+    rs256.jti = "token";
+    rs256.subject = "user";
+    rs256.issuedAt = std::chrono::system_clock::now();
+    rs256.notBefore = rs256.issuedAt;
+    rs256.expiration = rs256.issuedAt + std::chrono::hours(1);
+    const Rs256Engine engine(readKey("jwtRS512.pem"), readKey("jwtRS512.pem.pub"));
+
+    QTest::newRow("alg none") << QString::fromStdString(base64UrlEncode(R"({"alg":"none","typ":"JWT"})") + '.'
+                                                        + base64UrlEncode(claims.dump()) + '.');
+    QTest::newRow("alg RS256 signed with secret") << signHs256({{"alg", "RS256"}, {"typ", "JWT"}}, claims);
+    QTest::newRow("RS256") << QString::fromStdString(engine.sign(rs256));
+    QTest::newRow("tampered payload") << tampered;
+    QTest::newRow("truncated signature") << valid.left(valid.size() - 4);
+    QTest::newRow("no signature") << valid.left(payloadEnd);
+    QTest::newRow("expired exp") << signHs256(hs256, expired);
+    QTest::newRow("future nbf") << signHs256(hs256, early);
+    QTest::newRow("non-ASCII") << nonAscii;
+    QTest::newRow("empty") << QString();
+}
+
+void TokenTest::rejectsToken() {
+    QFETCH(QString, token);
+    QVERIFY(!verifyJwtAndGetToken(token, SECRET));
+}
+
+void TokenTest::base64UrlVectors_data() {
+    QTest::addColumn<QByteArray>("data");
+    QTest::addColumn<QByteArray>("encoded");
+
+    // RFC 4648, section 10, without padding
+    QTest::newRow("empty") << QByteArray() << QByteArray();
+    QTest::newRow("f") << QByteArray("f") << QByteArray("Zg");
+    QTest::newRow("fo") << QByteArray("fo") << QByteArray("Zm8");
+    QTest::newRow("foo") << QByteArray("foo") << QByteArray("Zm9v");
+    QTest::newRow("foob") << QByteArray("foob") << QByteArray("Zm9vYg");
+    QTest::newRow("fooba") << QByteArray("fooba") << QByteArray("Zm9vYmE");
+    QTest::newRow("foobar") << QByteArray("foobar") << QByteArray("Zm9vYmFy");
+    // characters, that differ from base64
+    QTest::newRow("url alphabet") << QByteArray::fromHex("fbffbf") << QByteArray("-_-_");
+}
+
+void TokenTest::base64UrlVectors() {
+    QFETCH(QByteArray, data);
+    QFETCH(QByteArray, encoded);
+    const std::string_view bytes(data.constData(), data.size());
+    const std::string_view text(encoded.constData(), encoded.size());
+
+    QCOMPARE(QByteArray::fromStdString(base64UrlEncode(bytes)), encoded);
+    QCOMPARE(base64UrlLength(data.size()), static_cast<size_t>(encoded.size()));
+    const auto decoded = base64UrlDecode(text);
+    QVERIFY(decoded);
+    QCOMPARE(QByteArray::fromStdString(decoded.value()), data);
+
+    // buffer variants, as authentication identifiers are encoded
+    QString wide(encoded.size(), Qt::Uninitialized);
+    base64UrlEncode(reinterpret_cast<const unsigned char *>(data.constData()), data.size(),
+                    reinterpret_cast<char16_t *>(wide.data()));
+    QCOMPARE(wide, QString::fromLatin1(encoded));
+    QByteArray out(encoded.size() * 3 / 4, '\0');
+    QVERIFY(base64UrlDecode(reinterpret_cast<const char16_t *>(wide.constData()), wide.size(),
+                            reinterpret_cast<unsigned char *>(out.data())));
+    QCOMPARE(out, data);
+}
+
+void TokenTest::base64UrlRejectsInvalidText() {
+    QVERIFY(!base64UrlDecode("Zm9v+"));
+    QVERIFY(!base64UrlDecode("Zm9v/"));
+    QVERIFY(!base64UrlDecode("Zm9v Yg"));
+    // one character can't encode a byte
+    QVERIFY(!base64UrlDecode("Zm9vY"));
+    // padding is tolerated
+    QVERIFY(base64UrlDecode("Zm8=") == std::string("fo"));
+}
+
+void TokenTest::scryptMatchesRfc7914() {
+    // salt is "SALT ~ USER", so "Na" ~ "Cl" gives salt "NaCl" of the RFC
+    const PasswordHasher reference(PasswordHasher::Algorithm::Scrypt, "Na", 0, {1024, 8, 16});
+    QCOMPARE(reference.hash("Cl", "password"),
+             QString("fdbabe1c9d3472007856e7190d01e9fe7c6ad7cbc8237830e77376634b373162"));
+}
+
+QTEST_GUILESS_MAIN(TokenTest)
+
+#include "token_test.moc"
@@ -0,0 +1,354 @@
+#include <map_configuration.h>
+#include <auth_storage/sharded_auth_storage.h>
+#include <user_storage/caching_user_storage.h>
+#include <user_storage/fan_out_user_storage.h>
+#include <user_storage/filtered_user_storage.h>
+#include <user_storage/qsql_user_storage.h>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QMutex>
+#include <QTemporaryDir>
+#include <QtSql/qsqldatabase.h>
+#include <QtSql/qsqlquery.h>
+#include <QtTest>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+/// @brief In-memory backend with optional latency, that counts lookups and reports changes by hand
+class MapUserStorage : public IUserStorage {
+public:
+    QHash<QString, QString> versions;
+    std::chrono::milliseconds delay{0};
+    std::atomic<int> lookups{0};
+    /// @brief called after version is read and before it is returned, like change landing during lookup
+    std::function<void()> duringLookup;
+    UsersChanged listener;
+
+    std::optional<QString> authenticate(const QString &username, const QString &password) override {
+        if (password != "password") {
+            return std::nullopt;
+        }
+        return this->getUserVersion(username);
+    }
+
+    std::optional<QString> getUserVersion(const QString &username) override {
+        ++this->lookups;
+        std::this_thread::sleep_for(this->delay);
+        std::optional<QString> version;
+        const auto it = this->versions.constFind(username);
+        if (it != this->versions.constEnd()) {
+            version = it.value();
+        }
+        if (this->duringLookup) {
+            this->duringLookup();
+        }
+        return version;
+    }
+
+    bool onUsersChanged(UsersChanged listener) override {
+        this->listener = std::move(listener);
+        return true;
+    }
+};
+
+/// @brief Backend, that doesn't answer until it is released, like directory behind dead connection
+class HungUserStorage : public IUserStorage {
+    std::mutex mutex;
+    std::condition_variable changed;
+    bool released = false;
+
+    void hang() {
+        std::unique_lock lock(this->mutex);
+        this->changed.wait(lock, [this]() {
+            return this->released;
+        });
+    }
+
+public:
+    std::optional<QString> authenticate(const QString &, const QString &) override {
+        this->hang();
+        return std::nullopt;
+    }
+
+    std::optional<QString> getUserVersion(const QString &) override {
+        this->hang();
+        return std::nullopt;
+    }
+
+    /// @brief let abandoned queries finish
+    void release() {
+        std::lock_guard lock(this->mutex);
+        this->released = true;
+        this->changed.notify_all();
+    }
+};
+
+/// @brief Releases hung backend on destruction. Declared after fan-out storage, so its workers don't wait for
+/// abandoned queries forever, even if test fails early.
+struct HungRelease {
+    HungUserStorage *storage;
+
+    ~HungRelease() {
+        this->storage->release();
+    }
+};
+
+/// @brief Invalidation of CachingUserStorage, delivery of change feed of QSqlUserStorage, FanOutUserStorage with
+/// slow and hung backends
+class UserStorageTest : public QObject {
+    Q_OBJECT
+
+    QTemporaryDir directory;
+
+    /// @brief create QSQLITE database with users "user0".."user9" of versions "version0".."version9"
+    /// @return configuration of polled change feed of the database
+    MapConfiguration createDatabase();
+
+    /// @brief change users by own connection
+    static bool execute(const QString &sql);
+
+private Q_SLOTS:
+    void cachingServesCachedVersion();
+
+    void cachingSkipsVersionChangedDuringLookup_data();
+
+    void cachingSkipsVersionChangedDuringLookup();
+
+    void cachingDropsChangedUsers();
+
+    void changeFeedRemovesSessionsOfUpdatedUser();
+
+    void changeFeedLetsInsertedUserThroughFilter();
+
+    void fanOutAnswersWithoutWaitingForSlowBackend();
+
+    void fanOutHedgesToNextBackend();
+
+    void fanOutSkipsHungBackend();
+
+    void cleanup();
+};
+
+/// @brief connection of "administrator", that changes users
+static const QString ADMIN = "admin";
+
+MapConfiguration UserStorageTest::createDatabase() {
+    const QString path = this->directory.filePath("users.sqlite");
+    QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE", ADMIN);
+    db.setDatabaseName(path);
+    db.open();
+    QSqlQuery query(db);
+    query.exec("CREATE TABLE users (id INTEGER PRIMARY KEY, username VARCHAR(255), password VARCHAR(255))");
+    query.exec("CREATE UNIQUE INDEX users_username ON users (username)");
+    for (int i = 0; i < 10; ++i) {
+        query.exec(QString("INSERT INTO users (username, password) VALUES ('user%1', 'version%1')").arg(i));
+    }
+
+    MapConfiguration configuration;
+    configuration.user = {
+        {"driver", "qsqlite"}, {"name", path}, {"schema", "main"}, {"change_feed", "poll"},
+        {"change_poll_interval", 10},
+    };
+    return configuration;
+}
+
+bool UserStorageTest::execute(const QString &sql) {
+    QSqlQuery query(QSqlDatabase::database(ADMIN));
+    return query.exec(sql) && query.numRowsAffected() == 1;
+}
+
+void UserStorageTest::cleanup() {
+    QSqlDatabase::removeDatabase(ADMIN);
+    QFile::remove(this->directory.filePath("users.sqlite"));
+}
+
+void UserStorageTest::cachingServesCachedVersion() {
+    auto backend = std::make_unique<MapUserStorage>();
+    MapUserStorage *map = backend.get();
+    map->versions.insert("alice", "v1");
+    CachingUserStorage cache(std::move(backend));
+
+    QVERIFY(cache.getUserVersion("alice") == QString("v1"));
+    QVERIFY(cache.getUserVersion("alice") == QString("v1"));
+    QCOMPARE(map->lookups.load(), 1);
+    // unknown users aren't cached
+    QVERIFY(!cache.getUserVersion("bob"));
+    QVERIFY(!cache.getUserVersion("bob"));
+    QCOMPARE(map->lookups.load(), 3);
+
+    // successful login refreshes cached version
+    map->versions.insert("alice", "v2");
+    QVERIFY(cache.authenticate("alice", "password") == QString("v2"));
+    QVERIFY(cache.getUserVersion("alice") == QString("v2"));
+    QCOMPARE(map->lookups.load(), 4);
+}
+
+void UserStorageTest::cachingSkipsVersionChangedDuringLookup_data() {
+    QTest::addColumn<QString>("change");
+    QTest::newRow("invalidate") << QString("invalidate");
+    QTest::newRow("clear") << QString("clear");
+    QTest::newRow("change feed") << QString("feed");
+    QTest::newRow("lost changes") << QString("lost");
+}
+
+void UserStorageTest::cachingSkipsVersionChangedDuringLookup() {
+    QFETCH(QString, change);
+    auto backend = std::make_unique<MapUserStorage>();
+    MapUserStorage *map = backend.get();
+    map->versions.insert("alice", "v1");
+    CachingUserStorage cache(std::move(backend));
+
+    bool changed = false;
+    map->duringLookup = [&]() {
+        if (changed) {
+            return;
+        }
+        changed = true;
+        map->versions.insert("alice", "v2");
+        if (change == "invalidate") {
+            cache.invalidate("alice");
+        } else if (change == "clear") {
+            cache.clear();
+        } else if (change == "feed") {
+            map->listener({"alice"});
+        } else {
+            map->listener({});
+        }
+    };
+
+    // version read before change is returned, but not cached, so the next lookup reads the new one
+    QVERIFY(cache.getUserVersion("alice") == QString("v1"));
+    QCOMPARE(cache.size(), 0);
+    QVERIFY(cache.getUserVersion("alice") == QString("v2"));
+    QVERIFY(cache.getUserVersion("alice") == QString("v2"));
+    QCOMPARE(map->lookups.load(), 2);
+}
+
+void UserStorageTest::cachingDropsChangedUsers() {
+    auto backend = std::make_unique<MapUserStorage>();
+    MapUserStorage *map = backend.get();
+    map->versions.insert("alice", "v1");
+    map->versions.insert("bob", "v1");
+    CachingUserStorage cache(std::move(backend));
+    QVERIFY(cache.getUserVersion("alice"));
+    QVERIFY(cache.getUserVersion("bob"));
+
+    map->versions.insert("alice", "v2");
+    map->versions.insert("bob", "v2");
+    map->listener({"alice"});
+    QVERIFY(cache.getUserVersion("alice") == QString("v2"));
+    QVERIFY(cache.getUserVersion("bob") == QString("v1"));
+    QCOMPARE(map->lookups.load(), 3);
+
+    // empty set: changes are lost, any user may be changed
+    map->listener({});
+    QCOMPARE(cache.size(), 0);
+    QVERIFY(cache.getUserVersion("bob") == QString("v2"));
+}
+
+void UserStorageTest::changeFeedRemovesSessionsOfUpdatedUser() {
+    MapConfiguration configuration = this->createDatabase();
+    QMutex mutex;
+    QSet<QString> delivered;
+    ShardedAuthStorage auths;
+    CachingUserStorage users(std::make_unique<QSqlUserStorage>(&configuration), &configuration);
+    users.onUsersChanged([&](const QSet<QString> &usernames) {
+        auths.removeByUsers(usernames);
+        QMutexLocker locker(&mutex);
+        delivered.unite(usernames);
+    });
+    const auto isDelivered = [&](const QString &username) {
+        QMutexLocker locker(&mutex);
+        return delivered.contains(username);
+    };
+
+    // user version is cached and session is open before change
+    const auto version = users.getUserVersion("user1");
+    QVERIFY(version == QString("version1"));
+    const QString token = auths.authenticate("user1", version.value());
+    const QString other = auths.authenticate("user2", "version2");
+
+    QVERIFY(execute("UPDATE users SET password = 'changed' WHERE username = 'user1'"));
+    QTRY_VERIFY_WITH_TIMEOUT(isDelivered("user1"), 5000);
+    QVERIFY(!auths.get(token));
+    QVERIFY(auths.get(other));
+    QVERIFY(users.getUserVersion("user1") == QString("changed"));
+}
+
+void UserStorageTest::changeFeedLetsInsertedUserThroughFilter() {
+    MapConfiguration configuration = this->createDatabase();
+    // filter is never rebuilt, so only the change feed lets new user in
+    configuration.user["filter_refresh"] = 0;
+    FilteredUserStorage filtered(std::make_unique<QSqlUserStorage>(&configuration), &configuration);
+    QVERIFY(filtered.getUserVersion("user1") == QString("version1"));
+    QVERIFY(!filtered.getUserVersion("new"));
+
+    QVERIFY(execute("INSERT INTO users (username, password) VALUES ('new', 'version-new')"));
+    QTRY_VERIFY_WITH_TIMEOUT(filtered.getUserVersion("new") == QString("version-new"), 5000);
+}
+
+void UserStorageTest::fanOutAnswersWithoutWaitingForSlowBackend() {
+    auto slow = std::make_unique<MapUserStorage>();
+    slow->versions.insert("slow", "v1");
+    slow->delay = std::chrono::milliseconds(1000);
+    auto fast = std::make_unique<MapUserStorage>();
+    fast->versions.insert("fast", "v2");
+    std::vector<std::unique_ptr<IUserStorage> > storages;
+    storages.push_back(std::move(slow));
+    storages.push_back(std::move(fast));
+    FanOutUserStorage fanOut(std::move(storages));
+
+    QElapsedTimer timer;
+    timer.start();
+    QVERIFY(fanOut.getUserVersion("fast") == QString("v2"));
+    QVERIFY(timer.elapsed() < 500);
+    QVERIFY(fanOut.getUserVersion("slow") == QString("v1"));
+    QVERIFY(!fanOut.getUserVersion("missing"));
+}
+
+void UserStorageTest::fanOutHedgesToNextBackend() {
+    auto slow = std::make_unique<MapUserStorage>();
+    slow->delay = std::chrono::milliseconds(1000);
+    auto fast = std::make_unique<MapUserStorage>();
+    fast->versions.insert("fast", "v2");
+    MapUserStorage *second = fast.get();
+    std::vector<std::unique_ptr<IUserStorage> > storages;
+    storages.push_back(std::move(slow));
+    storages.push_back(std::move(fast));
+    MapConfiguration configuration;
+    configuration.user = {{"hedge_delay", 20}};
+    FanOutUserStorage fanOut(std::move(storages), &configuration);
+
+    QElapsedTimer timer;
+    timer.start();
+    QVERIFY(fanOut.getUserVersion("fast") == QString("v2"));
+    QVERIFY(timer.elapsed() < 500);
+    QCOMPARE(second->lookups.load(), 1);
+}
+
+void UserStorageTest::fanOutSkipsHungBackend() {
+    auto hung = std::make_unique<HungUserStorage>();
+    HungUserStorage *hungStorage = hung.get();
+    auto fast = std::make_unique<MapUserStorage>();
+    fast->versions.insert("fast", "v2");
+    std::vector<std::unique_ptr<IUserStorage> > storages;
+    storages.push_back(std::move(hung));
+    storages.push_back(std::move(fast));
+    MapConfiguration configuration;
+    configuration.user = {{"backend_timeout", 50}};
+    FanOutUserStorage fanOut(std::move(storages), &configuration);
+    const HungRelease release{hungStorage};
+
+    // once workers and queue of hung backend are taken, it is skipped at once
+    for (int i = 0; i < 20; ++i) {
+        QVERIFY(fanOut.getUserVersion("fast") == QString("v2"));
+    }
+    QVERIFY_EXCEPTION_THROWN((void) fanOut.getUserVersion("missing"), UserStorageUnavailable);
+}
+
+QTEST_GUILESS_MAIN(UserStorageTest)
+
+#include "user_storage_test.moc"